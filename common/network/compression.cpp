@@ -0,0 +1,150 @@
+#include "compression.h"
+#include "utils/lz4.h"
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+namespace usb_redirector {
+namespace network {
+
+// 滑动平均中新样本的权重
+static constexpr double ESTIMATE_WEIGHT = 0.25;
+
+AdaptiveCompressor::AdaptiveCompressor(const CompressionConfig& config)
+    : enabled_(config.enabled)
+    , config_(config)
+    , peer_link_bytes_per_second_(0)
+    , ratio_estimate_(1.0)
+    , speed_estimate_(0.0)
+    , has_estimate_(false)
+    , bypass_(false)
+    , since_probe_(0) {
+}
+
+void AdaptiveCompressor::SetConfig(const CompressionConfig& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    enabled_.store(config.enabled);
+    has_estimate_ = false;
+    bypass_ = false;
+}
+
+CompressionConfig AdaptiveCompressor::GetConfig() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_;
+}
+
+void AdaptiveCompressor::SetPeerLinkBandwidth(uint64_t bytes_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peer_link_bytes_per_second_ = bytes_per_second;
+}
+
+bool AdaptiveCompressor::Worthwhile(double ratio, double bytes_per_second) const {
+    if (ratio > config_.max_ratio) {
+        return false;
+    }
+    uint64_t link = config_.link_bytes_per_second ? config_.link_bytes_per_second : peer_link_bytes_per_second_;
+    return link == 0 || bytes_per_second > static_cast<double>(link);
+}
+
+bool AdaptiveCompressor::Compress(const struct iovec* segments, size_t count, size_t len,
+                                  std::vector<uint8_t>& out, size_t out_offset) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!config_.enabled || len == 0 || len < config_.min_payload_bytes || len > UINT32_MAX) {
+            return false;
+        }
+        if (bypass_) {
+            if (++since_probe_ < config_.probe_interval) {
+                stats_.bypassed++;
+                return false;
+            }
+            since_probe_ = 0;
+        }
+    }
+
+    // LZ4块需要连续的输入，多段载荷先聚集到线程本地缓冲区
+    const uint8_t* input = static_cast<const uint8_t*>(segments[0].iov_base);
+    if (count > 1) {
+        thread_local std::vector<uint8_t> gather;
+        gather.resize(len);
+        size_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(gather.data() + offset, segments[i].iov_base, segments[i].iov_len);
+            offset += segments[i].iov_len;
+        }
+        input = gather.data();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    out.resize(out_offset + HEADER_SIZE + utils::Lz4CompressBound(len));
+    size_t compressed = utils::Lz4Compress(input, len, out.data() + out_offset + HEADER_SIZE,
+                                           out.size() - out_offset - HEADER_SIZE);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double ratio = static_cast<double>(compressed + HEADER_SIZE) / len;
+    double speed = len / std::max(seconds, 1e-9);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (has_estimate_) {
+        ratio_estimate_ += ESTIMATE_WEIGHT * (ratio - ratio_estimate_);
+        speed_estimate_ += ESTIMATE_WEIGHT * (speed - speed_estimate_);
+    } else {
+        ratio_estimate_ = ratio;
+        speed_estimate_ = speed;
+        has_estimate_ = true;
+    }
+    bypass_ = !Worthwhile(ratio_estimate_, speed_estimate_);
+
+    // 压缩已经完成，只要体积收益足够就发送压缩结果
+    if (compressed == 0 || ratio > config_.max_ratio) {
+        stats_.rejected++;
+        out.resize(out_offset);
+        return false;
+    }
+
+    uint8_t* header = out.data() + out_offset;
+    header[0] = static_cast<uint8_t>(len >> 24);
+    header[1] = static_cast<uint8_t>(len >> 16);
+    header[2] = static_cast<uint8_t>(len >> 8);
+    header[3] = static_cast<uint8_t>(len);
+    out.resize(out_offset + HEADER_SIZE + compressed);
+
+    stats_.compressed++;
+    stats_.bytes_in += len;
+    stats_.bytes_out += HEADER_SIZE + compressed;
+    return true;
+}
+
+bool AdaptiveCompressor::Decompress(const uint8_t* payload, size_t len, std::vector<uint8_t>& out, size_t max_len) {
+    if (len < HEADER_SIZE) {
+        return false;
+    }
+    size_t original = (static_cast<size_t>(payload[0]) << 24) | (static_cast<size_t>(payload[1]) << 16) |
+                      (static_cast<size_t>(payload[2]) << 8) | payload[3];
+    if (original > max_len) {
+        return false;
+    }
+
+    out.resize(original);
+    if (!utils::Lz4Decompress(payload + HEADER_SIZE, len - HEADER_SIZE, out.data(), original)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.decompressed++;
+    return true;
+}
+
+bool AdaptiveCompressor::IsBypassing() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bypass_;
+}
+
+CompressionStatistics AdaptiveCompressor::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace network
+} // namespace usb_redirector
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <sys/uio.h>
+
+namespace usb_redirector {
+namespace network {
+
+// 载荷压缩配置
+struct CompressionConfig {
+    bool enabled = false;
+    size_t min_payload_bytes = 4096;        // 小于此大小的载荷不压缩
+    double max_ratio = 0.9;                 // 压缩后超过原大小的此比例视为不值得
+    uint64_t link_bytes_per_second = 0;     // 链路带宽，0表示未知（只按压缩率判断）
+    uint32_t probe_interval = 64;           // 旁路期间每隔多少个合格载荷试压一次
+};
+
+// 载荷压缩统计
+struct CompressionStatistics {
+    uint64_t compressed = 0;        // 以压缩形式发送的消息数
+    uint64_t rejected = 0;          // 试压后收益不足、仍发送原始数据的消息数
+    uint64_t bypassed = 0;          // 旁路期间未试压直接发送的消息数
+    uint64_t bytes_in = 0;          // 压缩发送的消息的原始字节数
+    uint64_t bytes_out = 0;         // 对应的压缩后字节数
+    uint64_t decompressed = 0;      // 收到并解压的消息数
+
+    double Ratio() const {
+        return bytes_in > 0 ? static_cast<double>(bytes_out) / bytes_in : 1.0;
+    }
+};
+
+// 自适应LZ4载荷压缩：只压缩达到大小阈值的载荷，并持续估计压缩率和压缩速度。
+// 压缩与网络发送流水进行，有效吞吐量为min(压缩速度, 链路带宽/压缩率)，
+// 因此压缩率不足（已压缩的媒体）或压缩速度跟不上链路（快速局域网）时自动旁路，
+// 旁路期间定期试压一次，数据变得可压缩后恢复
+class AdaptiveCompressor {
+public:
+    // 压缩载荷格式：[原始长度(4字节大端)][LZ4块]
+    static constexpr size_t HEADER_SIZE = 4;
+
+    explicit AdaptiveCompressor(const CompressionConfig& config = CompressionConfig());
+
+    void SetConfig(const CompressionConfig& config);
+    CompressionConfig GetConfig() const;
+    bool Enabled() const { return enabled_.load(); }
+
+    // 对端提供的链路带宽提示，只在本端未配置带宽时采用
+    void SetPeerLinkBandwidth(uint64_t bytes_per_second);
+
+    // 压缩由各段组成的载荷，值得时把压缩载荷写到out的out_offset处（out随之调整大小）并返回true；
+    // 否则out不变，调用方发送原始载荷。可从多个线程并发调用
+    bool Compress(const struct iovec* segments, size_t count, size_t len,
+                  std::vector<uint8_t>& out, size_t out_offset);
+
+    // 解压压缩载荷，原始长度超过max_len或数据损坏时返回false
+    bool Decompress(const uint8_t* payload, size_t len, std::vector<uint8_t>& out, size_t max_len);
+
+    bool IsBypassing() const;
+    CompressionStatistics GetStatistics() const;
+
+private:
+    bool Worthwhile(double ratio, double bytes_per_second) const;   // 需持锁
+
+    std::atomic<bool> enabled_;
+    CompressionConfig config_;
+    uint64_t peer_link_bytes_per_second_;
+    double ratio_estimate_;                 // 压缩率的指数滑动平均
+    double speed_estimate_;                 // 压缩速度（字节/秒）的指数滑动平均
+    bool has_estimate_;
+    bool bypass_;
+    uint32_t since_probe_;
+
+    CompressionStatistics stats_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace network
+} // namespace usb_redirector
@@ -0,0 +1,435 @@
+#include "event_loop.h"
+#include "io_uring.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <future>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#else
+#error "EventLoop requires epoll or kqueue"
+#endif
+
+namespace usb_redirector {
+namespace network {
+
+static constexpr int MAX_EVENTS_PER_POLL = 64;
+
+size_t EventLoopGroup::default_thread_count_ = 0;
+IoBackend EventLoopGroup::default_backend_ = IoBackend::REACTOR;
+
+EventLoop::EventLoop(IoBackend backend)
+    : requested_backend_(backend)
+    , syscall_count_(0)
+    , poll_fd_(-1)
+    , wakeup_read_fd_(-1)
+    , wakeup_write_fd_(-1)
+    , running_(false)
+    , wakeup_pending_(false) {
+}
+
+EventLoop::~EventLoop() {
+    Stop();
+}
+
+bool EventLoop::Start() {
+    if (running_.load()) {
+        return true;
+    }
+
+#if defined(__linux__)
+    poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (poll_fd_ < 0) {
+        return false;
+    }
+
+    wakeup_read_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_read_fd_ < 0) {
+        close(poll_fd_);
+        poll_fd_ = -1;
+        return false;
+    }
+    wakeup_write_fd_ = wakeup_read_fd_;
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeup_read_fd_;
+    epoll_ctl(poll_fd_, EPOLL_CTL_ADD, wakeup_read_fd_, &ev);
+
+    // io_uring完成事件通过注册的eventfd并入epoll，内核不支持时回退到就绪通知模式
+    if (requested_backend_ == IoBackend::IO_URING && IoUring::IsSupported()) {
+        uring_ = std::make_unique<IoUring>();
+        if (uring_->Init()) {
+            ev.events = EPOLLIN;
+            ev.data.fd = uring_->GetEventFd();
+            epoll_ctl(poll_fd_, EPOLL_CTL_ADD, uring_->GetEventFd(), &ev);
+        } else {
+            uring_.reset();
+        }
+    }
+#else
+    poll_fd_ = kqueue();
+    if (poll_fd_ < 0) {
+        return false;
+    }
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        close(poll_fd_);
+        poll_fd_ = -1;
+        return false;
+    }
+    for (int fd : pipe_fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    wakeup_read_fd_ = pipe_fds[0];
+    wakeup_write_fd_ = pipe_fds[1];
+
+    struct kevent ev;
+    EV_SET(&ev, wakeup_read_fd_, EVFILT_READ, EV_ADD, 0, 0, nullptr);
+    kevent(poll_fd_, &ev, 1, nullptr, 0, nullptr);
+#endif
+
+    running_.store(true);
+    loop_thread_ = std::thread(&EventLoop::Loop, this);
+    return true;
+}
+
+void EventLoop::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    Wakeup();
+    if (loop_thread_.joinable()) {
+        loop_thread_.join();
+    }
+
+    // 循环已停止，执行剩余任务以释放等待者
+    RunPendingTasks();
+    uring_.reset();
+
+    if (wakeup_write_fd_ >= 0 && wakeup_write_fd_ != wakeup_read_fd_) {
+        close(wakeup_write_fd_);
+    }
+    if (wakeup_read_fd_ >= 0) {
+        close(wakeup_read_fd_);
+    }
+    wakeup_read_fd_ = -1;
+    wakeup_write_fd_ = -1;
+
+    if (poll_fd_ >= 0) {
+        close(poll_fd_);
+        poll_fd_ = -1;
+    }
+
+    std::lock_guard<std::mutex> lock(handlers_mutex_);
+    handlers_.clear();
+}
+
+bool EventLoop::Add(int fd, uint32_t events, EventHandler handler) {
+    if (!running_.load() || fd < 0) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+        handlers_[fd] = std::make_shared<EventHandler>(std::move(handler));
+    }
+
+#if defined(__linux__)
+    struct epoll_event ev = {};
+    ev.events = EPOLLET | EPOLLRDHUP;
+    if (events & EVENT_READ) {
+        ev.events |= EPOLLIN;
+    }
+    if (events & EVENT_WRITE) {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.fd = fd;
+    bool ok = epoll_ctl(poll_fd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    struct kevent changes[2];
+    int count = 0;
+    if (events & EVENT_READ) {
+        EV_SET(&changes[count++], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    }
+    if (events & EVENT_WRITE) {
+        EV_SET(&changes[count++], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    }
+    bool ok = kevent(poll_fd_, changes, count, nullptr, 0, nullptr) == 0;
+#endif
+
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+        handlers_.erase(fd);
+    }
+    return ok;
+}
+
+void EventLoop::Remove(int fd) {
+    bool registered;
+    {
+        std::lock_guard<std::mutex> lock(handlers_mutex_);
+        registered = handlers_.erase(fd) > 0;
+    }
+
+    if (registered && poll_fd_ >= 0) {
+#if defined(__linux__)
+        epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        struct kevent changes[2];
+        EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        for (auto& change : changes) {
+            kevent(poll_fd_, &change, 1, nullptr, 0, nullptr);
+        }
+#endif
+    }
+
+    // 在其他线程中注销时，等待本轮事件分发结束，确保处理函数不再运行
+    // （即使fd已被循环线程自行注销，其处理函数也可能仍在执行）
+    Sync();
+}
+
+void EventLoop::Sync() {
+    if (IsInLoopThread() || !running_.load()) {
+        return;
+    }
+
+    auto done = std::make_shared<std::promise<void>>();
+    auto future = done->get_future();
+    RunInLoop([done] { done->set_value(); });
+    future.wait();
+}
+
+void EventLoop::RunInLoop(Task task) {
+    if (IsInLoopThread()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        pending_tasks_.push_back(std::move(task));
+    }
+
+    if (!running_.load()) {
+        RunPendingTasks();
+    } else if (!wakeup_pending_.exchange(true)) {
+        // 已有未处理的唤醒时无需再次写入
+        Wakeup();
+    }
+}
+
+uint64_t EventLoop::GetSyscallCount() const {
+    uint64_t count = syscall_count_.load(std::memory_order_relaxed);
+    if (uring_) {
+        count += uring_->GetEnterCount();
+    }
+    return count;
+}
+
+void EventLoop::Loop() {
+    loop_thread_id_.store(std::this_thread::get_id());
+
+#if defined(__linux__)
+    struct epoll_event events[MAX_EVENTS_PER_POLL];
+#else
+    struct kevent events[MAX_EVENTS_PER_POLL];
+#endif
+
+    while (running_.load()) {
+#if defined(__linux__)
+        int count = epoll_wait(poll_fd_, events, MAX_EVENTS_PER_POLL, -1);
+#else
+        int count = kevent(poll_fd_, nullptr, 0, events, MAX_EVENTS_PER_POLL, nullptr);
+#endif
+        CountSyscalls(1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+#if defined(__linux__)
+            int fd = events[i].data.fd;
+            uint32_t mask = 0;
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                mask |= EVENT_READ;
+            }
+            if (events[i].events & EPOLLOUT) {
+                mask |= EVENT_WRITE;
+            }
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                mask |= EVENT_READ | EVENT_CLOSE;
+            }
+#else
+            int fd = static_cast<int>(events[i].ident);
+            uint32_t mask = 0;
+            if (events[i].filter == EVFILT_READ) {
+                mask |= EVENT_READ;
+            } else if (events[i].filter == EVFILT_WRITE) {
+                mask |= EVENT_WRITE;
+            }
+            if (events[i].flags & EV_ERROR) {
+                mask |= EVENT_READ | EVENT_CLOSE;
+            }
+#endif
+
+            if (fd == wakeup_read_fd_) {
+                DrainWakeup();
+                continue;
+            }
+
+            if (uring_ && fd == uring_->GetEventFd()) {
+                DrainUring();
+                continue;
+            }
+
+            std::shared_ptr<EventHandler> handler;
+            {
+                std::lock_guard<std::mutex> lock(handlers_mutex_);
+                auto it = handlers_.find(fd);
+                if (it != handlers_.end()) {
+                    handler = it->second;
+                }
+            }
+
+            if (handler) {
+                (*handler)(mask);
+            }
+        }
+
+        RunPendingTasks();
+
+        // 本轮产生的所有io_uring请求用一次系统调用提交
+        if (uring_) {
+            uring_->Submit();
+        }
+    }
+
+    loop_thread_id_.store(std::thread::id());
+}
+
+void EventLoop::Wakeup() {
+    if (wakeup_write_fd_ < 0) {
+        return;
+    }
+
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t ret = write(wakeup_write_fd_, &one, sizeof(one));
+#else
+    uint8_t one = 1;
+    ssize_t ret = write(wakeup_write_fd_, &one, sizeof(one));
+#endif
+    CountSyscalls(1);
+    (void)ret;
+}
+
+void EventLoop::DrainWakeup() {
+    uint8_t buffer[64];
+    do {
+        CountSyscalls(1);
+    } while (read(wakeup_read_fd_, buffer, sizeof(buffer)) > 0);
+}
+
+void EventLoop::DrainUring() {
+    // 先清空eventfd再收割，之后到达的完成事件会再次触发通知
+    uint64_t value;
+    ssize_t ret = read(uring_->GetEventFd(), &value, sizeof(value));
+    CountSyscalls(1);
+    (void)ret;
+    uring_->ProcessCompletions();
+}
+
+void EventLoop::RunPendingTasks() {
+    wakeup_pending_.store(false);
+
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        tasks.swap(pending_tasks_);
+    }
+
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+// EventLoopGroup implementation
+EventLoopGroup& EventLoopGroup::Instance() {
+    // 有意不析构：避免与持有TcpSocket的全局对象产生静态析构顺序问题
+    static EventLoopGroup* instance = [] {
+        size_t count = default_thread_count_;
+        if (count == 0) {
+            count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 4);
+        }
+        return new EventLoopGroup(count, default_backend_);
+    }();
+    return *instance;
+}
+
+void EventLoopGroup::SetDefaultThreadCount(size_t count) {
+    default_thread_count_ = count;
+}
+
+void EventLoopGroup::SetDefaultBackend(IoBackend backend) {
+    default_backend_ = backend;
+}
+
+EventLoopGroup::EventLoopGroup(size_t thread_count, IoBackend backend)
+    : next_index_(0) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        auto loop = std::make_unique<EventLoop>(backend);
+        if (loop->Start()) {
+            loops_.push_back(std::move(loop));
+        }
+    }
+}
+
+EventLoopGroup::~EventLoopGroup() {
+    for (auto& loop : loops_) {
+        loop->Stop();
+    }
+}
+
+EventLoop* EventLoopGroup::Next() {
+    if (loops_.empty()) {
+        return nullptr;
+    }
+    return loops_[next_index_.fetch_add(1, std::memory_order_relaxed) % loops_.size()].get();
+}
+
+IoBackend EventLoopGroup::GetBackend() const {
+    if (!loops_.empty() && loops_.front()->GetUring()) {
+        return IoBackend::IO_URING;
+    }
+    return IoBackend::REACTOR;
+}
+
+uint64_t EventLoopGroup::GetSyscallCount() const {
+    uint64_t count = 0;
+    for (const auto& loop : loops_) {
+        count += loop->GetSyscallCount();
+    }
+    return count;
+}
+
+} // namespace network
+} // namespace usb_redirector
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+
+namespace usb_redirector {
+namespace network {
+
+class IoUring;
+
+// I/O后端：REACTOR为epoll/kqueue就绪通知；IO_URING为Linux完成队列（不支持时自动回退到REACTOR）
+enum class IoBackend {
+    REACTOR,
+    IO_URING
+};
+
+// 基于epoll(Linux)/kqueue(macOS)的事件循环，所有fd均以边缘触发方式注册
+class EventLoop {
+public:
+    // 事件掩码
+    static constexpr uint32_t EVENT_READ = 0x01;
+    static constexpr uint32_t EVENT_WRITE = 0x02;
+    static constexpr uint32_t EVENT_CLOSE = 0x04;  // 对端关闭或发生错误
+
+    using EventHandler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+
+    explicit EventLoop(IoBackend backend = IoBackend::REACTOR);
+    ~EventLoop();
+
+    // 禁止拷贝
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // 启动和停止循环线程
+    bool Start();
+    void Stop();
+    bool IsRunning() const { return running_.load(); }
+
+    // 注册fd（边缘触发），fd必须已设置为非阻塞
+    bool Add(int fd, uint32_t events, EventHandler handler);
+
+    // 注销fd；返回后保证该fd的处理函数不会再被调用
+    void Remove(int fd);
+
+    // 在循环线程中执行任务
+    void RunInLoop(Task task);
+    bool IsInLoopThread() const { return std::this_thread::get_id() == loop_thread_id_.load(); }
+
+    // 等待循环线程完成当前一轮分发（在循环线程中调用时立即返回）
+    void Sync();
+
+    // io_uring实例，仅在IO_URING后端启用成功时非空，只能在循环线程中使用
+    IoUring* GetUring() const { return uring_.get(); }
+
+    // 累计系统调用次数（用于基准测试）
+    void CountSyscalls(uint64_t count) { syscall_count_.fetch_add(count, std::memory_order_relaxed); }
+    uint64_t GetSyscallCount() const;
+
+private:
+    void Loop();
+    void Wakeup();
+    void DrainWakeup();
+    void RunPendingTasks();
+    void DrainUring();
+
+    IoBackend requested_backend_;
+    std::unique_ptr<IoUring> uring_;
+    std::atomic<uint64_t> syscall_count_;
+
+    int poll_fd_;
+    int wakeup_read_fd_;
+    int wakeup_write_fd_;
+
+    std::atomic<bool> running_;
+    std::thread loop_thread_;
+    std::atomic<std::thread::id> loop_thread_id_;
+
+    std::mutex handlers_mutex_;
+    std::unordered_map<int, std::shared_ptr<EventHandler>> handlers_;
+
+    std::mutex tasks_mutex_;
+    std::vector<Task> pending_tasks_;
+    std::atomic<bool> wakeup_pending_;
+};
+
+// 固定数量的I/O线程，每个线程运行一个EventLoop
+class EventLoopGroup {
+public:
+    static EventLoopGroup& Instance();
+
+    // 设置默认组的I/O线程数和后端，需在首次使用网络前调用
+    static void SetDefaultThreadCount(size_t count);
+    static void SetDefaultBackend(IoBackend backend);
+
+    explicit EventLoopGroup(size_t thread_count, IoBackend backend = IoBackend::REACTOR);
+    ~EventLoopGroup();
+
+    // 禁止拷贝
+    EventLoopGroup(const EventLoopGroup&) = delete;
+    EventLoopGroup& operator=(const EventLoopGroup&) = delete;
+
+    // 轮询选择下一个事件循环
+    EventLoop* Next();
+    size_t Size() const { return loops_.size(); }
+
+    // 实际使用的后端（请求IO_URING但内核不支持时为REACTOR）
+    IoBackend GetBackend() const;
+
+    // 所有事件循环的系统调用总数
+    uint64_t GetSyscallCount() const;
+
+private:
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::atomic<size_t> next_index_;
+
+    static size_t default_thread_count_;
+    static IoBackend default_backend_;
+};
+
+} // namespace network
+} // namespace usb_redirector
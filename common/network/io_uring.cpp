@@ -0,0 +1,480 @@
+#include "io_uring.h"
+
+#if defined(USB_REDIRECTOR_HAVE_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#endif
+
+namespace usb_redirector {
+namespace network {
+
+#if defined(USB_REDIRECTOR_HAVE_IO_URING)
+
+static constexpr uint16_t RECV_BUFFER_GROUP = 0;
+
+static int SysIoUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int SysIoUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int SysIoUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+// 探测时等待完成事件，超时视为不支持，避免异常内核上阻塞启动
+static bool WaitForCompletion(int event_fd) {
+    struct pollfd pfd = {event_fd, POLLIN, 0};
+    return poll(&pfd, 1, 1000) == 1;
+}
+
+bool IoUring::IsSupported() {
+    static const bool supported = [] {
+        IoUring ring;
+        if (!ring.Init(8)) {
+            return false;
+        }
+
+        // 用socketpair验证多次接收确实可用（需要Linux 6.0+）
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+            return false;
+        }
+
+        int32_t result = -1;
+        bool more = false;
+        ring.PrepareRecvMultishot(fds[0], [&](int32_t res, const uint8_t*, bool m) {
+            result = res;
+            more = m;
+        });
+        ring.Submit();
+
+        uint8_t byte = 0x5A;
+        bool ok = write(fds[1], &byte, 1) == 1;
+        if (ok) {
+            ok = WaitForCompletion(ring.event_fd_);
+            ring.ProcessCompletions();
+            ok = ok && result == 1 && more;
+        }
+
+        // 关闭读端使多次接收请求结束
+        shutdown(fds[0], SHUT_RDWR);
+        uint64_t value;
+        ssize_t ret = read(ring.event_fd_, &value, sizeof(value));
+        (void)ret;
+        WaitForCompletion(ring.event_fd_);
+        ring.ProcessCompletions();
+        close(fds[0]);
+        close(fds[1]);
+        return ok;
+    }();
+    return supported;
+}
+
+IoUring::IoUring()
+    : ring_fd_(-1)
+    , event_fd_(-1)
+    , sq_ring_(MAP_FAILED)
+    , sq_ring_size_(0)
+    , cq_ring_(MAP_FAILED)
+    , cq_ring_size_(0)
+    , sqes_(nullptr)
+    , sqes_size_(0)
+    , sq_head_(nullptr)
+    , sq_tail_(nullptr)
+    , sq_array_(nullptr)
+    , sq_mask_(0)
+    , sq_entries_(0)
+    , sqe_tail_(0)
+    , submitted_tail_(0)
+    , cq_head_(nullptr)
+    , cq_tail_(nullptr)
+    , cq_mask_(0)
+    , cqes_(nullptr)
+    , buf_ring_(nullptr)
+    , buf_ring_size_(0)
+    , recv_buffers_(nullptr)
+    , buf_ring_tail_(0)
+    , operations_(nullptr)
+    , enter_count_(0) {
+}
+
+IoUring::~IoUring() {
+    Shutdown();
+}
+
+bool IoUring::Init(unsigned entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SUBMIT_ALL;
+
+    ring_fd_ = SysIoUringSetup(entries, &params);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+
+    // 映射提交队列和完成队列
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        Shutdown();
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            Shutdown();
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        Shutdown();
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq_base = static_cast<uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = submitted_tail_ = *sq_tail_;
+
+    auto* cq_base = static_cast<uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+
+    // 完成事件通过eventfd通知EventLoop
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0 || SysIoUringRegister(ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) < 0) {
+        Shutdown();
+        return false;
+    }
+
+    if (!SetupBufferRing()) {
+        Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+bool IoUring::SetupBufferRing() {
+    // 缓冲环与接收缓冲区都按页对齐映射，由内核在接收时直接选择
+    buf_ring_size_ = RECV_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void* ring_mem = mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_mem == MAP_FAILED) {
+        return false;
+    }
+    buf_ring_ = static_cast<io_uring_buf_ring*>(ring_mem);
+
+    void* buffers = mmap(nullptr, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) {
+        munmap(ring_mem, buf_ring_size_);
+        buf_ring_ = nullptr;
+        return false;
+    }
+    recv_buffers_ = static_cast<uint8_t*>(buffers);
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring_);
+    reg.ring_entries = RECV_BUFFER_COUNT;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (SysIoUringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(recv_buffers_, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE);
+        munmap(ring_mem, buf_ring_size_);
+        recv_buffers_ = nullptr;
+        buf_ring_ = nullptr;
+        return false;
+    }
+
+    buf_ring_tail_ = 0;
+    for (uint16_t i = 0; i < RECV_BUFFER_COUNT; ++i) {
+        RecycleBuffer(i);
+    }
+    return true;
+}
+
+void IoUring::RecycleBuffer(uint16_t buffer_id) {
+    // 缓冲环首项与环头部共用内存；头文件中的柔性数组在C++下偏移不同，按数组直接寻址
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(buf_ring_);
+    struct io_uring_buf* buf = &bufs[buf_ring_tail_ & (RECV_BUFFER_COUNT - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(recv_buffers_ + static_cast<size_t>(buffer_id) * RECV_BUFFER_SIZE);
+    buf->len = RECV_BUFFER_SIZE;
+    buf->bid = buffer_id;
+    ++buf_ring_tail_;
+    __atomic_store_n(&buf_ring_->tail, buf_ring_tail_, __ATOMIC_RELEASE);
+}
+
+void IoUring::Shutdown() {
+    // 先关闭ring，内核会取消所有未完成的请求
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+
+    if (recv_buffers_) {
+        munmap(recv_buffers_, RECV_BUFFER_COUNT * RECV_BUFFER_SIZE);
+        recv_buffers_ = nullptr;
+    }
+    if (buf_ring_) {
+        munmap(buf_ring_, buf_ring_size_);
+        buf_ring_ = nullptr;
+    }
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = MAP_FAILED;
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = MAP_FAILED;
+    }
+    if (event_fd_ >= 0) {
+        close(event_fd_);
+        event_fd_ = -1;
+    }
+
+    // 释放不会再完成的请求上下文（不调用回调）
+    while (operations_) {
+        DeleteOperation(operations_);
+    }
+}
+
+IoUring::Operation* IoUring::NewOperation(CompletionHandler handler) {
+    auto* op = new Operation;
+    op->handler = std::move(handler);
+    op->next = operations_;
+    if (operations_) {
+        operations_->prev = op;
+    }
+    operations_ = op;
+    return op;
+}
+
+void IoUring::DeleteOperation(Operation* op) {
+    if (op->prev) {
+        op->prev->next = op->next;
+    } else {
+        operations_ = op->next;
+    }
+    if (op->next) {
+        op->next->prev = op->prev;
+    }
+    delete op;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    if (ring_fd_ < 0) {
+        return nullptr;
+    }
+
+    // 提交队列已满时先提交一批
+    if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        Submit();
+        if (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = sqe_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sqe_tail_;
+    return sqe;
+}
+
+bool IoUring::PrepareRecvMultishot(int fd, CompletionHandler handler) {
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_BUFFER_GROUP;
+    sqe->user_data = reinterpret_cast<uint64_t>(NewOperation(std::move(handler)));
+    return true;
+}
+
+bool IoUring::PrepareSend(int fd, const uint8_t* data, size_t len, CompletionHandler handler) {
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(NewOperation(std::move(handler)));
+    return true;
+}
+
+int IoUring::Submit() {
+    unsigned to_submit = sqe_tail_ - submitted_tail_;
+    if (to_submit == 0 || ring_fd_ < 0) {
+        return 0;
+    }
+
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+
+    int ret;
+    do {
+        ret = SysIoUringEnter(ring_fd_, to_submit, 0, 0);
+        enter_count_.fetch_add(1, std::memory_order_relaxed);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0) {
+        submitted_tail_ += static_cast<unsigned>(ret);
+    }
+    return ret;
+}
+
+size_t IoUring::ProcessCompletions() {
+    if (ring_fd_ < 0) {
+        return 0;
+    }
+
+    size_t processed = 0;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        const io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+        auto* op = reinterpret_cast<Operation*>(cqe->user_data);
+        int32_t result = cqe->res;
+        uint32_t flags = cqe->flags;
+
+        ++head;
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+        const uint8_t* buffer = nullptr;
+        uint16_t buffer_id = 0;
+        if (flags & IORING_CQE_F_BUFFER) {
+            buffer_id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            buffer = recv_buffers_ + static_cast<size_t>(buffer_id) * RECV_BUFFER_SIZE;
+        }
+
+        bool more = (flags & IORING_CQE_F_MORE) != 0;
+        if (op && op->handler) {
+            op->handler(result, buffer, more);
+        }
+
+        if (buffer) {
+            RecycleBuffer(buffer_id);
+        }
+        if (op && !more) {
+            DeleteOperation(op);
+        }
+
+        ++processed;
+        if (head == tail) {
+            tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    return processed;
+}
+
+#else // !USB_REDIRECTOR_HAVE_IO_URING
+
+bool IoUring::IsSupported() {
+    return false;
+}
+
+IoUring::IoUring()
+    : ring_fd_(-1)
+    , event_fd_(-1)
+    , sq_ring_(nullptr)
+    , sq_ring_size_(0)
+    , cq_ring_(nullptr)
+    , cq_ring_size_(0)
+    , sqes_(nullptr)
+    , sqes_size_(0)
+    , sq_head_(nullptr)
+    , sq_tail_(nullptr)
+    , sq_array_(nullptr)
+    , sq_mask_(0)
+    , sq_entries_(0)
+    , sqe_tail_(0)
+    , submitted_tail_(0)
+    , cq_head_(nullptr)
+    , cq_tail_(nullptr)
+    , cq_mask_(0)
+    , cqes_(nullptr)
+    , buf_ring_(nullptr)
+    , buf_ring_size_(0)
+    , recv_buffers_(nullptr)
+    , buf_ring_tail_(0)
+    , operations_(nullptr)
+    , enter_count_(0) {
+}
+
+IoUring::~IoUring() = default;
+
+bool IoUring::Init(unsigned) {
+    return false;
+}
+
+void IoUring::Shutdown() {
+}
+
+bool IoUring::PrepareRecvMultishot(int, CompletionHandler) {
+    return false;
+}
+
+bool IoUring::PrepareSend(int, const uint8_t*, size_t, CompletionHandler) {
+    return false;
+}
+
+int IoUring::Submit() {
+    return 0;
+}
+
+size_t IoUring::ProcessCompletions() {
+    return 0;
+}
+
+#endif // USB_REDIRECTOR_HAVE_IO_URING
+
+} // namespace network
+} // namespace usb_redirector
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <atomic>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace usb_redirector {
+namespace network {
+
+// 基于原始系统调用的io_uring封装（不依赖liburing）
+// 只能在所属EventLoop线程中使用；未启用USB_REDIRECTOR_HAVE_IO_URING时IsSupported()恒为false
+class IoUring {
+public:
+    // result为CQE结果；buffer为内核从接收缓冲池中选择的缓冲区（没有则为nullptr），
+    // 回调返回后缓冲区即被回收；more表示该请求还会产生后续完成事件
+    using CompletionHandler = std::function<void(int32_t result, const uint8_t* buffer, bool more)>;
+
+    static constexpr unsigned DEFAULT_ENTRIES = 256;
+    static constexpr unsigned RECV_BUFFER_COUNT = 64;
+    static constexpr size_t RECV_BUFFER_SIZE = 64 * 1024;
+
+    // 运行时探测内核是否支持（多次接收 + 提供的缓冲环）
+    static bool IsSupported();
+
+    IoUring();
+    ~IoUring();
+
+    // 禁止拷贝
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool Init(unsigned entries = DEFAULT_ENTRIES);
+    void Shutdown();
+
+    // 完成事件通知fd，由EventLoop加入epoll
+    int GetEventFd() const { return event_fd_; }
+
+    // 准备请求（在下一次Submit时批量提交）
+    bool PrepareRecvMultishot(int fd, CompletionHandler handler);
+    bool PrepareSend(int fd, const uint8_t* data, size_t len, CompletionHandler handler);
+
+    // 用一次io_uring_enter提交所有已准备的请求
+    int Submit();
+
+    // 处理所有已完成的请求，返回处理数量
+    size_t ProcessCompletions();
+
+    // io_uring_enter调用次数
+    uint64_t GetEnterCount() const { return enter_count_.load(std::memory_order_relaxed); }
+
+private:
+    // 提交给内核的请求上下文，以侵入式链表记录以便关闭时释放
+    struct Operation {
+        CompletionHandler handler;
+        Operation* prev = nullptr;
+        Operation* next = nullptr;
+    };
+
+    Operation* NewOperation(CompletionHandler handler);
+    void DeleteOperation(Operation* op);
+    io_uring_sqe* GetSqe();
+    bool SetupBufferRing();
+    void RecycleBuffer(uint16_t buffer_id);
+
+    int ring_fd_;
+    int event_fd_;
+
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_array_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned sqe_tail_;       // 本地已准备的SQE尾部
+    unsigned submitted_tail_; // 已提交给内核的尾部
+
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+
+    io_uring_buf_ring* buf_ring_;
+    size_t buf_ring_size_;
+    uint8_t* recv_buffers_;
+    uint16_t buf_ring_tail_;
+
+    Operation* operations_;
+    std::atomic<uint64_t> enter_count_;
+};
+
+} // namespace network
+} // namespace usb_redirector
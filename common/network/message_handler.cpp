@@ -1,4 +1,6 @@
 #include "message_handler.h"
+#include "utils/crc32c.h"
+#include "utils/logger.h"
 #include <arpa/inet.h>
 #include <cstring>
 #include <algorithm>
@@ -6,14 +8,26 @@
 namespace usb_redirector {
 namespace network {
 
-uint32_t MessageHandler::next_sequence_ = 1;
+// 去重消息的字段均为大端
+static constexpr size_t DEDUP_EXTENT_ENTRY_SIZE = protocol::DEDUP_HASH_SIZE + 4;   // 提议中每个extent的哈希和长度
+
+static void PutBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+static uint32_t GetBigEndian32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
 
 NetworkMessage::NetworkMessage(MessageType type, const std::vector<uint8_t>& data)
     : payload(data) {
     header.magic = MessageHandler::MESSAGE_MAGIC;
     header.type = static_cast<uint32_t>(type);
     header.length = static_cast<uint32_t>(data.size());
-    header.sequence = MessageHandler::GetNextSequence();
+    header.sequence = 0;  // 序列化时由连接分配
     header.checksum = 0; // 将在序列化时计算
 }
 
@@ -22,24 +36,214 @@ NetworkMessage::NetworkMessage(MessageType type, const uint8_t* data, size_t len
     header.magic = MessageHandler::MESSAGE_MAGIC;
     header.type = static_cast<uint32_t>(type);
     header.length = static_cast<uint32_t>(len);
-    header.sequence = MessageHandler::GetNextSequence();
+    header.sequence = 0;  // 序列化时由连接分配
     header.checksum = 0; // 将在序列化时计算
 }
 
-MessageHandler::MessageHandler() {
-    receive_buffer_.reserve(MAX_MESSAGE_SIZE);
+MessageView MessageView::Retain() const {
+    if (lease_) {
+        return *this;
+    }
+
+    MessageView retained;
+    retained.header_ = header_;
+    auto lease = std::make_shared<const std::vector<uint8_t>>(data_, data_ + size_);
+    retained.data_ = lease->data();
+    retained.size_ = lease->size();
+    retained.lease_ = std::move(lease);
+    return retained;
+}
+
+size_t DedupOffer::DataLength() const {
+    size_t total = 0;
+    for (const auto& extent : extents) {
+        total += extent.length;
+    }
+    return total;
+}
+
+NetworkMessage MessageView::ToMessage() const {
+    NetworkMessage message;
+    message.header = header_;
+    message.payload.assign(data_, data_ + size_);
+    return message;
+}
+
+OutgoingFrame::OutgoingFrame()
+    : header_()
+    , count_(1)
+    , payload_size_(0)
+    , inline_size_(0) {
+    iov_[0].iov_base = &header_;
+    iov_[0].iov_len = sizeof(MessageHeader);
+}
+
+bool OutgoingFrame::AppendCopy(const void* data, size_t len) {
+    if (inline_size_ + len > INLINE_CAPACITY) {
+        return false;
+    }
+
+    uint8_t* dest = inline_data_ + inline_size_;
+    std::memcpy(dest, data, len);
+    inline_size_ += len;
+
+    // 与上一段内部数据相邻时合并为一段
+    if (count_ > 1 && static_cast<uint8_t*>(iov_[count_ - 1].iov_base) + iov_[count_ - 1].iov_len == dest) {
+        iov_[count_ - 1].iov_len += len;
+        payload_size_ += len;
+        return true;
+    }
+    return AppendRef(dest, len);
+}
+
+bool OutgoingFrame::AppendRef(const void* data, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    if (count_ > MAX_SEGMENTS) {
+        return false;
+    }
+
+    iov_[count_].iov_base = const_cast<void*>(data);
+    iov_[count_].iov_len = len;
+    ++count_;
+    payload_size_ += len;
+    return true;
+}
+
+MessageHandler::MessageHandler()
+    : receive_buffer_(2 * (sizeof(MessageHeader) + MAX_MESSAGE_SIZE))
+    , preferred_mode_(ChecksumMode::CRC32C)
+    , send_mode_(ChecksumMode::LEGACY_SUM)
+    , local_features_(0)
+    , negotiated_features_(0)
+    , fragment_size_(0)
+    , reassembling_(false)
+    , fragment_header_() {
+}
+
+void MessageHandler::ResetSession() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    receive_buffer_.Clear();
+    sequence_.Reset();
+    send_mode_.store(ChecksumMode::LEGACY_SUM);
+    negotiated_features_.store(0);
+    reassembling_ = false;
+    fragment_buffer_.clear();
+}
+
+void MessageHandler::SetPreferredChecksumMode(ChecksumMode mode) {
+    preferred_mode_.store(mode);
+}
+
+uint32_t MessageHandler::SupportedModeMask() const {
+    // 累加和与CRC32C总是接受，不校验必须由本端显式选择
+    uint32_t mask = (1u << static_cast<uint32_t>(ChecksumMode::LEGACY_SUM)) |
+                    (1u << static_cast<uint32_t>(ChecksumMode::CRC32C));
+    if (preferred_mode_.load() == ChecksumMode::NONE) {
+        mask |= 1u << static_cast<uint32_t>(ChecksumMode::NONE);
+    }
+    return mask;
+}
+
+NetworkMessage MessageHandler::CreateCapabilities() const {
+    // 载荷：[版本][支持的校验模式位图][偏好模式][功能位图]，后续版本只在末尾追加字段
+    std::vector<uint8_t> data;
+    data.push_back(CAPABILITIES_VERSION);
+    data.push_back(static_cast<uint8_t>(SupportedModeMask()));
+    data.push_back(static_cast<uint8_t>(preferred_mode_.load()));
+    data.push_back(LocalFeatures());
+    // 版本3：链路带宽提示（Mbit/s，0表示未知），供对端的压缩决策参考
+    uint64_t link = compressor_.GetConfig().link_bytes_per_second / 125000;
+    PutBigEndian32(data, static_cast<uint32_t>(std::min<uint64_t>(link, UINT32_MAX)));
+    return NetworkMessage(MessageType::CAPABILITIES, data);
+}
+
+uint8_t MessageHandler::LocalFeatures() const {
+    return local_features_.load() | (compressor_.Enabled() ? FEATURE_COMPRESSION : 0) |
+           (fragment_size_.load() > 0 ? FEATURE_FRAGMENTS : 0);
+}
+
+bool MessageHandler::CompressionActive() const {
+    return (negotiated_features_.load() & FEATURE_COMPRESSION) && compressor_.Enabled();
+}
+
+bool MessageHandler::FragmentsActive() const {
+    return (negotiated_features_.load() & FEATURE_FRAGMENTS) && fragment_size_.load() > 0;
+}
+
+void MessageHandler::HandleCapabilities(const uint8_t* payload, size_t len) {
+    if (len < 3) {
+        LOG_WARNING("Malformed capabilities message");
+        return;
+    }
+
+    uint32_t common = SupportedModeMask() & payload[1];
+    auto peer_preferred = static_cast<ChecksumMode>(payload[2]);
+    auto local_preferred = preferred_mode_.load();
+
+    // 规则对称，双方独立得出同一结果
+    ChecksumMode mode = ChecksumMode::LEGACY_SUM;
+    if (local_preferred == ChecksumMode::NONE && peer_preferred == ChecksumMode::NONE &&
+        (common & (1u << static_cast<uint32_t>(ChecksumMode::NONE)))) {
+        mode = ChecksumMode::NONE;
+    } else if (common & (1u << static_cast<uint32_t>(ChecksumMode::CRC32C))) {
+        mode = ChecksumMode::CRC32C;
+    }
+
+    if (send_mode_.exchange(mode) != mode) {
+        LOG_INFO("Negotiated checksum mode: " << static_cast<int>(mode));
+    }
+
+    // 版本1的对端没有功能位图
+    uint8_t features = len >= 4 ? static_cast<uint8_t>(LocalFeatures() & payload[3]) : 0;
+    if (negotiated_features_.exchange(features) != features) {
+        LOG_INFO("Negotiated features: 0x" << std::hex << static_cast<int>(features) << std::dec);
+    }
+    if (len >= 8) {
+        compressor_.SetPeerLinkBandwidth(static_cast<uint64_t>(GetBigEndian32(payload + 4)) * 125000);
+    }
 }
 
 void MessageHandler::ProcessReceivedData(const uint8_t* data, size_t len) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    // 将数据添加到接收缓冲区
-    receive_buffer_.insert(receive_buffer_.end(), data, data + len);
+    while (len > 0) {
+        // 没有缓存数据时直接在输入上解析，只把末尾不完整的消息放入缓冲区
+        if (receive_buffer_.Empty()) {
+            size_t consumed = ParseMessages(data, len);
+            data += consumed;
+            len -= consumed;
+            if (len == 0) {
+                break;
+            }
+        }
 
-    // 处理完整的消息
-    while (receive_buffer_.size() >= sizeof(MessageHeader)) {
+        // 缓冲区容量至少是最大消息的两倍，解析后总有剩余空间
+        size_t chunk = std::min(len, receive_buffer_.Available());
+        if (chunk == 0) {
+            receive_buffer_.Clear();
+            continue;
+        }
+
+        receive_buffer_.Append(data, chunk);
+        data += chunk;
+        len -= chunk;
+        receive_buffer_.Consume(ParseMessages(receive_buffer_.Data(), receive_buffer_.Size()));
+    }
+}
+
+size_t MessageHandler::ParseMessages(const uint8_t* data, size_t len) {
+    // 网络字节序的魔数，用于重新同步
+    static const uint8_t magic_bytes[] = {
+        static_cast<uint8_t>(MESSAGE_MAGIC >> 24), static_cast<uint8_t>(MESSAGE_MAGIC >> 16),
+        static_cast<uint8_t>(MESSAGE_MAGIC >> 8), static_cast<uint8_t>(MESSAGE_MAGIC)
+    };
+
+    size_t offset = 0;
+    while (len - offset >= sizeof(MessageHeader)) {
         MessageHeader header;
-        std::memcpy(&header, receive_buffer_.data(), sizeof(MessageHeader));
+        std::memcpy(&header, data + offset, sizeof(MessageHeader));
 
         // 转换字节序
         header.magic = ntohl(header.magic);
@@ -51,47 +255,87 @@ void MessageHandler::ProcessReceivedData(const uint8_t* data, size_t len) {
         // 验证魔数
         if (header.magic != MESSAGE_MAGIC) {
             // 查找下一个可能的魔数位置
-            auto it = std::search(receive_buffer_.begin() + 1, receive_buffer_.end(),
-                                reinterpret_cast<const uint8_t*>(&MESSAGE_MAGIC),
-                                reinterpret_cast<const uint8_t*>(&MESSAGE_MAGIC) + sizeof(MESSAGE_MAGIC));
-            if (it != receive_buffer_.end()) {
-                receive_buffer_.erase(receive_buffer_.begin(), it);
-            } else {
-                receive_buffer_.clear();
-            }
+            const uint8_t* end = data + len;
+            const uint8_t* it = std::search(data + offset + 1, end, magic_bytes, magic_bytes + sizeof(magic_bytes));
+            offset = it - data;
             continue;
         }
 
         // 检查消息长度
         if (header.length > MAX_MESSAGE_SIZE) {
-            receive_buffer_.erase(receive_buffer_.begin(), receive_buffer_.begin() + sizeof(MessageHeader));
+            offset += sizeof(MessageHeader);
             continue;
         }
 
         // 检查是否有完整的消息
         size_t total_size = sizeof(MessageHeader) + header.length;
-        if (receive_buffer_.size() < total_size) {
+        if (len - offset < total_size) {
             break; // 等待更多数据
         }
 
         // 验证消息
-        if (ValidateMessage(header, receive_buffer_.data() + sizeof(MessageHeader))) {
-            ProcessCompleteMessage(receive_buffer_.data(), total_size);
+        const uint8_t* payload = data + offset + sizeof(MessageHeader);
+        if (ValidateMessage(header, payload)) {
+            // 校验和覆盖压缩后的载荷，通过校验后再解压
+            if (header.type & COMPRESSED_FLAG) {
+                if (compressor_.Decompress(payload, header.length, decompress_buffer_, MAX_MESSAGE_SIZE)) {
+                    header.length = static_cast<uint32_t>(decompress_buffer_.size());
+                    payload = decompress_buffer_.data();
+                } else {
+                    LOG_WARNING("Dropping message with corrupted compressed payload");
+                    payload = nullptr;
+                }
+            }
+            if (payload) {
+                uint32_t fragment_flags = header.type & (MORE_FRAGMENTS_FLAG | CONTINUATION_FLAG);
+                header.type &= MESSAGE_TYPE_MASK;
+                if (fragment_flags) {
+                    payload = ReassembleFragment(header, payload, fragment_flags);
+                }
+            }
+            if (payload) {
+                ProcessCompleteMessage(header, payload);
+            }
         }
 
-        // 移除已处理的消息
-        receive_buffer_.erase(receive_buffer_.begin(), receive_buffer_.begin() + total_size);
+        // 前移读位置即完成消费
+        offset += total_size;
     }
+
+    return offset;
 }
 
 std::vector<uint8_t> MessageHandler::SerializeMessage(const NetworkMessage& message) {
     std::vector<uint8_t> buffer;
-    buffer.resize(sizeof(MessageHeader) + message.payload.size());
-
     MessageHeader header = message.header;
+    uint32_t flags = 0;
+
+    // 值得压缩时压缩结果直接写在消息头之后
+    if (CompressionActive() && !message.payload.empty()) {
+        struct iovec segment = {const_cast<uint8_t*>(message.payload.data()), message.payload.size()};
+        if (compressor_.Compress(&segment, 1, message.payload.size(), buffer, sizeof(MessageHeader))) {
+            flags = COMPRESSED_FLAG;
+            header.length = static_cast<uint32_t>(buffer.size() - sizeof(MessageHeader));
+        }
+    }
+    if (!flags) {
+        buffer.resize(sizeof(MessageHeader) + message.payload.size());
+        if (!message.payload.empty()) {
+            std::memcpy(buffer.data() + sizeof(MessageHeader), message.payload.data(), message.payload.size());
+        }
+    }
 
-    // 计算校验和
-    header.checksum = CalculateChecksum(message.payload.data(), message.payload.size());
+    // 未指定序列号的消息从本连接的序列号空间分配
+    if (header.sequence == 0) {
+        header.sequence = NextSequence();
+    }
+
+    // 在type高位标记校验模式并计算校验和
+    ChecksumMode mode = send_mode_.load();
+    header.type = (header.type & MESSAGE_TYPE_MASK) | flags |
+                  (static_cast<uint32_t>(mode) << CHECKSUM_MODE_SHIFT);
+    header.checksum = CalculateChecksum(mode, buffer.data() + sizeof(MessageHeader),
+                                        buffer.size() - sizeof(MessageHeader));
 
     // 转换字节序
     header.magic = htonl(header.magic);
@@ -100,14 +344,130 @@ std::vector<uint8_t> MessageHandler::SerializeMessage(const NetworkMessage& mess
     header.sequence = htonl(header.sequence);
     header.checksum = htonl(header.checksum);
 
-    // 复制头部和载荷
     std::memcpy(buffer.data(), &header, sizeof(MessageHeader));
-    if (!message.payload.empty()) {
-        std::memcpy(buffer.data() + sizeof(MessageHeader),
-                   message.payload.data(), message.payload.size());
+    return buffer;
+}
+
+const uint8_t* MessageHandler::ReassembleFragment(MessageHeader& header, const uint8_t* payload, uint32_t flags) {
+    // 首个分片开始新的消息，后续分片必须接在同类型的未完成消息之后
+    if (!(flags & CONTINUATION_FLAG)) {
+        if (reassembling_) {
+            LOG_WARNING("Discarding incomplete fragmented message");
+        }
+        reassembling_ = true;
+        fragment_header_ = header;
+        fragment_buffer_.clear();
+    } else if (!reassembling_ || fragment_header_.type != header.type) {
+        LOG_WARNING("Dropping fragment without a preceding first fragment");
+        return nullptr;
     }
 
-    return buffer;
+    if (fragment_buffer_.size() + header.length > MAX_MESSAGE_SIZE) {
+        LOG_WARNING("Dropping oversized fragmented message");
+        reassembling_ = false;
+        fragment_buffer_.clear();
+        return nullptr;
+    }
+    fragment_buffer_.insert(fragment_buffer_.end(), payload, payload + header.length);
+    if (flags & MORE_FRAGMENTS_FLAG) {
+        return nullptr;
+    }
+
+    // 最后一个分片：以首个分片的消息头交付完整消息
+    reassembling_ = false;
+    header = fragment_header_;
+    header.length = static_cast<uint32_t>(fragment_buffer_.size());
+    return fragment_buffer_.data();
+}
+
+void MessageHandler::FinalizeFrame(MessageType type, OutgoingFrame& frame) {
+    FinalizeFrame(type, frame, 0);
+}
+
+bool MessageHandler::SendFrame(MessageType type, OutgoingFrame& frame, SendPriority priority,
+                               const FrameSender& send) {
+    // 只拆分批量帧：接收端只有一个重组缓冲区，流上同一时刻只能有一组分片
+    size_t fragment_size = fragment_size_.load();
+    if (priority != SendPriority::BULK || !FragmentsActive() || frame.payload_size_ <= fragment_size) {
+        FinalizeFrame(type, frame, 0);
+        return send(frame.Iov(), frame.Count(), priority);
+    }
+
+    // 同优先级的完整帧可以插在分片之间，另一组分片不行
+    std::lock_guard<std::mutex> lock(fragment_mutex_);
+    size_t count = (frame.payload_size_ + fragment_size - 1) / fragment_size;
+    size_t chunk = (frame.payload_size_ + count - 1) / count;
+    size_t remaining = frame.payload_size_;
+    size_t segment = 1;
+    size_t segment_offset = 0;
+    bool first = true;
+
+    while (remaining > 0) {
+        // 分片只引用原帧的各段（包括原帧内部的小块数据）
+        OutgoingFrame fragment;
+        size_t take = std::min(remaining, chunk);
+        remaining -= take;
+        while (take > 0) {
+            const struct iovec& source = frame.iov_[segment];
+            size_t len = std::min(take, source.iov_len - segment_offset);
+            fragment.AppendRef(static_cast<const uint8_t*>(source.iov_base) + segment_offset, len);
+            take -= len;
+            segment_offset += len;
+            if (segment_offset == source.iov_len) {
+                ++segment;
+                segment_offset = 0;
+            }
+        }
+
+        uint32_t flags = (first ? 0 : CONTINUATION_FLAG) | (remaining > 0 ? MORE_FRAGMENTS_FLAG : 0);
+        first = false;
+        FinalizeFrame(type, fragment, flags);
+        if (!send(fragment.Iov(), fragment.Count(), priority)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SendPriority MessageHandler::TransferPriority(protocol::UsbTransferType type) {
+    switch (type) {
+        case protocol::UsbTransferType::CONTROL:
+            return SendPriority::CONTROL;
+        case protocol::UsbTransferType::INTERRUPT:
+        case protocol::UsbTransferType::ISOCHRONOUS:
+            return SendPriority::INTERRUPT;
+        case protocol::UsbTransferType::BULK:
+        default:
+            return SendPriority::BULK;
+    }
+}
+
+void MessageHandler::FinalizeFrame(MessageType type, OutgoingFrame& frame, uint32_t flags) {
+    ChecksumMode mode = send_mode_.load();
+
+    // 压缩后的载荷由帧持有，替换原有各段
+    if (CompressionActive() && frame.payload_size_ > 0 &&
+        compressor_.Compress(frame.iov_ + 1, frame.count_ - 1, frame.payload_size_, frame.compressed_, 0)) {
+        flags |= COMPRESSED_FLAG;
+        frame.iov_[1].iov_base = frame.compressed_.data();
+        frame.iov_[1].iov_len = frame.compressed_.size();
+        frame.count_ = 2;
+        frame.payload_size_ = frame.compressed_.size();
+    }
+
+    uint32_t checksum = 0;
+    for (size_t i = 1; i < frame.count_; ++i) {
+        checksum = UpdateChecksum(mode, checksum, static_cast<const uint8_t*>(frame.iov_[i].iov_base),
+                                  frame.iov_[i].iov_len);
+    }
+
+    MessageHeader& header = frame.header_;
+    header.magic = htonl(MESSAGE_MAGIC);
+    header.type = htonl((static_cast<uint32_t>(type) & MESSAGE_TYPE_MASK) | flags |
+                        (static_cast<uint32_t>(mode) << CHECKSUM_MODE_SHIFT));
+    header.length = htonl(static_cast<uint32_t>(frame.payload_size_));
+    header.sequence = htonl(NextSequence());
+    header.checksum = htonl(checksum);
 }
 
 NetworkMessage MessageHandler::CreateDeviceListRequest() {
@@ -147,6 +507,22 @@ NetworkMessage MessageHandler::CreateUrbResponse(const protocol::UsbUrb& urb) {
     return NetworkMessage(MessageType::URB_RESPONSE, data);
 }
 
+NetworkMessage MessageHandler::CreateUrbUnlink(uint32_t seqnum, uint32_t unlink_seqnum) {
+    protocol::UsbipCmdUnlink cmd = {};
+    cmd.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_CMD_UNLINK);
+    cmd.header.seqnum = seqnum;
+    cmd.unlink_seqnum = unlink_seqnum;
+    return NetworkMessage(MessageType::URB_UNLINK, protocol::UsbipProtocol::SerializeCmdUnlink(cmd));
+}
+
+NetworkMessage MessageHandler::CreateUrbUnlinkResponse(uint32_t seqnum, int32_t status) {
+    protocol::UsbipRetUnlink ret = {};
+    ret.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_RET_UNLINK);
+    ret.header.seqnum = seqnum;
+    ret.status = status;
+    return NetworkMessage(MessageType::URB_UNLINK_RESPONSE, protocol::UsbipProtocol::SerializeRetUnlink(ret));
+}
+
 NetworkMessage MessageHandler::CreateDeviceDisconnect(const std::string& bus_id) {
     std::vector<uint8_t> data(bus_id.begin(), bus_id.end());
     return NetworkMessage(MessageType::DEVICE_DISCONNECT, data);
@@ -156,54 +532,169 @@ NetworkMessage MessageHandler::CreateHeartbeat() {
     return NetworkMessage(MessageType::HEARTBEAT, std::vector<uint8_t>());
 }
 
-void MessageHandler::ProcessCompleteMessage(const uint8_t* data, size_t len) {
-    if (len < sizeof(MessageHeader)) {
-        return;
+NetworkMessage MessageHandler::CreateDedupOffer(uint32_t offer_id, const uint8_t* usbip_header, size_t header_length,
+                                               const std::vector<protocol::DedupExtent>& extents) {
+    // 载荷：[提议ID][USBIP头部长度][USBIP头部][extent数][各extent的哈希(32)和长度(4)]
+    std::vector<uint8_t> data;
+    data.reserve(12 + header_length + extents.size() * DEDUP_EXTENT_ENTRY_SIZE);
+    PutBigEndian32(data, offer_id);
+    PutBigEndian32(data, static_cast<uint32_t>(header_length));
+    data.insert(data.end(), usbip_header, usbip_header + header_length);
+    PutBigEndian32(data, static_cast<uint32_t>(extents.size()));
+    for (const auto& extent : extents) {
+        data.insert(data.end(), extent.hash.bytes, extent.hash.bytes + protocol::DEDUP_HASH_SIZE);
+        PutBigEndian32(data, extent.length);
     }
+    return NetworkMessage(MessageType::DEDUP_OFFER, data);
+}
 
-    MessageHeader header;
-    std::memcpy(&header, data, sizeof(MessageHeader));
+bool MessageHandler::ParseDedupOffer(const MessageView& message, DedupOffer& offer) {
+    const uint8_t* data = message.Data();
+    size_t len = message.Size();
+    if (len < 12) {
+        return false;
+    }
 
-    // 转换字节序
-    header.magic = ntohl(header.magic);
-    header.type = ntohl(header.type);
-    header.length = ntohl(header.length);
-    header.sequence = ntohl(header.sequence);
-    header.checksum = ntohl(header.checksum);
+    offer.offer_id = GetBigEndian32(data);
+    offer.usbip_header_length = GetBigEndian32(data + 4);
+    if (offer.usbip_header_length > len - 12) {
+        return false;
+    }
+    offer.usbip_header = data + 8;
+
+    size_t offset = 8 + offer.usbip_header_length;
+    uint32_t count = GetBigEndian32(data + offset);
+    offset += 4;
+    if (count > (len - offset) / DEDUP_EXTENT_ENTRY_SIZE ||
+        len - offset != static_cast<size_t>(count) * DEDUP_EXTENT_ENTRY_SIZE) {
+        return false;
+    }
 
-    NetworkMessage message;
-    message.header = header;
+    // 接收端按头部加数据的总长预先分配，总长由对端决定，超过单条消息上限的提议直接拒绝
+    offer.extents.clear();
+    offer.extents.reserve(count);
+    size_t total = offer.usbip_header_length;
+    for (uint32_t i = 0; i < count; ++i, offset += DEDUP_EXTENT_ENTRY_SIZE) {
+        protocol::DedupExtent extent;
+        std::memcpy(extent.hash.bytes, data + offset, protocol::DEDUP_HASH_SIZE);
+        extent.length = GetBigEndian32(data + offset + protocol::DEDUP_HASH_SIZE);
+        if (extent.length == 0 || extent.length > protocol::DEDUP_EXTENT_SIZE) {
+            return false;
+        }
+        total += extent.length;
+        if (total > MAX_MESSAGE_SIZE) {
+            return false;
+        }
+        offer.extents.push_back(extent);
+    }
+    return true;
+}
 
-    if (header.length > 0) {
-        const uint8_t* payload = data + sizeof(MessageHeader);
-        message.payload.assign(payload, payload + header.length);
+NetworkMessage MessageHandler::CreateDedupRequest(uint32_t offer_id, const std::vector<uint32_t>& missing) {
+    // 载荷：[提议ID][缺少的extent数][各extent序号]
+    std::vector<uint8_t> data;
+    data.reserve(8 + missing.size() * 4);
+    PutBigEndian32(data, offer_id);
+    PutBigEndian32(data, static_cast<uint32_t>(missing.size()));
+    for (uint32_t index : missing) {
+        PutBigEndian32(data, index);
+    }
+    return NetworkMessage(MessageType::DEDUP_REQUEST, data);
+}
+
+bool MessageHandler::ParseDedupRequest(const MessageView& message, uint32_t& offer_id,
+                                       std::vector<uint32_t>& missing) {
+    if (message.Size() < 8) {
+        return false;
+    }
+    offer_id = GetBigEndian32(message.Data());
+    uint32_t count = GetBigEndian32(message.Data() + 4);
+    if (message.Size() - 8 != static_cast<size_t>(count) * 4) {
+        return false;
     }
 
+    missing.clear();
+    missing.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        missing.push_back(GetBigEndian32(message.Data() + 8 + i * 4));
+    }
+    return true;
+}
+
+bool MessageHandler::BuildDedupData(OutgoingFrame& frame, uint32_t offer_id, uint32_t index,
+                                    const uint8_t* data, size_t len) {
+    // 载荷：[提议ID][extent序号][extent数据]
+    std::vector<uint8_t> header;
+    PutBigEndian32(header, offer_id);
+    PutBigEndian32(header, index);
+    return frame.AppendCopy(header.data(), header.size()) && frame.AppendRef(data, len);
+}
+
+bool MessageHandler::ParseDedupData(const MessageView& message, uint32_t& offer_id, uint32_t& index,
+                                    const uint8_t*& data, size_t& len) {
+    if (message.Size() < 8) {
+        return false;
+    }
+    offer_id = GetBigEndian32(message.Data());
+    index = GetBigEndian32(message.Data() + 4);
+    data = message.Data() + 8;
+    len = message.Size() - 8;
+    return true;
+}
+
+void MessageHandler::ProcessCompleteMessage(const MessageHeader& header, const uint8_t* payload) {
+    // 能力协商先在内部处理，再交给回调（接受方需要回复）
+    if (static_cast<MessageType>(header.type) == MessageType::CAPABILITIES) {
+        HandleCapabilities(payload, header.length);
+    }
+
+    // 载荷不拷贝，直接以视图形式交给回调
     if (message_callback_) {
-        message_callback_(message);
+        message_callback_(MessageView(header, payload, header.length));
     }
 }
 
-uint32_t MessageHandler::CalculateChecksum(const uint8_t* data, size_t len) {
-    uint32_t checksum = 0;
-    for (size_t i = 0; i < len; ++i) {
-        checksum += data[i];
+uint32_t MessageHandler::CalculateChecksum(ChecksumMode mode, const uint8_t* data, size_t len) {
+    return UpdateChecksum(mode, 0, data, len);
+}
+
+uint32_t MessageHandler::UpdateChecksum(ChecksumMode mode, uint32_t checksum, const uint8_t* data, size_t len) {
+    // 各模式都支持分段累积，分散的载荷段可以依次计算
+    switch (mode) {
+        case ChecksumMode::CRC32C:
+            return utils::Crc32c(data, len, checksum);
+
+        case ChecksumMode::NONE:
+            return 0;
+
+        case ChecksumMode::LEGACY_SUM:
+        default:
+            for (size_t i = 0; i < len; ++i) {
+                checksum += data[i];
+            }
+            return checksum;
     }
-    return checksum;
 }
 
 bool MessageHandler::ValidateMessage(const MessageHeader& header, const uint8_t* payload) {
+    uint32_t mode_bits = (header.type & CHECKSUM_MODE_MASK) >> CHECKSUM_MODE_SHIFT;
+    if (!(SupportedModeMask() & (1u << mode_bits))) {
+        return false;
+    }
+
+    auto mode = static_cast<ChecksumMode>(mode_bits);
+    if (mode == ChecksumMode::NONE) {
+        return true;
+    }
+
+    // 空载荷在各模式下的校验和都为0
     if (header.length == 0) {
         return header.checksum == 0;
     }
 
-    uint32_t calculated_checksum = CalculateChecksum(payload, header.length);
+    uint32_t calculated_checksum = CalculateChecksum(mode, payload, header.length);
     return calculated_checksum == header.checksum;
 }
 
-uint32_t MessageHandler::GetNextSequence() {
-    return next_sequence_++;
-}
-
 } // namespace network
 } // namespace usb_redirector
@@ -5,8 +5,14 @@
 #include <functional>
 #include <mutex>
 #include <queue>
+#include <atomic>
+#include <sys/uio.h>
 #include "protocol/usbip_protocol.h"
 #include "protocol/usb_types.h"
+#include "protocol/dedup_store.h"
+#include "utils/ring_buffer.h"
+#include "compression.h"
+#include "tcp_socket.h"
 
 namespace usb_redirector {
 namespace network {
@@ -20,9 +26,27 @@ enum class MessageType : uint32_t {
     URB_SUBMIT = 5,
     URB_RESPONSE = 6,
     DEVICE_DISCONNECT = 7,
-    HEARTBEAT = 8
+    HEARTBEAT = 8,
+    CAPABILITIES = 9,       // 能力协商（校验模式等）
+    URB_UNLINK = 10,        // USBIP_CMD_UNLINK
+    URB_UNLINK_RESPONSE = 11, // USBIP_RET_UNLINK
+    DEDUP_OFFER = 12,       // 以各extent的哈希代替READ数据
+    DEDUP_REQUEST = 13,     // 接收端回复本地没有的extent（为空表示全部命中）
+    DEDUP_DATA = 14         // 发送端补发的单个extent
 };
 
+// 帧校验模式，写在消息头type字段的高位，每帧自描述
+enum class ChecksumMode : uint8_t {
+    LEGACY_SUM = 0,         // 逐字节累加和（兼容旧版本）
+    NONE = 1,               // 不校验（仅用于可信的本地链路）
+    CRC32C = 2              // CRC32C（硬件加速）
+};
+
+// 能力协商中的可选功能位，双方都声明时启用
+static constexpr uint8_t FEATURE_DEDUP = 0x01;     // 按内容哈希去重的READ数据传输
+static constexpr uint8_t FEATURE_COMPRESSION = 0x02; // LZ4载荷压缩
+static constexpr uint8_t FEATURE_FRAGMENTS = 0x04;   // 大的批量帧拆成分片发送
+
 // 网络消息头
 struct MessageHeader {
     uint32_t magic;         // 魔数，用于验证
@@ -42,13 +66,104 @@ struct NetworkMessage {
     NetworkMessage(MessageType type, const uint8_t* data, size_t len);
 };
 
+// 接收消息的零拷贝视图：载荷直接指向接收缓冲区，只在消息回调期间有效。
+// 需要在回调返回后继续持有时调用Retain()取得引用计数的租约（只在首次取得时拷贝一次）
+class MessageView {
+public:
+    MessageView() = default;
+    MessageView(const MessageHeader& header, const uint8_t* payload, size_t len)
+        : header_(header), data_(payload), size_(len) {}
+
+    const MessageHeader& Header() const { return header_; }
+    MessageType Type() const { return static_cast<MessageType>(header_.type); }  // 已去除校验模式标志
+
+    // 载荷访问
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+    uint8_t operator[](size_t index) const { return data_[index]; }
+
+    // 是否持有租约（可在回调之外安全使用）
+    bool IsRetained() const { return lease_ != nullptr; }
+    MessageView Retain() const;
+
+    // 拷贝为独立的NetworkMessage
+    NetworkMessage ToMessage() const;
+
+private:
+    MessageHeader header_ = {};
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::shared_ptr<const std::vector<uint8_t>> lease_;
+};
+
+// 分散-聚集发送的帧：iovec[0]为消息头，其后依次为载荷各段。
+// 协议头等小块数据拷贝到帧内部，大块数据只引用调用方缓冲区（发送前必须保持有效）
+class OutgoingFrame {
+public:
+    static constexpr size_t MAX_SEGMENTS = 4;
+    static constexpr size_t INLINE_CAPACITY = 128;
+
+    OutgoingFrame();
+
+    // 帧内部持有iovec指向自身的指针，禁止拷贝
+    OutgoingFrame(const OutgoingFrame&) = delete;
+    OutgoingFrame& operator=(const OutgoingFrame&) = delete;
+
+    // 追加拷贝到帧内部的小块数据（如USBIP头部）
+    bool AppendCopy(const void* data, size_t len);
+    // 追加引用外部缓冲区的数据段
+    bool AppendRef(const void* data, size_t len);
+
+    const struct iovec* Iov() const { return iov_; }
+    size_t Count() const { return count_; }
+    size_t PayloadSize() const { return payload_size_; }
+
+private:
+    friend class MessageHandler;
+
+    MessageHeader header_;                  // 网络字节序
+    struct iovec iov_[MAX_SEGMENTS + 1];
+    size_t count_;
+    size_t payload_size_;
+    uint8_t inline_data_[INLINE_CAPACITY];
+    size_t inline_size_;
+    std::vector<uint8_t> compressed_;       // 压缩后的载荷，替换原有各段
+};
+
+// 去重提议：USBIP头部原样携带，数据以extent哈希列表代替
+struct DedupOffer {
+    uint32_t offer_id = 0;                  // 发送端分配，DEDUP_REQUEST/DEDUP_DATA以此配对
+    const uint8_t* usbip_header = nullptr;  // 指向消息载荷
+    size_t usbip_header_length = 0;
+    std::vector<protocol::DedupExtent> extents;
+
+    size_t DataLength() const;
+};
+
 class MessageHandler {
 public:
-    using MessageCallback = std::function<void(const NetworkMessage& message)>;
+    // 回调中的视图只在回调期间有效
+    using MessageCallback = std::function<void(const MessageView& message)>;
+    // 把一个完整帧交给连接发送（通常是TcpSocket::SendV）
+    using FrameSender = std::function<bool(const struct iovec* iov, size_t count, SendPriority priority)>;
 
     static constexpr uint32_t MESSAGE_MAGIC = 0x55534249; // "USBI"
     static constexpr size_t MAX_MESSAGE_SIZE = 1024 * 1024; // 1MB
 
+    // type字段布局：低16位为消息类型，第16-17位为校验模式，第18位表示载荷经LZ4压缩，
+    // 第19位表示后面还有分片，第20位表示本帧不是首个分片
+    static constexpr uint32_t MESSAGE_TYPE_MASK = 0x0000FFFF;
+    static constexpr uint32_t CHECKSUM_MODE_SHIFT = 16;
+    static constexpr uint32_t CHECKSUM_MODE_MASK = 0x3u << CHECKSUM_MODE_SHIFT;
+    static constexpr uint32_t COMPRESSED_FLAG = 1u << 18;
+    static constexpr uint32_t MORE_FRAGMENTS_FLAG = 1u << 19;
+    static constexpr uint32_t CONTINUATION_FLAG = 1u << 20;
+    static constexpr size_t DEFAULT_FRAGMENT_SIZE = 64 * 1024;
+    static constexpr uint8_t CAPABILITIES_VERSION = 3;
+
     MessageHandler();
     ~MessageHandler() = default;
 
@@ -60,9 +175,47 @@ public:
     // 处理接收到的数据
     void ProcessReceivedData(const uint8_t* data, size_t len);
 
-    // 序列化消息为网络数据
+    // 序列化消息为网络数据（按当前发送校验模式）
     std::vector<uint8_t> SerializeMessage(const NetworkMessage& message);
 
+    // 新连接建立时调用：丢弃上一连接残留的不完整数据，重置序列号空间并重新协商校验模式
+    void ResetSession();
+
+    // 为分散-聚集帧填写消息头（分配序列号并按各载荷段计算校验和），之后用TcpSocket::SendV发送
+    void FinalizeFrame(MessageType type, OutgoingFrame& frame);
+
+    // 填写消息头并以指定优先级发送。协商了分片时，载荷超过分片大小的批量帧拆成若干
+    // 等长的分片帧（各自压缩和校验）依次发送，高优先级的帧可以插在分片之间；
+    // 接收端按顺序拼回原消息后再交给回调
+    bool SendFrame(MessageType type, OutgoingFrame& frame, SendPriority priority, const FrameSender& send);
+
+    // 分片大小，0表示不拆分。非零时随能力协商声明FEATURE_FRAGMENTS，分片帧总能接收
+    void SetFragmentSize(size_t bytes) { fragment_size_.store(bytes); }
+    size_t GetFragmentSize() const { return fragment_size_.load(); }
+
+    // USB传输类型对应的发送优先级：控制 > 中断/同步 > 批量
+    static SendPriority TransferPriority(protocol::UsbTransferType type);
+
+    // 校验模式协商：连接发起方发送CAPABILITIES，接受方收到后回复自己的CAPABILITIES。
+    // 双方都偏好NONE时不校验，双方都支持CRC32C时使用CRC32C，否则保持累加和。
+    // 协商完成前按累加和发送；接收时按每帧标志校验，拒绝本端不支持的模式
+    void SetPreferredChecksumMode(ChecksumMode mode);
+    ChecksumMode GetPreferredChecksumMode() const { return preferred_mode_.load(); }
+    ChecksumMode GetChecksumMode() const { return send_mode_.load(); }
+    NetworkMessage CreateCapabilities() const;
+
+    // 可选功能（FEATURE_*）随能力协商交换，双方都声明的功能才生效，每个新连接重新协商
+    void SetLocalFeatures(uint8_t features) { local_features_.store(features); }
+    uint8_t GetNegotiatedFeatures() const { return negotiated_features_.load(); }
+
+    // 载荷压缩：启用后随能力协商声明FEATURE_COMPRESSION，双方都启用时发送的大载荷按需压缩
+    // （帧头标志，校验和覆盖压缩后的载荷）。压缩帧总能接收。链路带宽也随能力协商告知对端
+    void SetCompressionConfig(const CompressionConfig& config) { compressor_.SetConfig(config); }
+    CompressionStatistics GetCompressionStatistics() const { return compressor_.GetStatistics(); }
+
+    // 按指定模式计算载荷校验和
+    static uint32_t CalculateChecksum(ChecksumMode mode, const uint8_t* data, size_t len);
+
     // 创建各种类型的消息
     static NetworkMessage CreateDeviceListRequest();
     static NetworkMessage CreateDeviceListResponse(const std::vector<protocol::UsbipDeviceInfo>& devices);
@@ -70,22 +223,61 @@ public:
     static NetworkMessage CreateDeviceImportResponse(bool success, const std::string& error = "");
     static NetworkMessage CreateUrbSubmit(const protocol::UsbUrb& urb);
     static NetworkMessage CreateUrbResponse(const protocol::UsbUrb& urb);
+    static NetworkMessage CreateUrbUnlink(uint32_t seqnum, uint32_t unlink_seqnum);
+    static NetworkMessage CreateUrbUnlinkResponse(uint32_t seqnum, int32_t status);
     static NetworkMessage CreateDeviceDisconnect(const std::string& bus_id);
     static NetworkMessage CreateHeartbeat();
 
-    // 获取下一个序列号
-    static uint32_t GetNextSequence();
+    // 去重传输：发送端以DEDUP_OFFER代替携带READ数据的URB_SUBMIT，接收端从本地存储
+    // 补齐命中的extent，以DEDUP_REQUEST列出缺少的extent，发送端逐个以DEDUP_DATA补发
+    static NetworkMessage CreateDedupOffer(uint32_t offer_id, const uint8_t* usbip_header, size_t header_length,
+                                           const std::vector<protocol::DedupExtent>& extents);
+    static bool ParseDedupOffer(const MessageView& message, DedupOffer& offer);
+    static NetworkMessage CreateDedupRequest(uint32_t offer_id, const std::vector<uint32_t>& missing);
+    static bool ParseDedupRequest(const MessageView& message, uint32_t& offer_id, std::vector<uint32_t>& missing);
+    // DEDUP_DATA的头部拷贝进帧，extent数据只引用（发送前保持有效），之后调用FinalizeFrame
+    static bool BuildDedupData(OutgoingFrame& frame, uint32_t offer_id, uint32_t index,
+                               const uint8_t* data, size_t len);
+    static bool ParseDedupData(const MessageView& message, uint32_t& offer_id, uint32_t& index,
+                               const uint8_t*& data, size_t& len);
+
+    // 从本连接的序列号空间分配下一个序列号
+    uint32_t NextSequence() { return sequence_.Next(); }
 
 private:
-    void ProcessCompleteMessage(const uint8_t* data, size_t len);
-    uint32_t CalculateChecksum(const uint8_t* data, size_t len);
+    // 在连续数据上就地解析完整消息，返回已消费的字节数
+    size_t ParseMessages(const uint8_t* data, size_t len);
+    void ProcessCompleteMessage(const MessageHeader& header, const uint8_t* payload);
+    // 追加一个分片，消息完整时改写header并返回拼好的载荷，否则返回nullptr
+    const uint8_t* ReassembleFragment(MessageHeader& header, const uint8_t* payload, uint32_t flags);
+    void FinalizeFrame(MessageType type, OutgoingFrame& frame, uint32_t flags);
     bool ValidateMessage(const MessageHeader& header, const uint8_t* payload);
+    static uint32_t UpdateChecksum(ChecksumMode mode, uint32_t checksum, const uint8_t* data, size_t len);
+    void HandleCapabilities(const uint8_t* payload, size_t len);
+    uint32_t SupportedModeMask() const;
+    uint8_t LocalFeatures() const;
+    bool CompressionActive() const;
+    bool FragmentsActive() const;
 
-    std::vector<uint8_t> receive_buffer_;
+    utils::RingBuffer receive_buffer_;  // 只缓存跨越多次接收的不完整消息
     MessageCallback message_callback_;
     std::mutex mutex_;
 
-    static uint32_t next_sequence_;
+    std::atomic<ChecksumMode> preferred_mode_;
+    std::atomic<ChecksumMode> send_mode_;
+    std::atomic<uint8_t> local_features_;
+    std::atomic<uint8_t> negotiated_features_;
+
+    AdaptiveCompressor compressor_;
+    std::vector<uint8_t> decompress_buffer_;    // 解压后的载荷，只在消息回调期间有效
+
+    std::atomic<size_t> fragment_size_;
+    std::mutex fragment_mutex_;                 // 同一时刻只有一组分片在发送
+    bool reassembling_;
+    MessageHeader fragment_header_;             // 首个分片的消息头
+    std::vector<uint8_t> fragment_buffer_;      // 拼接中的载荷，交付后只在消息回调期间有效
+
+    protocol::SequenceSpace sequence_;
 };
 
 } // namespace network
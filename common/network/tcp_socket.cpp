@@ -1,6 +1,8 @@
 #include "tcp_socket.h"
+#include "io_uring.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -12,11 +14,106 @@
 namespace usb_redirector {
 namespace network {
 
+#if defined(MSG_NOSIGNAL)
+static constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static constexpr int SEND_FLAGS = 0;
+#endif
+
+static constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+
+// 单次sendmsg最多提交的段数（不超过IOV_MAX）
+static constexpr size_t SEND_IOV_BATCH = 64;
+
+static bool SetNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return false;
+    }
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+#if defined(SO_NOSIGPIPE)
+    // macOS没有MSG_NOSIGNAL，改为在套接字上屏蔽SIGPIPE
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+    return true;
+}
+
+// 关闭Nagle算法使小的控制帧立即发出；限制内核中尚未发出的数据量，
+// 积压留在按优先级排队的用户态队列里
+static void ConfigureConnection(int fd) {
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+#if defined(TCP_NOTSENT_LOWAT)
+    int lowat = TcpSocket::SEND_LOW_WATERMARK;
+    setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
+}
+
+static int CreateListenSocket(const std::string& bind_addr, uint16_t port, std::string& error) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        error = "Failed to create socket: " + std::string(strerror(errno));
+        return -1;
+    }
+
+    // 设置地址重用
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        error = "Failed to set socket options: " + std::string(strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    std::memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+
+    if (bind_addr.empty() || bind_addr == "0.0.0.0") {
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+    } else {
+        if (inet_pton(AF_INET, bind_addr.c_str(), &server_addr.sin_addr) <= 0) {
+            error = "Invalid bind address: " + bind_addr;
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (bind(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        error = "Failed to bind: " + std::string(strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) < 0) {
+        error = "Failed to listen: " + std::string(strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (!SetNonBlocking(fd)) {
+        error = "Failed to set non-blocking mode: " + std::string(strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
 TcpSocket::TcpSocket()
-    : socket_fd_(-1)
+    : TcpSocket(EventLoopGroup::Instance()) {
+}
+
+TcpSocket::TcpSocket(EventLoopGroup& group)
+    : group_(group)
+    , socket_fd_(-1)
     , is_connected_(false)
     , is_listening_(false)
-    , should_stop_(false) {
+    , listen_loop_(nullptr) {
 }
 
 TcpSocket::~TcpSocket() {
@@ -28,8 +125,8 @@ bool TcpSocket::Connect(const std::string& host, uint16_t port) {
         return false;
     }
 
-    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd_ < 0) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
         NotifyError("Failed to create socket: " + std::string(strerror(errno)));
         return false;
     }
@@ -41,23 +138,48 @@ bool TcpSocket::Connect(const std::string& host, uint16_t port) {
 
     if (inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) <= 0) {
         NotifyError("Invalid address: " + host);
-        close(socket_fd_);
-        socket_fd_ = -1;
+        close(fd);
         return false;
     }
 
-    if (connect(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (connect(fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         NotifyError("Failed to connect: " + std::string(strerror(errno)));
-        close(socket_fd_);
-        socket_fd_ = -1;
+        close(fd);
         return false;
     }
 
+    return Adopt(fd);
+}
+
+bool TcpSocket::Adopt(int fd) {
+    if (!SetNonBlocking(fd)) {
+        NotifyError("Failed to set non-blocking mode: " + std::string(strerror(errno)));
+        close(fd);
+        return false;
+    }
+
+    auto conn = std::make_shared<Connection>();
+    conn->fd = fd;
+    conn->loop = group_.Next();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+        socket_fd_ = fd;
+    }
     is_connected_.store(true);
-    should_stop_.store(false);
 
-    // 启动接收线程
-    receive_thread_ = std::thread(&TcpSocket::ReceiveThread, this);
+    if (!AttachConnection(conn)) {
+        NotifyError("Failed to register socket with event loop");
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            connection_.reset();
+            socket_fd_ = -1;
+        }
+        is_connected_.store(false);
+        CloseConnection(*conn);
+        return false;
+    }
 
     NotifyConnect(true);
     return true;
@@ -68,194 +190,706 @@ bool TcpSocket::Listen(const std::string& bind_addr, uint16_t port) {
         return false;
     }
 
-    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_fd_ < 0) {
-        NotifyError("Failed to create socket: " + std::string(strerror(errno)));
+    std::string error;
+    int fd = CreateListenSocket(bind_addr, port, error);
+    if (fd < 0) {
+        NotifyError(error);
         return false;
     }
 
-    // 设置地址重用
-    int opt = 1;
-    if (setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        NotifyError("Failed to set socket options: " + std::string(strerror(errno)));
-        close(socket_fd_);
-        socket_fd_ = -1;
+    EventLoop* loop = group_.Next();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        socket_fd_ = fd;
+        listen_loop_ = loop;
+    }
+    is_listening_.store(true);
+
+    // 接受连接由事件循环驱动
+    if (!loop || !loop->Add(fd, EventLoop::EVENT_READ, [this](uint32_t) { OnAcceptable(); })) {
+        NotifyError("Failed to register listener with event loop");
+        is_listening_.store(false);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            socket_fd_ = -1;
+            listen_loop_ = nullptr;
+        }
+        close(fd);
         return false;
     }
 
-    struct sockaddr_in server_addr;
-    std::memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
+    return true;
+}
 
-    if (bind_addr.empty() || bind_addr == "0.0.0.0") {
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-    } else {
-        if (inet_pton(AF_INET, bind_addr.c_str(), &server_addr.sin_addr) <= 0) {
-            NotifyError("Invalid bind address: " + bind_addr);
-            close(socket_fd_);
-            socket_fd_ = -1;
+bool TcpSocket::Send(const uint8_t* data, size_t len, SendPriority priority, uint32_t tag) {
+    struct iovec iov;
+    iov.iov_base = const_cast<uint8_t*>(data);
+    iov.iov_len = len;
+    return SendV(&iov, 1, priority, tag);
+}
+
+bool TcpSocket::Send(const std::vector<uint8_t>& data, SendPriority priority, uint32_t tag) {
+    return Send(data.data(), data.size(), priority, tag);
+}
+
+bool TcpSocket::SendV(const struct iovec* iov, size_t count, SendPriority priority, uint32_t tag) {
+    if (is_listening_.load()) {
+        std::vector<std::shared_ptr<Connection>> clients;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            clients = clients_;
+        }
+
+        if (clients.empty()) {
             return false;
         }
+
+        bool result = true;
+        for (auto& client : clients) {
+            result = SendOnConnection(client, iov, count, priority, tag) && result;
+        }
+        return result;
     }
 
-    if (bind(socket_fd_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        NotifyError("Failed to bind: " + std::string(strerror(errno)));
-        close(socket_fd_);
-        socket_fd_ = -1;
-        return false;
+    std::shared_ptr<Connection> conn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conn = connection_;
     }
 
-    if (listen(socket_fd_, 5) < 0) {
-        NotifyError("Failed to listen: " + std::string(strerror(errno)));
-        close(socket_fd_);
-        socket_fd_ = -1;
+    if (!is_connected_.load() || !conn) {
         return false;
     }
 
-    is_listening_.store(true);
-    should_stop_.store(false);
-
-    // 启动接受连接线程
-    accept_thread_ = std::thread(&TcpSocket::AcceptThread, this);
-
-    return true;
+    return SendOnConnection(conn, iov, count, priority, tag);
 }
 
-bool TcpSocket::Send(const uint8_t* data, size_t len) {
-    if (!is_connected_.load() || socket_fd_ < 0) {
-        return false;
+size_t TcpSocket::DropQueuedFrames(uint32_t tag) {
+    if (tag == 0) {
+        return 0;
     }
 
-    size_t total_sent = 0;
-    while (total_sent < len) {
-        ssize_t sent = send(socket_fd_, data + total_sent, len - total_sent, 0);
-        if (sent < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
+    std::vector<std::shared_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections = clients_;
+        if (connection_) {
+            connections.push_back(connection_);
+        }
+    }
+
+    size_t dropped = 0;
+    for (auto& conn : connections) {
+        bool released = false;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            for (auto& queue : conn->queues) {
+                size_t removed = 0;
+                for (auto it = queue.frames.begin(); it != queue.frames.end();) {
+                    it->begin -= removed;
+                    it->end -= removed;
+                    // 帧的开头已经写出（包括直接写入内核的部分）时必须完整发送，否则流会错位
+                    bool started = queue.offset > it->begin || it->end - it->begin != it->size;
+                    if (it->tag != tag || started) {
+                        ++it;
+                        continue;
+                    }
+                    size_t length = it->end - it->begin;
+                    queue.data.erase(queue.data.begin() + it->begin, queue.data.begin() + it->end);
+                    conn->pending_bytes -= length;
+                    removed += length;
+                    it = queue.frames.erase(it);
+                    ++dropped;
+                    released = true;
+                }
+                if (queue.frames.empty()) {
+                    queue.data.clear();
+                    queue.offset = 0;
+                }
             }
-            NotifyError("Send failed: " + std::string(strerror(errno)));
-            return false;
         }
-        total_sent += sent;
+        if (released) {
+            conn->drained_cv.notify_all();
+        }
     }
+    return dropped;
+}
 
-    return true;
+SendStatistics TcpSocket::GetSendStatistics() const {
+    SendStatistics stats;
+    for (size_t i = 0; i < SEND_PRIORITY_COUNT; ++i) {
+        stats.classes[i].frames = send_counters_[i].frames.load(std::memory_order_relaxed);
+        stats.classes[i].bytes = send_counters_[i].bytes.load(std::memory_order_relaxed);
+        stats.classes[i].total_wait_us = send_counters_[i].wait_us.Sum();
+        stats.classes[i].max_wait_us = send_counters_[i].wait_us.Max();
+        stats.classes[i].wait = send_counters_[i].wait_us.Summarize();
+    }
+    return stats;
 }
 
-bool TcpSocket::Send(const std::vector<uint8_t>& data) {
-    return Send(data.data(), data.size());
+void TcpSocket::RecordFrame(size_t priority, size_t bytes, Clock::time_point enqueued) {
+    uint64_t wait_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - enqueued).count();
+    ClassCounters& counters = send_counters_[priority];
+    counters.frames.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.wait_us.Record(wait_us);
 }
 
 void TcpSocket::Close() {
-    should_stop_.store(true);
-    is_connected_.store(false);
-    is_listening_.store(false);
+    bool was_connected = is_connected_.exchange(false);
+    bool was_listening = is_listening_.exchange(false);
 
-    if (socket_fd_ >= 0) {
-        close(socket_fd_);
-        socket_fd_ = -1;
-    }
-
-    // 关闭所有客户端连接
+    std::shared_ptr<Connection> conn;
+    std::vector<std::shared_ptr<Connection>> clients;
+    int listen_fd = -1;
+    EventLoop* listen_loop = nullptr;
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        for (int fd : client_fds_) {
-            close(fd);
+        conn.swap(connection_);
+        clients.swap(clients_);
+        if (listen_loop_) {
+            listen_fd = socket_fd_;
+            listen_loop = listen_loop_;
+            listen_loop_ = nullptr;
         }
-        client_fds_.clear();
+        socket_fd_ = -1;
+    }
+
+    if (listen_fd >= 0) {
+        listen_loop->Remove(listen_fd);
+        close(listen_fd);
     }
 
-    if (receive_thread_.joinable()) {
-        receive_thread_.join();
+    // 关闭所有客户端连接
+    for (auto& client : clients) {
+        CloseConnection(*client);
     }
 
-    if (accept_thread_.joinable()) {
-        accept_thread_.join();
+    if (conn) {
+        CloseConnection(*conn);
     }
 
-    NotifyConnect(false);
+    if (was_connected || was_listening) {
+        NotifyConnect(false);
+    }
 }
 
-void TcpSocket::ReceiveThread() {
-    const size_t buffer_size = 8192;
-    std::vector<uint8_t> buffer(buffer_size);
+bool TcpSocket::AttachConnection(const std::shared_ptr<Connection>& conn) {
+    if (!conn->loop) {
+        return false;
+    }
+    ConfigureConnection(conn->fd);
 
-    while (!should_stop_.load() && is_connected_.load()) {
-        ssize_t received = recv(socket_fd_, buffer.data(), buffer_size, 0);
-        if (received > 0) {
-            if (data_callback_) {
-                data_callback_(buffer.data(), received);
+    // 完成模式：由多次接收请求持续投递数据，无需注册就绪事件
+    conn->uring = conn->loop->GetUring();
+    if (conn->uring) {
+        conn->loop->RunInLoop([this, conn] {
+            if (!conn->closed) {
+                ArmUringReceive(conn);
             }
-        } else if (received == 0) {
-            // 连接关闭
-            break;
-        } else {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                NotifyError("Receive failed: " + std::string(strerror(errno)));
+        });
+        return true;
+    }
+
+    std::weak_ptr<Connection> weak_conn = conn;
+    return conn->loop->Add(conn->fd, EventLoop::EVENT_READ | EventLoop::EVENT_WRITE,
+                           [this, weak_conn](uint32_t events) {
+        if (auto c = weak_conn.lock()) {
+            OnConnectionEvent(c, events);
+        }
+    });
+}
+
+void TcpSocket::OnConnectionEvent(const std::shared_ptr<Connection>& conn, uint32_t events) {
+    if (events & EventLoop::EVENT_WRITE) {
+        std::string error;
+        bool flushed;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            flushed = FlushPending(*conn, error);
+        }
+        conn->drained_cv.notify_all();
+
+        if (!flushed) {
+            NotifyError(error);
+        }
+    }
+
+    if (events & EventLoop::EVENT_READ) {
+        // 每个I/O线程共用一个接收缓冲区
+        thread_local std::vector<uint8_t> buffer(RECEIVE_BUFFER_SIZE);
+
+        // 边缘触发：必须读到EAGAIN为止
+        while (!conn->closed) {
+            ssize_t received = recv(conn->fd, buffer.data(), buffer.size(), 0);
+            conn->loop->CountSyscalls(1);
+            if (received > 0) {
+                if (data_callback_) {
+                    data_callback_(buffer.data(), received);
+                }
+            } else if (received == 0) {
+                // 对端关闭连接
+                OnConnectionClosed(conn);
+                return;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break;
+            } else {
+                NotifyError("Receive failed: " + std::string(strerror(errno)));
+                OnConnectionClosed(conn);
+                return;
             }
         }
     }
 
-    is_connected_.store(false);
-    NotifyConnect(false);
+    if ((events & EventLoop::EVENT_CLOSE) && !conn->closed) {
+        OnConnectionClosed(conn);
+    }
 }
 
-void TcpSocket::AcceptThread() {
-    while (!should_stop_.load() && is_listening_.load()) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+void TcpSocket::OnConnectionClosed(const std::shared_ptr<Connection>& conn) {
+    CloseConnection(*conn);
+
+    bool is_primary = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (connection_ == conn) {
+            connection_.reset();
+            socket_fd_ = -1;
+            is_primary = true;
+        } else {
+            // 从客户端列表中移除
+            clients_.erase(std::remove(clients_.begin(), clients_.end(), conn), clients_.end());
+        }
+    }
+
+    if (is_primary && is_connected_.exchange(false)) {
+        NotifyConnect(false);
+    }
+}
 
-        int client_fd = accept(socket_fd_, (struct sockaddr*)&client_addr, &client_len);
+void TcpSocket::OnAcceptable() {
+    while (is_listening_.load()) {
+        int client_fd = accept(socket_fd_, nullptr, nullptr);
         if (client_fd < 0) {
-            if (errno != EAGAIN && errno != EWOULDBLOCK && !should_stop_.load()) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && is_listening_.load()) {
                 NotifyError("Accept failed: " + std::string(strerror(errno)));
             }
+            break;
+        }
+
+        if (!SetNonBlocking(client_fd)) {
+            close(client_fd);
             continue;
         }
 
+        auto conn = std::make_shared<Connection>();
+        conn->fd = client_fd;
+        conn->loop = group_.Next();
+
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            client_fds_.push_back(client_fd);
+            clients_.push_back(conn);
         }
 
-        // 为每个客户端启动处理线程
-        std::thread client_thread(&TcpSocket::HandleClient, this, client_fd);
-        client_thread.detach();
+        if (!AttachConnection(conn)) {
+            OnConnectionClosed(conn);
+        }
     }
 }
 
-void TcpSocket::HandleClient(int client_fd) {
-    const size_t buffer_size = 8192;
-    std::vector<uint8_t> buffer(buffer_size);
+bool TcpSocket::SendOnConnection(const std::shared_ptr<Connection>& conn_ptr, const struct iovec* iov, size_t count,
+                                 SendPriority priority, uint32_t tag) {
+    if (conn_ptr->uring) {
+        return QueueUringSend(conn_ptr, iov, count, priority, tag);
+    }
+
+    Connection& conn = *conn_ptr;
+    Clock::time_point enqueued = Clock::now();
+    size_t frame_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        frame_size += iov[i].iov_len;
+    }
+    std::string error;
+    {
+        std::unique_lock<std::mutex> lock(conn.mutex);
+
+        // 背压：待发送数据过多时等待I/O线程写出（I/O线程自身不能等待）
+        if (!conn.loop->IsInLoopThread()) {
+            conn.drained_cv.wait(lock, [&conn] {
+                return conn.closed || conn.pending_bytes < MAX_PENDING_BYTES;
+            });
+        }
+
+        if (conn.closed) {
+            return false;
+        }
+
+        // 各队列都没有排队数据时直接写入内核，保持发送顺序。
+        // index/offset指向第一个尚未写出的字节
+        size_t index = 0;
+        size_t offset = 0;
+        if (conn.pending_bytes == 0) {
+            while (index < count) {
+                struct iovec batch[SEND_IOV_BATCH];
+                size_t batch_count = 0;
+                for (size_t i = index; i < count && batch_count < SEND_IOV_BATCH; ++i) {
+                    size_t skip = (i == index) ? offset : 0;
+                    batch[batch_count].iov_base = static_cast<uint8_t*>(iov[i].iov_base) + skip;
+                    batch[batch_count].iov_len = iov[i].iov_len - skip;
+                    ++batch_count;
+                }
 
-    while (!should_stop_.load()) {
-        ssize_t received = recv(client_fd, buffer.data(), buffer_size, 0);
-        if (received > 0) {
-            if (data_callback_) {
-                data_callback_(buffer.data(), received);
+                struct msghdr msg = {};
+                msg.msg_iov = batch;
+                msg.msg_iovlen = batch_count;
+                ssize_t sent = sendmsg(conn.fd, &msg, SEND_FLAGS);
+                conn.loop->CountSyscalls(1);
+                if (sent >= 0) {
+                    size_t remaining = static_cast<size_t>(sent);
+                    while (index < count && remaining >= iov[index].iov_len - offset) {
+                        remaining -= iov[index].iov_len - offset;
+                        offset = 0;
+                        ++index;
+                    }
+                    offset += remaining;
+                    if (sent == 0 && index < count) {
+                        break;
+                    }
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                } else {
+                    error = "Send failed: " + std::string(strerror(errno));
+                    break;
+                }
             }
-        } else if (received == 0) {
-            // 客户端关闭连接
-            break;
+        }
+
+        // 剩余数据拷贝到对应优先级的队列，交给I/O线程在可写时发送
+        if (error.empty()) {
+            if (index < count) {
+                EnqueueFrame(conn, priority, iov, count, index, offset, frame_size, enqueued, tag);
+                // 帧的开头已经写入内核，剩余部分必须紧接着写出
+                if (index > 0 || offset > 0) {
+                    conn.active = static_cast<int>(priority);
+                }
+            } else {
+                RecordFrame(static_cast<size_t>(priority), frame_size, enqueued);
+            }
+        }
+    }
+
+    if (!error.empty()) {
+        NotifyError(error);
+        return false;
+    }
+
+    return true;
+}
+
+void TcpSocket::EnqueueFrame(Connection& conn, SendPriority priority, const struct iovec* iov, size_t count,
+                             size_t index, size_t offset, size_t frame_size, Clock::time_point enqueued,
+                             uint32_t tag) {
+    SendQueue& queue = conn.queues[static_cast<size_t>(priority)];
+
+    // 已写出的部分过半时前移，队列不会无限增长
+    if (queue.offset > 0 && queue.offset >= queue.data.size() / 2) {
+        queue.data.erase(queue.data.begin(), queue.data.begin() + queue.offset);
+        for (auto& frame : queue.frames) {
+            frame.begin -= queue.offset;
+            frame.end -= queue.offset;
+        }
+        queue.offset = 0;
+    }
+
+    size_t begin = queue.data.size();
+    for (size_t i = index; i < count; ++i) {
+        const uint8_t* base = static_cast<const uint8_t*>(iov[i].iov_base);
+        queue.data.insert(queue.data.end(), base + offset, base + iov[i].iov_len);
+        offset = 0;
+    }
+    conn.pending_bytes += queue.data.size() - begin;
+    queue.frames.push_back({begin, queue.data.size(), frame_size, enqueued, tag});
+}
+
+void TcpSocket::AdvanceQueue(Connection& conn, size_t priority, size_t offset) {
+    SendQueue& queue = conn.queues[priority];
+    conn.pending_bytes -= offset - queue.offset;
+    queue.offset = offset;
+
+    while (!queue.frames.empty() && queue.frames.front().end <= offset) {
+        RecordFrame(priority, queue.frames.front().size, queue.frames.front().enqueued);
+        queue.frames.pop_front();
+    }
+    if (queue.frames.empty()) {
+        queue.data.clear();
+        queue.offset = 0;
+    }
+
+    // 停在帧中间时，下次必须先写完该帧
+    bool partial = !queue.frames.empty() && queue.offset > queue.frames.front().begin;
+    conn.active = partial ? static_cast<int>(priority) : -1;
+}
+
+bool TcpSocket::FlushPending(Connection& conn, std::string& error) {
+    if (conn.closed) {
+        return true;
+    }
+
+    while (conn.pending_bytes > 0) {
+        // 写到一半的帧优先，否则取优先级最高的非空队列
+        size_t priority = 0;
+        if (conn.active >= 0) {
+            priority = static_cast<size_t>(conn.active);
         } else {
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            while (conn.queues[priority].frames.empty()) {
+                ++priority;
+            }
+        }
+        SendQueue& queue = conn.queues[priority];
+
+        // 更高优先级有数据排队时只写到当前帧结束，否则整个队列一次写出
+        size_t end = queue.data.size();
+        for (size_t higher = 0; higher < priority; ++higher) {
+            if (!conn.queues[higher].frames.empty()) {
+                end = queue.frames.front().end;
                 break;
             }
         }
+
+        ssize_t sent = send(conn.fd, queue.data.data() + queue.offset, end - queue.offset, SEND_FLAGS);
+        conn.loop->CountSyscalls(1);
+        if (sent > 0) {
+            AdvanceQueue(conn, priority, queue.offset + sent);
+        } else if (sent == 0) {
+            // 写入长度非0时send返回0说明连接已不可写，errno没有意义；
+            // 边缘触发下不会再收到可写事件，不能等下次重试
+            error = "Send failed: connection closed while sending";
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else {
+            error = "Send failed: " + std::string(strerror(errno));
+            return false;
+        }
     }
 
-    close(client_fd);
+    return true;
+}
 
-    // 从客户端列表中移除
+void TcpSocket::CloseConnection(Connection& conn) {
+    int fd;
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        client_fds_.erase(std::remove(client_fds_.begin(), client_fds_.end(), client_fd),
-                         client_fds_.end());
+        std::lock_guard<std::mutex> lock(conn.mutex);
+        if (conn.closed) {
+            return;
+        }
+        conn.closed = true;
+        fd = conn.fd;
+    }
+
+    // 先从事件循环注销，再关闭fd，避免fd被复用后收到旧事件
+    if (conn.uring) {
+        // 完成模式：关闭读写使未完成的请求尽快结束，并等待正在执行的完成回调返回
+        // （inflight由发送请求持有，随连接对象释放）
+        shutdown(fd, SHUT_RDWR);
+        conn.loop->Sync();
+    } else if (conn.loop) {
+        conn.loop->Remove(fd);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(conn.mutex);
+        close(fd);
+        conn.fd = -1;
+        for (auto& queue : conn.queues) {
+            queue.data.clear();
+            queue.offset = 0;
+            queue.frames.clear();
+        }
+        conn.pending_bytes = 0;
+        conn.active = -1;
+    }
+    conn.drained_cv.notify_all();
+}
+
+void TcpSocket::ArmUringReceive(const std::shared_ptr<Connection>& conn) {
+    bool armed = conn->uring->PrepareRecvMultishot(conn->fd,
+                                                   [this, conn](int32_t result, const uint8_t* buffer, bool more) {
+        if (!conn->closed) {
+            OnUringReceive(conn, result, buffer, more);
+        }
+    });
+
+    if (!armed) {
+        NotifyError("Failed to queue receive request");
+        OnConnectionClosed(conn);
     }
 }
 
+void TcpSocket::OnUringReceive(const std::shared_ptr<Connection>& conn, int32_t result,
+                               const uint8_t* buffer, bool more) {
+    if (result > 0) {
+        if (data_callback_) {
+            data_callback_(buffer, result);
+        }
+        // 内核结束了本次多次接收（例如缓冲区暂时耗尽）时重新提交
+        if (!more && !conn->closed) {
+            ArmUringReceive(conn);
+        }
+        return;
+    }
+
+    if (result == -ENOBUFS) {
+        if (!more) {
+            ArmUringReceive(conn);
+        }
+        return;
+    }
+
+    if (result != 0) {
+        NotifyError("Receive failed: " + std::string(strerror(-result)));
+    }
+    OnConnectionClosed(conn);
+}
+
+bool TcpSocket::QueueUringSend(const std::shared_ptr<Connection>& conn, const struct iovec* iov, size_t count,
+                               SendPriority priority, uint32_t tag) {
+    Clock::time_point enqueued = Clock::now();
+    size_t frame_size = 0;
+    for (size_t i = 0; i < count; ++i) {
+        frame_size += iov[i].iov_len;
+    }
+
+    bool schedule = false;
+    {
+        std::unique_lock<std::mutex> lock(conn->mutex);
+
+        // 背压：待发送数据过多时等待I/O线程写出（I/O线程自身不能等待）
+        if (!conn->loop->IsInLoopThread()) {
+            conn->drained_cv.wait(lock, [&conn] {
+                return conn->closed || conn->pending_bytes < MAX_PENDING_BYTES;
+            });
+        }
+
+        if (conn->closed) {
+            return false;
+        }
+
+        // 数据只追加到队列，由I/O线程在本轮结束时按优先级合并提交
+        EnqueueFrame(*conn, priority, iov, count, 0, 0, frame_size, enqueued, tag);
+        if (!conn->send_scheduled) {
+            conn->send_scheduled = true;
+            schedule = true;
+        }
+    }
+
+    if (schedule) {
+        conn->loop->RunInLoop([this, conn] {
+            if (!conn->closed) {
+                SubmitUringSend(conn);
+            }
+        });
+    }
+    return true;
+}
+
+void TcpSocket::SubmitUringSend(const std::shared_ptr<Connection>& conn) {
+    bool queued;
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        if (conn->closed) {
+            return;
+        }
+
+        // 上一批已全部写出，按优先级取排队的帧组成下一批
+        if (conn->inflight_offset == conn->inflight.size()) {
+            for (const auto& frame : conn->inflight_frames) {
+                RecordFrame(frame.priority, frame.size, frame.enqueued);
+            }
+            conn->inflight_frames.clear();
+            conn->inflight.clear();
+            conn->inflight_offset = 0;
+            if (conn->pending_bytes == 0) {
+                conn->send_scheduled = false;
+                return;
+            }
+            FillUringBatch(*conn);
+        }
+
+        queued = conn->uring->PrepareSend(conn->fd, conn->inflight.data() + conn->inflight_offset,
+                                          conn->inflight.size() - conn->inflight_offset,
+                                          [this, conn](int32_t result, const uint8_t*, bool) {
+            if (!conn->closed) {
+                OnUringSendComplete(conn, result);
+            }
+        });
+    }
+    conn->drained_cv.notify_all();
+
+    if (!queued) {
+        NotifyError("Failed to queue send request");
+        OnConnectionClosed(conn);
+    }
+}
+
+void TcpSocket::FillUringBatch(Connection& conn) {
+    // 批次只由整帧组成，高优先级的帧在批次之间越过排队的低优先级数据
+    for (size_t priority = 0; priority < SEND_PRIORITY_COUNT && conn.inflight.size() < URING_SEND_BATCH;
+         ++priority) {
+        SendQueue& queue = conn.queues[priority];
+        if (queue.frames.empty()) {
+            continue;
+        }
+
+        // 整个队列都能放入空批次时直接交换，不拷贝
+        if (conn.inflight.empty() && queue.offset == 0 && queue.data.size() <= URING_SEND_BATCH) {
+            conn.inflight.swap(queue.data);
+            for (const auto& frame : queue.frames) {
+                conn.inflight_frames.push_back({priority, frame.size, frame.enqueued});
+            }
+            conn.pending_bytes -= conn.inflight.size();
+            queue.frames.clear();
+            continue;
+        }
+
+        while (!queue.frames.empty() && conn.inflight.size() < URING_SEND_BATCH) {
+            const QueuedFrame& frame = queue.frames.front();
+            conn.inflight.insert(conn.inflight.end(), queue.data.begin() + frame.begin, queue.data.begin() + frame.end);
+            conn.inflight_frames.push_back({priority, frame.size, frame.enqueued});
+            conn.pending_bytes -= frame.end - frame.begin;
+            queue.offset = frame.end;
+            queue.frames.pop_front();
+        }
+        if (queue.frames.empty()) {
+            queue.data.clear();
+            queue.offset = 0;
+        }
+    }
+}
+
+void TcpSocket::OnUringSendComplete(const std::shared_ptr<Connection>& conn, int32_t result) {
+    if (result < 0) {
+        NotifyError("Send failed: " + std::string(strerror(-result)));
+        OnConnectionClosed(conn);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(conn->mutex);
+        conn->inflight_offset += result;
+    }
+    SubmitUringSend(conn);
+}
+
 void TcpSocket::NotifyError(const std::string& error) {
     if (error_callback_) {
         error_callback_(error);
@@ -300,5 +934,101 @@ std::string TcpSocket::GetRemoteAddress() const {
     return std::string(ip_str) + ":" + std::to_string(ntohs(addr.sin_port));
 }
 
+// TcpServer implementation
+TcpServer::TcpServer()
+    : TcpServer(EventLoopGroup::Instance()) {
+}
+
+TcpServer::TcpServer(EventLoopGroup& group)
+    : group_(group)
+    , server_fd_(-1)
+    , is_running_(false)
+    , loop_(nullptr) {
+}
+
+TcpServer::~TcpServer() {
+    Stop();
+}
+
+bool TcpServer::Start(const std::string& bind_addr, uint16_t port) {
+    if (is_running_.load()) {
+        return false;
+    }
+
+    std::string error;
+    server_fd_ = CreateListenSocket(bind_addr, port, error);
+    if (server_fd_ < 0) {
+        return false;
+    }
+
+    loop_ = group_.Next();
+    is_running_.store(true);
+
+    if (!loop_ || !loop_->Add(server_fd_, EventLoop::EVENT_READ, [this](uint32_t) { OnAcceptable(); })) {
+        is_running_.store(false);
+        close(server_fd_);
+        server_fd_ = -1;
+        loop_ = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void TcpServer::Stop() {
+    if (!is_running_.exchange(false)) {
+        return;
+    }
+
+    loop_->Remove(server_fd_);
+    close(server_fd_);
+    server_fd_ = -1;
+    loop_ = nullptr;
+
+    std::vector<std::shared_ptr<TcpSocket>> clients;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        clients.swap(clients_);
+    }
+
+    for (auto& client : clients) {
+        client->Close();
+    }
+}
+
+size_t TcpServer::GetClientCount() const {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    return std::count_if(clients_.begin(), clients_.end(),
+                         [](const std::shared_ptr<TcpSocket>& client) { return client->IsConnected(); });
+}
+
+void TcpServer::OnAcceptable() {
+    while (is_running_.load()) {
+        int client_fd = accept(server_fd_, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        // 先交给上层设置回调，再开始接收数据
+        auto client = std::make_shared<TcpSocket>(group_);
+        if (client_connect_callback_) {
+            client_connect_callback_(client);
+        }
+
+        if (!client->Adopt(client_fd)) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(clients_mutex_);
+        clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                      [](const std::shared_ptr<TcpSocket>& c) { return !c->IsConnected(); }),
+                       clients_.end());
+        clients_.push_back(client);
+    }
+}
+
 } // namespace network
 } // namespace usb_redirector
@@ -2,116 +2,249 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <sys/uio.h>
+#include "event_loop.h"
+#include "utils/latency_histogram.h"
 
 namespace usb_redirector {
 namespace network {
 
+class TcpServer;
+class IoUring;
+
+// 发送优先级：每个连接按优先级分别排队，高优先级的帧在帧边界处越过低优先级的排队数据，
+// 同一优先级内保持发送顺序
+enum class SendPriority : uint8_t {
+    CONTROL = 0,        // 控制传输和会话消息
+    INTERRUPT = 1,      // 中断和同步传输
+    BULK = 2            // 批量传输
+};
+static constexpr size_t SEND_PRIORITY_COUNT = 3;
+
+// 单个优先级的发送统计。排队时间从SendV调用到帧的最后一个字节交给内核
+struct SendClassStatistics {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t total_wait_us = 0;
+    uint64_t max_wait_us = 0;
+    utils::LatencySummary wait;     // 排队时间分布（p50/p99/p999）
+
+    double AverageWaitUs() const { return frames > 0 ? static_cast<double>(total_wait_us) / frames : 0.0; }
+};
+
+struct SendStatistics {
+    SendClassStatistics classes[SEND_PRIORITY_COUNT];  // 按SendPriority索引
+};
+
 class TcpSocket {
 public:
     using DataCallback = std::function<void(const uint8_t* data, size_t len)>;
     using ErrorCallback = std::function<void(const std::string& error)>;
     using ConnectCallback = std::function<void(bool connected)>;
 
+    // 单个连接允许缓存的未发送数据上限，超过后Send阻塞等待
+    static constexpr size_t MAX_PENDING_BYTES = 16 * 1024 * 1024; // 16MB
+    // 内核中尚未发出的数据上限（TCP_NOTSENT_LOWAT）：积压留在用户态队列里，才能被高优先级帧越过
+    static constexpr int SEND_LOW_WATERMARK = 128 * 1024;
+    // io_uring后端单批提交的数据量，批内的帧不能再被越过
+    static constexpr size_t URING_SEND_BATCH = 256 * 1024;
+
     TcpSocket();
+    // 使用指定的事件循环组（默认为EventLoopGroup::Instance()）
+    explicit TcpSocket(EventLoopGroup& group);
     virtual ~TcpSocket();
 
     // 禁止拷贝
     TcpSocket(const TcpSocket&) = delete;
     TcpSocket& operator=(const TcpSocket&) = delete;
 
-    // 设置回调函数
+    // 设置回调函数（回调在I/O线程中执行）
     void SetDataCallback(DataCallback callback) { data_callback_ = std::move(callback); }
     void SetErrorCallback(ErrorCallback callback) { error_callback_ = std::move(callback); }
     void SetConnectCallback(ConnectCallback callback) { connect_callback_ = std::move(callback); }
 
     // 连接到服务器
     bool Connect(const std::string& host, uint16_t port);
-    
-    // 启动服务器监听
+
+    // 启动服务器监听（服务器模式下Send发往所有已接受的连接）
     bool Listen(const std::string& bind_addr, uint16_t port);
-    
-    // 发送数据
-    bool Send(const uint8_t* data, size_t len);
-    bool Send(const std::vector<uint8_t>& data);
-    
+
+    // 发送数据，每次调用是一个不可分割的帧。tag非0的帧在写出前可由DropQueuedFrames撤回
+    bool Send(const uint8_t* data, size_t len, SendPriority priority = SendPriority::CONTROL, uint32_t tag = 0);
+    bool Send(const std::vector<uint8_t>& data, SendPriority priority = SendPriority::CONTROL, uint32_t tag = 0);
+
+    // 分散-聚集发送：各段按顺序写入同一个流，不需要先拼接。
+    // 返回后缓冲区即可释放（内核未接收的部分已拷贝到对应优先级的发送队列）
+    bool SendV(const struct iovec* iov, size_t count, SendPriority priority = SendPriority::CONTROL,
+               uint32_t tag = 0);
+
+    // 从发送队列中丢弃带该tag且还没有任何字节写出的帧，返回丢弃的帧数。
+    // 已开始写出的帧和已交给内核（或io_uring批次）的数据无法撤回
+    size_t DropQueuedFrames(uint32_t tag);
+
+    // 各优先级的帧数、字节数和排队时间（所有连接累计）
+    SendStatistics GetSendStatistics() const;
+
     // 关闭连接
     void Close();
-    
+
     // 检查连接状态
     bool IsConnected() const { return is_connected_.load(); }
-    
+
     // 获取本地和远程地址
     std::string GetLocalAddress() const;
     std::string GetRemoteAddress() const;
 
 private:
-    void ReceiveThread();
-    void AcceptThread();
-    void HandleClient(int client_fd);
+    friend class TcpServer;
+
+    using Clock = std::chrono::steady_clock;
+
+    // 排队的帧：在所属队列data中的位置、完整帧长、入队时间和发送方指定的tag
+    struct QueuedFrame {
+        size_t begin;
+        size_t end;
+        size_t size;                    // 直接写入内核的开头部分也计入
+        Clock::time_point enqueued;
+        uint32_t tag;                   // 0表示不可撤回
+    };
+
+    // 单个优先级的发送队列，各帧按到达顺序拼接存放
+    struct SendQueue {
+        std::vector<uint8_t> data;
+        size_t offset = 0;              // 已写出的字节
+        std::deque<QueuedFrame> frames;
+    };
+
+    // io_uring批次中的帧，整批发送完成时统计
+    struct BatchedFrame {
+        size_t priority;
+        size_t size;
+        Clock::time_point enqueued;
+    };
+
+    // 单个TCP连接的状态，由所属EventLoop驱动
+    struct Connection {
+        int fd = -1;
+        EventLoop* loop = nullptr;
+        std::atomic<bool> closed{false};
+        std::mutex mutex;
+        std::condition_variable drained_cv;
+        SendQueue queues[SEND_PRIORITY_COUNT];  // 尚未写入内核的数据，按SendPriority索引
+        size_t pending_bytes = 0;               // 各队列中尚未写出的字节总数
+        int active = -1;                        // 已写出一部分的帧所在队列，该帧写完前不能切换
+
+        // io_uring后端：正在由内核发送的一批数据，发送完成前不能修改
+        IoUring* uring = nullptr;
+        bool send_scheduled = false;
+        std::vector<uint8_t> inflight;
+        size_t inflight_offset = 0;
+        std::vector<BatchedFrame> inflight_frames;
+    };
+
+    // 统计计数器（各连接共用）
+    struct ClassCounters {
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        utils::LatencyHistogram wait_us;
+    };
+
+    // 接管已连接的fd（TcpServer使用）
+    bool Adopt(int fd);
+
+    bool AttachConnection(const std::shared_ptr<Connection>& conn);
+    void OnConnectionEvent(const std::shared_ptr<Connection>& conn, uint32_t events);
+    void OnConnectionClosed(const std::shared_ptr<Connection>& conn);
+    void OnAcceptable();
+    bool SendOnConnection(const std::shared_ptr<Connection>& conn, const struct iovec* iov, size_t count,
+                          SendPriority priority, uint32_t tag);
+    bool FlushPending(Connection& conn, std::string& error);
+    // 把iov中从(index, offset)开始的剩余数据作为一帧追加到对应优先级的队列
+    static void EnqueueFrame(Connection& conn, SendPriority priority, const struct iovec* iov, size_t count,
+                             size_t index, size_t offset, size_t frame_size, Clock::time_point enqueued,
+                             uint32_t tag);
+    // 队列前移到offset，记录其间写完的帧
+    void AdvanceQueue(Connection& conn, size_t priority, size_t offset);
+    void RecordFrame(size_t priority, size_t bytes, Clock::time_point enqueued);
+    void CloseConnection(Connection& conn);
+
+    // io_uring后端：多次接收请求持续投递数据，发送按批提交
+    void ArmUringReceive(const std::shared_ptr<Connection>& conn);
+    void OnUringReceive(const std::shared_ptr<Connection>& conn, int32_t result, const uint8_t* buffer, bool more);
+    bool QueueUringSend(const std::shared_ptr<Connection>& conn, const struct iovec* iov, size_t count,
+                        SendPriority priority, uint32_t tag);
+    void SubmitUringSend(const std::shared_ptr<Connection>& conn);
+    static void FillUringBatch(Connection& conn);
+    void OnUringSendComplete(const std::shared_ptr<Connection>& conn, int32_t result);
+
     void NotifyError(const std::string& error);
     void NotifyConnect(bool connected);
 
+    EventLoopGroup& group_;
     int socket_fd_;
     std::atomic<bool> is_connected_;
     std::atomic<bool> is_listening_;
-    std::atomic<bool> should_stop_;
-    
-    std::thread receive_thread_;
-    std::thread accept_thread_;
-    
+
+    EventLoop* listen_loop_;
+    std::shared_ptr<Connection> connection_;               // 客户端模式
+    std::vector<std::shared_ptr<Connection>> clients_;     // 服务器模式的客户端连接
+
     DataCallback data_callback_;
     ErrorCallback error_callback_;
     ConnectCallback connect_callback_;
-    
+
+    ClassCounters send_counters_[SEND_PRIORITY_COUNT];
+
     mutable std::mutex mutex_;
-    std::vector<int> client_fds_;  // 用于服务器模式的客户端连接
 };
 
 class TcpServer {
 public:
     using ClientConnectCallback = std::function<void(std::shared_ptr<TcpSocket> client)>;
-    
+
     TcpServer();
+    explicit TcpServer(EventLoopGroup& group);
     ~TcpServer();
-    
+
     // 禁止拷贝
     TcpServer(const TcpServer&) = delete;
     TcpServer& operator=(const TcpServer&) = delete;
-    
-    // 设置客户端连接回调
-    void SetClientConnectCallback(ClientConnectCallback callback) { 
-        client_connect_callback_ = std::move(callback); 
+
+    // 设置客户端连接回调（在客户端开始接收数据前调用，可在其中设置客户端回调）
+    void SetClientConnectCallback(ClientConnectCallback callback) {
+        client_connect_callback_ = std::move(callback);
     }
-    
+
     // 启动服务器
     bool Start(const std::string& bind_addr, uint16_t port);
-    
+
     // 停止服务器
     void Stop();
-    
+
     // 检查服务器状态
     bool IsRunning() const { return is_running_.load(); }
-    
+
     // 获取连接的客户端数量
     size_t GetClientCount() const;
 
 private:
-    void AcceptThread();
-    void HandleClient(int client_fd);
-    
+    void OnAcceptable();
+
+    EventLoopGroup& group_;
     int server_fd_;
     std::atomic<bool> is_running_;
-    std::atomic<bool> should_stop_;
-    
-    std::thread accept_thread_;
+
+    EventLoop* loop_;
     ClientConnectCallback client_connect_callback_;
-    
+
     mutable std::mutex clients_mutex_;
     std::vector<std::shared_ptr<TcpSocket>> clients_;
 };
@@ -0,0 +1,55 @@
+#include "block_io.h"
+#include <algorithm>
+#include <cstring>
+
+namespace usb_redirector {
+namespace protocol {
+
+static void PutBigEndian(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+bool BlockIo::NeedsLongCommand(uint64_t lba, uint32_t block_count) {
+    uint64_t last_block = lba + std::max<uint32_t>(block_count, 1) - 1;
+    return block_count > 0xFFFF || last_block > 0xFFFFFFFFull;
+}
+
+uint32_t BlockIo::MaxCommandBlocks(uint64_t lba, uint32_t block_count, uint32_t block_size,
+                                   uint32_t max_transfer_bytes) {
+    uint32_t count = std::min(block_count, std::max<uint32_t>(1, max_transfer_bytes / block_size));
+    if (lba <= 0xFFFFFFFFull) {
+        // 10字节命令的块数只有16位
+        count = std::min<uint32_t>(count, 0xFFFF);
+    }
+    return count;
+}
+
+uint8_t BlockIo::BuildReadWriteCdb(uint8_t* cdb, bool is_read, uint64_t lba, uint32_t block_count, bool fua) {
+    uint8_t length;
+    std::memset(cdb, 0, 16);
+
+    if (NeedsLongCommand(lba, block_count)) {
+        // READ(16)/WRITE(16)：8字节LBA，4字节块数
+        length = 16;
+        cdb[0] = static_cast<uint8_t>(is_read ? ScsiCommand::READ_16 : ScsiCommand::WRITE_16);
+        PutBigEndian(&cdb[2], lba, 8);
+        PutBigEndian(&cdb[10], block_count, 4);
+    } else {
+        // READ(10)/WRITE(10)：4字节LBA，2字节块数
+        length = 10;
+        cdb[0] = static_cast<uint8_t>(is_read ? ScsiCommand::READ_10 : ScsiCommand::WRITE_10);
+        PutBigEndian(&cdb[2], lba, 4);
+        PutBigEndian(&cdb[7], block_count, 2);
+    }
+
+    if (fua && !is_read) {
+        cdb[1] |= SCSI_CDB_FUA;
+    }
+    return length;
+}
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "mass_storage.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// 块读写配置
+struct BlockIoConfig {
+    uint32_t max_transfer_bytes = 128 * 1024;   // 单条READ/WRITE命令的最大数据量
+    size_t max_commands_in_flight = 4;          // Bulk-Only下同时在途的CBW/数据/CSW序列数
+    size_t max_uas_commands_in_flight = 32;     // UAS下同时在途的命令数，另受流数量限制
+};
+
+// SCSI块读写接口，由Bulk-Only（BotBlockIo）和UAS（UasBlockIo）两种传输实现
+class BlockIo {
+public:
+    virtual ~BlockIo() = default;
+
+    // 读写连续的块。LBA超出32位（512字节块时即2 TiB以上）时自动使用16字节命令，
+    // fua时每条WRITE都带FUA位
+    virtual bool Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, uint8_t* data) = 0;
+    virtual bool Write(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, const uint8_t* data,
+                       bool fua = false) = 0;
+
+    // SYNCHRONIZE CACHE(10)：整个LUN的设备缓存写入介质
+    virtual bool SynchronizeCache(uint8_t lun) = 0;
+
+    // 执行单条SCSI命令并等待状态。返回传输是否成功，SCSI状态（BOT下为CSW状态）由status带回
+    virtual bool ExecuteScsi(uint8_t lun, const uint8_t* cdb, uint8_t cdb_length, bool data_in,
+                             uint8_t* data, uint32_t length, uint8_t& status, uint32_t* actual_length = nullptr) = 0;
+
+    // 填充READ(10/16)/WRITE(10/16)的CDB，返回CDB长度
+    static uint8_t BuildReadWriteCdb(uint8_t* cdb, bool is_read, uint64_t lba, uint32_t block_count, bool fua = false);
+    // 该范围是否需要16字节命令
+    static bool NeedsLongCommand(uint64_t lba, uint32_t block_count);
+    // 单条命令的块数上限：受max_transfer_bytes和10字节命令的16位块数限制
+    static uint32_t MaxCommandBlocks(uint64_t lba, uint32_t block_count, uint32_t block_size,
+                                     uint32_t max_transfer_bytes);
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,294 @@
+#include "bot_block_io.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace usb_redirector {
+namespace protocol {
+
+BotBlockIo::BotBlockIo(BulkOnlyTransport& transport, const BlockIoConfig& config)
+    : transport_(transport)
+    , config_(config)
+    , next_tag_(1)
+    , in_flight_(0) {
+    config_.max_transfer_bytes = std::max<uint32_t>(1, config_.max_transfer_bytes);
+    config_.max_commands_in_flight = std::max<size_t>(1, config_.max_commands_in_flight);
+}
+
+void BotBlockIo::BuildReadWrite(CommandBlockWrapper& cbw, bool is_read, uint8_t lun, uint64_t lba,
+                                uint32_t block_count, uint32_t block_size, uint32_t tag, bool fua) {
+    std::memset(&cbw, 0, sizeof(cbw));
+    cbw.dCBWSignature = CBW_SIGNATURE;
+    cbw.dCBWTag = tag;
+    cbw.dCBWDataTransferLength = block_count * block_size;
+    cbw.bmCBWFlags = is_read ? CBW_FLAG_DATA_IN : CBW_FLAG_DATA_OUT;
+    cbw.bCBWLUN = lun & 0x0F;
+
+    cbw.bCBWCBLength = BuildReadWriteCdb(cbw.CBWCB, is_read, lba, block_count, fua);
+}
+
+void BotBlockIo::Issue(Command& command) {
+    bool is_read = (command.cbw.bmCBWFlags & CBW_FLAG_DATA_IN) != 0;
+    std::lock_guard<std::mutex> submit_lock(submit_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++in_flight_;
+        command.pending = command.length > 0 ? 3 : 2;
+        command.failed = false;
+        command.data_stalled = false;
+        command.csw_stalled = false;
+        command.csw_received = false;
+        command.data_actual = 0;
+    }
+
+    // 未能提交的阶段直接计为完成
+    auto abandon = [this, &command](int stages) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command.failed = true;
+        command.pending -= stages;
+        stage_done_.notify_all();
+    };
+
+    bool submitted = transport_.SubmitBulk(false, reinterpret_cast<uint8_t*>(&command.cbw), sizeof(CommandBlockWrapper),
+        [this, &command](BulkOnlyTransport::Status status, uint32_t actual_length) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (status != BulkOnlyTransport::Status::OK || actual_length != sizeof(CommandBlockWrapper)) {
+                command.failed = true;
+            }
+            --command.pending;
+            stage_done_.notify_all();
+        });
+    if (!submitted) {
+        abandon(command.pending);
+        return;
+    }
+
+    if (command.length > 0) {
+        submitted = transport_.SubmitBulk(is_read, command.data, command.length,
+            [this, &command](BulkOnlyTransport::Status status, uint32_t actual_length) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                command.data_actual = actual_length;
+                if (status == BulkOnlyTransport::Status::STALL) {
+                    command.data_stalled = true;
+                } else if (status != BulkOnlyTransport::Status::OK) {
+                    command.failed = true;
+                }
+                --command.pending;
+                stage_done_.notify_all();
+            });
+        if (!submitted) {
+            abandon(2);
+            return;
+        }
+    }
+
+    if (!ReadStatus(command)) {
+        abandon(1);
+    }
+}
+
+bool BotBlockIo::ReadStatus(Command& command) {
+    return transport_.SubmitBulk(true, reinterpret_cast<uint8_t*>(&command.csw), sizeof(CommandStatusWrapper),
+        [this, &command](BulkOnlyTransport::Status status, uint32_t actual_length) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (status == BulkOnlyTransport::Status::OK && actual_length == sizeof(CommandStatusWrapper)) {
+                command.csw_received = true;
+            } else if (status == BulkOnlyTransport::Status::STALL) {
+                command.csw_stalled = true;
+            }
+            --command.pending;
+            stage_done_.notify_all();
+        });
+}
+
+void BotBlockIo::WaitCommand(Command& command) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stage_done_.wait(lock, [&command]() { return command.pending == 0; });
+}
+
+void BotBlockIo::Retire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --in_flight_;
+}
+
+bool BotBlockIo::CompleteCommand(Command& command, bool allow_retry) {
+    if (command.failed) {
+        return false;
+    }
+
+    if (!command.csw_received) {
+        if (!allow_retry || !(command.data_stalled || command.csw_stalled)) {
+            return false;
+        }
+
+        // 恢复期间不允许其他调用方提交命令
+        std::lock_guard<std::mutex> submit_lock(submit_mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (in_flight_ != 1) {
+                return false;
+            }
+        }
+
+        // 按BOT规范：清除STALL的端点后再读一次CSW
+        bool is_read = (command.cbw.bmCBWFlags & CBW_FLAG_DATA_IN) != 0;
+        if (command.data_stalled) {
+            transport_.ClearHalt(is_read);
+        }
+        if (command.csw_stalled && !(command.data_stalled && is_read)) {
+            transport_.ClearHalt(true);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            command.pending = 1;
+            command.csw_stalled = false;
+        }
+        if (!ReadStatus(command)) {
+            return false;
+        }
+        WaitCommand(command);
+        if (!command.csw_received) {
+            return false;
+        }
+    }
+
+    if (command.csw.dCSWSignature != CSW_SIGNATURE || command.csw.dCSWTag != command.cbw.dCBWTag) {
+        LOG_ERROR("Invalid CSW for tag " << command.cbw.dCBWTag);
+        return false;
+    }
+    return true;
+}
+
+bool BotBlockIo::Execute(const CommandBlockWrapper& cbw, uint8_t* data, uint32_t length,
+                         CommandStatusWrapper& csw, uint32_t* actual_length) {
+    Command command = Command();
+    command.cbw = cbw;
+    command.data = data;
+    command.length = length;
+
+    Issue(command);
+    WaitCommand(command);
+    bool valid = CompleteCommand(command, true);
+    Retire();
+
+    csw = command.csw;
+    if (actual_length) {
+        *actual_length = command.data_actual;
+    }
+    return valid;
+}
+
+bool BotBlockIo::ExecuteScsi(uint8_t lun, const uint8_t* cdb, uint8_t cdb_length, bool data_in,
+                             uint8_t* data, uint32_t length, uint8_t& status, uint32_t* actual_length) {
+    CommandBlockWrapper cbw = {};
+    cbw.dCBWSignature = CBW_SIGNATURE;
+    cbw.dCBWTag = NextTag();
+    cbw.dCBWDataTransferLength = length;
+    cbw.bmCBWFlags = data_in ? CBW_FLAG_DATA_IN : CBW_FLAG_DATA_OUT;
+    cbw.bCBWLUN = lun & 0x0F;
+    cbw.bCBWCBLength = std::min<uint8_t>(cdb_length, sizeof(cbw.CBWCB));
+    std::memcpy(cbw.CBWCB, cdb, cbw.bCBWCBLength);
+
+    CommandStatusWrapper csw = {};
+    if (!Execute(cbw, data, length, csw, actual_length)) {
+        return false;
+    }
+    status = csw.bCSWStatus;
+    return true;
+}
+
+bool BotBlockIo::Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, uint8_t* data) {
+    return Transfer(true, lun, lba, block_count, block_size, data, false);
+}
+
+bool BotBlockIo::Write(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, const uint8_t* data,
+                       bool fua) {
+    // 写方向只读取缓冲区
+    return Transfer(false, lun, lba, block_count, block_size, const_cast<uint8_t*>(data), fua);
+}
+
+bool BotBlockIo::SynchronizeCache(uint8_t lun) {
+    CommandBlockWrapper cbw = {};
+    cbw.dCBWSignature = CBW_SIGNATURE;
+    cbw.dCBWTag = NextTag();
+    cbw.bCBWLUN = lun & 0x0F;
+    cbw.bCBWCBLength = 10;
+    cbw.CBWCB[0] = static_cast<uint8_t>(ScsiCommand::SYNCHRONIZE_CACHE_10);
+    // LBA和块数为0表示整个介质
+
+    CommandStatusWrapper csw = {};
+    if (!Execute(cbw, nullptr, 0, csw) || csw.bCSWStatus != CSW_STATUS_PASSED) {
+        LOG_ERROR("SYNCHRONIZE CACHE failed on LUN " << static_cast<int>(lun));
+        return false;
+    }
+    return true;
+}
+
+bool BotBlockIo::Transfer(bool is_read, uint8_t lun, uint64_t lba, uint32_t block_count,
+                          uint32_t block_size, uint8_t* data, bool fua) {
+    if (block_count == 0) {
+        return true;
+    }
+    if (block_size == 0 || !data) {
+        return false;
+    }
+
+    size_t depth = config_.max_commands_in_flight;
+
+    // 环形窗口：第i条命令使用window[i % depth]，回调持有其引用，窗口大小固定
+    std::vector<Command> window(depth);
+    size_t issued = 0;
+    size_t retired = 0;
+    bool ok = true;
+
+    while (ok && (block_count > 0 || retired < issued)) {
+        // 填满窗口
+        while (block_count > 0 && issued - retired < depth) {
+            uint32_t count = MaxCommandBlocks(lba, block_count, block_size, config_.max_transfer_bytes);
+
+            Command& command = window[issued % depth];
+            command = Command();
+            BuildReadWrite(command.cbw, is_read, lun, lba, count, block_size, NextTag(), fua);
+            command.data = data;
+            command.length = count * block_size;
+            command.lba = lba;
+            Issue(command);
+
+            ++issued;
+            data += command.length;
+            lba += count;
+            block_count -= count;
+        }
+
+        // 按提交顺序回收最早的命令
+        Command& oldest = window[retired % depth];
+        WaitCommand(oldest);
+        bool last_in_flight = (issued - retired == 1);
+        if (!CompleteCommand(oldest, last_in_flight)) {
+            LOG_ERROR("SCSI " << (is_read ? "READ" : "WRITE") << " transport failed at LBA " << oldest.lba);
+            ok = false;
+        } else if (oldest.csw.bCSWStatus != CSW_STATUS_PASSED || oldest.csw.dCSWDataResidue != 0 ||
+                   oldest.data_actual != oldest.length) {
+            LOG_ERROR("SCSI " << (is_read ? "READ" : "WRITE") << " failed at LBA " << oldest.lba
+                      << ": status " << static_cast<int>(oldest.csw.bCSWStatus)
+                      << ", residue " << oldest.csw.dCSWDataResidue);
+            ok = false;
+        }
+        Retire();
+        ++retired;
+    }
+
+    // 出错后等其余在途命令结束，缓冲区才能交还调用方
+    while (retired < issued) {
+        WaitCommand(window[retired % depth]);
+        Retire();
+        ++retired;
+    }
+
+    return ok;
+}
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "block_io.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// Bulk-Only Transport的一对批量端点：由真实设备（libusb传输引擎）或仿真设备实现
+class BulkOnlyTransport {
+public:
+    enum class Status {
+        OK,
+        STALL,
+        ERROR
+    };
+
+    using Completion = std::function<void(Status status, uint32_t actual_length)>;
+
+    virtual ~BulkOnlyTransport() = default;
+
+    // 在IN或OUT端点上排队一次批量传输，同一端点上按提交顺序完成。
+    // 返回true后completion必定被调用一次（可在任意线程）；返回false时不调用
+    virtual bool SubmitBulk(bool in, uint8_t* data, uint32_t length, Completion completion) = 0;
+
+    // 清除端点的STALL状态（同步）
+    virtual bool ClearHalt(bool in) = 0;
+};
+
+// 流水线化的SCSI块读写：把请求拆分为不超过max_transfer_bytes的READ/WRITE命令，
+// 每条命令的CBW、数据和CSW一次性排队，且下一条命令在上一条的CSW返回前就已提交，
+// 设备以NAK做流控，主机侧不再有逐阶段的往返等待。
+// 可被多个线程（如不同LUN）同时调用：各命令的三个阶段整体排队，命令之间在管道上交错
+class BotBlockIo : public BlockIo {
+public:
+    explicit BotBlockIo(BulkOnlyTransport& transport, const BlockIoConfig& config = BlockIoConfig());
+    ~BotBlockIo() override = default;
+
+    // 禁止拷贝
+    BotBlockIo(const BotBlockIo&) = delete;
+    BotBlockIo& operator=(const BotBlockIo&) = delete;
+
+    bool Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, uint8_t* data) override;
+    bool Write(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, const uint8_t* data,
+               bool fua = false) override;
+    bool SynchronizeCache(uint8_t lun) override;
+    bool ExecuteScsi(uint8_t lun, const uint8_t* cdb, uint8_t cdb_length, bool data_in,
+                     uint8_t* data, uint32_t length, uint8_t& status, uint32_t* actual_length = nullptr) override;
+
+    // 执行单条命令并等待CSW，返回CSW是否有效，命令状态由调用方检查csw.bCSWStatus
+    bool Execute(const CommandBlockWrapper& cbw, uint8_t* data, uint32_t length,
+                 CommandStatusWrapper& csw, uint32_t* actual_length = nullptr);
+
+    // 填充READ(10/16)/WRITE(10/16)的CBW
+    static void BuildReadWrite(CommandBlockWrapper& cbw, bool is_read, uint8_t lun, uint64_t lba,
+                               uint32_t block_count, uint32_t block_size, uint32_t tag, bool fua = false);
+
+    uint32_t NextTag() { return next_tag_.fetch_add(1, std::memory_order_relaxed); }
+    const BlockIoConfig& GetConfig() const { return config_; }
+
+private:
+    // 一条在途命令
+    struct Command {
+        CommandBlockWrapper cbw;
+        CommandStatusWrapper csw;
+        uint8_t* data = nullptr;
+        uint32_t length = 0;
+        uint64_t lba = 0;
+        int pending = 0;                 // 尚未完成的阶段数
+        bool failed = false;             // 某阶段提交失败或出错
+        bool data_stalled = false;
+        bool csw_stalled = false;
+        bool csw_received = false;
+        uint32_t data_actual = 0;
+    };
+
+    bool Transfer(bool is_read, uint8_t lun, uint64_t lba, uint32_t block_count,
+                  uint32_t block_size, uint8_t* data, bool fua);
+    void Issue(Command& command);
+    void WaitCommand(Command& command);
+    // 命令已回收，不再计入在途命令数
+    void Retire();
+    // 校验CSW；allow_retry且没有其他命令在途时，在STALL后清除端点并重读CSW
+    bool CompleteCommand(Command& command, bool allow_retry);
+    bool ReadStatus(Command& command);
+
+    BulkOnlyTransport& transport_;
+    BlockIoConfig config_;
+    std::atomic<uint32_t> next_tag_;
+
+    std::mutex submit_mutex_;           // 保证一条命令的各阶段在管道上连续排队
+    std::mutex mutex_;
+    std::condition_variable stage_done_;
+    size_t in_flight_;                  // 所有调用方已提交、尚未回收的命令数
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,285 @@
+#include "dedup_store.h"
+#include "utils/blake2b.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace usb_redirector {
+namespace protocol {
+
+// 文件名为64位十六进制哈希
+static constexpr size_t HASH_NAME_LENGTH = DEDUP_HASH_SIZE * 2;
+// 旧版本以16位十六进制的XXH64命名，不抗碰撞，打开时删除
+static constexpr size_t LEGACY_HASH_NAME_LENGTH = 16;
+
+DedupHash ComputeDedupHash(const uint8_t* data, size_t len) {
+    DedupHash hash;
+    utils::Blake2b(data, len, hash.bytes, DEDUP_HASH_SIZE);
+    return hash;
+}
+
+std::vector<DedupExtent> HashExtents(const uint8_t* data, size_t len) {
+    std::vector<DedupExtent> extents;
+    extents.reserve((len + DEDUP_EXTENT_SIZE - 1) / DEDUP_EXTENT_SIZE);
+    for (size_t offset = 0; offset < len; offset += DEDUP_EXTENT_SIZE) {
+        uint32_t length = static_cast<uint32_t>(std::min<size_t>(DEDUP_EXTENT_SIZE, len - offset));
+        extents.push_back({ComputeDedupHash(data + offset, length), length});
+    }
+    return extents;
+}
+
+static int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static bool IsHexName(const char* name, size_t length) {
+    if (std::strlen(name) != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (HexDigit(name[i]) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool ParseHashName(const char* name, DedupHash& hash) {
+    if (!IsHexName(name, HASH_NAME_LENGTH)) {
+        return false;
+    }
+    for (size_t i = 0; i < DEDUP_HASH_SIZE; ++i) {
+        hash.bytes[i] = static_cast<uint8_t>((HexDigit(name[2 * i]) << 4) | HexDigit(name[2 * i + 1]));
+    }
+    return true;
+}
+
+DedupStore::DedupStore()
+    : max_bytes_(0)
+    , temp_counter_(0) {
+}
+
+bool DedupStore::Open(const std::string& directory, uint64_t max_bytes) {
+    Close();
+
+    if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOG_ERROR("Failed to create dedup store " << directory << ": " << std::strerror(errno));
+        return false;
+    }
+
+    DIR* dir = ::opendir(directory.c_str());
+    if (!dir) {
+        LOG_ERROR("Failed to open dedup store " << directory << ": " << std::strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_ = directory;
+    max_bytes_ = max_bytes;
+
+    // 索引已有的extent，清理上次异常退出留下的临时文件
+    while (struct dirent* entry = ::readdir(dir)) {
+        std::string path = directory_ + "/" + entry->d_name;
+        DedupHash hash;
+        if (!ParseHashName(entry->d_name, hash)) {
+            if (std::strstr(entry->d_name, ".tmp") || IsHexName(entry->d_name, LEGACY_HASH_NAME_LENGTH)) {
+                ::unlink(path.c_str());
+            }
+            continue;
+        }
+
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size == 0 || st.st_size > DEDUP_EXTENT_SIZE) {
+            continue;
+        }
+        Insert(hash, static_cast<uint32_t>(st.st_size));
+    }
+    ::closedir(dir);
+
+    EvictIfNeeded();
+    LOG_INFO("Dedup store " << directory_ << ": " << stats_.stored_extents << " extents, "
+             << stats_.stored_bytes << " bytes");
+    return true;
+}
+
+void DedupStore::Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    directory_.clear();
+    index_.clear();
+    lru_.clear();
+    stats_.stored_extents = 0;
+    stats_.stored_bytes = 0;
+}
+
+bool DedupStore::IsOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !directory_.empty();
+}
+
+std::string DedupStore::PathFor(const DedupHash& hash) const {
+    static const char HEX[] = "0123456789abcdef";
+    char name[HASH_NAME_LENGTH + 1];
+    for (size_t i = 0; i < DEDUP_HASH_SIZE; ++i) {
+        name[2 * i] = HEX[hash.bytes[i] >> 4];
+        name[2 * i + 1] = HEX[hash.bytes[i] & 0x0F];
+    }
+    name[HASH_NAME_LENGTH] = '\0';
+    return directory_ + "/" + name;
+}
+
+void DedupStore::Insert(const DedupHash& hash, uint32_t length) {
+    auto it = index_.find(hash);
+    if (it != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return;
+    }
+    lru_.push_front(hash);
+    index_[hash] = Entry{length, lru_.begin()};
+    stats_.stored_extents++;
+    stats_.stored_bytes += length;
+}
+
+void DedupStore::Remove(const DedupHash& hash) {
+    auto it = index_.find(hash);
+    if (it == index_.end()) {
+        return;
+    }
+    // hash可能引用lru_中的元素（淘汰时），先删除文件再移除索引
+    ::unlink(PathFor(hash).c_str());
+    stats_.stored_extents--;
+    stats_.stored_bytes -= it->second.length;
+    lru_.erase(it->second.lru);
+    index_.erase(it);
+}
+
+void DedupStore::EvictIfNeeded() {
+    while (max_bytes_ > 0 && stats_.stored_bytes > max_bytes_ && !lru_.empty()) {
+        Remove(lru_.back());
+        stats_.evictions++;
+    }
+}
+
+bool DedupStore::Contains(const DedupExtent& extent) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(extent.hash);
+    return it != index_.end() && it->second.length == extent.length;
+}
+
+bool DedupStore::Load(const DedupExtent& extent, uint8_t* data) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(extent.hash);
+        if (directory_.empty() || it == index_.end() || it->second.length != extent.length) {
+            stats_.misses++;
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        path = PathFor(extent.hash);
+    }
+
+    // 文件可能在此期间被淘汰，打开失败按未命中处理
+    bool ok = false;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        size_t done = 0;
+        while (done < extent.length) {
+            ssize_t n = ::pread(fd, data + done, extent.length - done, static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+        ::close(fd);
+        ok = done == extent.length && ComputeDedupHash(data, extent.length) == extent.hash;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok) {
+        if (fd >= 0 && !directory_.empty()) {
+            LOG_WARNING("Discarding corrupted dedup extent " << path);
+            stats_.corrupted++;
+            Remove(extent.hash);
+        }
+        stats_.misses++;
+        return false;
+    }
+    stats_.hits++;
+    stats_.bytes_saved += extent.length;
+    return true;
+}
+
+bool DedupStore::Store(const DedupExtent& extent, const uint8_t* data) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.bytes_fetched += extent.length;
+        if (directory_.empty()) {
+            return false;
+        }
+        if (index_.count(extent.hash)) {
+            return true;
+        }
+        path = PathFor(extent.hash);
+    }
+
+    if (extent.length == 0 || extent.length > DEDUP_EXTENT_SIZE ||
+        ComputeDedupHash(data, extent.length) != extent.hash) {
+        LOG_WARNING("Dedup extent content does not match its hash, not storing");
+        return false;
+    }
+
+    // 先写临时文件再改名，其他进程或重启后不会看到写了一半的extent
+    std::string temp = path + ".tmp" + std::to_string(temp_counter_.fetch_add(1));
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_WARNING("Failed to create dedup extent " << temp << ": " << std::strerror(errno));
+        return false;
+    }
+    size_t done = 0;
+    while (done < extent.length) {
+        ssize_t n = ::write(fd, data + done, extent.length - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    bool ok = ::close(fd) == 0 && done == extent.length && ::rename(temp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        LOG_WARNING("Failed to write dedup extent " << path << ": " << std::strerror(errno));
+        ::unlink(temp.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Insert(extent.hash, extent.length);
+    EvictIfNeeded();
+    return true;
+}
+
+DedupStatistics DedupStore::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace protocol
+} // namespace usb_redirector
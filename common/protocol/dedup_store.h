@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+
+namespace usb_redirector {
+namespace protocol {
+
+// 去重的单位：READ数据按64KiB切分，最后一段可能不满
+static constexpr uint32_t DEDUP_EXTENT_SIZE = 64 * 1024;
+
+// extent的内容地址：BLAKE2b-256。接收端只凭哈希就用本地内容应答READ，
+// 哈希必须抗碰撞，否则碰撞的两段数据会被悄无声息地互相替换
+static constexpr size_t DEDUP_HASH_SIZE = 32;
+
+struct DedupHash {
+    uint8_t bytes[DEDUP_HASH_SIZE];
+
+    bool operator==(const DedupHash& other) const {
+        return std::memcmp(bytes, other.bytes, DEDUP_HASH_SIZE) == 0;
+    }
+    bool operator!=(const DedupHash& other) const {
+        return !(*this == other);
+    }
+};
+
+// 哈希本身已均匀分布，索引直接取前8字节
+struct DedupHashHasher {
+    size_t operator()(const DedupHash& hash) const {
+        uint64_t value;
+        std::memcpy(&value, hash.bytes, sizeof(value));
+        return static_cast<size_t>(value);
+    }
+};
+
+DedupHash ComputeDedupHash(const uint8_t* data, size_t len);
+
+// 一段数据的内容地址
+struct DedupExtent {
+    DedupHash hash;
+    uint32_t length;
+};
+
+// 把数据按DEDUP_EXTENT_SIZE切分并计算每段的哈希
+std::vector<DedupExtent> HashExtents(const uint8_t* data, size_t len);
+
+// 去重缓存统计
+struct DedupStatistics {
+    uint64_t hits = 0;              // 由本地存储应答的extent数
+    uint64_t misses = 0;            // 需要从发送端拉取的extent数
+    uint64_t bytes_saved = 0;       // 命中而免于经网络传输的字节数
+    uint64_t bytes_fetched = 0;     // 未命中而经网络传输的字节数
+    uint64_t evictions = 0;
+    uint64_t corrupted = 0;         // 读出后哈希不符而丢弃的extent数
+    uint64_t stored_extents = 0;    // 当前存储的extent数
+    uint64_t stored_bytes = 0;
+
+    double HitRatio() const {
+        return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+    }
+};
+
+// 接收端的内容寻址存储：每个extent以哈希命名存为目录下的一个文件，重启后仍然有效。
+// 多个接收端反复读取同一镜像或固件包时，相同的extent只需经网络传输一次。
+// 超过容量时按LRU淘汰；读出时重新计算哈希，文件损坏按未命中处理
+class DedupStore {
+public:
+    DedupStore();
+    ~DedupStore() = default;
+
+    // 禁止拷贝
+    DedupStore(const DedupStore&) = delete;
+    DedupStore& operator=(const DedupStore&) = delete;
+
+    // 打开（必要时创建）存储目录并索引已有的extent。max_bytes为0表示不限容量
+    bool Open(const std::string& directory, uint64_t max_bytes = 0);
+    void Close();
+    bool IsOpen() const;
+
+    bool Contains(const DedupExtent& extent) const;
+
+    // 命中时把内容读入data（至少extent.length字节）并返回true
+    bool Load(const DedupExtent& extent, uint8_t* data);
+
+    // 保存经网络取得的extent。内容与哈希不符时不保存并返回false
+    bool Store(const DedupExtent& extent, const uint8_t* data);
+
+    DedupStatistics GetStatistics() const;
+
+private:
+    struct Entry {
+        uint32_t length;
+        std::list<DedupHash>::iterator lru;
+    };
+
+    std::string PathFor(const DedupHash& hash) const;
+    void Insert(const DedupHash& hash, uint32_t length);    // 需持锁
+    void Remove(const DedupHash& hash);                     // 需持锁
+    void EvictIfNeeded();                                   // 需持锁
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    std::unordered_map<DedupHash, Entry, DedupHashHasher> index_;
+    std::list<DedupHash> lru_;                      // 表头为最近使用
+    std::atomic<uint64_t> temp_counter_;            // 并发写入同一extent时临时文件不冲突
+
+    DedupStatistics stats_;
+    mutable std::mutex mutex_;                      // 保护索引和统计，文件读写不持锁
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+
+namespace usb_redirector {
+namespace protocol {
+
+// SCSI命令
+enum class ScsiCommand : uint8_t {
+    TEST_UNIT_READY = 0x00,
+    REQUEST_SENSE = 0x03,
+    INQUIRY = 0x12,
+    MODE_SENSE_6 = 0x1A,
+    READ_CAPACITY_10 = 0x25,
+    READ_10 = 0x28,
+    WRITE_10 = 0x2A,
+    SYNCHRONIZE_CACHE_10 = 0x35,
+    MODE_SENSE_10 = 0x5A,
+    READ_CAPACITY_16 = 0x9E,
+    READ_16 = 0x88,
+    WRITE_16 = 0x8A,
+    SYNCHRONIZE_CACHE_16 = 0x91,
+    REPORT_LUNS = 0xA0
+};
+
+// READ/WRITE(10/16) CDB字节1中的FUA位：数据写入介质后才返回
+static constexpr uint8_t SCSI_CDB_FUA = 0x08;
+
+// USB大容量存储类特定请求
+enum class MassStorageRequest : uint8_t {
+    BULK_ONLY_MASS_STORAGE_RESET = 0xFF,
+    GET_MAX_LUN = 0xFE
+};
+
+// Bulk-Only Transport常量
+static constexpr uint32_t CBW_SIGNATURE = 0x43425355; // "USBC"
+static constexpr uint32_t CSW_SIGNATURE = 0x53425355; // "USBS"
+static constexpr uint8_t CBW_FLAG_DATA_IN = 0x80;
+static constexpr uint8_t CBW_FLAG_DATA_OUT = 0x00;
+
+// CSW状态
+static constexpr uint8_t CSW_STATUS_PASSED = 0x00;
+static constexpr uint8_t CSW_STATUS_FAILED = 0x01;
+static constexpr uint8_t CSW_STATUS_PHASE_ERROR = 0x02;
+
+// 命令块包装器 (CBW)
+struct CommandBlockWrapper {
+    uint32_t dCBWSignature;      // 0x43425355 "USBC"
+    uint32_t dCBWTag;            // 命令标签
+    uint32_t dCBWDataTransferLength; // 数据传输长度
+    uint8_t bmCBWFlags;          // 标志位
+    uint8_t bCBWLUN;             // 逻辑单元号
+    uint8_t bCBWCBLength;        // 命令块长度
+    uint8_t CBWCB[16];           // 命令块
+} __attribute__((packed));
+
+// 命令状态包装器 (CSW)
+struct CommandStatusWrapper {
+    uint32_t dCSWSignature;      // 0x53425355 "USBS"
+    uint32_t dCSWTag;            // 命令标签
+    uint32_t dCSWDataResidue;    // 数据残留
+    uint8_t bCSWStatus;          // 命令状态
+} __attribute__((packed));
+
+static_assert(sizeof(CommandBlockWrapper) == 31, "CBW must be 31 bytes");
+static_assert(sizeof(CommandStatusWrapper) == 13, "CSW must be 13 bytes");
+
+// Bulk-Only设备最多16个LUN
+static constexpr uint8_t MASS_STORAGE_MAX_LUN = 15;
+
+// 大容量存储接口协议：Bulk-Only和USB Attached SCSI
+static constexpr uint8_t MASS_STORAGE_PROTOCOL_BOT = 0x50;
+static constexpr uint8_t MASS_STORAGE_PROTOCOL_UAS = 0x62;
+
+// UAS管道用途描述符（跟在每个端点描述符之后）
+static constexpr uint8_t UAS_PIPE_USAGE_DESCRIPTOR = 0x24;
+
+// UAS管道ID
+enum class UasPipe : uint8_t {
+    COMMAND = 1,
+    STATUS = 2,
+    DATA_IN = 3,
+    DATA_OUT = 4
+};
+
+// UAS信息单元(IU)类型
+enum class UasIuId : uint8_t {
+    COMMAND = 0x01,
+    SENSE = 0x03,
+    RESPONSE = 0x04,
+    TASK_MANAGEMENT = 0x05,
+    READ_READY = 0x06,
+    WRITE_READY = 0x07
+};
+
+// SCSI状态
+static constexpr uint8_t SCSI_STATUS_GOOD = 0x00;
+static constexpr uint8_t SCSI_STATUS_CHECK_CONDITION = 0x02;
+
+// 命令IU（不带附加CDB）
+struct UasCommandIu {
+    uint8_t bIUID;               // UasIuId::COMMAND
+    uint8_t reserved1;
+    uint16_t wTag;               // 标签，大端；使用流时即流ID
+    uint8_t bPrioAttr;           // 任务优先级和任务属性
+    uint8_t reserved5;
+    uint8_t bLength;             // 附加CDB长度（单位4字节，位7:2）
+    uint8_t reserved7;
+    uint8_t LUN[8];              // SAM格式的逻辑单元号
+    uint8_t CDB[16];
+} __attribute__((packed));
+
+// 状态管道上返回的Sense IU / Response IU共用的头部
+struct UasSenseIu {
+    uint8_t bIUID;               // UasIuId::SENSE
+    uint8_t reserved1;
+    uint16_t wTag;               // 大端
+    uint16_t wStatusQualifier;
+    uint8_t bStatus;             // SCSI状态
+    uint8_t reserved7[7];
+    uint16_t wSenseLength;       // 大端
+    uint8_t SenseData[18];
+} __attribute__((packed));
+
+struct UasResponseIu {
+    uint8_t bIUID;               // UasIuId::RESPONSE
+    uint8_t reserved1;
+    uint16_t wTag;               // 大端
+    uint8_t AdditionalInfo[3];
+    uint8_t bResponseCode;
+} __attribute__((packed));
+
+static_assert(sizeof(UasCommandIu) == 32, "UAS command IU must be 32 bytes");
+static_assert(sizeof(UasSenseIu) == 34, "UAS sense IU with fixed sense data must be 34 bytes");
+static_assert(sizeof(UasResponseIu) == 8, "UAS response IU must be 8 bytes");
+
+} // namespace protocol
+} // namespace usb_redirector
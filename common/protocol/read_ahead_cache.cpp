@@ -0,0 +1,254 @@
+#include "read_ahead_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace usb_redirector {
+namespace protocol {
+
+static constexpr uint64_t EXTENT_INDEX_MASK = (1ull << 56) - 1;
+
+ReadAheadCache::ReadAheadCache(uint32_t block_size, const ReadAheadConfig& config, ReadFunction read_function)
+    : block_size_(std::max<uint32_t>(1, block_size))
+    , config_(config)
+    , read_function_(std::move(read_function))
+    , prefetching_(0)
+    , stopping_(false) {
+    extent_blocks_ = std::max<uint32_t>(1, config_.extent_bytes / block_size_);
+    max_extents_ = std::max<size_t>(1, config_.cache_bytes / (static_cast<size_t>(extent_blocks_) * block_size_));
+    std::fill(lun_blocks_, lun_blocks_ + MAX_LUNS, std::numeric_limits<uint64_t>::max());
+
+    prefetch_thread_ = std::thread(&ReadAheadCache::PrefetchThread, this);
+}
+
+ReadAheadCache::~ReadAheadCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    prefetch_queued_.notify_all();
+    extent_done_.notify_all();
+
+    if (prefetch_thread_.joinable()) {
+        prefetch_thread_.join();
+    }
+}
+
+void ReadAheadCache::SetLunBlocks(uint8_t lun, uint64_t total_blocks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lun_blocks_[lun % MAX_LUNS] = total_blocks;
+}
+
+bool ReadAheadCache::Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint8_t* data) {
+    if (block_count == 0) {
+        return true;
+    }
+    lun %= MAX_LUNS;
+
+    // 未命中的连续区段，稍后在锁外从设备读取
+    struct Miss {
+        uint64_t lba;
+        uint32_t count;
+        uint8_t* data;
+    };
+    std::vector<Miss> misses;
+
+    uint64_t end = lba + block_count;
+    bool sequential = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        uint64_t current = lba;
+        uint8_t* out = data;
+        while (current < end) {
+            uint64_t index = current / extent_blocks_;
+            uint32_t offset = static_cast<uint32_t>(current % extent_blocks_);
+            uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(end - current, extent_blocks_ - offset));
+            uint64_t key = Key(lun, index);
+
+            // 正在预读的extent等它完成，比重复读一遍便宜
+            auto it = extents_.find(key);
+            while (it != extents_.end() && !it->second.ready && !stopping_) {
+                extent_done_.wait(lock);
+                it = extents_.find(key);
+            }
+
+            if (it != extents_.end() && it->second.ready && offset + count <= it->second.blocks) {
+                Extent& extent = it->second;
+                std::memcpy(out, extent.data.data() + static_cast<size_t>(offset) * block_size_,
+                            static_cast<size_t>(count) * block_size_);
+                extent.touched = true;
+                lru_.splice(lru_.begin(), lru_, extent.lru);
+                stats_.hit_blocks += count;
+            } else {
+                stats_.miss_blocks += count;
+                if (!misses.empty() && misses.back().lba + misses.back().count == current) {
+                    misses.back().count += count;
+                } else {
+                    misses.push_back({current, count, out});
+                }
+            }
+
+            current += count;
+            out += static_cast<size_t>(count) * block_size_;
+        }
+
+        // 顺序流检测：本次读紧接上次读的末尾
+        Stream& stream = streams_[lun];
+        stream.run = (lba == stream.next_lba) ? stream.run + 1 : 0;
+        stream.next_lba = end;
+        sequential = stream.run >= config_.sequential_threshold;
+    }
+
+    for (const auto& miss : misses) {
+        if (!read_function_(lun, miss.lba, miss.count, miss.data)) {
+            return false;
+        }
+    }
+
+    // 前台读完成后再安排预读，避免预读抢在未命中的读之前占用设备
+    if (sequential) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SchedulePrefetch(lun, end);
+    }
+    return true;
+}
+
+void ReadAheadCache::SchedulePrefetch(uint8_t lun, uint64_t next_lba) {
+    uint64_t first = next_lba / extent_blocks_;
+    bool queued = false;
+
+    for (uint32_t i = 0; i < config_.prefetch_extents; ++i) {
+        uint64_t index = first + i;
+        uint64_t start = index * extent_blocks_;
+        if (start >= lun_blocks_[lun]) {
+            break;
+        }
+
+        uint64_t key = Key(lun, index);
+        if (extents_.count(key) > 0) {
+            continue;
+        }
+        if (!MakeRoom()) {
+            break;
+        }
+
+        Extent& extent = extents_[key];
+        extent.blocks = static_cast<uint32_t>(std::min<uint64_t>(extent_blocks_, lun_blocks_[lun] - start));
+        if (!free_buffers_.empty()) {
+            extent.data = std::move(free_buffers_.back());
+            free_buffers_.pop_back();
+        }
+        extent.data.resize(static_cast<size_t>(extent_blocks_) * block_size_);
+
+        prefetch_queue_.push_back(key);
+        ++prefetching_;
+        queued = true;
+    }
+
+    if (queued) {
+        prefetch_queued_.notify_one();
+    }
+}
+
+bool ReadAheadCache::MakeRoom() {
+    while (extents_.size() >= max_extents_) {
+        // 正在预读的extent不在LRU中，不会被淘汰
+        if (lru_.empty()) {
+            return false;
+        }
+        EraseExtent(extents_.find(lru_.back()));
+    }
+    return true;
+}
+
+void ReadAheadCache::EraseExtent(std::unordered_map<uint64_t, Extent>::iterator it) {
+    Extent& extent = it->second;
+    if (extent.ready) {
+        lru_.erase(extent.lru);
+        if (!extent.touched) {
+            stats_.prefetch_wasted++;
+        }
+    }
+    free_buffers_.push_back(std::move(extent.data));
+    extents_.erase(it);
+}
+
+void ReadAheadCache::Invalidate(uint8_t lun, uint64_t lba, uint32_t block_count) {
+    if (block_count == 0) {
+        return;
+    }
+    lun %= MAX_LUNS;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t first = lba / extent_blocks_;
+    uint64_t last = (lba + block_count - 1) / extent_blocks_;
+    for (uint64_t index = first; index <= last; ++index) {
+        auto it = extents_.find(Key(lun, index));
+        if (it == extents_.end()) {
+            continue;
+        }
+        stats_.invalidated++;
+        if (it->second.ready) {
+            EraseExtent(it);
+        } else {
+            // 读到的可能是写入前的数据，完成后丢弃
+            it->second.stale = true;
+        }
+    }
+}
+
+void ReadAheadCache::WaitForPrefetch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    extent_done_.wait(lock, [this]() { return prefetching_ == 0 || stopping_; });
+}
+
+ReadAheadStatistics ReadAheadCache::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void ReadAheadCache::PrefetchThread() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        prefetch_queued_.wait(lock, [this]() { return stopping_ || !prefetch_queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+
+        uint64_t key = prefetch_queue_.front();
+        prefetch_queue_.pop_front();
+
+        // 正在预读的extent只会被标记失效，不会被删除
+        auto it = extents_.find(key);
+        bool ok = false;
+        if (!it->second.stale) {
+            uint8_t lun = static_cast<uint8_t>(key >> 56);
+            uint64_t lba = (key & EXTENT_INDEX_MASK) * extent_blocks_;
+            uint8_t* buffer = it->second.data.data();
+            uint32_t blocks = it->second.blocks;
+
+            lock.unlock();
+            ok = read_function_(lun, lba, blocks, buffer);
+            lock.lock();
+            it = extents_.find(key);
+        }
+
+        if (!ok || it->second.stale) {
+            EraseExtent(it);
+        } else {
+            Extent& extent = it->second;
+            extent.ready = true;
+            lru_.push_front(key);
+            extent.lru = lru_.begin();
+            stats_.prefetched++;
+        }
+
+        --prefetching_;
+        extent_done_.notify_all();
+    }
+}
+
+} // namespace protocol
+} // namespace usb_redirector
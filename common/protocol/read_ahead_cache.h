@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace usb_redirector {
+namespace protocol {
+
+// 预读缓存配置
+struct ReadAheadConfig {
+    size_t cache_bytes = 32 * 1024 * 1024;  // 缓存总大小，0表示关闭预读
+    uint32_t extent_bytes = 128 * 1024;     // 缓存和预读的单位
+    uint32_t sequential_threshold = 2;      // 连续多少次顺序读后开始预读
+    uint32_t prefetch_extents = 4;          // 预读窗口（领先当前读位置的extent数）
+};
+
+// 预读缓存统计
+struct ReadAheadStatistics {
+    uint64_t hit_blocks = 0;        // 从缓存返回的块数
+    uint64_t miss_blocks = 0;       // 从设备读取的块数
+    uint64_t prefetched = 0;        // 预读完成的extent数
+    uint64_t prefetch_wasted = 0;   // 预读后未被使用就被淘汰或失效的extent数
+    uint64_t invalidated = 0;       // 因写入失效的extent数
+};
+
+// 顺序预读缓存：按LUN检测顺序LBA流，由后台线程提前读取后续extent，
+// 之后的读命中时直接从内存返回。缓存以extent为单位按LRU淘汰，写入时失效重叠的extent。
+// 设备读通过回调完成，回调在调用线程或预读线程上执行，调用时不持有缓存锁
+class ReadAheadCache {
+public:
+    using ReadFunction = std::function<bool(uint8_t lun, uint64_t lba, uint32_t block_count, uint8_t* data)>;
+
+    static constexpr size_t MAX_LUNS = 16;
+
+    ReadAheadCache(uint32_t block_size, const ReadAheadConfig& config, ReadFunction read_function);
+    ~ReadAheadCache();
+
+    // 禁止拷贝
+    ReadAheadCache(const ReadAheadCache&) = delete;
+    ReadAheadCache& operator=(const ReadAheadCache&) = delete;
+
+    // 设置LUN的总块数，预读不会越过设备末尾
+    void SetLunBlocks(uint8_t lun, uint64_t total_blocks);
+
+    // 读取块：命中部分从缓存拷贝，其余经回调从设备读取，并按访问模式安排预读
+    bool Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint8_t* data);
+
+    // 写入后调用：失效与该范围重叠的extent（正在预读的在完成后丢弃）
+    void Invalidate(uint8_t lun, uint64_t lba, uint32_t block_count);
+
+    // 等待已安排的预读全部完成
+    void WaitForPrefetch();
+
+    ReadAheadStatistics GetStatistics() const;
+    const ReadAheadConfig& GetConfig() const { return config_; }
+
+private:
+    struct Extent {
+        std::vector<uint8_t> data;
+        uint32_t blocks = 0;                // 有效块数（设备末尾的extent可能不满）
+        bool ready = false;                 // false表示正在预读
+        bool stale = false;                 // 预读期间被写入失效
+        bool touched = false;               // 是否被读命中过
+        std::list<uint64_t>::iterator lru;  // ready时有效
+    };
+
+    // 每个LUN的顺序流状态
+    struct Stream {
+        uint64_t next_lba = 0;
+        uint32_t run = 0;
+    };
+
+    static uint64_t Key(uint8_t lun, uint64_t extent_index) {
+        return (static_cast<uint64_t>(lun) << 56) | extent_index;
+    }
+
+    void SchedulePrefetch(uint8_t lun, uint64_t next_lba);
+    bool MakeRoom();                        // 需持锁，淘汰LRU尾部直到可以再放一个extent
+    void EraseExtent(std::unordered_map<uint64_t, Extent>::iterator it);  // 需持锁
+    void PrefetchThread();
+
+    uint32_t block_size_;
+    ReadAheadConfig config_;
+    uint32_t extent_blocks_;
+    size_t max_extents_;
+    ReadFunction read_function_;
+
+    std::unordered_map<uint64_t, Extent> extents_;
+    std::list<uint64_t> lru_;               // 前端为最近使用
+    std::deque<uint64_t> prefetch_queue_;
+    size_t prefetching_;                    // 已安排但未完成的预读数
+    std::vector<std::vector<uint8_t>> free_buffers_;
+    Stream streams_[MAX_LUNS];
+    uint64_t lun_blocks_[MAX_LUNS];
+    ReadAheadStatistics stats_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable prefetch_queued_;
+    std::condition_variable extent_done_;
+    bool stopping_;
+    std::thread prefetch_thread_;
+};
+
+} // namespace protocol
+} // namespace usb_redirector
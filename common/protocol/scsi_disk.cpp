@@ -0,0 +1,513 @@
+#include "scsi_disk.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace usb_redirector {
+namespace protocol {
+
+// 发现顺序读时提前让内核读入的范围
+static constexpr uint64_t PREFETCH_BYTES = 1024 * 1024;
+
+static uint64_t ReadBigEndian(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static void PutBigEndian(uint8_t* out, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+ScsiDisk::ScsiDisk(uint32_t block_size)
+    : block_size_(block_size > 0 ? block_size : 512)
+    , fd_(-1)
+    , data_(nullptr)
+    , mapped_bytes_(0)
+    , total_blocks_(0)
+    , read_only_(false)
+    , next_sequential_lba_(0)
+    , overlay_fd_(-1)
+    , overlay_(nullptr)
+    , overlay_words_(0)
+    , overlay_blocks_(0)
+    , sense_key_(SCSI_SENSE_NO_SENSE)
+    , asc_(0)
+    , ascq_(0) {
+}
+
+ScsiDisk::~ScsiDisk() {
+    Close();
+}
+
+bool ScsiDisk::Open(const std::string& path, uint64_t create_bytes, bool read_only) {
+    Close();
+
+    int flags = read_only ? O_RDONLY : O_RDWR;
+    if (create_bytes > 0 && !read_only) {
+        flags |= O_CREAT;
+    }
+    fd_ = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        LOG_ERROR("Failed to open disk image " << path << ": " << std::strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        LOG_ERROR("Failed to stat disk image " << path << ": " << std::strerror(errno));
+        Close();
+        return false;
+    }
+
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (size == 0 && create_bytes > 0) {
+        // 只设置文件长度，不分配数据块
+        if (ftruncate(fd_, static_cast<off_t>(create_bytes)) != 0) {
+            LOG_ERROR("Failed to size disk image " << path << ": " << std::strerror(errno));
+            Close();
+            return false;
+        }
+        size = create_bytes;
+        LOG_INFO("Created sparse disk image " << path << " (" << size << " bytes)");
+    }
+
+    total_blocks_ = size / block_size_;
+    if (total_blocks_ == 0) {
+        LOG_ERROR("Disk image " << path << " is smaller than one block");
+        Close();
+        return false;
+    }
+
+    mapped_bytes_ = static_cast<size_t>(total_blocks_ * block_size_);
+    void* mapping = mmap(nullptr, mapped_bytes_, PROT_READ | (read_only ? 0 : PROT_WRITE), MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map disk image " << path << ": " << std::strerror(errno));
+        mapped_bytes_ = 0;
+        Close();
+        return false;
+    }
+
+    data_ = static_cast<uint8_t*>(mapping);
+    read_only_ = read_only;
+    next_sequential_lba_ = 0;
+    sense_key_ = SCSI_SENSE_NO_SENSE;
+    asc_ = 0;
+    ascq_ = 0;
+    LOG_INFO("Disk image " << path << ": " << total_blocks_ << " blocks, " << block_size_
+             << " bytes per block" << (read_only ? ", read-only" : ""));
+    return true;
+}
+
+void ScsiDisk::Close() {
+    CloseOverlay();
+    if (data_) {
+        if (!read_only_) {
+            msync(data_, mapped_bytes_, MS_SYNC);
+        }
+        munmap(data_, mapped_bytes_);
+        data_ = nullptr;
+        mapped_bytes_ = 0;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    total_blocks_ = 0;
+}
+
+bool ScsiDisk::AttachOverlay(const std::string& path) {
+    if (!IsOpen()) {
+        LOG_ERROR("Disk image must be opened before attaching an overlay");
+        return false;
+    }
+    CloseOverlay();
+
+    overlay_fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (overlay_fd_ < 0) {
+        LOG_ERROR("Failed to create overlay " << path << ": " << std::strerror(errno));
+        return false;
+    }
+    // overlay只属于本会话，没有位图也无法复用
+    ::unlink(path.c_str());
+
+    if (ftruncate(overlay_fd_, static_cast<off_t>(mapped_bytes_)) != 0) {
+        LOG_ERROR("Failed to size overlay " << path << ": " << std::strerror(errno));
+        CloseOverlay();
+        return false;
+    }
+    void* mapping = mmap(nullptr, mapped_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, overlay_fd_, 0);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map overlay " << path << ": " << std::strerror(errno));
+        CloseOverlay();
+        return false;
+    }
+
+    overlay_ = static_cast<uint8_t*>(mapping);
+    overlay_words_ = static_cast<size_t>((total_blocks_ + 63) / 64);
+    overlay_bitmap_.reset(new std::atomic<uint64_t>[overlay_words_]);
+    for (size_t i = 0; i < overlay_words_; ++i) {
+        overlay_bitmap_[i].store(0, std::memory_order_relaxed);
+    }
+    overlay_blocks_.store(0);
+    LOG_INFO("Copy-on-write overlay attached: " << path);
+    return true;
+}
+
+void ScsiDisk::DiscardOverlay() {
+    if (!overlay_) {
+        return;
+    }
+    for (size_t i = 0; i < overlay_words_; ++i) {
+        overlay_bitmap_[i].store(0, std::memory_order_relaxed);
+    }
+    overlay_blocks_.store(0);
+    // 清空位图即完成丢弃；再归还overlay占用的页和磁盘空间
+    madvise(overlay_, mapped_bytes_, MADV_DONTNEED);
+    if (ftruncate(overlay_fd_, 0) != 0 || ftruncate(overlay_fd_, static_cast<off_t>(mapped_bytes_)) != 0) {
+        LOG_WARNING("Failed to release overlay space: " << std::strerror(errno));
+    }
+    LOG_INFO("Copy-on-write overlay discarded");
+}
+
+void ScsiDisk::CloseOverlay() {
+    if (overlay_) {
+        munmap(overlay_, mapped_bytes_);
+        overlay_ = nullptr;
+    }
+    if (overlay_fd_ >= 0) {
+        ::close(overlay_fd_);
+        overlay_fd_ = -1;
+    }
+    overlay_bitmap_.reset();
+    overlay_words_ = 0;
+    overlay_blocks_.store(0);
+}
+
+bool ScsiDisk::InOverlay(uint64_t lba) const {
+    return (overlay_bitmap_[lba / 64].load(std::memory_order_acquire) >> (lba % 64)) & 1;
+}
+
+uint64_t ScsiDisk::AllocatedBytes() const {
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_blocks) * 512;
+}
+
+ScsiDiskStatistics ScsiDisk::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+uint8_t ScsiDisk::CheckCondition(uint8_t sense_key, uint8_t asc, uint8_t ascq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sense_key_ = sense_key;
+    asc_ = asc;
+    ascq_ = ascq;
+    stats_.check_conditions++;
+    return SCSI_STATUS_CHECK_CONDITION;
+}
+
+bool ScsiDisk::Sync(uint64_t offset, uint64_t length) {
+    // overlay是会话内的临时数据，只需写入页缓存；只读镜像没有可写回的内容
+    if (overlay_ || read_only_ || length == 0) {
+        return true;
+    }
+    // msync要求起始地址按页对齐
+    uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset / page * page;
+    uint64_t end = std::min<uint64_t>(offset + length, mapped_bytes_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.syncs++;
+    }
+    return msync(data_ + start, static_cast<size_t>(end - start), MS_SYNC) == 0;
+}
+
+uint8_t ScsiDisk::Execute(const uint8_t* cdb, uint8_t cdb_length, const uint8_t* data_out, uint32_t data_out_length,
+                          uint32_t data_in_length, utils::PooledBuffer& data_in) {
+    data_in.clear();
+    if (cdb_length == 0) {
+        return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);   // INVALID COMMAND OPERATION CODE
+    }
+
+    uint8_t opcode = cdb[0];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.commands++;
+        // sense数据只保留到下一条命令
+        if (opcode != static_cast<uint8_t>(ScsiCommand::REQUEST_SENSE)) {
+            sense_key_ = SCSI_SENSE_NO_SENSE;
+            asc_ = 0;
+            ascq_ = 0;
+        }
+    }
+
+    switch (static_cast<ScsiCommand>(opcode)) {
+        case ScsiCommand::INQUIRY:
+            return Inquiry(data_in);
+        case ScsiCommand::REQUEST_SENSE:
+            RequestSense(data_in);
+            if (cdb_length >= 5) {
+                data_in.resize(std::min<size_t>(data_in.size(), cdb[4]));
+            }
+            return SCSI_STATUS_GOOD;
+        default:
+            break;
+    }
+
+    if (!IsOpen()) {
+        return CheckCondition(SCSI_SENSE_NOT_READY, 0x3A, 0x00);         // MEDIUM NOT PRESENT
+    }
+
+    switch (static_cast<ScsiCommand>(opcode)) {
+        case ScsiCommand::TEST_UNIT_READY:
+            return SCSI_STATUS_GOOD;
+        case ScsiCommand::READ_CAPACITY_10:
+            return ReadCapacity(false, data_in);
+        case ScsiCommand::READ_CAPACITY_16:
+            // SERVICE ACTION IN(16)，只支持READ CAPACITY(16)
+            if (cdb_length < 16 || (cdb[1] & 0x1F) != 0x10) {
+                return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+            }
+            ReadCapacity(true, data_in);
+            data_in.resize(std::min<size_t>(data_in.size(), ReadBigEndian(&cdb[10], 4)));
+            return SCSI_STATUS_GOOD;
+        case ScsiCommand::MODE_SENSE_6:
+            return ModeSense(cdb, false, data_in);
+        case ScsiCommand::MODE_SENSE_10:
+            return cdb_length >= 10 ? ModeSense(cdb, true, data_in)
+                                    : CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+        case ScsiCommand::READ_10:
+        case ScsiCommand::WRITE_10:
+        case ScsiCommand::READ_16:
+        case ScsiCommand::WRITE_16: {
+            bool is_long = opcode == static_cast<uint8_t>(ScsiCommand::READ_16) ||
+                           opcode == static_cast<uint8_t>(ScsiCommand::WRITE_16);
+            if (cdb_length < (is_long ? 16 : 10)) {
+                return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+            }
+            return ReadWrite(cdb, data_out, data_out_length, data_in_length, data_in);
+        }
+        case ScsiCommand::SYNCHRONIZE_CACHE_10:
+        case ScsiCommand::SYNCHRONIZE_CACHE_16: {
+            bool is_long = opcode == static_cast<uint8_t>(ScsiCommand::SYNCHRONIZE_CACHE_16);
+            if (cdb_length < (is_long ? 16 : 10)) {
+                return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+            }
+            uint64_t lba = is_long ? ReadBigEndian(&cdb[2], 8) : ReadBigEndian(&cdb[2], 4);
+            uint64_t count = is_long ? ReadBigEndian(&cdb[10], 4) : ReadBigEndian(&cdb[7], 2);
+            if (lba > total_blocks_) {
+                return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);
+            }
+            // 块数为0表示到介质末尾
+            if (count == 0 || count > total_blocks_ - lba) {
+                count = total_blocks_ - lba;
+            }
+            if (!Sync(lba * block_size_, count * block_size_)) {
+                return CheckCondition(SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);  // WRITE ERROR
+            }
+            return SCSI_STATUS_GOOD;
+        }
+        default:
+            LOG_DEBUG("Unsupported SCSI command: 0x" << std::hex << static_cast<int>(opcode));
+            return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+    }
+}
+
+uint8_t ScsiDisk::ReadWrite(const uint8_t* cdb, const uint8_t* data_out, uint32_t data_out_length,
+                            uint32_t data_in_length, utils::PooledBuffer& data_in) {
+    uint8_t opcode = cdb[0];
+    bool is_read = opcode == static_cast<uint8_t>(ScsiCommand::READ_10) ||
+                   opcode == static_cast<uint8_t>(ScsiCommand::READ_16);
+    bool is_long = opcode == static_cast<uint8_t>(ScsiCommand::READ_16) ||
+                   opcode == static_cast<uint8_t>(ScsiCommand::WRITE_16);
+    uint64_t lba = is_long ? ReadBigEndian(&cdb[2], 8) : ReadBigEndian(&cdb[2], 4);
+    uint64_t count = is_long ? ReadBigEndian(&cdb[10], 4) : ReadBigEndian(&cdb[7], 2);
+
+    if (lba > total_blocks_ || count > total_blocks_ - lba) {
+        return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);   // LBA OUT OF RANGE
+    }
+
+    uint64_t offset = lba * block_size_;
+    size_t length = static_cast<size_t>(count * block_size_);
+
+    if (is_read) {
+        if (data_in_length < length) {
+            // 主机期望的数据少于CDB声明的长度（BOT的Hi < Di），不为读不完的数据分配缓冲
+            return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+        }
+        bool sequential;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sequential = lba == next_sequential_lba_;
+            next_sequential_lba_ = lba + count;
+            stats_.read_blocks += count;
+        }
+        // 顺序读：让内核提前读入后面的数据，下一条READ直接命中页缓存
+        if (sequential && length > 0) {
+            uint64_t ahead = offset + length;
+            uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            uint64_t start = ahead / page * page;
+            uint64_t end = std::min<uint64_t>(ahead + std::max<uint64_t>(length, PREFETCH_BYTES), mapped_bytes_);
+            if (start < end) {
+                madvise(data_ + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+            }
+        }
+        ReadBlocks(lba, count, data_in);
+        return SCSI_STATUS_GOOD;
+    }
+
+    if (IsReadOnly()) {
+        return CheckCondition(SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);      // WRITE PROTECTED
+    }
+    if (data_out_length < length) {
+        // 主机发来的数据少于CDB声明的长度
+        return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+    }
+
+    if (overlay_) {
+        // 先写数据再置位，并发的读看到置位时数据已经就绪
+        std::memcpy(overlay_ + offset, data_out, length);
+        for (uint64_t block = lba; block < lba + count; ++block) {
+            uint64_t bit = 1ull << (block % 64);
+            if ((overlay_bitmap_[block / 64].fetch_or(bit, std::memory_order_release) & bit) == 0) {
+                overlay_blocks_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    } else {
+        std::memcpy(data_ + offset, data_out, length);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.written_blocks += count;
+    }
+    if ((cdb[1] & SCSI_CDB_FUA) && !Sync(offset, length)) {
+        return CheckCondition(SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+    }
+    return SCSI_STATUS_GOOD;
+}
+
+void ScsiDisk::ReadBlocks(uint64_t lba, uint64_t count, utils::PooledBuffer& data_in) {
+    data_in.resize(static_cast<size_t>(count * block_size_));
+    uint8_t* out = data_in.mutable_data();
+    if (!overlay_) {
+        std::memcpy(out, data_ + lba * block_size_, data_in.size());
+        return;
+    }
+
+    // 按来源把请求切成连续段，每段一次拷贝
+    uint64_t overlay_reads = 0;
+    uint64_t block = lba;
+    while (block < lba + count) {
+        bool from_overlay = InOverlay(block);
+        uint64_t run_end = block + 1;
+        while (run_end < lba + count && InOverlay(run_end) == from_overlay) {
+            ++run_end;
+        }
+        const uint8_t* source = from_overlay ? overlay_ : data_;
+        std::memcpy(out + (block - lba) * block_size_, source + block * block_size_,
+                    static_cast<size_t>((run_end - block) * block_size_));
+        if (from_overlay) {
+            overlay_reads += run_end - block;
+        }
+        block = run_end;
+    }
+    if (overlay_reads > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.overlay_reads += overlay_reads;
+    }
+}
+
+uint8_t ScsiDisk::ReadCapacity(bool long_form, utils::PooledBuffer& data_in) {
+    uint64_t last_lba = total_blocks_ - 1;
+    if (long_form) {
+        data_in.assign(32, 0);
+        uint8_t* out = data_in.mutable_data();
+        PutBigEndian(out, last_lba, 8);
+        PutBigEndian(out + 8, block_size_, 4);
+    } else {
+        // 超出32位时返回0xFFFFFFFF，主机改用READ CAPACITY(16)
+        data_in.assign(8, 0);
+        uint8_t* out = data_in.mutable_data();
+        PutBigEndian(out, std::min<uint64_t>(last_lba, 0xFFFFFFFFull), 4);
+        PutBigEndian(out + 4, block_size_, 4);
+    }
+    return SCSI_STATUS_GOOD;
+}
+
+uint8_t ScsiDisk::ModeSense(const uint8_t* cdb, bool ten_byte, utils::PooledBuffer& data_in) {
+    uint8_t page_code = cdb[2] & 0x3F;
+    size_t allocation = ten_byte ? ReadBigEndian(&cdb[7], 2) : cdb[4];
+
+    // 只有缓存模式页：写缓存开启（WCE），与写入先落在页缓存一致
+    static constexpr uint8_t CACHING_PAGE = 0x08;
+    static constexpr uint8_t ALL_PAGES = 0x3F;
+    if (page_code != CACHING_PAGE && page_code != ALL_PAGES) {
+        return CheckCondition(SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+    }
+
+    size_t header = ten_byte ? 8 : 4;
+    data_in.assign(header + 20, 0);
+    uint8_t* out = data_in.mutable_data();
+    uint8_t* page = out + header;
+    page[0] = CACHING_PAGE;
+    page[1] = 18;
+    page[2] = 0x04;                     // WCE
+
+    // 模式参数头：数据长度不含长度字段本身，设备参数字节的位7为写保护
+    uint8_t device_specific = IsReadOnly() ? 0x80 : 0x00;
+    if (ten_byte) {
+        PutBigEndian(out, data_in.size() - 2, 2);
+        out[3] = device_specific;
+    } else {
+        out[0] = static_cast<uint8_t>(data_in.size() - 1);
+        out[2] = device_specific;
+    }
+    data_in.resize(std::min(data_in.size(), allocation));
+    return SCSI_STATUS_GOOD;
+}
+
+uint8_t ScsiDisk::Inquiry(utils::PooledBuffer& data_in) {
+    data_in.assign(36, 0);
+    uint8_t* out = data_in.mutable_data();
+    out[0] = IsOpen() ? 0x00 : 0x20;   // 直接访问设备；未打开镜像时外设限定符为"未连接"
+    out[1] = 0x80;                      // 可移动介质
+    out[2] = 0x04;                      // SPC-2
+    out[3] = 0x02;                      // 响应数据格式
+    out[4] = 31;                        // 附加长度
+    std::memcpy(out + 8, "Virtual ", 8);
+    std::memcpy(out + 16, "Disk Image      ", 16);
+    std::memcpy(out + 32, "1.0 ", 4);
+    return SCSI_STATUS_GOOD;
+}
+
+void ScsiDisk::RequestSense(utils::PooledBuffer& data_in) {
+    // 固定格式sense数据，读出后清除
+    data_in.assign(18, 0);
+    uint8_t* out = data_in.mutable_data();
+    std::lock_guard<std::mutex> lock(mutex_);
+    out[0] = 0x70;
+    out[2] = sense_key_;
+    out[7] = 10;
+    out[12] = asc_;
+    out[13] = ascq_;
+    sense_key_ = SCSI_SENSE_NO_SENSE;
+    asc_ = 0;
+    ascq_ = 0;
+}
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include "mass_storage.h"
+#include "utils/buffer_pool.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// SCSI sense键
+static constexpr uint8_t SCSI_SENSE_NO_SENSE = 0x00;
+static constexpr uint8_t SCSI_SENSE_NOT_READY = 0x02;
+static constexpr uint8_t SCSI_SENSE_MEDIUM_ERROR = 0x03;
+static constexpr uint8_t SCSI_SENSE_ILLEGAL_REQUEST = 0x05;
+static constexpr uint8_t SCSI_SENSE_DATA_PROTECT = 0x07;
+
+// 磁盘镜像统计
+struct ScsiDiskStatistics {
+    uint64_t commands = 0;
+    uint64_t read_blocks = 0;
+    uint64_t written_blocks = 0;
+    uint64_t check_conditions = 0;  // 以CHECK CONDITION结束的命令数
+    uint64_t syncs = 0;             // SYNCHRONIZE CACHE和FUA写入引起的msync次数
+    uint64_t overlay_reads = 0;     // 从写时复制层读出的块数
+};
+
+// 以mmap映射的磁盘镜像文件实现的SCSI直接访问设备，接收端可直接用本地镜像应答
+// 大容量存储命令（无需经过网络），也可作为基准测试的负载。
+// 支持TEST UNIT READY、REQUEST SENSE、INQUIRY、MODE SENSE(6/10)、READ CAPACITY(10/16)、
+// READ/WRITE(10/16)和SYNCHRONIZE CACHE(10/16)。写入落在页缓存中，FUA写入和
+// SYNCHRONIZE CACHE经msync落盘；新建的镜像是稀疏文件，未写过的块读出为零且不占用磁盘。
+// 挂上写时复制层后镜像只读共享：多个会话（各自一个ScsiDisk）映射同一镜像，
+// 写入落在各自的稀疏overlay文件中，由块位图决定每个块从哪一层读出
+class ScsiDisk {
+public:
+    explicit ScsiDisk(uint32_t block_size = 512);
+    ~ScsiDisk();
+
+    // 禁止拷贝
+    ScsiDisk(const ScsiDisk&) = delete;
+    ScsiDisk& operator=(const ScsiDisk&) = delete;
+
+    // 打开镜像。文件不存在且create_bytes非零时创建该大小的稀疏文件；
+    // 文件大小不是块大小整数倍时忽略末尾不足一块的部分
+    bool Open(const std::string& path, uint64_t create_bytes = 0, bool read_only = false);
+    void Close();
+
+    // 在镜像上叠加本会话的写时复制层（Open之后、执行命令之前调用）。overlay文件创建后
+    // 立即删除目录项，会话结束时空间自动回收；镜像可以只读打开
+    bool AttachOverlay(const std::string& path);
+    // 丢弃本会话的全部写入，立即恢复为镜像内容。调用方保证此时没有命令在执行
+    void DiscardOverlay();
+    bool HasOverlay() const { return overlay_ != nullptr; }
+    // 本会话写过的块数
+    uint64_t OverlayBlocks() const { return overlay_blocks_.load(); }
+
+    bool IsOpen() const { return data_ != nullptr; }
+    // 写保护：镜像只读且没有写时复制层
+    bool IsReadOnly() const { return read_only_ && !overlay_; }
+    uint64_t TotalBlocks() const { return total_blocks_; }
+    uint32_t BlockSize() const { return block_size_; }
+    // 镜像文件实际占用的磁盘空间
+    uint64_t AllocatedBytes() const;
+
+    // 执行一条SCSI命令，返回SCSI状态。data_out为主机写入的数据（数据OUT阶段），
+    // 数据IN阶段的内容放入data_in，data_in_length为主机期望接收的长度（BOT的dCBWDataTransferLength）。
+    // READ要读出的数据多于data_in_length时不读取，以CHECK CONDITION拒绝。
+    // CHECK CONDITION的原因由下一条REQUEST SENSE读取
+    uint8_t Execute(const uint8_t* cdb, uint8_t cdb_length, const uint8_t* data_out, uint32_t data_out_length,
+                    uint32_t data_in_length, utils::PooledBuffer& data_in);
+
+    ScsiDiskStatistics GetStatistics() const;
+
+private:
+    uint8_t ReadWrite(const uint8_t* cdb, const uint8_t* data_out, uint32_t data_out_length,
+                      uint32_t data_in_length, utils::PooledBuffer& data_in);
+    uint8_t ReadCapacity(bool long_form, utils::PooledBuffer& data_in);
+    uint8_t ModeSense(const uint8_t* cdb, bool ten_byte, utils::PooledBuffer& data_in);
+    uint8_t Inquiry(utils::PooledBuffer& data_in);
+    void RequestSense(utils::PooledBuffer& data_in);
+    // 读出连续的块，有写时复制层时逐段选择来源
+    void ReadBlocks(uint64_t lba, uint64_t count, utils::PooledBuffer& data_in);
+    bool InOverlay(uint64_t lba) const;
+    // 把[offset, offset+length)所在的页写回文件（有写时复制层时为overlay）
+    bool Sync(uint64_t offset, uint64_t length);
+    void CloseOverlay();
+    // 记录sense数据并返回CHECK CONDITION
+    uint8_t CheckCondition(uint8_t sense_key, uint8_t asc, uint8_t ascq);
+
+    uint32_t block_size_;
+    int fd_;
+    uint8_t* data_;
+    size_t mapped_bytes_;
+    uint64_t total_blocks_;
+    bool read_only_;
+    uint64_t next_sequential_lba_;      // 上一次读结束处，用于发现顺序读
+
+    // 写时复制层：与镜像等长的稀疏映射，位图中置位的块以overlay为准
+    int overlay_fd_;
+    uint8_t* overlay_;
+    std::unique_ptr<std::atomic<uint64_t>[]> overlay_bitmap_;
+    size_t overlay_words_;
+    std::atomic<uint64_t> overlay_blocks_;
+
+    uint8_t sense_key_;
+    uint8_t asc_;
+    uint8_t ascq_;
+
+    ScsiDiskStatistics stats_;
+    mutable std::mutex mutex_;          // 保护sense和统计，数据经映射直接读写
+};
+
+} // namespace protocol
+} // namespace usb_redirector
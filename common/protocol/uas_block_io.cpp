@@ -0,0 +1,298 @@
+#include "uas_block_io.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cstring>
+
+namespace usb_redirector {
+namespace protocol {
+
+static uint16_t ReadBigEndian16(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+UasBlockIo::UasBlockIo(UasTransport& transport, const BlockIoConfig& config)
+    : transport_(transport)
+    , config_(config)
+    , tag_waiters_(0) {
+    config_.max_transfer_bytes = std::max<uint32_t>(1, config_.max_transfer_bytes);
+    depth_ = std::max<size_t>(1, std::min<size_t>(config_.max_uas_commands_in_flight, transport_.StreamCount()));
+    commands_.resize(depth_);
+    for (size_t i = depth_; i > 0; --i) {
+        free_tags_.push_back(i - 1);
+    }
+}
+
+void UasBlockIo::BuildCommandIu(UasCommandIu& iu, uint16_t tag, uint8_t lun, const uint8_t* cdb, uint8_t cdb_length) {
+    std::memset(&iu, 0, sizeof(iu));
+    iu.bIUID = static_cast<uint8_t>(UasIuId::COMMAND);
+    // 字段按线上字节序逐字节填写
+    uint8_t* tag_bytes = reinterpret_cast<uint8_t*>(&iu.wTag);
+    tag_bytes[0] = static_cast<uint8_t>(tag >> 8);
+    tag_bytes[1] = static_cast<uint8_t>(tag);
+    iu.bPrioAttr = 0;           // SIMPLE任务属性
+    iu.LUN[1] = lun;            // 单级LUN，外设寻址
+    std::memcpy(iu.CDB, cdb, std::min<size_t>(cdb_length, sizeof(iu.CDB)));
+}
+
+uint16_t UasBlockIo::Tag(const Command& command) const {
+    // 标签0保留，流ID从1开始
+    return static_cast<uint16_t>(&command - commands_.data() + 1);
+}
+
+size_t UasBlockIo::AcquireTag(const void* owner, bool has_in_flight) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (has_in_flight) {
+        if (free_tags_.empty() || tag_waiters_ > 0) {
+            return depth_;
+        }
+    } else {
+        ++tag_waiters_;
+        tag_released_.wait(lock, [this]() { return !free_tags_.empty(); });
+        --tag_waiters_;
+    }
+
+    size_t index = free_tags_.back();
+    free_tags_.pop_back();
+    commands_[index].owner = owner;
+    return index;
+}
+
+void UasBlockIo::ReleaseTag(size_t index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands_[index].owner = nullptr;
+        free_tags_.push_back(index);
+    }
+    tag_released_.notify_one();
+}
+
+void UasBlockIo::Issue(Command& command) {
+    uint16_t tag = Tag(command);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command.active = true;
+        command.pending = command.length > 0 ? 3 : 2;
+        command.failed = false;
+        command.status_actual = 0;
+        command.data_actual = 0;
+    }
+
+    // 未能提交的传输直接计为完成
+    auto abandon = [this, &command](int transfers) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command.failed = true;
+        command.pending -= transfers;
+        stage_done_.notify_all();
+    };
+
+    // 先在该命令的流上排好状态和数据传输，设备收到命令后可以立即响应
+    bool submitted = transport_.SubmitBulk(UasPipe::STATUS, tag, command.status_buffer, STATUS_BUFFER_SIZE,
+        [this, &command](UasTransport::Status status, uint32_t actual_length) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (status == UasTransport::Status::OK) {
+                command.status_actual = actual_length;
+            } else {
+                command.failed = true;
+            }
+            --command.pending;
+            stage_done_.notify_all();
+        });
+    if (!submitted) {
+        abandon(command.pending);
+        return;
+    }
+
+    if (command.length > 0) {
+        submitted = transport_.SubmitBulk(command.data_in ? UasPipe::DATA_IN : UasPipe::DATA_OUT, tag,
+                                          command.data, command.length,
+            [this, &command](UasTransport::Status status, uint32_t actual_length) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                command.data_actual = actual_length;
+                // 数据管道STALL时设备仍会在状态管道上报告结果
+                if (status == UasTransport::Status::ERROR) {
+                    command.failed = true;
+                }
+                --command.pending;
+                stage_done_.notify_all();
+            });
+        if (!submitted) {
+            // 已排队的状态传输由传输超时或设备断开结束
+            abandon(2);
+            return;
+        }
+    }
+
+    submitted = transport_.SubmitBulk(UasPipe::COMMAND, 0, reinterpret_cast<uint8_t*>(&command.iu),
+                                      sizeof(UasCommandIu),
+        [this, &command](UasTransport::Status status, uint32_t actual_length) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (status != UasTransport::Status::OK || actual_length != sizeof(UasCommandIu)) {
+                command.failed = true;
+            }
+            --command.pending;
+            stage_done_.notify_all();
+        });
+    if (!submitted) {
+        abandon(1);
+    }
+}
+
+void UasBlockIo::WaitCommand(Command& command) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stage_done_.wait(lock, [&command]() { return command.pending == 0; });
+}
+
+size_t UasBlockIo::WaitAny(const void* owner) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t index = commands_.size();
+    stage_done_.wait(lock, [this, owner, &index]() {
+        for (size_t i = 0; i < commands_.size(); ++i) {
+            if (commands_[i].owner == owner && commands_[i].active && commands_[i].pending == 0) {
+                index = i;
+                return true;
+            }
+        }
+        return false;
+    });
+    return index;
+}
+
+bool UasBlockIo::CompleteCommand(Command& command, uint8_t& status) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        command.active = false;
+    }
+    if (command.failed) {
+        return false;
+    }
+
+    const uint8_t* iu = command.status_buffer;
+    if (command.status_actual < sizeof(UasResponseIu) || ReadBigEndian16(&iu[2]) != Tag(command)) {
+        LOG_ERROR("Invalid UAS status IU for tag " << Tag(command));
+        return false;
+    }
+
+    if (iu[0] == static_cast<uint8_t>(UasIuId::SENSE) && command.status_actual >= 16) {
+        status = iu[6];
+        return true;
+    }
+    if (iu[0] == static_cast<uint8_t>(UasIuId::RESPONSE)) {
+        LOG_ERROR("UAS command rejected for tag " << Tag(command)
+                  << ": response code " << static_cast<int>(iu[7]));
+    } else {
+        LOG_ERROR("Unexpected UAS IU 0x" << std::hex << static_cast<int>(iu[0]) << " on status pipe");
+    }
+    return false;
+}
+
+bool UasBlockIo::ExecuteScsi(uint8_t lun, const uint8_t* cdb, uint8_t cdb_length, bool data_in,
+                             uint8_t* data, uint32_t length, uint8_t& status, uint32_t* actual_length) {
+    size_t index = AcquireTag(&length, false);
+    Command& command = commands_[index];
+    BuildCommandIu(command.iu, Tag(command), lun, cdb, cdb_length);
+    command.data = data;
+    command.length = length;
+    command.data_in = data_in;
+    command.lba = 0;
+
+    Issue(command);
+    WaitCommand(command);
+    bool valid = CompleteCommand(command, status);
+    if (actual_length) {
+        *actual_length = command.data_actual;
+    }
+    ReleaseTag(index);
+    return valid;
+}
+
+bool UasBlockIo::Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, uint8_t* data) {
+    return Transfer(true, lun, lba, block_count, block_size, data, false);
+}
+
+bool UasBlockIo::Write(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, const uint8_t* data,
+                       bool fua) {
+    // 写方向只读取缓冲区
+    return Transfer(false, lun, lba, block_count, block_size, const_cast<uint8_t*>(data), fua);
+}
+
+bool UasBlockIo::SynchronizeCache(uint8_t lun) {
+    // LBA和块数为0表示整个介质
+    uint8_t cdb[10] = {static_cast<uint8_t>(ScsiCommand::SYNCHRONIZE_CACHE_10)};
+    uint8_t status = 0;
+    if (!ExecuteScsi(lun, cdb, sizeof(cdb), false, nullptr, 0, status) || status != SCSI_STATUS_GOOD) {
+        LOG_ERROR("SYNCHRONIZE CACHE failed on LUN " << static_cast<int>(lun));
+        return false;
+    }
+    return true;
+}
+
+bool UasBlockIo::Transfer(bool is_read, uint8_t lun, uint64_t lba, uint32_t block_count,
+                          uint32_t block_size, uint8_t* data, bool fua) {
+    if (block_count == 0) {
+        return true;
+    }
+    if (block_size == 0 || !data) {
+        return false;
+    }
+
+    // 以局部变量的地址标识本次调用拥有的命令
+    const void* owner = &data;
+    size_t in_flight = 0;
+    bool ok = true;
+
+    while (ok && (block_count > 0 || in_flight > 0)) {
+        // 每个空闲标签立即补发一条命令
+        while (block_count > 0) {
+            size_t index = AcquireTag(owner, in_flight > 0);
+            if (index == depth_) {
+                break;
+            }
+            uint32_t count = MaxCommandBlocks(lba, block_count, block_size, config_.max_transfer_bytes);
+
+            Command& command = commands_[index];
+            uint8_t cdb[16];
+            uint8_t cdb_length = BuildReadWriteCdb(cdb, is_read, lba, count, fua);
+            BuildCommandIu(command.iu, Tag(command), lun, cdb, cdb_length);
+            command.data = data;
+            command.length = count * block_size;
+            command.data_in = is_read;
+            command.lba = lba;
+            Issue(command);
+
+            ++in_flight;
+            data += command.length;
+            lba += count;
+            block_count -= count;
+        }
+
+        // 设备可以乱序完成，先完成的先回收
+        size_t index = WaitAny(owner);
+        Command& done = commands_[index];
+        uint8_t status = 0;
+        if (!CompleteCommand(done, status)) {
+            LOG_ERROR("SCSI " << (is_read ? "READ" : "WRITE") << " transport failed at LBA " << done.lba);
+            ok = false;
+        } else if (status != SCSI_STATUS_GOOD || done.data_actual != done.length) {
+            LOG_ERROR("SCSI " << (is_read ? "READ" : "WRITE") << " failed at LBA " << done.lba
+                      << ": status " << static_cast<int>(status)
+                      << ", transferred " << done.data_actual << "/" << done.length);
+            ok = false;
+        }
+        ReleaseTag(index);
+        --in_flight;
+    }
+
+    // 出错后等其余在途命令结束，缓冲区才能交还调用方
+    while (in_flight > 0) {
+        uint8_t status = 0;
+        size_t index = WaitAny(owner);
+        CompleteCommand(commands_[index], status);
+        ReleaseTag(index);
+        --in_flight;
+    }
+
+    return ok;
+}
+
+} // namespace protocol
+} // namespace usb_redirector
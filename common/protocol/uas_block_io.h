@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "block_io.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// UAS的四条管道：由真实设备（libusb批量流）或仿真设备实现
+class UasTransport {
+public:
+    enum class Status {
+        OK,
+        STALL,
+        ERROR
+    };
+
+    using Completion = std::function<void(Status status, uint32_t actual_length)>;
+
+    virtual ~UasTransport() = default;
+
+    // 在管道上排队一次批量传输。状态和数据管道按stream_id（即命令标签）分流，
+    // 命令管道不使用流（stream_id为0）。
+    // 返回true后completion必定被调用一次（可在任意线程）；返回false时不调用
+    virtual bool SubmitBulk(UasPipe pipe, uint16_t stream_id, uint8_t* data, uint32_t length,
+                            Completion completion) = 0;
+
+    // 已分配的流数量，决定可同时在途的命令数
+    virtual uint16_t StreamCount() const = 0;
+};
+
+// USB Attached SCSI块读写：每条命令占用一个标签（流），先在该流上排队状态和数据传输，
+// 再经命令管道发出命令IU。设备可以乱序完成，任一命令完成后立即补发下一条，
+// 保持max_uas_commands_in_flight条命令同时在途。多个线程（如不同LUN）共享标签池，
+// 有其他调用方在等标签时，已有命令在途的调用方不再多占，各自的命令在管道上交错
+// 仅支持USB 3批量流模式；USB 2下的READ READY/WRITE READY模式由设备的BOT备用设置代替
+class UasBlockIo : public BlockIo {
+public:
+    explicit UasBlockIo(UasTransport& transport, const BlockIoConfig& config = BlockIoConfig());
+    ~UasBlockIo() override = default;
+
+    // 禁止拷贝
+    UasBlockIo(const UasBlockIo&) = delete;
+    UasBlockIo& operator=(const UasBlockIo&) = delete;
+
+    bool Read(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, uint8_t* data) override;
+    bool Write(uint8_t lun, uint64_t lba, uint32_t block_count, uint32_t block_size, const uint8_t* data,
+               bool fua = false) override;
+    bool SynchronizeCache(uint8_t lun) override;
+    bool ExecuteScsi(uint8_t lun, const uint8_t* cdb, uint8_t cdb_length, bool data_in,
+                     uint8_t* data, uint32_t length, uint8_t& status, uint32_t* actual_length = nullptr) override;
+
+    // 填充命令IU
+    static void BuildCommandIu(UasCommandIu& iu, uint16_t tag, uint8_t lun, const uint8_t* cdb, uint8_t cdb_length);
+
+    // 实际可同时在途的命令数（配置与流数量取小）
+    size_t Depth() const { return depth_; }
+
+private:
+    // 状态管道缓冲区：Sense IU头部加上最长的sense数据
+    static constexpr uint32_t STATUS_BUFFER_SIZE = 16 + 96;
+
+    // 一条在途命令，下标+1即其标签
+    struct Command {
+        UasCommandIu iu;
+        uint8_t status_buffer[STATUS_BUFFER_SIZE];
+        uint8_t* data = nullptr;
+        uint32_t length = 0;
+        bool data_in = false;
+        uint64_t lba = 0;
+        bool active = false;
+        const void* owner = nullptr;     // 发起该命令的调用
+        int pending = 0;                 // 尚未完成的传输数
+        bool failed = false;             // 某传输提交失败或出错
+        uint32_t status_actual = 0;
+        uint32_t data_actual = 0;
+    };
+
+    uint16_t Tag(const Command& command) const;
+    // 取一个空闲标签，返回命令下标。has_in_flight时不等待，且有其他调用方在等时让出，此时返回depth_
+    size_t AcquireTag(const void* owner, bool has_in_flight);
+    void ReleaseTag(size_t index);
+    void Issue(Command& command);
+    void WaitCommand(Command& command);
+    // 等待owner的任一在途命令完成，返回其下标
+    size_t WaitAny(const void* owner);
+    // 解析状态IU，返回传输是否有效
+    bool CompleteCommand(Command& command, uint8_t& status);
+    bool Transfer(bool is_read, uint8_t lun, uint64_t lba, uint32_t block_count,
+                  uint32_t block_size, uint8_t* data, bool fua);
+
+    UasTransport& transport_;
+    BlockIoConfig config_;
+    size_t depth_;
+
+    std::vector<Command> commands_;
+
+    std::mutex mutex_;
+    std::condition_variable stage_done_;
+    std::vector<size_t> free_tags_;
+    size_t tag_waiters_;
+    std::condition_variable tag_released_;
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,201 @@
+#include "urb_metrics.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+namespace {
+
+std::atomic<uint64_t> g_next_metrics_id{1};
+
+// 每个线程缓存最近使用的几个实例的计数块，命中时只是几次比较
+struct LocalBlockCache {
+    static constexpr size_t SIZE = 4;
+    uint64_t ids[SIZE] = {};
+    void* blocks[SIZE] = {};
+    size_t next = 0;
+};
+
+thread_local LocalBlockCache t_block_cache;
+
+} // namespace
+
+UrbMetrics::ThreadBlock::ThreadBlock()
+    : owner(std::this_thread::get_id()) {
+    for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (auto& kind : latency) {
+        for (auto& type : kind) {
+            for (auto& histogram : type) {
+                histogram.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+UrbMetrics::ThreadBlock::~ThreadBlock() {
+    for (auto& kind : latency) {
+        for (auto& type : kind) {
+            for (auto& histogram : type) {
+                delete histogram.load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+UrbMetrics::UrbMetrics()
+    : id_(g_next_metrics_id.fetch_add(1, std::memory_order_relaxed))
+    , blocks_(nullptr) {
+}
+
+UrbMetrics::~UrbMetrics() {
+    // 实例ID不复用，其他线程缓存中指向这些块的项不会再被命中
+    ThreadBlock* block = blocks_.load(std::memory_order_acquire);
+    while (block) {
+        ThreadBlock* next = block->next;
+        delete block;
+        block = next;
+    }
+}
+
+UrbMetrics::ThreadBlock& UrbMetrics::LocalBlock() {
+    LocalBlockCache& cache = t_block_cache;
+    for (size_t i = 0; i < LocalBlockCache::SIZE; ++i) {
+        if (cache.ids[i] == id_) {
+            return *static_cast<ThreadBlock*>(cache.blocks[i]);
+        }
+    }
+
+    // 缓存未命中：本线程可能已有块（被其他实例挤出了缓存），否则新建
+    std::thread::id self = std::this_thread::get_id();
+    ThreadBlock* block = blocks_.load(std::memory_order_acquire);
+    while (block && block->owner != self) {
+        block = block->next;
+    }
+    if (!block) {
+        block = new ThreadBlock();
+        ThreadBlock* head = blocks_.load(std::memory_order_relaxed);
+        do {
+            block->next = head;
+        } while (!blocks_.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    size_t slot = cache.next++ % LocalBlockCache::SIZE;
+    cache.ids[slot] = id_;
+    cache.blocks[slot] = block;
+    return *block;
+}
+
+void UrbMetrics::RecordUrb(const UsbUrb& urb) {
+    ThreadBlock& block = LocalBlock();
+    block.Add(TOTAL_URBS, 1);
+    block.Add(BYTES_TRANSFERRED, urb.actual_length);
+    if (urb.status != 0) {
+        block.Add(ERRORS, 1);
+    }
+
+    switch (urb.type) {
+        case UsbTransferType::CONTROL:
+            block.Add(CONTROL_URBS, 1);
+            break;
+        case UsbTransferType::BULK:
+            block.Add(BULK_URBS, 1);
+            break;
+        case UsbTransferType::INTERRUPT:
+            block.Add(INTERRUPT_URBS, 1);
+            break;
+        case UsbTransferType::ISOCHRONOUS:
+            block.Add(ISO_URBS, 1);
+            break;
+    }
+}
+
+void UrbMetrics::RecordLatency(UrbLatencyKind kind, UsbTransferType type, uint8_t endpoint, uint64_t latency_us) {
+    ThreadBlock& block = LocalBlock();
+    auto& slot = block.latency[static_cast<size_t>(kind)][static_cast<size_t>(type) % URB_TRANSFER_TYPE_COUNT]
+                              [EndpointIndex(endpoint)];
+    utils::LatencyHistogram* histogram = slot.load(std::memory_order_relaxed);
+    if (!histogram) {
+        histogram = new utils::LatencyHistogram();
+        slot.store(histogram, std::memory_order_release);
+    }
+    histogram->Record(latency_us);
+}
+
+UrbCounters UrbMetrics::GetCounters() const {
+    uint64_t sums[COUNTER_COUNT] = {};
+    for (ThreadBlock* block = blocks_.load(std::memory_order_acquire); block; block = block->next) {
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            sums[i] += block->counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    UrbCounters counters;
+    counters.total_urbs = sums[TOTAL_URBS];
+    counters.control_urbs = sums[CONTROL_URBS];
+    counters.bulk_urbs = sums[BULK_URBS];
+    counters.interrupt_urbs = sums[INTERRUPT_URBS];
+    counters.iso_urbs = sums[ISO_URBS];
+    counters.bytes_transferred = sums[BYTES_TRANSFERRED];
+    counters.errors = sums[ERRORS];
+    return counters;
+}
+
+utils::LatencySummary UrbMetrics::GetLatency(UrbLatencyKind kind, UsbTransferType type) const {
+    utils::LatencyHistogram merged;
+    size_t kind_index = static_cast<size_t>(kind);
+    size_t type_index = static_cast<size_t>(type) % URB_TRANSFER_TYPE_COUNT;
+    for (ThreadBlock* block = blocks_.load(std::memory_order_acquire); block; block = block->next) {
+        for (const auto& slot : block->latency[kind_index][type_index]) {
+            if (const utils::LatencyHistogram* histogram = slot.load(std::memory_order_acquire)) {
+                merged.Merge(*histogram);
+            }
+        }
+    }
+    return merged.Summarize();
+}
+
+std::vector<EndpointLatency> UrbMetrics::GetEndpointLatencies(UrbLatencyKind kind) const {
+    std::vector<EndpointLatency> result;
+    size_t kind_index = static_cast<size_t>(kind);
+    utils::LatencyHistogram merged;
+    for (size_t type = 0; type < URB_TRANSFER_TYPE_COUNT; ++type) {
+        for (size_t endpoint = 0; endpoint < ENDPOINT_COUNT; ++endpoint) {
+            merged.Reset();
+            for (ThreadBlock* block = blocks_.load(std::memory_order_acquire); block; block = block->next) {
+                if (const utils::LatencyHistogram* histogram =
+                        block->latency[kind_index][type][endpoint].load(std::memory_order_acquire)) {
+                    merged.Merge(*histogram);
+                }
+            }
+            if (merged.Count() > 0) {
+                EndpointLatency entry;
+                entry.type = static_cast<UsbTransferType>(type);
+                entry.endpoint = EndpointAddress(endpoint);
+                entry.latency = merged.Summarize();
+                result.push_back(entry);
+            }
+        }
+    }
+    return result;
+}
+
+void UrbMetrics::Reset() {
+    for (ThreadBlock* block = blocks_.load(std::memory_order_acquire); block; block = block->next) {
+        for (auto& counter : block->counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto& kind : block->latency) {
+            for (auto& type : kind) {
+                for (auto& slot : type) {
+                    if (utils::LatencyHistogram* histogram = slot.load(std::memory_order_acquire)) {
+                        histogram->Reset();
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "usb_types.h"
+#include "utils/latency_histogram.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// URB延迟的种类
+enum class UrbLatencyKind : uint8_t {
+    END_TO_END = 0,         // URB生成（设备数据到达）到收到接收端的USBIP_RET_SUBMIT
+    DEVICE_TRANSFER = 1     // libusb传输从提交到完成
+};
+static constexpr size_t URB_LATENCY_KIND_COUNT = 2;
+static constexpr size_t URB_TRANSFER_TYPE_COUNT = 4;    // 按UsbTransferType索引
+
+// URB计数（各线程计数块之和）
+struct UrbCounters {
+    uint64_t total_urbs = 0;
+    uint64_t control_urbs = 0;
+    uint64_t bulk_urbs = 0;
+    uint64_t interrupt_urbs = 0;
+    uint64_t iso_urbs = 0;
+    uint64_t bytes_transferred = 0;
+    uint64_t errors = 0;
+};
+
+// 单个端点上某类延迟的分布
+struct EndpointLatency {
+    UsbTransferType type = UsbTransferType::CONTROL;
+    uint8_t endpoint = 0;           // 端点地址，IN方向带0x80
+    utils::LatencySummary latency;
+};
+
+// URB计数和延迟直方图。每个记录线程第一次记录时分配自己的计数块（按缓存行对齐），
+// 之后只写本线程的块，不加锁也没有跨核的缓存行争用；读取时遍历所有块求和、合并直方图。
+// 直方图按延迟种类、传输类型和端点分开，首次记录到某个组合时才分配
+class UrbMetrics {
+public:
+    static constexpr size_t ENDPOINT_COUNT = 32;    // 16个端点号 x 2个方向
+
+    UrbMetrics();
+    ~UrbMetrics();
+
+    // 禁止拷贝
+    UrbMetrics(const UrbMetrics&) = delete;
+    UrbMetrics& operator=(const UrbMetrics&) = delete;
+
+    // 计入一个已捕获的URB
+    void RecordUrb(const UsbUrb& urb);
+    // endpoint为端点地址（IN方向带0x80），控制传输为0或0x80
+    void RecordLatency(UrbLatencyKind kind, UsbTransferType type, uint8_t endpoint, uint64_t latency_us);
+
+    // 读取不加锁，各计数分别读取，彼此之间不是同一时刻的快照
+    UrbCounters GetCounters() const;
+    // 某类传输在所有端点上的延迟分布
+    utils::LatencySummary GetLatency(UrbLatencyKind kind, UsbTransferType type) const;
+    // 有记录的各端点（按传输类型区分）的延迟分布
+    std::vector<EndpointLatency> GetEndpointLatencies(UrbLatencyKind kind) const;
+
+    // 清零（与并发的记录之间不同步，清零期间的少量记录可能丢失）
+    void Reset();
+
+private:
+    enum Counter : size_t {
+        TOTAL_URBS,
+        CONTROL_URBS,
+        BULK_URBS,
+        INTERRUPT_URBS,
+        ISO_URBS,
+        BYTES_TRANSFERRED,
+        ERRORS,
+        COUNTER_COUNT
+    };
+
+    // 只由owner线程写入，读改写不需要原子指令
+    struct alignas(64) ThreadBlock {
+        std::thread::id owner;
+        ThreadBlock* next = nullptr;
+        std::atomic<uint64_t> counters[COUNTER_COUNT];
+        std::atomic<utils::LatencyHistogram*> latency[URB_LATENCY_KIND_COUNT][URB_TRANSFER_TYPE_COUNT][ENDPOINT_COUNT];
+
+        ThreadBlock();
+        ~ThreadBlock();
+        void Add(Counter counter, uint64_t value) {
+            counters[counter].store(counters[counter].load(std::memory_order_relaxed) + value,
+                                    std::memory_order_relaxed);
+        }
+    };
+
+    static size_t EndpointIndex(uint8_t endpoint) {
+        return (endpoint & 0x0F) | ((endpoint & 0x80) ? 0x10 : 0);
+    }
+    static uint8_t EndpointAddress(size_t index) {
+        return static_cast<uint8_t>((index & 0x0F) | ((index & 0x10) ? 0x80 : 0));
+    }
+
+    // 当前线程的计数块，首次调用时创建并挂到链表上
+    ThreadBlock& LocalBlock();
+
+    const uint64_t id_;                     // 区分实例，线程局部缓存以此为键
+    std::atomic<ThreadBlock*> blocks_;      // 只增不减，析构时释放
+};
+
+} // namespace protocol
+} // namespace usb_redirector
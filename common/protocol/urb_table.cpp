@@ -0,0 +1,185 @@
+#include "urb_table.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+namespace usb_redirector {
+namespace protocol {
+
+static uint64_t NowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UrbTable::UrbTable(size_t max_concurrent_urbs)
+    : max_concurrent_(std::max<size_t>(1, max_concurrent_urbs))
+    , size_(0) {
+    // 槽数取不小于两倍最大并发数的2的幂，负载因子不超过0.5，探测链很短
+    size_t capacity = 1;
+    while (capacity < max_concurrent_ * 2) {
+        capacity <<= 1;
+    }
+    slots_.resize(capacity);
+    mask_ = capacity - 1;
+    std::fill(depth_, depth_ + ENDPOINT_COUNT, 0);
+}
+
+size_t UrbTable::HomeSlot(uint32_t seqnum) const {
+    // seqnum基本连续，乘法散列打散到各槽
+    return (static_cast<uint64_t>(seqnum) * 0x9E3779B97F4A7C15ull >> 32) & mask_;
+}
+
+size_t UrbTable::FindSlot(uint32_t seqnum) const {
+    for (size_t index = HomeSlot(seqnum); slots_[index].used; index = (index + 1) & mask_) {
+        if (slots_[index].urb.seqnum == seqnum) {
+            return index;
+        }
+    }
+    return slots_.size();
+}
+
+void UrbTable::EraseSlot(size_t index) {
+    Slot& erased = slots_[index];
+    depth_[EndpointIndex(erased.urb.endpoint, erased.urb.direction)]--;
+    erased.used = false;
+    erased.callback = nullptr;
+    --size_;
+
+    // 后移删除：把探测链上越过空位的记录移回，保持查找不中断
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask_; slots_[next].used; next = (next + 1) & mask_) {
+        size_t home = HomeSlot(slots_[next].urb.seqnum);
+        // home不在(hole, next]区间内时，该记录可以移到空位
+        bool movable = (hole <= next) ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            slots_[hole] = std::move(slots_[next]);
+            slots_[next].used = false;
+            slots_[next].callback = nullptr;
+            hole = next;
+        }
+    }
+}
+
+bool UrbTable::Insert(uint32_t seqnum, uint8_t endpoint, UsbDirection direction,
+                      uint8_t* buffer, size_t buffer_length, CompletionCallback callback) {
+    InflightUrb urb;
+    urb.seqnum = seqnum;
+    urb.endpoint = endpoint;
+    urb.direction = direction;
+    urb.buffer = buffer;
+    urb.buffer_length = buffer_length;
+    return Insert(urb, std::move(callback));
+}
+
+bool UrbTable::Insert(const InflightUrb& urb, CompletionCallback callback) {
+    uint32_t seqnum = urb.seqnum;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (size_ >= max_concurrent_) {
+        return false;
+    }
+
+    size_t index = HomeSlot(seqnum);
+    for (; slots_[index].used; index = (index + 1) & mask_) {
+        if (slots_[index].urb.seqnum == seqnum) {
+            return false;
+        }
+    }
+
+    Slot& slot = slots_[index];
+    slot.used = true;
+    slot.urb = urb;
+    slot.urb.submit_time_us = NowMicroseconds();
+    slot.callback = std::move(callback);
+
+    depth_[EndpointIndex(urb.endpoint, urb.direction)]++;
+    ++size_;
+    return true;
+}
+
+bool UrbTable::Complete(uint32_t seqnum, int32_t status, const uint8_t* data, size_t len,
+                        InflightUrb* completed) {
+    InflightUrb urb;
+    CompletionCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t index = FindSlot(seqnum);
+        if (index == slots_.size()) {
+            return false;
+        }
+        urb = slots_[index].urb;
+        callback = std::move(slots_[index].callback);
+        EraseSlot(index);
+    }
+
+    if (urb.buffer && data && len > 0) {
+        std::memcpy(urb.buffer, data, std::min(len, urb.buffer_length));
+    }
+
+    if (callback) {
+        callback(urb, status, data, len);
+    }
+    if (completed) {
+        *completed = urb;
+    }
+    return true;
+}
+
+bool UrbTable::Remove(uint32_t seqnum, InflightUrb* removed) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t index = FindSlot(seqnum);
+    if (index == slots_.size()) {
+        return false;
+    }
+    if (removed) {
+        *removed = slots_[index].urb;
+    }
+    EraseSlot(index);
+    return true;
+}
+
+bool UrbTable::Lookup(uint32_t seqnum, InflightUrb& urb) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t index = FindSlot(seqnum);
+    if (index == slots_.size()) {
+        return false;
+    }
+    urb = slots_[index].urb;
+    return true;
+}
+
+size_t UrbTable::CancelAll(int32_t status) {
+    std::vector<std::pair<InflightUrb, CompletionCallback>> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& slot : slots_) {
+            if (slot.used) {
+                cancelled.emplace_back(slot.urb, std::move(slot.callback));
+                slot.used = false;
+                slot.callback = nullptr;
+            }
+        }
+        size_ = 0;
+        std::fill(depth_, depth_ + ENDPOINT_COUNT, 0);
+    }
+
+    for (auto& entry : cancelled) {
+        if (entry.second) {
+            entry.second(entry.first, status, nullptr, 0);
+        }
+    }
+    return cancelled.size();
+}
+
+size_t UrbTable::Size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+}
+
+size_t UrbTable::QueueDepth(uint8_t endpoint, UsbDirection direction) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depth_[EndpointIndex(endpoint, direction)];
+}
+
+} // namespace protocol
+} // namespace usb_redirector
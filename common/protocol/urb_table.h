@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include "usb_types.h"
+
+namespace usb_redirector {
+namespace protocol {
+
+// 一个在途URB的记录
+struct InflightUrb {
+    uint32_t seqnum = 0;
+    uint8_t endpoint = 0;               // 端点号
+    UsbDirection direction = UsbDirection::OUT;
+    UsbTransferType type = UsbTransferType::BULK;
+    uint64_t capture_time_us = 0;       // URB生成时间（UsbUrb::timestamp），用于端到端延迟
+    uint64_t submit_time_us = 0;        // 提交时间（steady_clock，微秒），登记时填写
+    uint8_t* buffer = nullptr;          // 接收数据的缓冲区，可为空（调用方保证完成前有效）
+    size_t buffer_length = 0;
+};
+
+// 在途URB表：以seqnum为键的开放寻址哈希表（线性探测，删除时后移而不留墓碑），
+// 构造时按最大并发数一次性分配。请求发出时登记，收到USBIP_RET_SUBMIT时按seqnum配对完成
+class UrbTable {
+public:
+    // 完成回调：data为响应数据（已拷贝到登记的缓冲区），在表锁之外调用
+    using CompletionCallback = std::function<void(const InflightUrb& urb, int32_t status,
+                                                  const uint8_t* data, size_t len)>;
+
+    static constexpr size_t DEFAULT_MAX_CONCURRENT_URBS = 256;
+    static constexpr size_t ENDPOINT_COUNT = 32;    // 16个端点号 x 2个方向
+
+    explicit UrbTable(size_t max_concurrent_urbs = DEFAULT_MAX_CONCURRENT_URBS);
+    ~UrbTable() = default;
+
+    // 禁止拷贝
+    UrbTable(const UrbTable&) = delete;
+    UrbTable& operator=(const UrbTable&) = delete;
+
+    // 登记在途URB，表满或seqnum重复时返回false
+    bool Insert(uint32_t seqnum, uint8_t endpoint, UsbDirection direction,
+                uint8_t* buffer = nullptr, size_t buffer_length = 0,
+                CompletionCallback callback = nullptr);
+    // 按记录登记（submit_time_us由表填写）
+    bool Insert(const InflightUrb& urb, CompletionCallback callback = nullptr);
+
+    // 按seqnum完成：拷贝响应数据到登记的缓冲区并调用回调，未找到时返回false。
+    // completed非空时返回被完成的记录
+    bool Complete(uint32_t seqnum, int32_t status, const uint8_t* data = nullptr, size_t len = 0,
+                  InflightUrb* completed = nullptr);
+
+    // 取出记录但不调用回调（如请求被撤销）
+    bool Remove(uint32_t seqnum, InflightUrb* removed = nullptr);
+
+    // 查询记录
+    bool Lookup(uint32_t seqnum, InflightUrb& urb) const;
+
+    // 以指定状态完成所有在途URB（如连接断开），返回完成的数量
+    size_t CancelAll(int32_t status);
+
+    size_t Size() const;
+    size_t MaxConcurrent() const { return max_concurrent_; }
+
+    // 某个端点（按端点号和方向区分）上的在途URB数量
+    size_t QueueDepth(uint8_t endpoint, UsbDirection direction) const;
+
+private:
+    struct Slot {
+        bool used = false;
+        InflightUrb urb;
+        CompletionCallback callback;
+    };
+
+    static size_t EndpointIndex(uint8_t endpoint, UsbDirection direction) {
+        return (endpoint & 0x0F) | (direction == UsbDirection::IN ? 0x10 : 0);
+    }
+    size_t HomeSlot(uint32_t seqnum) const;
+    size_t FindSlot(uint32_t seqnum) const;     // 未找到返回slots_.size()
+    void EraseSlot(size_t index);               // 删除并后移后续探测链
+
+    size_t max_concurrent_;
+    size_t mask_;
+    std::vector<Slot> slots_;
+    size_t size_;
+    size_t depth_[ENDPOINT_COUNT];
+    mutable std::mutex mutex_;
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include "utils/buffer_pool.h"
 
 namespace usb_redirector {
 namespace protocol {
@@ -77,7 +78,8 @@ enum class UsbDescriptorType : uint8_t {
     ENDPOINT = 0x05,
     DEVICE_QUALIFIER = 0x06,
     OTHER_SPEED_CONFIGURATION = 0x07,
-    INTERFACE_POWER = 0x08
+    INTERFACE_POWER = 0x08,
+    SS_ENDPOINT_COMPANION = 0x30
 };
 
 // USB设备描述符
@@ -143,13 +145,14 @@ struct UsbSetupPacket {
 } __attribute__((packed));
 
 // URB (USB Request Block)
+// 沿处理链路按值传递并移动，数据缓冲随之转移而不拷贝
 struct UsbUrb {
     uint32_t id;                    // URB唯一标识
     UsbTransferType type;           // 传输类型
     UsbDirection direction;         // 传输方向
     uint8_t endpoint;               // 端点地址
     uint32_t flags;                 // 传输标志
-    std::vector<uint8_t> data;      // 数据缓冲区
+    utils::PooledBuffer data;       // 数据缓冲区（池化、引用计数，URB拷贝时共享）
     UsbSetupPacket setup;           // Setup包(仅控制传输)
     int32_t status;                 // 传输状态
     uint32_t actual_length;         // 实际传输长度
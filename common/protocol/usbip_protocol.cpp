@@ -6,8 +6,6 @@
 namespace usb_redirector {
 namespace protocol {
 
-uint32_t UsbipProtocol::next_seqnum_ = 1;
-
 std::vector<uint8_t> UsbipProtocol::SerializeDeviceList(const std::vector<UsbipDeviceInfo>& devices) {
     std::vector<uint8_t> buffer;
     
@@ -79,6 +77,26 @@ std::vector<uint8_t> UsbipProtocol::SerializeRetSubmit(const UsbipRetSubmit& ret
     return buffer;
 }
 
+std::vector<uint8_t> UsbipProtocol::SerializeCmdUnlink(const UsbipCmdUnlink& cmd) {
+    std::vector<uint8_t> buffer(sizeof(UsbipCmdUnlink));
+    
+    UsbipCmdUnlink net_cmd = cmd;
+    HostToNetwork(net_cmd);
+    
+    std::memcpy(buffer.data(), &net_cmd, sizeof(UsbipCmdUnlink));
+    return buffer;
+}
+
+std::vector<uint8_t> UsbipProtocol::SerializeRetUnlink(const UsbipRetUnlink& ret) {
+    std::vector<uint8_t> buffer(sizeof(UsbipRetUnlink));
+    
+    UsbipRetUnlink net_ret = ret;
+    HostToNetwork(net_ret);
+    
+    std::memcpy(buffer.data(), &net_ret, sizeof(UsbipRetUnlink));
+    return buffer;
+}
+
 bool UsbipProtocol::ParseHeader(const uint8_t* data, size_t len, UsbipHeader& header) {
     if (len < sizeof(UsbipHeader)) {
         return false;
@@ -109,6 +127,26 @@ bool UsbipProtocol::ParseRetSubmit(const uint8_t* data, size_t len, UsbipRetSubm
     return true;
 }
 
+bool UsbipProtocol::ParseCmdUnlink(const uint8_t* data, size_t len, UsbipCmdUnlink& cmd) {
+    if (len < sizeof(UsbipCmdUnlink)) {
+        return false;
+    }
+    
+    std::memcpy(&cmd, data, sizeof(UsbipCmdUnlink));
+    NetworkToHost(cmd);
+    return true;
+}
+
+bool UsbipProtocol::ParseRetUnlink(const uint8_t* data, size_t len, UsbipRetUnlink& ret) {
+    if (len < sizeof(UsbipRetUnlink)) {
+        return false;
+    }
+    
+    std::memcpy(&ret, data, sizeof(UsbipRetUnlink));
+    NetworkToHost(ret);
+    return true;
+}
+
 void UsbipProtocol::HostToNetwork(UsbipHeader& header) {
     header.command = htonl(header.command);
     header.seqnum = htonl(header.seqnum);
@@ -162,5 +200,25 @@ void UsbipProtocol::NetworkToHost(UsbipRetSubmit& ret) {
     ret.error_count = ntohl(ret.error_count);
 }
 
+void UsbipProtocol::HostToNetwork(UsbipCmdUnlink& cmd) {
+    HostToNetwork(cmd.header);
+    cmd.unlink_seqnum = htonl(cmd.unlink_seqnum);
+}
+
+void UsbipProtocol::NetworkToHost(UsbipCmdUnlink& cmd) {
+    NetworkToHost(cmd.header);
+    cmd.unlink_seqnum = ntohl(cmd.unlink_seqnum);
+}
+
+void UsbipProtocol::HostToNetwork(UsbipRetUnlink& ret) {
+    HostToNetwork(ret.header);
+    ret.status = htonl(ret.status);
+}
+
+void UsbipProtocol::NetworkToHost(UsbipRetUnlink& ret) {
+    NetworkToHost(ret.header);
+    ret.status = ntohl(ret.status);
+}
+
 } // namespace protocol
 } // namespace usb_redirector
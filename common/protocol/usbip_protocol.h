@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 namespace usb_redirector {
 namespace protocol {
@@ -54,6 +55,20 @@ struct UsbipRetSubmit {
     int32_t error_count;
 } __attribute__((packed));
 
+// URB撤销命令（与CMD_SUBMIT同为48字节）
+struct UsbipCmdUnlink {
+    UsbipHeader header;
+    uint32_t unlink_seqnum;     // 要撤销的CMD_SUBMIT的seqnum
+    uint8_t padding[24];
+} __attribute__((packed));
+
+// URB撤销返回：status为-ECONNRESET表示已撤销，0表示URB在撤销前已经完成
+struct UsbipRetUnlink {
+    UsbipHeader header;
+    int32_t status;
+    uint8_t padding[24];
+} __attribute__((packed));
+
 // 设备信息
 struct UsbipDeviceInfo {
     char path[256];
@@ -72,6 +87,30 @@ struct UsbipDeviceInfo {
     uint8_t bNumInterfaces;
 } __attribute__((packed));
 
+// 会话内的序列号空间：由连接持有，多个线程可并发无锁分配。
+// 独占一个缓存行避免与相邻数据伪共享；回绕时跳过0（0表示未分配）
+class alignas(64) SequenceSpace {
+public:
+    explicit SequenceSpace(uint32_t first = 1) : next_(first) {}
+
+    SequenceSpace(const SequenceSpace&) = delete;
+    SequenceSpace& operator=(const SequenceSpace&) = delete;
+
+    uint32_t Next() {
+        uint32_t value = next_.fetch_add(1, std::memory_order_relaxed);
+        if (value == 0) {
+            value = next_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    // 新会话开始时重置
+    void Reset(uint32_t first = 1) { next_.store(first, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> next_;
+};
+
 class UsbipProtocol {
 public:
     UsbipProtocol() = default;
@@ -81,10 +120,14 @@ public:
     static std::vector<uint8_t> SerializeDeviceList(const std::vector<UsbipDeviceInfo>& devices);
     static std::vector<uint8_t> SerializeCmdSubmit(const UsbipCmdSubmit& cmd, const uint8_t* data = nullptr, size_t data_len = 0);
     static std::vector<uint8_t> SerializeRetSubmit(const UsbipRetSubmit& ret, const uint8_t* data = nullptr, size_t data_len = 0);
+    static std::vector<uint8_t> SerializeCmdUnlink(const UsbipCmdUnlink& cmd);
+    static std::vector<uint8_t> SerializeRetUnlink(const UsbipRetUnlink& ret);
     
     static bool ParseHeader(const uint8_t* data, size_t len, UsbipHeader& header);
     static bool ParseCmdSubmit(const uint8_t* data, size_t len, UsbipCmdSubmit& cmd);
     static bool ParseRetSubmit(const uint8_t* data, size_t len, UsbipRetSubmit& ret);
+    static bool ParseCmdUnlink(const uint8_t* data, size_t len, UsbipCmdUnlink& cmd);
+    static bool ParseRetUnlink(const uint8_t* data, size_t len, UsbipRetUnlink& ret);
 
     // 字节序转换
     static void HostToNetwork(UsbipHeader& header);
@@ -93,9 +136,10 @@ public:
     static void NetworkToHost(UsbipCmdSubmit& cmd);
     static void HostToNetwork(UsbipRetSubmit& ret);
     static void NetworkToHost(UsbipRetSubmit& ret);
-
-private:
-    static uint32_t next_seqnum_;
+    static void HostToNetwork(UsbipCmdUnlink& cmd);
+    static void NetworkToHost(UsbipCmdUnlink& cmd);
+    static void HostToNetwork(UsbipRetUnlink& ret);
+    static void NetworkToHost(UsbipRetUnlink& ret);
 };
 
 } // namespace protocol
@@ -0,0 +1,210 @@
+#include "write_coalescer.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace usb_redirector {
+namespace protocol {
+
+WriteCoalescer::WriteCoalescer(uint32_t block_size, const WriteCoalescerConfig& config, WriteFunction write_function)
+    : block_size_(std::max<uint32_t>(1, block_size))
+    , config_(config)
+    , write_function_(std::move(write_function))
+    , pending_bytes_(0)
+    , deferred_error_(false)
+    , stopping_(false) {
+    flush_thread_ = std::thread(&WriteCoalescer::FlushThread, this);
+}
+
+WriteCoalescer::~WriteCoalescer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    pending_changed_.notify_all();
+
+    if (flush_thread_.joinable()) {
+        flush_thread_.join();
+    }
+
+    if (!FlushAll()) {
+        LOG_ERROR("Failed to write back pending data on shutdown");
+    }
+}
+
+void WriteCoalescer::Insert(ExtentMap& extents, uint64_t lba, uint32_t block_count, const uint8_t* data) {
+    const size_t length = static_cast<size_t>(block_count) * block_size_;
+    const uint64_t end = lba + block_count;
+
+    // 找出与新区段重叠或相邻的已有区段[first, last)
+    auto first = extents.upper_bound(lba);
+    if (first != extents.begin()) {
+        auto previous = std::prev(first);
+        if (previous->first + previous->second.size() / block_size_ >= lba) {
+            first = previous;
+        }
+    }
+    uint64_t merged_start = lba;
+    uint64_t merged_end = end;
+    auto last = first;
+    for (; last != extents.end() && last->first <= end; ++last) {
+        merged_start = std::min(merged_start, last->first);
+        merged_end = std::max<uint64_t>(merged_end, last->first + last->second.size() / block_size_);
+    }
+
+    if (first == last) {
+        extents.emplace(lba, std::vector<uint8_t>(data, data + length));
+        pending_bytes_ += length;
+        return;
+    }
+
+    // 顺序追加时沿用起始区段的缓冲区，其余区段拷入后再用新数据覆盖重叠部分
+    std::vector<uint8_t> merged;
+    auto it = first;
+    if (first->first == merged_start) {
+        merged = std::move(first->second);
+        pending_bytes_ -= merged.size();
+        ++it;
+    }
+    merged.resize(static_cast<size_t>(merged_end - merged_start) * block_size_);
+    for (; it != last; ++it) {
+        std::memcpy(merged.data() + (it->first - merged_start) * block_size_, it->second.data(), it->second.size());
+        pending_bytes_ -= it->second.size();
+    }
+    std::memcpy(merged.data() + (lba - merged_start) * block_size_, data, length);
+    pending_bytes_ += merged.size();
+
+    extents.erase(first, last);
+    extents.emplace(merged_start, std::move(merged));
+}
+
+void WriteCoalescer::Write(uint8_t lun, uint64_t lba, uint32_t block_count, const uint8_t* data) {
+    if (block_count == 0) {
+        return;
+    }
+
+    bool flush_now;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_bytes_ == 0) {
+            oldest_ = Clock::now();
+        }
+        Insert(pending_[lun % MAX_LUNS], lba, block_count, data);
+        stats_.writes_in++;
+        stats_.blocks_in += block_count;
+        flush_now = pending_bytes_ >= config_.max_pending_bytes;
+    }
+    pending_changed_.notify_one();
+
+    if (flush_now) {
+        FlushAll();
+    }
+}
+
+bool WriteCoalescer::WriteOut(std::vector<PendingExtent>& extents) {
+    bool ok = true;
+    for (auto& extent : extents) {
+        uint32_t block_count = static_cast<uint32_t>(extent.data.size() / block_size_);
+        bool written = write_function_(extent.lun, extent.lba, block_count, extent.data.data());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.device_writes++;
+        stats_.blocks_out += block_count;
+        if (!written) {
+            LOG_ERROR("Write-back failed at LBA " << extent.lba << " (" << block_count << " blocks)");
+            deferred_error_ = true;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool WriteCoalescer::FlushAll() {
+    std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+
+    std::vector<PendingExtent> extents;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t lun = 0; lun < MAX_LUNS; ++lun) {
+            for (auto& entry : pending_[lun]) {
+                extents.push_back({static_cast<uint8_t>(lun), entry.first, std::move(entry.second)});
+            }
+            pending_[lun].clear();
+        }
+        pending_bytes_ = 0;
+    }
+
+    return WriteOut(extents);
+}
+
+bool WriteCoalescer::FlushRange(uint8_t lun, uint64_t lba, uint32_t block_count) {
+    // 即使没有重叠的待写数据，也要等正在进行的写出完成
+    std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+
+    std::vector<PendingExtent> extents;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ExtentMap& pending = pending_[lun % MAX_LUNS];
+        const uint64_t end = lba + block_count;
+
+        auto it = pending.upper_bound(lba);
+        if (it != pending.begin()) {
+            auto previous = std::prev(it);
+            if (previous->first + previous->second.size() / block_size_ > lba) {
+                it = previous;
+            }
+        }
+        while (it != pending.end() && it->first < end) {
+            pending_bytes_ -= it->second.size();
+            extents.push_back({static_cast<uint8_t>(lun % MAX_LUNS), it->first, std::move(it->second)});
+            it = pending.erase(it);
+        }
+    }
+
+    return WriteOut(extents);
+}
+
+bool WriteCoalescer::Flush() {
+    bool ok = FlushAll();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.barriers++;
+    ok = ok && !deferred_error_;
+    deferred_error_ = false;
+    return ok;
+}
+
+size_t WriteCoalescer::PendingBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_bytes_;
+}
+
+WriteCoalescerStatistics WriteCoalescer::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void WriteCoalescer::FlushThread() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!stopping_) {
+        if (pending_bytes_ == 0) {
+            pending_changed_.wait(lock);
+            continue;
+        }
+
+        auto deadline = oldest_ + std::chrono::microseconds(config_.window_us);
+        if (Clock::now() < deadline) {
+            pending_changed_.wait_until(lock, deadline);
+            continue;
+        }
+
+        lock.unlock();
+        FlushAll();
+        lock.lock();
+    }
+}
+
+} // namespace protocol
+} // namespace usb_redirector
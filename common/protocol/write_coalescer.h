@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace usb_redirector {
+namespace protocol {
+
+// 写合并配置
+struct WriteCoalescerConfig {
+    size_t max_pending_bytes = 1024 * 1024;     // 待写数据达到此大小时立即写出，0表示关闭合并
+    uint32_t window_us = 2000;                  // 最早的待写数据最多停留的时间
+};
+
+// 写合并统计
+struct WriteCoalescerStatistics {
+    uint64_t writes_in = 0;         // 收到的WRITE命令数
+    uint64_t blocks_in = 0;
+    uint64_t device_writes = 0;     // 实际发往设备的写请求数
+    uint64_t blocks_out = 0;        // 实际写出的块数（重叠写入被吸收后少于blocks_in）
+    uint64_t barriers = 0;          // SYNCHRONIZE CACHE/FUA屏障次数
+
+    // 合并比：平均每次设备写承载的WRITE命令数
+    double CoalescingRatio() const {
+        return device_writes > 0 ? static_cast<double>(writes_in) / device_writes : 0.0;
+    }
+};
+
+// 写回合并：把相邻或重叠的小WRITE在短时间窗口或大小阈值内合并为大的连续写。
+// 后写入的数据覆盖重叠部分；待写数据在窗口到期、超过阈值、读到重叠范围或遇到屏障时写出。
+// 写回失败作为延迟错误在下一次Flush（屏障）时返回
+class WriteCoalescer {
+public:
+    using WriteFunction = std::function<bool(uint8_t lun, uint64_t lba, uint32_t block_count, const uint8_t* data)>;
+
+    static constexpr size_t MAX_LUNS = 16;
+
+    WriteCoalescer(uint32_t block_size, const WriteCoalescerConfig& config, WriteFunction write_function);
+    // 写出剩余数据
+    ~WriteCoalescer();
+
+    // 禁止拷贝
+    WriteCoalescer(const WriteCoalescer&) = delete;
+    WriteCoalescer& operator=(const WriteCoalescer&) = delete;
+
+    // 接收一次写入（拷贝数据），超过阈值时在调用线程上写出
+    void Write(uint8_t lun, uint64_t lba, uint32_t block_count, const uint8_t* data);
+
+    // 写出与该范围重叠的待写数据，读之前调用
+    bool FlushRange(uint8_t lun, uint64_t lba, uint32_t block_count);
+
+    // 屏障：写出全部待写数据，返回自上次屏障以来的写回是否全部成功
+    bool Flush();
+
+    size_t PendingBytes() const;
+    WriteCoalescerStatistics GetStatistics() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    // 每个LUN的待写区段，以起始LBA为键，互不重叠也不相邻
+    using ExtentMap = std::map<uint64_t, std::vector<uint8_t>>;
+
+    struct PendingExtent {
+        uint8_t lun;
+        uint64_t lba;
+        std::vector<uint8_t> data;
+    };
+
+    void Insert(ExtentMap& extents, uint64_t lba, uint32_t block_count, const uint8_t* data);   // 需持锁
+    bool WriteOut(std::vector<PendingExtent>& extents);    // 需持flush_mutex_
+    bool FlushAll();
+    void FlushThread();
+
+    uint32_t block_size_;
+    WriteCoalescerConfig config_;
+    WriteFunction write_function_;
+
+    ExtentMap pending_[MAX_LUNS];
+    size_t pending_bytes_;
+    Clock::time_point oldest_;              // 最早一笔待写数据的到达时间
+    bool deferred_error_;
+    WriteCoalescerStatistics stats_;
+
+    mutable std::mutex mutex_;
+    std::mutex flush_mutex_;                // 串行化写出，保证发往设备的顺序
+    std::condition_variable pending_changed_;
+    bool stopping_;
+    std::thread flush_thread_;
+};
+
+} // namespace protocol
+} // namespace usb_redirector
@@ -0,0 +1,133 @@
+#include "blake2b.h"
+#include <cstring>
+
+namespace usb_redirector {
+namespace utils {
+
+static constexpr size_t BLOCK_SIZE = 128;
+
+static constexpr uint64_t IV[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL
+};
+
+static constexpr uint8_t SIGMA[12][16] = {
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3},
+    {11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4},
+    { 7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8},
+    { 9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13},
+    { 2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9},
+    {12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11},
+    {13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10},
+    { 6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5},
+    {10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0},
+    { 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15},
+    {14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3}
+};
+
+static inline uint64_t RotateRight(uint64_t value, int bits) {
+    return (value >> bits) | (value << (64 - bits));
+}
+
+// 按小端读写，与参考实现的字节序一致
+static inline uint64_t ReadLe64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline void WriteLe64(uint8_t* p, uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    std::memcpy(p, &value, sizeof(value));
+}
+
+#define BLAKE2B_G(a, b, c, d, x, y)         \
+    do {                                    \
+        a = a + b + (x);                    \
+        d = RotateRight(d ^ a, 32);         \
+        c = c + d;                          \
+        b = RotateRight(b ^ c, 24);         \
+        a = a + b + (y);                    \
+        d = RotateRight(d ^ a, 16);         \
+        c = c + d;                          \
+        b = RotateRight(b ^ c, 63);         \
+    } while (0)
+
+// 压缩一个128字节的块；counter为到此块末尾为止已处理的字节数
+static void Compress(uint64_t h[8], const uint8_t* block, uint64_t counter, bool last) {
+    uint64_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = ReadLe64(block + i * 8);
+    }
+
+    uint64_t v[16];
+    for (int i = 0; i < 8; ++i) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    v[12] ^= counter;   // 计数器高64位恒为0：单次哈希的输入远小于2^64字节
+    if (last) {
+        v[14] = ~v[14];
+    }
+
+    for (int round = 0; round < 12; ++round) {
+        const uint8_t* s = SIGMA[round];
+        BLAKE2B_G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        BLAKE2B_G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        BLAKE2B_G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        BLAKE2B_G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        BLAKE2B_G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        BLAKE2B_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        BLAKE2B_G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        BLAKE2B_G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        h[i] ^= v[i] ^ v[i + 8];
+    }
+}
+
+#undef BLAKE2B_G
+
+void Blake2b(const uint8_t* data, size_t len, uint8_t* digest, size_t digest_length) {
+    if (digest_length == 0 || digest_length > BLAKE2B_MAX_DIGEST_SIZE) {
+        return;
+    }
+
+    uint64_t h[8];
+    for (int i = 0; i < 8; ++i) {
+        h[i] = IV[i];
+    }
+    // 参数块：摘要长度，无密钥，fanout和depth为1
+    h[0] ^= 0x01010000ULL ^ static_cast<uint64_t>(digest_length);
+
+    // 最后一块（可能不满或为空）单独处理，带结束标志
+    uint64_t counter = 0;
+    while (len > BLOCK_SIZE) {
+        counter += BLOCK_SIZE;
+        Compress(h, data, counter, false);
+        data += BLOCK_SIZE;
+        len -= BLOCK_SIZE;
+    }
+    uint8_t block[BLOCK_SIZE] = {};
+    if (len > 0) {
+        std::memcpy(block, data, len);
+    }
+    counter += len;
+    Compress(h, block, counter, true);
+
+    uint8_t out[BLAKE2B_MAX_DIGEST_SIZE];
+    for (int i = 0; i < 8; ++i) {
+        WriteLe64(out + i * 8, h[i]);
+    }
+    std::memcpy(digest, out, digest_length);
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace usb_redirector {
+namespace utils {
+
+static constexpr size_t BLAKE2B_MAX_DIGEST_SIZE = 64;
+
+// BLAKE2b（RFC 7693，无密钥）：加密哈希，输出与参考实现一致（跨平台、跨字节序稳定），
+// 可作为内容地址在两端之间传递。digest_length取1..64字节，不同长度的输出互不相同
+void Blake2b(const uint8_t* data, size_t len, uint8_t* digest, size_t digest_length);
+
+} // namespace utils
+} // namespace usb_redirector
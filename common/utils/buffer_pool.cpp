@@ -0,0 +1,270 @@
+#include "buffer_pool.h"
+#include <cstring>
+#include <new>
+
+namespace usb_redirector {
+namespace utils {
+
+BufferPool& BufferPool::Instance() {
+    // 有意不析构：全局和线程局部对象析构时还会释放缓冲区
+    static BufferPool* instance = new BufferPool();
+    return *instance;
+}
+
+BufferPool::BufferPool()
+    : acquires_(0)
+    , reuses_(0)
+    , heap_allocations_(0)
+    , oversized_(0) {
+}
+
+BufferPool::~BufferPool() {
+    Trim();
+}
+
+BufferPool::Block* BufferPool::Allocate(uint32_t size_class, size_t capacity) {
+    void* memory = ::operator new(sizeof(Block) + capacity);
+    Block* block = new (memory) Block;
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size_class = size_class;
+    block->capacity = capacity;
+    block->next = nullptr;
+    return block;
+}
+
+BufferPool::Block* BufferPool::Acquire(size_t size) {
+    acquires_.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t size_class = 0;
+    while (size_class < SIZE_CLASS_COUNT && SIZE_CLASSES[size_class] < size) {
+        ++size_class;
+    }
+    if (size_class == SIZE_CLASS_COUNT) {
+        oversized_.fetch_add(1, std::memory_order_relaxed);
+        heap_allocations_.fetch_add(1, std::memory_order_relaxed);
+        return Allocate(size_class, size);
+    }
+
+    FreeList& list = free_lists_[size_class];
+    {
+        std::lock_guard<std::mutex> lock(list.mutex);
+        if (list.head) {
+            Block* block = list.head;
+            list.head = block->next;
+            --list.count;
+            block->next = nullptr;
+            block->refs.store(1, std::memory_order_relaxed);
+            reuses_.fetch_add(1, std::memory_order_relaxed);
+            return block;
+        }
+    }
+
+    heap_allocations_.fetch_add(1, std::memory_order_relaxed);
+    return Allocate(size_class, SIZE_CLASSES[size_class]);
+}
+
+void BufferPool::Recycle(Block* block) {
+    if (block->size_class < SIZE_CLASS_COUNT) {
+        FreeList& list = free_lists_[block->size_class];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        if (list.count < MAX_CACHED_BLOCKS[block->size_class]) {
+            block->next = list.head;
+            list.head = block;
+            ++list.count;
+            return;
+        }
+    }
+
+    block->~Block();
+    ::operator delete(block);
+}
+
+void BufferPool::Trim() {
+    for (FreeList& list : free_lists_) {
+        Block* head = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(list.mutex);
+            head = list.head;
+            list.head = nullptr;
+            list.count = 0;
+        }
+        while (head) {
+            Block* next = head->next;
+            head->~Block();
+            ::operator delete(head);
+            head = next;
+        }
+    }
+}
+
+BufferPoolStatistics BufferPool::GetStatistics() const {
+    BufferPoolStatistics stats;
+    stats.acquires = acquires_.load(std::memory_order_relaxed);
+    stats.reuses = reuses_.load(std::memory_order_relaxed);
+    stats.heap_allocations = heap_allocations_.load(std::memory_order_relaxed);
+    stats.oversized = oversized_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        FreeList& list = const_cast<FreeList&>(free_lists_[i]);
+        std::lock_guard<std::mutex> lock(list.mutex);
+        stats.cached_blocks += list.count;
+        stats.cached_bytes += list.count * SIZE_CLASSES[i];
+    }
+    return stats;
+}
+
+PooledBuffer::PooledBuffer(size_t size)
+    : PooledBuffer() {
+    resize(size);
+}
+
+PooledBuffer::PooledBuffer(const uint8_t* data, size_t size)
+    : PooledBuffer() {
+    Assign(data, size);
+}
+
+PooledBuffer::PooledBuffer(std::initializer_list<uint8_t> data)
+    : PooledBuffer() {
+    Assign(data.begin(), data.size());
+}
+
+PooledBuffer::PooledBuffer(const std::vector<uint8_t>& data)
+    : PooledBuffer() {
+    Assign(data.data(), data.size());
+}
+
+PooledBuffer::PooledBuffer(const PooledBuffer& other) noexcept
+    : block_(other.block_)
+    , offset_(other.offset_)
+    , size_(other.size_) {
+    if (block_) {
+        block_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+PooledBuffer& PooledBuffer::operator=(const PooledBuffer& other) noexcept {
+    if (this != &other) {
+        if (other.block_) {
+            other.block_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Release();
+        block_ = other.block_;
+        offset_ = other.offset_;
+        size_ = other.size_;
+    }
+    return *this;
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : block_(other.block_)
+    , offset_(other.offset_)
+    , size_(other.size_) {
+    other.block_ = nullptr;
+    other.offset_ = 0;
+    other.size_ = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        Release();
+        block_ = other.block_;
+        offset_ = other.offset_;
+        size_ = other.size_;
+        other.block_ = nullptr;
+        other.offset_ = 0;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void PooledBuffer::Release() noexcept {
+    if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        BufferPool::Instance().Recycle(block_);
+    }
+    block_ = nullptr;
+    offset_ = 0;
+    size_ = 0;
+}
+
+void PooledBuffer::Reset(size_t capacity) {
+    if (block_ && !IsShared() && block_->capacity >= capacity) {
+        offset_ = 0;
+        size_ = 0;
+        return;
+    }
+    Release();
+    if (capacity > 0) {
+        block_ = BufferPool::Instance().Acquire(capacity);
+    }
+}
+
+void PooledBuffer::Reallocate(size_t capacity) {
+    capacity = std::max(capacity, size_);
+    BufferPool::Block* block = BufferPool::Instance().Acquire(capacity);
+    size_t size = size_;
+    if (size > 0) {
+        std::memcpy(block->Data(), block_->Data() + offset_, size);
+    }
+    Release();
+    block_ = block;
+    size_ = size;
+}
+
+void PooledBuffer::Assign(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        clear();
+        return;
+    }
+    // 数据可能来自本缓冲自身（共享时块由其他引用保持有效）
+    Reset(size);
+    std::memmove(block_->Data(), data, size);
+    size_ = size;
+}
+
+void PooledBuffer::resize(size_t size) {
+    if (size <= size_) {
+        size_ = size;
+        return;
+    }
+    if (size > capacity() || IsShared()) {
+        Reallocate(size);
+    }
+    std::memset(block_->Data() + offset_ + size_, 0, size - size_);
+    size_ = size;
+}
+
+void PooledBuffer::reserve(size_t capacity) {
+    if (capacity > this->capacity()) {
+        Reallocate(capacity);
+    }
+}
+
+void PooledBuffer::assign(size_t count, uint8_t value) {
+    Reset(count);
+    if (count > 0) {
+        std::memset(block_->Data(), value, count);
+    }
+    size_ = count;
+}
+
+void PooledBuffer::append(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    size_t required = size_ + size;
+    if (required > capacity() || IsShared()) {
+        Reallocate(std::max(required, size_ * 2));
+    }
+    std::memcpy(block_->Data() + offset_ + size_, data, size);
+    size_ = required;
+}
+
+PooledBuffer PooledBuffer::Slice(size_t offset, size_t length) const {
+    PooledBuffer slice(*this);
+    offset = std::min(offset, size_);
+    slice.offset_ += offset;
+    slice.size_ = std::min(length, size_ - offset);
+    return slice;
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+
+namespace usb_redirector {
+namespace utils {
+
+// 缓冲池统计
+struct BufferPoolStatistics {
+    uint64_t acquires = 0;          // 取出的块数
+    uint64_t reuses = 0;            // 其中命中空闲链表的块数
+    uint64_t heap_allocations = 0;  // 向堆申请的块数（含超大块）
+    uint64_t oversized = 0;         // 超过最大档位、不经池直接分配的块数
+    uint64_t cached_blocks = 0;     // 当前空闲链表中的块数
+    uint64_t cached_bytes = 0;
+};
+
+// 按大小分档的数据块池：512B、4KiB、64KiB、1MiB四档，每档一条空闲链表。
+// 块头部带引用计数，最后一个引用释放时块回到所在档位的链表，链表已满才交还堆；
+// 稳态下URB数据缓冲的取用和释放都不再分配内存。超过1MiB的请求直接向堆申请
+class BufferPool {
+public:
+    static constexpr size_t SIZE_CLASS_COUNT = 4;
+    static constexpr size_t SIZE_CLASSES[SIZE_CLASS_COUNT] = {512, 4096, 64 * 1024, 1024 * 1024};
+    // 每档最多缓存的空闲块数（每档约0.5~8MiB）
+    static constexpr size_t MAX_CACHED_BLOCKS[SIZE_CLASS_COUNT] = {1024, 512, 64, 8};
+
+    struct alignas(16) Block {
+        std::atomic<uint32_t> refs;
+        uint32_t size_class;        // SIZE_CLASS_COUNT表示超大块
+        size_t capacity;
+        Block* next;                // 空闲链表
+
+        uint8_t* Data() { return reinterpret_cast<uint8_t*>(this + 1); }
+    };
+
+    // 进程内共享的池，有意不析构（静态对象析构后仍可能有缓冲区释放）
+    static BufferPool& Instance();
+
+    BufferPool();
+    ~BufferPool();
+
+    // 禁止拷贝
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // 取一个容量不小于size的块，引用计数为1
+    Block* Acquire(size_t size);
+    // 引用计数已归零的块放回空闲链表
+    void Recycle(Block* block);
+
+    // 释放全部空闲块
+    void Trim();
+
+    BufferPoolStatistics GetStatistics() const;
+
+private:
+    struct alignas(64) FreeList {
+        std::mutex mutex;
+        Block* head = nullptr;
+        size_t count = 0;
+    };
+
+    static Block* Allocate(uint32_t size_class, size_t capacity);
+
+    FreeList free_lists_[SIZE_CLASS_COUNT];
+    std::atomic<uint64_t> acquires_;
+    std::atomic<uint64_t> reuses_;
+    std::atomic<uint64_t> heap_allocations_;
+    std::atomic<uint64_t> oversized_;
+};
+
+// 池化的字节缓冲，接口与std::vector<uint8_t>的常用部分一致。
+// 拷贝只增加引用计数，读访问（data、[]、begin等）总是直接读共享的块；写访问必须显式调用
+// mutable_data，多个缓冲共享同一块时先把内容复制到独占的新块，避免只读时意外触发整块复制。
+// Slice得到共享同一块的一段，用于零拷贝地切分数据。
+// 引用计数是原子的，缓冲可以在线程间传递，但同一个缓冲对象不能被并发修改
+class PooledBuffer {
+public:
+    using value_type = uint8_t;
+    using size_type = size_t;
+    using iterator = const uint8_t*;
+    using const_iterator = const uint8_t*;
+
+    PooledBuffer() noexcept : block_(nullptr), offset_(0), size_(0) {}
+    explicit PooledBuffer(size_t size);
+    PooledBuffer(const uint8_t* data, size_t size);
+    PooledBuffer(std::initializer_list<uint8_t> data);
+    PooledBuffer(const std::vector<uint8_t>& data);
+    ~PooledBuffer() { Release(); }
+
+    PooledBuffer(const PooledBuffer& other) noexcept;
+    PooledBuffer& operator=(const PooledBuffer& other) noexcept;
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return block_ ? block_->capacity - offset_ : 0; }
+
+    const uint8_t* data() const { return block_ ? block_->Data() + offset_ : nullptr; }
+    // 可写的数据指针：与其他缓冲共享时先复制出独占的块
+    uint8_t* mutable_data() {
+        Detach();
+        return block_ ? block_->Data() + offset_ : nullptr;
+    }
+    const uint8_t& operator[](size_t index) const { return data()[index]; }
+
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size_; }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    // 新增的字节清零，与std::vector一致
+    void resize(size_t size);
+    void reserve(size_t capacity);
+    void clear() { size_ = 0; }
+
+    void assign(size_t count, uint8_t value);
+    void assign(const uint8_t* first, const uint8_t* last) { Assign(first, static_cast<size_t>(last - first)); }
+    template <typename InputIt, typename = std::enable_if_t<!std::is_integral<InputIt>::value>>
+    void assign(InputIt first, InputIt last) {
+        size_t count = static_cast<size_t>(std::distance(first, last));
+        Reset(count);
+        std::copy(first, last, block_ ? block_->Data() : nullptr);
+        size_ = count;
+    }
+
+    // 在末尾追加数据
+    void append(const uint8_t* data, size_t size);
+
+    // 与本缓冲共享同一块的[offset, offset+length)，越界部分截掉
+    PooledBuffer Slice(size_t offset, size_t length) const;
+
+    // 与其他缓冲共享数据块
+    bool IsShared() const { return block_ && block_->refs.load(std::memory_order_acquire) > 1; }
+
+    std::vector<uint8_t> ToVector() const { return std::vector<uint8_t>(begin(), end()); }
+
+    friend bool operator==(const PooledBuffer& a, const PooledBuffer& b) {
+        return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const PooledBuffer& a, const PooledBuffer& b) { return !(a == b); }
+
+private:
+    void Assign(const uint8_t* data, size_t size);
+    // 丢弃内容，保证有独占的、容量不小于capacity的块
+    void Reset(size_t capacity);
+    // 保留前size_字节，换到独占的、容量不小于capacity的块
+    void Reallocate(size_t capacity);
+    // 共享时复制出独占的块
+    void Detach() {
+        if (IsShared()) {
+            Reallocate(size_);
+        }
+    }
+    void Release() noexcept;
+
+    BufferPool::Block* block_;
+    size_t offset_;     // Slice得到的缓冲从块内偏移处开始
+    size_t size_;
+};
+
+} // namespace utils
+} // namespace usb_redirector
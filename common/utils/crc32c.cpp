@@ -0,0 +1,155 @@
+#include "crc32c.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define USB_REDIRECTOR_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define USB_REDIRECTOR_CRC32C_ARM 1
+#endif
+
+namespace usb_redirector {
+namespace utils {
+
+static constexpr uint32_t CRC32C_POLY = 0x82F63B78; // 反射形式的Castagnoli多项式
+
+// slicing-by-8查表：table[k][b]为字节b后跟k个零字节的CRC
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+static const Crc32cTables& GetTables() {
+    static const Crc32cTables tables;
+    return tables;
+}
+
+uint32_t Crc32cPortable(const uint8_t* data, size_t len, uint32_t crc) {
+    const auto& t = GetTables().table;
+    crc = ~crc;
+
+    while (len >= 8) {
+        uint32_t lo;
+        uint32_t hi;
+        std::memcpy(&lo, data, 4);
+        std::memcpy(&hi, data + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+
+    while (len--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+
+    return ~crc;
+}
+
+#if defined(USB_REDIRECTOR_CRC32C_X86)
+__attribute__((target("sse4.2")))
+static uint32_t Crc32cHardware(const uint8_t* data, size_t len, uint32_t crc) {
+    crc = ~crc;
+
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t value;
+        std::memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+        data += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+
+    while (len >= 4) {
+        uint32_t value;
+        std::memcpy(&value, data, 4);
+        crc = _mm_crc32_u32(crc, value);
+        data += 4;
+        len -= 4;
+    }
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+
+    return ~crc;
+}
+#elif defined(USB_REDIRECTOR_CRC32C_ARM)
+static uint32_t Crc32cHardware(const uint8_t* data, size_t len, uint32_t crc) {
+    crc = ~crc;
+
+    while (len >= 8) {
+        uint64_t value;
+        std::memcpy(&value, data, 8);
+        crc = __crc32cd(crc, value);
+        data += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = __crc32cb(crc, *data++);
+    }
+
+    return ~crc;
+}
+#endif
+
+using Crc32cFunction = uint32_t (*)(const uint8_t*, size_t, uint32_t);
+
+// 首次调用时选择实现
+static Crc32cFunction SelectImplementation(const char** name) {
+#if defined(USB_REDIRECTOR_CRC32C_X86)
+    if (__builtin_cpu_supports("sse4.2")) {
+        *name = "sse4.2";
+        return Crc32cHardware;
+    }
+#elif defined(USB_REDIRECTOR_CRC32C_ARM)
+    *name = "armv8";
+    return Crc32cHardware;
+#endif
+    *name = "slicing-by-8";
+    return Crc32cPortable;
+}
+
+struct Crc32cSelection {
+    const char* name = nullptr;
+    Crc32cFunction function = SelectImplementation(&name);
+};
+
+// 函数内静态变量：其他编译单元的静态初始化中调用Crc32c时也已完成选择
+static const Crc32cSelection& Selection() {
+    static const Crc32cSelection selection;
+    return selection;
+}
+
+uint32_t Crc32c(const uint8_t* data, size_t len, uint32_t crc) {
+    return Selection().function(data, len, crc);
+}
+
+const char* Crc32cImplementation() {
+    return Selection().name;
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace usb_redirector {
+namespace utils {
+
+// CRC32C (Castagnoli)：运行时检测CPU，x86使用SSE4.2 crc32指令，ARMv8使用CRC扩展，
+// 否则使用slicing-by-8查表实现。crc参数用于分段计算（传入上一段的结果）
+uint32_t Crc32c(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+// 可移植的slicing-by-8实现（用于测试和基准对比）
+uint32_t Crc32cPortable(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+// 当前使用的实现名称："sse4.2"、"armv8"或"slicing-by-8"
+const char* Crc32cImplementation();
+
+} // namespace utils
+} // namespace usb_redirector
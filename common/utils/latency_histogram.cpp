@@ -0,0 +1,119 @@
+#include "latency_histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace usb_redirector {
+namespace utils {
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0)
+    , sum_(0)
+    , max_(0) {
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+    if (exponent > MAX_EXPONENT) {
+        return BUCKET_COUNT - 1;
+    }
+    // 最高位之后的SUB_BUCKET_BITS位决定子桶
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    return static_cast<size_t>((exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT +
+                               ((value >> shift) & (SUB_BUCKET_COUNT - 1)));
+}
+
+uint64_t LatencyHistogram::BucketLowerBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    unsigned shift = static_cast<unsigned>(index / SUB_BUCKET_COUNT) - 1;
+    return (SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    unsigned shift = static_cast<unsigned>(index / SUB_BUCKET_COUNT) - 1;
+    return BucketLowerBound(index) + (1ull << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    counts_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        uint64_t count = other.counts_[i].load(std::memory_order_relaxed);
+        if (count > 0) {
+            counts_[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+    count_.fetch_add(other.count_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum_.fetch_add(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint64_t value = other.max_.load(std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+    uint64_t count = Count();
+    return count > 0 ? static_cast<double>(Sum()) / count : 0.0;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+    // 以各桶计数之和为准：并发写入时count_可能与桶计数略有出入
+    uint64_t total = 0;
+    for (const auto& count : counts_) {
+        total += count.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    p = std::min(std::max(p, 0.0), 1.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts_[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), Max());
+        }
+    }
+    return Max();
+}
+
+LatencySummary LatencyHistogram::Summarize() const {
+    LatencySummary summary;
+    summary.count = Count();
+    summary.p50_us = Percentile(0.50);
+    summary.p99_us = Percentile(0.99);
+    summary.p999_us = Percentile(0.999);
+    summary.max_us = Max();
+    summary.mean_us = Mean();
+    return summary;
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+namespace usb_redirector {
+namespace utils {
+
+// 延迟分布摘要（微秒）
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t p50_us = 0;
+    uint64_t p99_us = 0;
+    uint64_t p999_us = 0;
+    uint64_t max_us = 0;
+    double mean_us = 0;
+};
+
+// HDR风格的对数分桶直方图：小于16的值各占一个桶，此后每个2的幂区间等分为16个子桶，
+// 相对误差不超过1/16。值的单位由调用方决定（本项目统一用微秒），超出范围的计入最后一个桶。
+// 记录只是几次无竞争的原子加法，不加锁也不分配内存；读取时可以把多个直方图合并后再求分位数
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr uint64_t SUB_BUCKET_COUNT = 1ull << SUB_BUCKET_BITS;
+    static constexpr unsigned MAX_EXPONENT = 35;     // 最高精确记录到2^36-1（微秒约19小时）
+    static constexpr size_t BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT;
+
+    LatencyHistogram();
+
+    // 禁止拷贝（计数是原子变量），用Merge合并
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    // 可被多个线程并发调用
+    void Record(uint64_t value);
+    // 累加other的计数（other可能仍在被写入，结果不是同一时刻的快照）
+    void Merge(const LatencyHistogram& other);
+    void Reset();
+
+    uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t Sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t Max() const { return max_.load(std::memory_order_relaxed); }
+    double Mean() const;
+    // 第p分位（0~1）所在桶的上界，不超过记录过的最大值；没有记录时返回0
+    uint64_t Percentile(double p) const;
+    LatencySummary Summarize() const;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketLowerBound(size_t index);
+    static uint64_t BucketUpperBound(size_t index);
+
+private:
+    std::atomic<uint64_t> counts_[BUCKET_COUNT];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+};
+
+} // namespace utils
+} // namespace usb_redirector
@@ -1,7 +1,9 @@
 #include "logger.h"
-#include <iostream>
-#include <iomanip>
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 // 避免与系统DEBUG宏冲突
@@ -12,60 +14,338 @@
 namespace usb_redirector {
 namespace utils {
 
+// 后台线程定期醒来写出，日志最多延迟这么久；队列过半时提交线程才提前唤醒它
+static constexpr auto WRITER_INTERVAL = std::chrono::milliseconds(10);
+static constexpr size_t WAKE_THRESHOLD = Logger::THREAD_QUEUE_SIZE / 2;
+// 源文件位置后缀 " (file:line)" 的最大长度
+static constexpr size_t MAX_LOCATION_LENGTH = 96;
+
+std::atomic<int> Logger::min_level_{static_cast<int>(LogLevel::INFO)};
+
+// 线程局部状态：指针和标志本身没有析构函数，线程退出过程中（holder析构之后）仍可安全读取。
+// holder析构时把队列标记为已退出交给后台线程释放，之后本线程的日志同步写出
+struct ThreadQueueHolder {
+    static thread_local Logger::ThreadQueue* queue;
+    static thread_local LogMessage::Formatter* formatter;
+    static thread_local bool exiting;
+
+    bool registered = false;
+
+    ~ThreadQueueHolder() {
+        exiting = true;
+        if (queue) {
+            queue->retired.store(true, std::memory_order_release);
+            queue = nullptr;
+        }
+        delete formatter;
+        formatter = nullptr;
+    }
+};
+
+thread_local Logger::ThreadQueue* ThreadQueueHolder::queue = nullptr;
+thread_local LogMessage::Formatter* ThreadQueueHolder::formatter = nullptr;
+thread_local bool ThreadQueueHolder::exiting = false;
+static thread_local ThreadQueueHolder t_holder;
+
 Logger& Logger::Instance() {
-    static Logger instance;
-    return instance;
+    // 有意不析构：静态对象析构时还会写日志。退出时写完剩余日志并停止后台线程
+    static Logger* instance = []() {
+        Logger* logger = new Logger();
+        std::atexit([]() { Logger::Instance().Shutdown(); });
+        return logger;
+    }();
+    return *instance;
+}
+
+Logger::Logger()
+    : running_(true)
+    , flush_requested_(0)
+    , flush_completed_(0)
+    , console_output_(true)
+    , cached_second_(-1) {
+    cached_time_[0] = '\0';
+    batch_.reserve(WRITE_BATCH_SIZE);
+    batch_text_.reserve(WRITE_BATCH_SIZE * 128);
+    writer_ = std::thread(&Logger::WriterThread, this);
 }
 
 void Logger::SetLogFile(const std::string& filename) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lock(output_mutex_);
     log_file_ = std::make_unique<std::ofstream>(filename, std::ios::app);
 }
 
+void Logger::SetConsoleOutput(bool enable) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    console_output_ = enable;
+}
+
+uint64_t Logger::NowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+Logger::ThreadQueue* Logger::LocalQueue() {
+    ThreadQueue* queue = ThreadQueueHolder::queue;
+    if (queue || ThreadQueueHolder::exiting) {
+        return queue;
+    }
+
+    // 本线程第一次写日志：分配队列并登记，holder在线程退出时交还
+    queue = new ThreadQueue();
+    {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues_.push_back(queue);
+    }
+    t_holder.registered = true;
+    ThreadQueueHolder::queue = queue;
+    return queue;
+}
+
 void Logger::Log(LogLevel level, const std::string& message) {
-    if (level < log_level_) {
+    if (IsEnabled(level)) {
+        Write(level, message.data(), message.size());
+    }
+}
+
+void Logger::Log(LogLevel level, const std::string& file, int line, const std::string& message) {
+    if (!IsEnabled(level)) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::string filename = file.substr(file.find_last_of("/\\") + 1);
+    std::string full_message = message + " (" + filename + ":" + std::to_string(line) + ")";
+    Write(level, full_message.data(), full_message.size());
+}
+
+void Logger::Write(LogLevel level, const char* text, size_t length) {
+    length = std::min(length, MESSAGE_CAPACITY);
+    uint64_t now = NowNs();
 
-    std::string timestamp = GetTimestamp();
-    std::string level_str = GetLogLevelString(level);
-    std::string log_line = "[" + timestamp + "] [" + level_str + "] " + message;
+    ThreadQueue* queue = running_.load(std::memory_order_acquire) ? LocalQueue() : nullptr;
+    if (!queue) {
+        WriteSync(level, text, length, now);
+        return;
+    }
 
-    if (console_output_) {
-        std::cout << log_line << std::endl;
+    // 队列已满：唤醒后台线程并等它腾出空间
+    uint64_t tail = queue->tail.load(std::memory_order_relaxed);
+    while (tail - queue->head.load(std::memory_order_acquire) >= THREAD_QUEUE_SIZE) {
+        if (!running_.load(std::memory_order_acquire)) {
+            WriteSync(level, text, length, now);
+            return;
+        }
+        ready_.Notify();
+        std::this_thread::yield();
+    }
+
+    Record& record = queue->records[tail % THREAD_QUEUE_SIZE];
+    record.time_ns = now;
+    record.length = static_cast<uint32_t>(length);
+    record.level = level;
+    std::memcpy(record.text, text, length);
+    queue->tail.store(tail + 1, std::memory_order_release);
+
+    // 后台线程按周期写出；只在队列刚好过半时唤醒一次，不让每次提交都进入内核
+    if (level == LogLevel::FATAL) {
+        Flush();
+    } else if (tail + 1 - queue->head.load(std::memory_order_relaxed) == WAKE_THRESHOLD) {
+        ready_.Notify();
+    }
+}
+
+void Logger::WriteSync(LogLevel level, const char* text, size_t length, uint64_t time_ns) {
+    std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+    // 先写出已排队的日志，保持先后顺序
+    while (DrainQueues() > 0) {
+    }
+
+    Record record;
+    record.time_ns = time_ns;
+    record.length = static_cast<uint32_t>(length);
+    record.level = level;
+    std::memcpy(record.text, text, length);
+
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    batch_text_.clear();
+    FormatRecord(record, batch_text_);
+    WriteOutput(batch_text_);
+}
+
+size_t Logger::DrainQueues() {
+    bool any_retired = false;
+    {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        drain_queues_.assign(queues_.begin(), queues_.end());
     }
 
+    // 各队列中已提交的日志一起按时间排序，多个线程的日志交错时仍按先后写出
+    batch_.clear();
+    taken_.assign(drain_queues_.size(), 0);
+    for (size_t i = 0; i < drain_queues_.size() && batch_.size() < WRITE_BATCH_SIZE; ++i) {
+        ThreadQueue* queue = drain_queues_[i];
+        if (queue->retired.load(std::memory_order_acquire)) {
+            any_retired = true;
+        }
+        uint64_t head = queue->head.load(std::memory_order_relaxed);
+        uint64_t tail = queue->tail.load(std::memory_order_acquire);
+        uint64_t count = std::min<uint64_t>(tail - head, WRITE_BATCH_SIZE - batch_.size());
+        for (uint64_t k = 0; k < count; ++k) {
+            batch_.emplace_back(&queue->records[(head + k) % THREAD_QUEUE_SIZE], i);
+        }
+        taken_[i] = count;
+    }
+
+    if (!batch_.empty()) {
+        std::stable_sort(batch_.begin(), batch_.end(),
+            [](const std::pair<const Record*, size_t>& a, const std::pair<const Record*, size_t>& b) {
+                return a.first->time_ns < b.first->time_ns;
+            });
+
+        {
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            batch_text_.clear();
+            for (const auto& entry : batch_) {
+                FormatRecord(*entry.first, batch_text_);
+            }
+            WriteOutput(batch_text_);
+        }
+
+        // 写出后才交还槽位
+        for (size_t i = 0; i < drain_queues_.size(); ++i) {
+            if (taken_[i] > 0) {
+                ThreadQueue* queue = drain_queues_[i];
+                queue->head.store(queue->head.load(std::memory_order_relaxed) + taken_[i],
+                                  std::memory_order_release);
+            }
+        }
+    }
+
+    // 释放所属线程已退出且已取空的队列
+    if (any_retired) {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        for (auto it = queues_.begin(); it != queues_.end();) {
+            ThreadQueue* queue = *it;
+            if (queue->retired.load(std::memory_order_acquire) &&
+                queue->head.load(std::memory_order_relaxed) == queue->tail.load(std::memory_order_acquire)) {
+                delete queue;
+                it = queues_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    return batch_.size();
+}
+
+void Logger::FormatRecord(const Record& record, std::string& out) {
+    // 时间戳的日期和时分秒部分按秒缓存，同一秒内只追加毫秒
+    int64_t second = static_cast<int64_t>(record.time_ns / 1000000000ull);
+    if (second != cached_second_) {
+        std::time_t time = static_cast<std::time_t>(second);
+        std::tm local = {};
+        localtime_r(&time, &local);
+        std::strftime(cached_time_, sizeof(cached_time_), "%Y-%m-%d %H:%M:%S", &local);
+        cached_second_ = second;
+    }
+    unsigned ms = static_cast<unsigned>(record.time_ns / 1000000ull % 1000);
+    char millis[4] = {static_cast<char>('0' + ms / 100), static_cast<char>('0' + ms / 10 % 10),
+                      static_cast<char>('0' + ms % 10), '\0'};
+
+    out += '[';
+    out += cached_time_;
+    out += '.';
+    out += millis;
+    out += "] [";
+    out += GetLogLevelString(record.level);
+    out += "] ";
+    out.append(record.text, record.length);
+    out += '\n';
+}
+
+void Logger::WriteOutput(const std::string& out) {
+    if (out.empty()) {
+        return;
+    }
+    if (console_output_) {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+    }
     if (log_file_ && log_file_->is_open()) {
-        *log_file_ << log_line << std::endl;
+        log_file_->write(out.data(), static_cast<std::streamsize>(out.size()));
         log_file_->flush();
     }
 }
 
-void Logger::Log(LogLevel level, const std::string& file, int line, const std::string& message) {
-    if (level < log_level_) {
+void Logger::WriterThread() {
+    while (running_.load(std::memory_order_acquire)) {
+        uint64_t requested = flush_requested_.load(std::memory_order_acquire);
+        size_t written;
+        {
+            std::lock_guard<std::mutex> lock(drain_mutex_);
+            written = DrainQueues();
+        }
+        if (written >= WRITE_BATCH_SIZE) {
+            // 积压较多，接着写
+            continue;
+        }
+
+        // 不满一批说明各队列都已取空，此前请求的Flush都已完成
+        {
+            std::lock_guard<std::mutex> lock(flush_mutex_);
+            if (requested > flush_completed_) {
+                flush_completed_ = requested;
+                flushed_.notify_all();
+            }
+        }
+
+        // 登记等待后再检查一次，避免错过睡眠前的Flush和停止请求
+        uint32_t epoch = ready_.PrepareWait();
+        if (!running_.load(std::memory_order_acquire) ||
+            flush_requested_.load(std::memory_order_acquire) != requested) {
+            ready_.CancelWait();
+            continue;
+        }
+        ready_.Wait(epoch, WRITER_INTERVAL);
+    }
+}
+
+void Logger::Flush() {
+    if (!running_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(drain_mutex_);
+        while (DrainQueues() > 0) {
+        }
         return;
     }
 
-    std::string filename = file.substr(file.find_last_of("/\\") + 1);
-    std::string full_message = message + " (" + filename + ":" + std::to_string(line) + ")";
-    Log(level, full_message);
+    uint64_t ticket = flush_requested_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    ready_.Notify();
+    std::unique_lock<std::mutex> lock(flush_mutex_);
+    flushed_.wait(lock, [this, ticket]() {
+        return flush_completed_ >= ticket || !running_.load(std::memory_order_acquire);
+    });
 }
 
-std::string Logger::GetTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        now.time_since_epoch()) % 1000;
+void Logger::Shutdown() {
+    if (running_.exchange(false)) {
+        ready_.Notify();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+    }
 
-    std::ostringstream oss;
-    oss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-    oss << '.' << std::setfill('0') << std::setw(3) << ms.count();
-    return oss.str();
+    {
+        std::lock_guard<std::mutex> lock(drain_mutex_);
+        while (DrainQueues() > 0) {
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        flush_completed_ = flush_requested_.load();
+    }
+    flushed_.notify_all();
 }
 
-std::string Logger::GetLogLevelString(LogLevel level) {
+const char* Logger::GetLogLevelString(LogLevel level) {
     switch (level) {
         case LogLevel::DEBUG:   return "DEBUG";
         case LogLevel::INFO:    return "INFO";
@@ -76,5 +356,69 @@ std::string Logger::GetLogLevelString(LogLevel level) {
     }
 }
 
+LogMessage::LogMessage(LogLevel level, const char* file, int line)
+    : level_(level)
+    , file_(file)
+    , line_(line)
+    , formatter_(ThreadQueueHolder::formatter) {
+    if (!formatter_ && !ThreadQueueHolder::exiting) {
+        formatter_ = new Formatter();
+        t_holder.registered = true;
+        ThreadQueueHolder::formatter = formatter_;
+    }
+    if (!formatter_ || formatter_->busy) {
+        // 格式化参数时又写了日志，或线程正在退出
+        nested_.reset(new Formatter());
+        formatter_ = nested_.get();
+    }
+    formatter_->busy = true;
+
+    // 复用的流恢复默认格式，上一条日志的std::hex等设置不会带过来
+    std::ostream& stream = formatter_->stream;
+    formatter_->buffer.Reset();
+    stream.clear();
+    stream.flags(std::ios_base::skipws | std::ios_base::dec);
+    stream.precision(6);
+    stream.width(0);
+    stream.fill(' ');
+}
+
+LogMessage::~LogMessage() {
+    LogBuffer& buffer = formatter_->buffer;
+
+    // 追加 " (file:line)"，消息过长时截断正文以保留位置
+    const char* name = file_;
+    for (const char* p = file_; *p; ++p) {
+        if (*p == '/' || *p == '\\') {
+            name = p + 1;
+        }
+    }
+    char digits[12];
+    size_t digit_count = 0;
+    unsigned line = line_ > 0 ? static_cast<unsigned>(line_) : 0;
+    do {
+        digits[digit_count++] = static_cast<char>('0' + line % 10);
+        line /= 10;
+    } while (line > 0);
+
+    char location[MAX_LOCATION_LENGTH];
+    size_t name_length = std::min(std::strlen(name), MAX_LOCATION_LENGTH - digit_count - 4);
+    size_t suffix = 0;
+    location[suffix++] = ' ';
+    location[suffix++] = '(';
+    std::memcpy(location + suffix, name, name_length);
+    suffix += name_length;
+    location[suffix++] = ':';
+    while (digit_count > 0) {
+        location[suffix++] = digits[--digit_count];
+    }
+    location[suffix++] = ')';
+    size_t length = std::min(buffer.Size(), Logger::MESSAGE_CAPACITY - suffix);
+    std::memcpy(buffer.Begin() + length, location, suffix);
+
+    Logger::Instance().Write(level_, buffer.Begin(), length + suffix);
+    formatter_->busy = false;
+}
+
 } // namespace utils
 } // namespace usb_redirector
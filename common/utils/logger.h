@@ -1,16 +1,30 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
 #include <string>
 #include <memory>
 #include <fstream>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <ostream>
 #include <sstream>
+#include <streambuf>
+#include "notifier.h"
 
 // 避免与系统DEBUG宏冲突
 #ifdef DEBUG
 #undef DEBUG
 #endif
 
+// 编译期最低日志级别（0=DEBUG ... 4=FATAL），低于它的日志宏编译后不留任何代码
+#ifndef USB_REDIRECTOR_MIN_LOG_LEVEL
+#define USB_REDIRECTOR_MIN_LOG_LEVEL 0
+#endif
+
 namespace usb_redirector {
 namespace utils {
 
@@ -22,16 +36,39 @@ enum class LogLevel {
     FATAL = 4
 };
 
+// 异步日志：日志宏先检查级别再格式化，消息格式化到线程局部的定长缓冲后放入本线程的
+// 单生产者环形队列，由后台线程按时间顺序成批写出（控制台和文件每批各写一次）。
+// 提交路径不加锁、不分配内存；超过MESSAGE_CAPACITY的消息被截断。
+// 队列满时提交线程等待后台线程腾出空间；后台线程未运行（Shutdown之后）时同步写出
 class Logger {
 public:
+    static constexpr size_t RECORD_SIZE = 512;
+    static constexpr size_t MESSAGE_CAPACITY = RECORD_SIZE - 16;
+    static constexpr size_t THREAD_QUEUE_SIZE = 256;    // 每个线程的队列可缓存的日志条数
+    static constexpr size_t WRITE_BATCH_SIZE = 1024;    // 后台线程每批最多写出的条数
+
+    // 进程内共享，有意不析构（静态对象析构时仍可能写日志），退出时由atexit写完剩余日志
     static Logger& Instance();
 
-    void SetLogLevel(LogLevel level) { log_level_ = level; }
+    // 运行期级别检查，宏在格式化之前调用
+    static bool IsEnabled(LogLevel level) {
+        return static_cast<int>(level) >= min_level_.load(std::memory_order_relaxed);
+    }
+
+    void SetLogLevel(LogLevel level) { min_level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    LogLevel GetLogLevel() const { return static_cast<LogLevel>(min_level_.load(std::memory_order_relaxed)); }
     void SetLogFile(const std::string& filename);
-    void SetConsoleOutput(bool enable) { console_output_ = enable; }
+    void SetConsoleOutput(bool enable);
 
     void Log(LogLevel level, const std::string& message);
     void Log(LogLevel level, const std::string& file, int line, const std::string& message);
+    // 提交已格式化的消息（不必以0结尾），不检查级别
+    void Write(LogLevel level, const char* text, size_t length);
+
+    // 等待此前提交的日志全部写出
+    void Flush();
+    // 写完剩余日志并停止后台线程，之后的日志同步写出
+    void Shutdown();
 
     // 便捷方法
     void Debug(const std::string& message) { Log(LogLevel::DEBUG, message); }
@@ -41,56 +78,122 @@ public:
     void Fatal(const std::string& message) { Log(LogLevel::FATAL, message); }
 
 private:
-    Logger() = default;
+    struct Record {
+        uint64_t time_ns;               // system_clock
+        uint32_t length;
+        LogLevel level;
+        char text[MESSAGE_CAPACITY];
+    };
+    static_assert(sizeof(Record) == RECORD_SIZE, "log record size");
+
+    // 单生产者（所属线程）/单消费者（后台线程）的环形队列
+    struct ThreadQueue {
+        Record records[THREAD_QUEUE_SIZE];
+        alignas(64) std::atomic<uint64_t> tail{0};     // 只由所属线程写
+        alignas(64) std::atomic<uint64_t> head{0};     // 只由后台线程写
+        std::atomic<bool> retired{false};              // 所属线程已退出，取空后释放
+    };
+    friend struct ThreadQueueHolder;
+
+    Logger();
     ~Logger() = default;
 
     Logger(const Logger&) = delete;
     Logger& operator=(const Logger&) = delete;
 
-    std::string GetTimestamp();
-    std::string GetLogLevelString(LogLevel level);
+    ThreadQueue* LocalQueue();
+    void WriterThread();
+    // 取出各队列中的日志，按时间排序后成批写出，返回写出的条数。需持drain_mutex_
+    size_t DrainQueues();
+    void WriteSync(LogLevel level, const char* text, size_t length, uint64_t time_ns);
+    // 把一条日志格式化追加到out，需持output_mutex_
+    void FormatRecord(const Record& record, std::string& out);
+    void WriteOutput(const std::string& out);
+
+    static const char* GetLogLevelString(LogLevel level);
+    static uint64_t NowNs();
+
+    static std::atomic<int> min_level_;
+
+    std::atomic<bool> running_;
+    std::thread writer_;
+    Notifier ready_;                            // 唤醒后台线程
 
-    LogLevel log_level_ = LogLevel::INFO;
-    bool console_output_ = true;
+    std::mutex queues_mutex_;                   // 保护queues_（线程注册和释放）
+    std::vector<ThreadQueue*> queues_;
+
+    std::mutex drain_mutex_;                    // 后台线程与Shutdown/同步写出互斥取队列
+    std::vector<ThreadQueue*> drain_queues_;    // 以下仅在持drain_mutex_时使用
+    std::vector<std::pair<const Record*, size_t>> batch_;  // (日志, 所属队列序号)
+    std::vector<uint64_t> taken_;
+    std::string batch_text_;
+
+    std::mutex flush_mutex_;
+    std::condition_variable flushed_;
+    std::atomic<uint64_t> flush_requested_;
+    uint64_t flush_completed_;                  // 受flush_mutex_保护
+
+    std::mutex output_mutex_;                   // 保护输出目标和时间戳缓存
+    bool console_output_;
     std::unique_ptr<std::ofstream> log_file_;
-    std::mutex mutex_;
+    int64_t cached_second_;
+    char cached_time_[24];                      // "YYYY-MM-DD HH:MM:SS"
 };
 
-// 日志宏
-#define LOG_DEBUG(msg) \
-    do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        usb_redirector::utils::Logger::Instance().Log(usb_redirector::utils::LogLevel::DEBUG, __FILE__, __LINE__, oss.str()); \
-    } while(0)
+// 日志宏使用的格式化缓冲：定长，写满后截断
+class LogBuffer : public std::streambuf {
+public:
+    LogBuffer() { Reset(); }
+    void Reset() { setp(data_, data_ + Logger::MESSAGE_CAPACITY); }
+    char* Begin() { return data_; }
+    size_t Size() const { return static_cast<size_t>(pptr() - pbase()); }
 
-#define LOG_INFO(msg) \
-    do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        usb_redirector::utils::Logger::Instance().Log(usb_redirector::utils::LogLevel::INFO, __FILE__, __LINE__, oss.str()); \
-    } while(0)
+private:
+    char data_[Logger::MESSAGE_CAPACITY];
+};
 
-#define LOG_WARNING(msg) \
-    do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        usb_redirector::utils::Logger::Instance().Log(usb_redirector::utils::LogLevel::WARNING, __FILE__, __LINE__, oss.str()); \
-    } while(0)
+// 一条日志的格式化过程：复用线程局部的流和缓冲（同一线程嵌套记录时临时新建），
+// 析构时附加源文件位置并提交
+class LogMessage {
+public:
+    LogMessage(LogLevel level, const char* file, int line);
+    ~LogMessage();
 
-#define LOG_ERROR(msg) \
-    do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        usb_redirector::utils::Logger::Instance().Log(usb_redirector::utils::LogLevel::ERROR, __FILE__, __LINE__, oss.str()); \
-    } while(0)
+    LogMessage(const LogMessage&) = delete;
+    LogMessage& operator=(const LogMessage&) = delete;
+
+    std::ostream& Stream() { return formatter_->stream; }
 
-#define LOG_FATAL(msg) \
+    struct Formatter {
+        Formatter() : stream(&buffer) {}
+        LogBuffer buffer;
+        std::ostream stream;
+        bool busy = false;
+    };
+
+private:
+    LogLevel level_;
+    const char* file_;
+    int line_;
+    Formatter* formatter_;
+    std::unique_ptr<Formatter> nested_;
+};
+
+// 日志宏：级别低于编译期下限时整条语句被优化掉；运行期级别不满足时不求值msg
+#define USB_REDIRECTOR_LOG(level, msg) \
     do { \
-        std::ostringstream oss; \
-        oss << msg; \
-        usb_redirector::utils::Logger::Instance().Log(usb_redirector::utils::LogLevel::FATAL, __FILE__, __LINE__, oss.str()); \
+        if (static_cast<int>(level) >= USB_REDIRECTOR_MIN_LOG_LEVEL && \
+            usb_redirector::utils::Logger::IsEnabled(level)) { \
+            usb_redirector::utils::LogMessage log_message_(level, __FILE__, __LINE__); \
+            log_message_.Stream() << msg; \
+        } \
     } while(0)
 
+#define LOG_DEBUG(msg) USB_REDIRECTOR_LOG(usb_redirector::utils::LogLevel::DEBUG, msg)
+#define LOG_INFO(msg) USB_REDIRECTOR_LOG(usb_redirector::utils::LogLevel::INFO, msg)
+#define LOG_WARNING(msg) USB_REDIRECTOR_LOG(usb_redirector::utils::LogLevel::WARNING, msg)
+#define LOG_ERROR(msg) USB_REDIRECTOR_LOG(usb_redirector::utils::LogLevel::ERROR, msg)
+#define LOG_FATAL(msg) USB_REDIRECTOR_LOG(usb_redirector::utils::LogLevel::FATAL, msg)
+
 } // namespace utils
 } // namespace usb_redirector
@@ -0,0 +1,206 @@
+#include "lz4.h"
+#include <algorithm>
+#include <cstring>
+
+namespace usb_redirector {
+namespace utils {
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t LAST_LITERALS = 5;     // 块末尾至少5字节为字面量
+static constexpr size_t MF_LIMIT = 12;         // 最后一个匹配须在块末尾12字节之前开始
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_LOG = 12;
+static constexpr int SKIP_TRIGGER = 6;         // 连续未命中时逐渐加大步长
+
+static inline uint32_t Read32(const uint8_t* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// 写入长度的扩展字节（255递减），返回新的写位置，空间不足时返回nullptr
+static inline uint8_t* WriteLength(uint8_t* op, const uint8_t* oend, size_t length) {
+    while (length >= 255) {
+        if (op >= oend) {
+            return nullptr;
+        }
+        *op++ = 255;
+        length -= 255;
+    }
+    if (op >= oend) {
+        return nullptr;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+// 输出一个序列：字面量加（可选的）匹配
+static uint8_t* WriteSequence(uint8_t* op, const uint8_t* oend, const uint8_t* literals, size_t literal_length,
+                              size_t offset, size_t match_length) {
+    if (op >= oend) {
+        return nullptr;
+    }
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15 && !(op = WriteLength(op, oend, literal_length - 15))) {
+        return nullptr;
+    }
+    if (static_cast<size_t>(oend - op) < literal_length) {
+        return nullptr;
+    }
+    if (literal_length > 0) {
+        std::memcpy(op, literals, literal_length);
+        op += literal_length;
+    }
+
+    if (match_length == 0) {
+        return op;
+    }
+    if (oend - op < 2) {
+        return nullptr;
+    }
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+
+    size_t extra = match_length - MIN_MATCH;
+    *token |= static_cast<uint8_t>(extra >= 15 ? 15 : extra);
+    if (extra >= 15) {
+        op = WriteLength(op, oend, extra - 15);
+    }
+    return op;
+}
+
+size_t Lz4Compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* iend = src + len;
+    uint8_t* op = dst;
+    const uint8_t* oend = dst + capacity;
+
+    if (len >= MF_LIMIT + 1) {
+        const uint8_t* mflimit = iend - MF_LIMIT;
+        const uint8_t* matchlimit = iend - LAST_LITERALS;
+        uint32_t table[1 << HASH_LOG] = {};     // 各哈希值最近一次出现的位置
+        uint32_t misses = 1u << SKIP_TRIGGER;
+
+        ++ip;
+        while (ip < mflimit) {
+            uint32_t h = Hash(Read32(ip));
+            const uint8_t* ref = src + table[h];
+            table[h] = static_cast<uint32_t>(ip - src);
+
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || Read32(ref) != Read32(ip)) {
+                ip += misses++ >> SKIP_TRIGGER;
+                continue;
+            }
+            misses = 1u << SKIP_TRIGGER;
+
+            // 向前扩展到上一序列末尾
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+
+            // 向后扩展，不越过块末尾的字面量区
+            const uint8_t* match_end = ip + MIN_MATCH;
+            const uint8_t* ref_end = ref + MIN_MATCH;
+            while (match_end < matchlimit && *match_end == *ref_end) {
+                ++match_end;
+                ++ref_end;
+            }
+
+            op = WriteSequence(op, oend, anchor, ip - anchor, ip - ref, match_end - ip);
+            if (!op) {
+                return 0;
+            }
+
+            ip = match_end;
+            anchor = ip;
+            // 把匹配末尾附近的位置放入表中，提高下一次命中的机会
+            if (ip < mflimit) {
+                table[Hash(Read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+            }
+        }
+    }
+
+    op = WriteSequence(op, oend, anchor, iend - anchor, 0, 0);
+    return op ? static_cast<size_t>(op - dst) : 0;
+}
+
+bool Lz4Decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+
+    // 读取长度扩展字节
+    auto read_length = [&ip, iend](size_t& length) {
+        uint8_t byte;
+        do {
+            if (ip >= iend) {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(literal_length)) {
+            return false;
+        }
+        if (literal_length > static_cast<size_t>(iend - ip) || literal_length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+        if (literal_length > 0) {
+            std::memcpy(op, ip, literal_length);
+            ip += literal_length;
+            op += literal_length;
+        }
+
+        // 最后一个序列只有字面量
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) {
+            return false;
+        }
+
+        size_t match_length = token & 0x0F;
+        if (match_length == 15 && !read_length(match_length)) {
+            return false;
+        }
+        match_length += MIN_MATCH;
+        if (match_length > static_cast<size_t>(oend - op)) {
+            return false;
+        }
+
+        // 源与目的可能重叠（offset小于匹配长度时为重复模式）：已输出的区域每次翻倍拷贝
+        const uint8_t* ref = op - offset;
+        while (match_length > 0) {
+            size_t chunk = std::min(match_length, static_cast<size_t>(op - ref));
+            std::memcpy(op, ref, chunk);
+            op += chunk;
+            match_length -= chunk;
+        }
+    }
+
+    return op == oend;
+}
+
+} // namespace utils
+} // namespace usb_redirector
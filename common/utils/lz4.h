@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace usb_redirector {
+namespace utils {
+
+// LZ4块格式编解码（与参考实现的LZ4_compress_default/LZ4_decompress_safe互通）。
+// 压缩使用单次哈希表贪心匹配；解压对任意输入都不会越界读写
+
+// 最坏情况下压缩结果的大小
+inline size_t Lz4CompressBound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+// 压缩src到dst，返回压缩后的字节数；dst容量不足时返回0
+size_t Lz4Compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+// 解压到dst，输出必须恰好为dst_len字节，数据损坏时返回false
+bool Lz4Decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len);
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <thread>
+
+namespace usb_redirector {
+namespace utils {
+
+// 有界的多生产者/单消费者无锁环形队列（按槽位序号的Vyukov算法）。
+// 生产者以CAS抢占写位置，写入后发布槽位序号；消费者独占读位置，取出后把槽位交还给下一圈。
+// 队列满时TryPush立即返回false且不移动元素，由调用方决定等待还是丢弃。
+// 容量向上取整为2的幂；元素类型需可默认构造和移动赋值
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t min_capacity)
+        : capacity_(RoundUp(min_capacity))
+        , mask_(capacity_ - 1)
+        , slots_(new Slot[capacity_])
+        , tail_(0)
+        , head_(0) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 禁止拷贝
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    size_t Capacity() const { return capacity_; }
+
+    // 近似的元素个数（并发时只作参考）
+    size_t SizeApprox() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    // 生产者：成功时移走value；队列满时返回false，value保持不变
+    bool TryPush(T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots_[pos & mask_];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPush(T&& value) { return TryPush(value); }
+
+    // 消费者：队列为空（或队首的生产者尚未写完）时返回false
+    bool TryPop(T& out) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[pos & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            return false;
+        }
+        out = std::move(slot.value);
+        slot.sequence.store(pos + capacity_, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 消费者：一次取出最多max_count个元素交给handler(T&&)。
+    // 每个元素先移出再交还槽位，handler执行期间生产者已可复用该槽位
+    template <typename Handler>
+    size_t Drain(size_t max_count, Handler&& handler) {
+        size_t count = 0;
+        T value;
+        while (count < max_count && TryPop(value)) {
+            handler(std::move(value));
+            ++count;
+        }
+        return count;
+    }
+
+    // 消费者视角的空判断
+    bool Empty() const {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        return slots_[pos & mask_].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    // 消费者：睡眠前短暂自旋等待，生产者紧接着投递时省去一次唤醒。返回是否等到了元素
+    bool SpinUntilNotEmpty(size_t iterations) const {
+        for (size_t i = 0; i < iterations; ++i) {
+            if (!Empty()) {
+                return true;
+            }
+            std::this_thread::yield();
+        }
+        return !Empty();
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t RoundUp(size_t n) {
+        size_t capacity = 2;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> tail_;     // 生产者共享
+    alignas(64) std::atomic<size_t> head_;     // 仅消费者写
+};
+
+} // namespace utils
+} // namespace usb_redirector
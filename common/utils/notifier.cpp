@@ -0,0 +1,68 @@
+#include "notifier.h"
+#include <climits>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+namespace usb_redirector {
+namespace utils {
+
+Notifier::Notifier()
+    : epoch_(0)
+    , waiters_(0)
+    , wakes_(0) {
+}
+
+uint32_t Notifier::PrepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    // 与Notify中的屏障配对：要么通知方看到等待方，要么等待方随后看到已发布的数据
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+}
+
+void Notifier::CancelWait() {
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool Notifier::Wait(uint32_t epoch, std::chrono::milliseconds timeout) {
+#if defined(__linux__)
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    ts.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000);
+    // 计数已变化时futex立即返回
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, epoch, &ts, nullptr, 0);
+#else
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, timeout, [this, epoch]() { return epoch_.load(std::memory_order_acquire) != epoch; });
+    }
+#endif
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return epoch_.load(std::memory_order_acquire) != epoch;
+}
+
+void Notifier::Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+    wakes_.fetch_add(1, std::memory_order_relaxed);
+#if defined(__linux__)
+    epoch_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    {
+        // 在锁内递增，避免等待方检查谓词与睡眠之间丢失通知
+        std::lock_guard<std::mutex> lock(mutex_);
+        epoch_.fetch_add(1, std::memory_order_release);
+    }
+    cv_.notify_all();
+#endif
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#if !defined(__linux__)
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace usb_redirector {
+namespace utils {
+
+// 事件计数器，配合无锁队列做睡眠/唤醒。等待方的用法：
+//   uint32_t epoch = notifier.PrepareWait();
+//   if (条件已满足) { notifier.CancelWait(); } else { notifier.Wait(epoch, timeout); }
+// 通知方先发布数据再调用Notify()。只有存在等待方时Notify才递增计数并进入内核
+// （Linux上为futex，其他平台为条件变量），等待方忙碌时通知只是一次原子读。
+class Notifier {
+public:
+    Notifier();
+
+    // 禁止拷贝
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    // 登记为等待方并返回当前计数，之后必须调用Wait或CancelWait之一
+    uint32_t PrepareWait();
+    void CancelWait();
+    // 计数仍等于epoch时睡眠，直到被通知或超时。返回是否被通知
+    bool Wait(uint32_t epoch, std::chrono::milliseconds timeout);
+
+    // 唤醒所有等待方
+    void Notify();
+
+    // 实际进入内核唤醒的次数
+    uint64_t WakeCount() const { return wakes_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> epoch_;
+    std::atomic<uint32_t> waiters_;
+    std::atomic<uint64_t> wakes_;
+#if !defined(__linux__)
+    std::mutex mutex_;
+    std::condition_variable cv_;
+#endif
+};
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,127 @@
+#include "ring_buffer.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <atomic>
+#include <algorithm>
+
+namespace usb_redirector {
+namespace utils {
+
+// 创建匿名共享内存对象，返回fd
+static int CreateSharedMemory(size_t size) {
+#if defined(__linux__)
+    int fd = memfd_create("usb_ring_buffer", MFD_CLOEXEC);
+#else
+    // macOS没有memfd，使用立即取消链接的POSIX共享内存
+    static std::atomic<uint32_t> counter{0};
+    std::string name = "/usb_ring." + std::to_string(getpid()) + "." + std::to_string(counter++);
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name.c_str());
+    }
+#endif
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+RingBuffer::RingBuffer(size_t min_capacity)
+    : data_(nullptr)
+    , capacity_(0)
+    , read_offset_(0)
+    , size_(0)
+    , mirrored_(false) {
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    capacity_ = (std::max<size_t>(min_capacity, 1) + page_size - 1) / page_size * page_size;
+
+    if (!MapMirror()) {
+        data_ = static_cast<uint8_t*>(std::malloc(capacity_));
+        if (!data_) {
+            capacity_ = 0;
+        }
+    }
+}
+
+RingBuffer::~RingBuffer() {
+    if (mirrored_) {
+        munmap(data_, capacity_ * 2);
+    } else {
+        std::free(data_);
+    }
+}
+
+bool RingBuffer::MapMirror() {
+    int fd = CreateSharedMemory(capacity_);
+    if (fd < 0) {
+        return false;
+    }
+
+    // 先保留两倍大小的地址空间，再把同一对象固定映射到前后两半
+    void* base = mmap(nullptr, capacity_ * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    uint8_t* first = static_cast<uint8_t*>(base);
+    bool ok = mmap(first, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == first &&
+              mmap(first + capacity_, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ==
+                  first + capacity_;
+    close(fd);
+
+    if (!ok) {
+        munmap(base, capacity_ * 2);
+        return false;
+    }
+
+    data_ = first;
+    mirrored_ = true;
+    return true;
+}
+
+bool RingBuffer::Append(const uint8_t* data, size_t len) {
+    if (len > Available()) {
+        return false;
+    }
+
+    if (!mirrored_ && read_offset_ + size_ + len > capacity_) {
+        std::memmove(data_, data_ + read_offset_, size_);
+        read_offset_ = 0;
+    }
+
+    // 双重映射下写入位置之后的capacity_ - size_字节都是连续的
+    std::memcpy(data_ + read_offset_ + size_, data, len);
+    size_ += len;
+    return true;
+}
+
+void RingBuffer::Consume(size_t len) {
+    if (len >= size_) {
+        Clear();
+        return;
+    }
+
+    size_ -= len;
+    read_offset_ += len;
+    if (read_offset_ >= capacity_) {
+        read_offset_ -= capacity_;
+    }
+}
+
+void RingBuffer::Clear() {
+    read_offset_ = 0;
+    size_ = 0;
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace usb_redirector {
+namespace utils {
+
+// 双重映射的环形缓冲区：同一块内存在虚拟地址上连续映射两次，
+// 从读位置开始的全部可读数据总是连续的，回绕时无需拷贝。
+// 无法建立双重映射时退化为普通缓冲区，写入空间不足时把未读数据移到开头。
+class RingBuffer {
+public:
+    // 容量向上取整到页大小
+    explicit RingBuffer(size_t min_capacity);
+    ~RingBuffer();
+
+    // 禁止拷贝
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    size_t Capacity() const { return capacity_; }
+    size_t Size() const { return size_; }
+    size_t Available() const { return capacity_ - size_; }
+    bool Empty() const { return size_ == 0; }
+    bool IsMirrored() const { return mirrored_; }
+
+    // 可读数据的起始位置（Size()字节连续可读）
+    const uint8_t* Data() const { return data_ + read_offset_; }
+
+    // 追加数据，空间不足时返回false
+    bool Append(const uint8_t* data, size_t len);
+
+    // 丢弃前len字节
+    void Consume(size_t len);
+    void Clear();
+
+private:
+    bool MapMirror();
+
+    uint8_t* data_;
+    size_t capacity_;
+    size_t read_offset_;    // 始终小于capacity_
+    size_t size_;
+    bool mirrored_;
+};
+
+} // namespace utils
+} // namespace usb_redirector
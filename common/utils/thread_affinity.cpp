@@ -0,0 +1,78 @@
+#include "thread_affinity.h"
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+namespace usb_redirector {
+namespace utils {
+
+bool PinCurrentThread(int cpu) {
+    if (cpu < 0) {
+        return false;
+    }
+#if defined(__linux__)
+    if (cpu >= CPU_SETSIZE || cpu >= MAX_CPUS) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(__APPLE__)
+    // 标签0表示不设置亲和性
+    thread_affinity_policy_data_t policy = {cpu + 1};
+    mach_port_t thread = mach_thread_self();
+    kern_return_t result = thread_policy_set(thread, THREAD_AFFINITY_POLICY,
+                                             reinterpret_cast<thread_policy_t>(&policy),
+                                             THREAD_AFFINITY_POLICY_COUNT);
+    mach_port_deallocate(mach_task_self(), thread);
+    return result == KERN_SUCCESS;
+#else
+    return false;
+#endif
+}
+
+bool ParseCpuList(const std::string& text, std::vector<int>& cpus) {
+    cpus.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find(',', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t dash = item.find('-');
+        char* rest = nullptr;
+        long first = std::strtol(item.c_str(), &rest, 10);
+        if (item.empty() || rest == item.c_str() || first < 0 || first >= MAX_CPUS) {
+            return false;
+        }
+        long last = first;
+        if (dash != std::string::npos) {
+            const char* range_end = item.c_str() + dash + 1;
+            last = std::strtol(range_end, &rest, 10);
+            // 先检查范围再展开，写错的上界不会生成大量编号
+            if (rest == range_end || last < first || last >= MAX_CPUS) {
+                return false;
+            }
+        }
+        if (*rest != '\0') {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus.empty();
+}
+
+} // namespace utils
+} // namespace usb_redirector
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace usb_redirector {
+namespace utils {
+
+// 把调用线程绑定到指定CPU，返回是否设置成功。Linux上为硬亲和性；
+// macOS不支持绑定核心，改为设置亲和性标签，提示调度器把标签不同的线程分散到不同的L2缓存域
+bool PinCurrentThread(int cpu);
+
+// CPU编号上限（与Linux的CPU_SETSIZE一致）
+constexpr int MAX_CPUS = 1024;
+
+// 解析"0,2,4-7"形式的CPU列表，格式错误或编号不小于MAX_CPUS时返回false
+bool ParseCpuList(const std::string& text, std::vector<int>& cpus);
+
+} // namespace utils
+} // namespace usb_redirector
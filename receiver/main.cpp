@@ -6,6 +6,7 @@
 
 #include "usbip/usbip_client.h"
 #include "virtual_device/virtual_usb_device.h"
+#include "network/event_loop.h"
 #include "utils/logger.h"
 
 using namespace usb_redirector;
@@ -44,6 +45,27 @@ public:
         return true;
     }
     
+    void SetChecksumMode(network::ChecksumMode mode) {
+        usbip_client_->SetChecksumMode(mode);
+    }
+    
+    void SetCompressionConfig(const network::CompressionConfig& config) {
+        usbip_client_->SetCompressionConfig(config);
+    }
+    
+    // 相同的READ数据只经网络传输一次，之后由dedup目录下的本地副本应答
+    bool EnableDedupCache(const std::string& directory, uint64_t max_bytes) {
+        return usbip_client_->EnableDedupCache(directory, max_bytes);
+    }
+    
+    // 导入的大容量存储设备改由本地磁盘镜像应答；给出overlay目录时镜像只读共享，
+    // 每个设备的写入落在该目录下各自的写时复制层
+    void SetDiskImage(const std::string& path, uint64_t create_bytes, const std::string& overlay_dir) {
+        disk_image_ = path;
+        disk_image_bytes_ = create_bytes;
+        overlay_dir_ = overlay_dir;
+    }
+    
     bool Start(const std::string& host = "", uint16_t port = 0) {
         if (running_) {
             return true;
@@ -95,6 +117,31 @@ public:
         // 断开USBIP连接
         usbip_client_->Disconnect();
         
+        auto dedup = usbip_client_->GetDedupStatistics();
+        if (dedup.hits + dedup.misses > 0) {
+            LOG_INFO("Dedup cache - Hits: " << dedup.hits << ", Misses: " << dedup.misses
+                     << ", Bytes saved: " << dedup.bytes_saved << ", Bytes fetched: " << dedup.bytes_fetched);
+        }
+        
+        auto compression = usbip_client_->GetCompressionStatistics();
+        if (compression.compressed + compression.decompressed > 0) {
+            LOG_INFO("Compression - Sent: " << compression.compressed << " (ratio " << compression.Ratio()
+                     << "), Bypassed: " << compression.bypassed + compression.rejected
+                     << ", Received: " << compression.decompressed);
+        }
+
+        auto send_stats = usbip_client_->GetSendStatistics();
+        static const char* const class_names[] = {"Control", "Interrupt", "Bulk"};
+        for (size_t i = 0; i < network::SEND_PRIORITY_COUNT; ++i) {
+            const auto& stats = send_stats.classes[i];
+            if (stats.frames > 0) {
+                LOG_INFO("Send queue " << class_names[i] << " - Frames: " << stats.frames
+                         << ", Avg wait: " << stats.AverageWaitUs() << " us, p50/p99/p999: " << stats.wait.p50_us
+                         << "/" << stats.wait.p99_us << "/" << stats.wait.p999_us
+                         << " us, Max wait: " << stats.max_wait_us << " us");
+            }
+        }
+        
         // 清理USBIP管理器
         usbip_manager_.Cleanup();
         
@@ -153,8 +200,8 @@ private:
             OnDeviceListReceived(devices);
         });
         
-        usbip_client_->SetUrbCallback([this](const protocol::UsbUrb& urb) {
-            OnUrbReceived(urb);
+        usbip_client_->SetUrbCallback([this](protocol::UsbUrb urb) {
+            OnUrbReceived(std::move(urb));
         });
         
         usbip_client_->SetErrorCallback([this](const std::string& error) {
@@ -183,7 +230,7 @@ private:
         }
     }
     
-    void OnUrbReceived(const protocol::UsbUrb& urb) {
+    void OnUrbReceived(protocol::UsbUrb urb) {
         LOG_DEBUG("Received URB: ID=" << urb.id 
                  << ", Type=" << static_cast<int>(urb.type)
                  << ", Endpoint=" << static_cast<int>(urb.endpoint)
@@ -191,7 +238,7 @@ private:
         
         // 查找对应的虚拟设备并处理URB
         for (auto& device : virtual_devices_) {
-            device->ProcessUrb(urb);
+            device->ProcessUrb(std::move(urb));
             break; // 简化：只发送给第一个设备
         }
     }
@@ -210,8 +257,8 @@ private:
         auto virtual_device = std::make_shared<receiver::VirtualUsbDevice>();
         
         // 设置URB响应回调
-        virtual_device->SetUrbResponseCallback([this](const protocol::UsbUrb& urb) {
-            OnUrbResponse(urb);
+        virtual_device->SetUrbResponseCallback([this](protocol::UsbUrb urb) {
+            OnUrbResponse(std::move(urb));
         });
         
         // 创建并附加设备
@@ -220,6 +267,20 @@ private:
             return false;
         }
         
+        if (!disk_image_.empty() &&
+            device_info.bDeviceClass == static_cast<uint8_t>(protocol::UsbDeviceClass::MASS_STORAGE)) {
+            std::string overlay_path;
+            if (!overlay_dir_.empty()) {
+                overlay_path = overlay_dir_ + "/" + device_info.busid + ".overlay";
+            }
+            if (!virtual_device->SetDiskImage(disk_image_, disk_image_bytes_, !overlay_path.empty(), overlay_path)) {
+                LOG_ERROR("Failed to open disk image " << disk_image_);
+                virtual_device->DestroyDevice();
+                return false;
+            }
+            LOG_INFO("Serving mass storage commands from disk image " << disk_image_);
+        }
+        
         if (!virtual_device->AttachDevice()) {
             LOG_ERROR("Failed to attach virtual device");
             virtual_device->DestroyDevice();
@@ -242,7 +303,7 @@ private:
         return true;
     }
     
-    void OnUrbResponse(const protocol::UsbUrb& urb) {
+    void OnUrbResponse(protocol::UsbUrb urb) {
         LOG_DEBUG("Sending URB response: ID=" << urb.id 
                  << ", Status=" << urb.status
                  << ", Length=" << urb.actual_length);
@@ -262,6 +323,10 @@ private:
     receiver::UsbipManager& usbip_manager_;
     
     std::vector<std::shared_ptr<receiver::VirtualUsbDevice>> virtual_devices_;
+    
+    std::string disk_image_;
+    uint64_t disk_image_bytes_ = 0;
+    std::string overlay_dir_;
 };
 
 // 全局变量用于信号处理
@@ -281,6 +346,19 @@ void PrintUsage(const char* program_name) {
               << "  -p, --port <port>     USB sender port (default: 3240)\n"
               << "  -l, --list            List available devices and exit\n"
               << "  -i, --import <bus_id> Import specific device by bus ID\n"
+              << "  --io-threads <n>      Number of network I/O threads (default: CPU count, max 4)\n"
+              << "  --io-backend <name>   Network I/O backend: epoll or io_uring (default: epoll)\n"
+              << "  --checksum <mode>     Frame checksum: crc32c, legacy or none (default: crc32c)\n"
+              << "  --image <path>        Serve imported mass storage devices from a local disk image\n"
+              << "  --image-size <MiB>    Create the image as a sparse file of this size if missing\n"
+              << "  --overlay <dir>       Share the image read-only; keep each session's writes in a\n"
+              << "                        copy-on-write overlay under <dir>\n"
+              << "  --compress            LZ4-compress large payloads when the sender agrees; bypassed\n"
+              << "                        automatically when the data or the link makes it not worth it\n"
+              << "  --link-mbps <n>       Link bandwidth hint for the compression decision (default: unknown)\n"
+              << "  --dedup-cache <dir>   Keep READ data in a content-addressed store under <dir>;\n"
+              << "                        extents already there are not transferred again\n"
+              << "  --dedup-cache-size <MiB> Limit the dedup store size (default: unlimited)\n"
               << "  --help                Show this help message\n";
 }
 
@@ -293,6 +371,13 @@ int main(int argc, char* argv[]) {
     uint16_t port = 0;
     bool list_only = false;
     std::string import_device;
+    network::ChecksumMode checksum_mode = network::ChecksumMode::CRC32C;
+    std::string disk_image;
+    uint64_t disk_image_mib = 0;
+    std::string overlay_dir;
+    std::string dedup_dir;
+    network::CompressionConfig compression;
+    uint64_t dedup_mib = 0;
     
     // 解析命令行参数
     for (int i = 1; i < argc; ++i) {
@@ -315,6 +400,89 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Error: --port requires an argument\n";
                 return 1;
             }
+        } else if (arg == "--io-threads") {
+            if (i + 1 < argc) {
+                network::EventLoopGroup::SetDefaultThreadCount(static_cast<size_t>(std::stoi(argv[++i])));
+            } else {
+                std::cerr << "Error: --io-threads requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--io-backend") {
+            if (i + 1 < argc) {
+                std::string backend = argv[++i];
+                if (backend == "io_uring") {
+                    network::EventLoopGroup::SetDefaultBackend(network::IoBackend::IO_URING);
+                } else if (backend == "epoll") {
+                    network::EventLoopGroup::SetDefaultBackend(network::IoBackend::REACTOR);
+                } else {
+                    std::cerr << "Error: unknown I/O backend: " << backend << "\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: --io-backend requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--checksum") {
+            if (i + 1 < argc) {
+                std::string mode = argv[++i];
+                if (mode == "crc32c") {
+                    checksum_mode = network::ChecksumMode::CRC32C;
+                } else if (mode == "legacy") {
+                    checksum_mode = network::ChecksumMode::LEGACY_SUM;
+                } else if (mode == "none") {
+                    checksum_mode = network::ChecksumMode::NONE;
+                } else {
+                    std::cerr << "Error: unknown checksum mode: " << mode << "\n";
+                    return 1;
+                }
+            } else {
+                std::cerr << "Error: --checksum requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--image") {
+            if (i + 1 < argc) {
+                disk_image = argv[++i];
+            } else {
+                std::cerr << "Error: --image requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--image-size") {
+            if (i + 1 < argc) {
+                disk_image_mib = std::stoull(argv[++i]);
+            } else {
+                std::cerr << "Error: --image-size requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--overlay") {
+            if (i + 1 < argc) {
+                overlay_dir = argv[++i];
+            } else {
+                std::cerr << "Error: --overlay requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--compress") {
+            compression.enabled = true;
+        } else if (arg == "--link-mbps") {
+            if (i + 1 < argc) {
+                compression.link_bytes_per_second = std::stoull(argv[++i]) * 125000;
+            } else {
+                std::cerr << "Error: --link-mbps requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--dedup-cache") {
+            if (i + 1 < argc) {
+                dedup_dir = argv[++i];
+            } else {
+                std::cerr << "Error: --dedup-cache requires an argument\n";
+                return 1;
+            }
+        } else if (arg == "--dedup-cache-size") {
+            if (i + 1 < argc) {
+                dedup_mib = std::stoull(argv[++i]);
+            } else {
+                std::cerr << "Error: --dedup-cache-size requires an argument\n";
+                return 1;
+            }
         } else if (arg == "-l" || arg == "--list") {
             list_only = true;
         } else if (arg == "-i" || arg == "--import") {
@@ -333,6 +501,15 @@ int main(int argc, char* argv[]) {
     
     try {
         g_receiver = std::make_unique<UsbReceiver>();
+        g_receiver->SetChecksumMode(checksum_mode);
+        g_receiver->SetCompressionConfig(compression);
+        if (!disk_image.empty()) {
+            g_receiver->SetDiskImage(disk_image, disk_image_mib * 1024 * 1024, overlay_dir);
+        }
+        if (!dedup_dir.empty() && !g_receiver->EnableDedupCache(dedup_dir, dedup_mib * 1024 * 1024)) {
+            LOG_ERROR("Failed to open dedup cache " << dedup_dir);
+            return 1;
+        }
         
         if (!g_receiver->Initialize()) {
             LOG_ERROR("Failed to initialize USB Receiver");
@@ -4,6 +4,7 @@
 #include <thread>
 #include <cstring>
 #include <arpa/inet.h>
+#include <errno.h>
 
 namespace usb_redirector {
 namespace receiver {
@@ -30,9 +31,12 @@ UsbipClient::UsbipClient()
     });
 
     // 设置消息处理回调
-    message_handler_->SetMessageCallback([this](const network::NetworkMessage& message) {
+    message_handler_->SetMessageCallback([this](const network::MessageView& message) {
         OnNetworkMessage(message);
     });
+
+    // 大的批量响应分片发送，控制和中断传输的响应可以插在分片之间
+    message_handler_->SetFragmentSize(network::MessageHandler::DEFAULT_FRAGMENT_SIZE);
 }
 
 UsbipClient::~UsbipClient() {
@@ -117,10 +121,54 @@ bool UsbipClient::SendUrbResponse(const protocol::UsbUrb& urb) {
         return false;
     }
 
-    auto message = network::MessageHandler::CreateUrbResponse(urb);
+    // 按seqnum与原请求配对，响应头使用请求的端点和方向
+    protocol::InflightUrb request;
+    if (!urb_table_.Remove(urb.id, &request)) {
+        // 已被撤销或未知的URB，不发送迟到的结果
+        LOG_DEBUG("No in-flight URB for response seqnum: " << urb.id);
+        return false;
+    }
+
+    // USBIP_RET_SUBMIT头部拷贝进帧，响应数据直接从URB缓冲区发送
+    protocol::UsbipRetSubmit ret_submit = {};
+    ret_submit.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_RET_SUBMIT);
+    ret_submit.header.seqnum = request.seqnum;
+    ret_submit.header.direction = static_cast<uint32_t>(request.direction);
+    ret_submit.header.ep = request.endpoint;
+    ret_submit.status = urb.status;
+    ret_submit.actual_length = static_cast<int32_t>(urb.actual_length);
+    protocol::UsbipProtocol::HostToNetwork(ret_submit);
+
+    network::OutgoingFrame frame;
+    frame.AppendCopy(&ret_submit, sizeof(ret_submit));
+    frame.AppendRef(urb.data.data(), urb.data.size());
+
+    return message_handler_->SendFrame(network::MessageType::URB_RESPONSE, frame,
+                                       network::MessageHandler::TransferPriority(urb.type),
+        [this](const struct iovec* iov, size_t count, network::SendPriority priority) {
+            return tcp_client_->SendV(iov, count, priority);
+        });
+}
+
+bool UsbipClient::EnableDedupCache(const std::string& directory, uint64_t max_bytes) {
+    if (!dedup_store_.Open(directory, max_bytes)) {
+        return false;
+    }
+    message_handler_->SetLocalFeatures(network::FEATURE_DEDUP);
+    return true;
+}
+
+bool UsbipClient::UnlinkUrb(uint32_t seqnum) {
+    if (!connected_.load()) {
+        LOG_ERROR("Not connected to USBIP server");
+        return false;
+    }
+
+    // 以最低优先级发送，不会越过同一URB仍在排队的数据
+    auto message = network::MessageHandler::CreateUrbUnlink(seqnums_.Next(), seqnum);
     auto data = message_handler_->SerializeMessage(message);
 
-    return tcp_client_->Send(data);
+    return tcp_client_->Send(data, network::SendPriority::BULK);
 }
 
 void UsbipClient::StartHeartbeat(int interval_seconds) {
@@ -149,8 +197,8 @@ void UsbipClient::StopHeartbeat() {
     LOG_INFO("Heartbeat stopped");
 }
 
-void UsbipClient::OnNetworkMessage(const network::NetworkMessage& message) {
-    switch (static_cast<network::MessageType>(message.header.type)) {
+void UsbipClient::OnNetworkMessage(const network::MessageView& message) {
+    switch (message.Type()) {
         case network::MessageType::DEVICE_LIST_RESPONSE:
             HandleDeviceListResponse(message);
             break;
@@ -167,8 +215,28 @@ void UsbipClient::OnNetworkMessage(const network::NetworkMessage& message) {
             HandleHeartbeat(message);
             break;
 
+        case network::MessageType::CAPABILITIES:
+            // 已由MessageHandler完成协商
+            break;
+
+        case network::MessageType::URB_UNLINK:
+            HandleUrbUnlink(message);
+            break;
+
+        case network::MessageType::URB_UNLINK_RESPONSE:
+            HandleUrbUnlinkResponse(message);
+            break;
+
+        case network::MessageType::DEDUP_OFFER:
+            HandleDedupOffer(message);
+            break;
+
+        case network::MessageType::DEDUP_DATA:
+            HandleDedupData(message);
+            break;
+
         default:
-            LOG_WARNING("Unknown message type: " << message.header.type);
+            LOG_WARNING("Unknown message type: " << message.Header().type);
             break;
     }
 }
@@ -189,21 +257,38 @@ void UsbipClient::OnNetworkConnect(bool connected) {
 
     if (connected) {
         LOG_INFO("Network connection established");
+
+        // 新连接使用新的会话状态并重新协商校验模式
+        message_handler_->ResetSession();
+        seqnums_.Reset();
+        auto data = message_handler_->SerializeMessage(message_handler_->CreateCapabilities());
+        tcp_client_->Send(data);
+
         StartHeartbeat();
     } else {
         LOG_INFO("Network connection lost");
         StopHeartbeat();
+
+        // 连接断开后在途URB不会再收到回复
+        size_t cancelled = urb_table_.CancelAll(-ECONNRESET);
+        if (cancelled > 0) {
+            LOG_WARNING("Dropped " << cancelled << " in-flight URBs");
+        }
+
+        // 未补齐的去重提议随连接失效
+        std::lock_guard<std::mutex> lock(offers_mutex_);
+        pending_offers_.clear();
     }
 }
 
-void UsbipClient::HandleDeviceListResponse(const network::NetworkMessage& message) {
+void UsbipClient::HandleDeviceListResponse(const network::MessageView& message) {
     LOG_INFO("Received device list response");
 
     // 解析设备列表
     std::vector<protocol::UsbipDeviceInfo> devices;
 
-    if (message.payload.size() >= 12) { // 至少包含头部信息
-        const uint8_t* data = message.payload.data();
+    if (message.Size() >= 12) { // 至少包含头部信息
+        const uint8_t* data = message.Data();
         size_t offset = 0;
 
         // 跳过操作码和状态
@@ -211,7 +296,7 @@ void UsbipClient::HandleDeviceListResponse(const network::NetworkMessage& messag
 
         // 读取设备数量
         uint32_t num_devices = 0;
-        if (offset + 4 <= message.payload.size()) {
+        if (offset + 4 <= message.Size()) {
             std::memcpy(&num_devices, data + offset, 4);
             num_devices = ntohl(num_devices);
             offset += 4;
@@ -219,7 +304,7 @@ void UsbipClient::HandleDeviceListResponse(const network::NetworkMessage& messag
             LOG_INFO("Device list contains " << num_devices << " devices");
 
             // 读取设备信息
-            for (uint32_t i = 0; i < num_devices && offset + sizeof(protocol::UsbipDeviceInfo) <= message.payload.size(); ++i) {
+            for (uint32_t i = 0; i < num_devices && offset + sizeof(protocol::UsbipDeviceInfo) <= message.Size(); ++i) {
                 protocol::UsbipDeviceInfo device_info;
                 std::memcpy(&device_info, data + offset, sizeof(protocol::UsbipDeviceInfo));
 
@@ -246,15 +331,15 @@ void UsbipClient::HandleDeviceListResponse(const network::NetworkMessage& messag
     }
 }
 
-void UsbipClient::HandleDeviceImportResponse(const network::NetworkMessage& message) {
+void UsbipClient::HandleDeviceImportResponse(const network::MessageView& message) {
     bool success = false;
     std::string error_msg;
 
-    if (!message.payload.empty()) {
-        success = message.payload[0] != 0;
+    if (!message.Empty()) {
+        success = message[0] != 0;
 
-        if (!success && message.payload.size() > 1) {
-            error_msg = std::string(message.payload.begin() + 1, message.payload.end());
+        if (!success && message.Size() > 1) {
+            error_msg = std::string(message.begin() + 1, message.end());
         }
     }
 
@@ -265,17 +350,17 @@ void UsbipClient::HandleDeviceImportResponse(const network::NetworkMessage& mess
     }
 }
 
-void UsbipClient::HandleUrbSubmit(const network::NetworkMessage& message) {
+void UsbipClient::HandleUrbSubmit(const network::MessageView& message) {
     LOG_DEBUG("Received URB submit");
 
     // 解析USBIP数据包
-    if (message.payload.size() < sizeof(protocol::UsbipCmdSubmit)) {
+    if (message.Size() < sizeof(protocol::UsbipCmdSubmit)) {
         LOG_ERROR("Invalid URB submit message size");
         return;
     }
 
     protocol::UsbipCmdSubmit cmd_submit;
-    if (!protocol::UsbipProtocol::ParseCmdSubmit(message.payload.data(), message.payload.size(), cmd_submit)) {
+    if (!protocol::UsbipProtocol::ParseCmdSubmit(message.Data(), message.Size(), cmd_submit)) {
         LOG_ERROR("Failed to parse URB submit command");
         return;
     }
@@ -292,16 +377,18 @@ void UsbipClient::HandleUrbSubmit(const network::NetworkMessage& message) {
         urb.type = protocol::UsbTransferType::CONTROL;
         std::memcpy(&urb.setup, &cmd_submit.setup, sizeof(urb.setup));
     } else {
-        urb.type = protocol::UsbTransferType::BULK; // 假设是批量传输
+        // USBIP头部不带传输类型：带同步包的是同步传输，其余假设是批量传输
+        urb.type = cmd_submit.number_of_packets > 0 ? protocol::UsbTransferType::ISOCHRONOUS
+                                                     : protocol::UsbTransferType::BULK;
     }
 
-    // 提取数据
+    // 提取数据（直接从接收缓冲区拷贝到URB，只拷贝一次）
     if (cmd_submit.transfer_buffer_length > 0) {
         size_t data_offset = sizeof(protocol::UsbipCmdSubmit);
-        if (message.payload.size() >= data_offset + cmd_submit.transfer_buffer_length) {
+        if (message.Size() >= data_offset + cmd_submit.transfer_buffer_length) {
             urb.data.assign(
-                message.payload.begin() + data_offset,
-                message.payload.begin() + data_offset + cmd_submit.transfer_buffer_length
+                message.begin() + data_offset,
+                message.begin() + data_offset + cmd_submit.transfer_buffer_length
             );
         }
     }
@@ -311,12 +398,179 @@ void UsbipClient::HandleUrbSubmit(const network::NetworkMessage& message) {
     urb.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
         std::chrono::steady_clock::now().time_since_epoch()).count();
 
+    // 登记为在途URB，回复时按seqnum配对
+    if (!urb_table_.Insert(urb.id, urb.endpoint, urb.direction)) {
+        LOG_WARNING("Cannot track URB seqnum " << urb.id << " (duplicate or "
+                    << urb_table_.MaxConcurrent() << " URBs already in flight)");
+        return;
+    }
+
     if (urb_callback_) {
-        urb_callback_(urb);
+        urb_callback_(std::move(urb));
     }
 }
 
-void UsbipClient::HandleHeartbeat(const network::NetworkMessage& message) {
+void UsbipClient::HandleUrbUnlink(const network::MessageView& message) {
+    protocol::UsbipCmdUnlink cmd_unlink;
+    if (!protocol::UsbipProtocol::ParseCmdUnlink(message.Data(), message.Size(), cmd_unlink)) {
+        LOG_ERROR("Failed to parse URB unlink command");
+        return;
+    }
+
+    // 从在途表移除，虚拟设备稍后产生的响应找不到配对而被丢弃，不再占用链路
+    bool pending = urb_table_.Remove(cmd_unlink.unlink_seqnum);
+    int32_t status = pending ? -ECONNRESET : 0;
+
+    auto response = network::MessageHandler::CreateUrbUnlinkResponse(cmd_unlink.header.seqnum, status);
+    auto data = message_handler_->SerializeMessage(response);
+    tcp_client_->Send(data, network::SendPriority::BULK);
+}
+
+void UsbipClient::HandleUrbUnlinkResponse(const network::MessageView& message) {
+    protocol::UsbipRetUnlink ret_unlink;
+    if (!protocol::UsbipProtocol::ParseRetUnlink(message.Data(), message.Size(), ret_unlink)) {
+        LOG_ERROR("Failed to parse URB unlink response");
+        return;
+    }
+
+    LOG_DEBUG("Unlink " << ret_unlink.header.seqnum << " completed with status " << ret_unlink.status);
+}
+
+void UsbipClient::HandleDedupOffer(const network::MessageView& message) {
+    network::DedupOffer offer;
+    if (!network::MessageHandler::ParseDedupOffer(message, offer)) {
+        LOG_ERROR("Failed to parse dedup offer");
+        return;
+    }
+
+    bool reserved;
+    {
+        std::lock_guard<std::mutex> lock(offers_mutex_);
+        reserved = ReserveOfferSlot();
+    }
+    if (!reserved) {
+        // 仍回复空列表，发送端据此释放保留的数据；这个URB与在途表满时一样被丢弃
+        LOG_WARNING("Too many pending dedup offers (" << MAX_PENDING_OFFERS << "), dropping offer "
+                    << offer.offer_id);
+        auto request = network::MessageHandler::CreateDedupRequest(offer.offer_id, {});
+        auto data = message_handler_->SerializeMessage(request);
+        tcp_client_->Send(data);
+        return;
+    }
+
+    PendingOffer pending;
+    pending.header_length = offer.usbip_header_length;
+    pending.payload.resize(offer.usbip_header_length + offer.DataLength());
+    std::memcpy(pending.payload.data(), offer.usbip_header, offer.usbip_header_length);
+
+    // 命中的extent直接从本地存储读入URB数据
+    std::vector<uint32_t> missing;
+    size_t offset = offer.usbip_header_length;
+    for (uint32_t i = 0; i < offer.extents.size(); ++i) {
+        if (!dedup_store_.Load(offer.extents[i], pending.payload.data() + offset)) {
+            missing.push_back(i);
+        }
+        offset += offer.extents[i].length;
+    }
+
+    // 空列表也要回复，发送端据此释放为该提议保留的数据
+    auto request = network::MessageHandler::CreateDedupRequest(offer.offer_id, missing);
+    auto data = message_handler_->SerializeMessage(request);
+    tcp_client_->Send(data);
+
+    if (missing.empty()) {
+        DeliverDedupPayload(pending.payload);
+        return;
+    }
+
+    pending.extents = std::move(offer.extents);
+    pending.missing.assign(pending.extents.size(), false);
+    for (uint32_t index : missing) {
+        pending.missing[index] = true;
+    }
+    pending.remaining = missing.size();
+    pending.created = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(offers_mutex_);
+    pending_offers_[offer.offer_id] = std::move(pending);
+}
+
+bool UsbipClient::ReserveOfferSlot() {
+    if (pending_offers_.size() < MAX_PENDING_OFFERS) {
+        return true;
+    }
+
+    // 发送端断开或补发失败的提议不会再补齐
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = pending_offers_.begin(); it != pending_offers_.end();) {
+        if (now - it->second.created >= OFFER_TIMEOUT) {
+            LOG_WARNING("Dedup offer " << it->first << " timed out with " << it->second.remaining
+                        << " extents missing");
+            it = pending_offers_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return pending_offers_.size() < MAX_PENDING_OFFERS;
+}
+
+void UsbipClient::HandleDedupData(const network::MessageView& message) {
+    uint32_t offer_id = 0;
+    uint32_t index = 0;
+    const uint8_t* data = nullptr;
+    size_t len = 0;
+    if (!network::MessageHandler::ParseDedupData(message, offer_id, index, data, len)) {
+        LOG_ERROR("Failed to parse dedup data");
+        return;
+    }
+
+    protocol::DedupExtent extent = {};
+    std::vector<uint8_t> complete;
+    {
+        std::lock_guard<std::mutex> lock(offers_mutex_);
+        auto it = pending_offers_.find(offer_id);
+        if (it == pending_offers_.end()) {
+            LOG_DEBUG("Dedup data for unknown offer " << offer_id);
+            return;
+        }
+
+        PendingOffer& pending = it->second;
+        if (index >= pending.extents.size() || !pending.missing[index] || len != pending.extents[index].length) {
+            LOG_WARNING("Unexpected dedup extent " << index << " for offer " << offer_id);
+            return;
+        }
+
+        size_t offset = pending.header_length;
+        for (uint32_t i = 0; i < index; ++i) {
+            offset += pending.extents[i].length;
+        }
+        std::memcpy(pending.payload.data() + offset, data, len);
+        pending.missing[index] = false;
+        extent = pending.extents[index];
+
+        if (--pending.remaining == 0) {
+            complete = std::move(pending.payload);
+            pending_offers_.erase(it);
+        }
+    }
+
+    // 保存供以后的提议命中；内容与哈希不符时不保存，数据仍以发送端为准
+    dedup_store_.Store(extent, data);
+
+    if (!complete.empty()) {
+        DeliverDedupPayload(complete);
+    }
+}
+
+void UsbipClient::DeliverDedupPayload(const std::vector<uint8_t>& payload) {
+    network::MessageHeader header = {};
+    header.magic = network::MessageHandler::MESSAGE_MAGIC;
+    header.type = static_cast<uint32_t>(network::MessageType::URB_SUBMIT);
+    header.length = static_cast<uint32_t>(payload.size());
+    HandleUrbSubmit(network::MessageView(header, payload.data(), payload.size()));
+}
+
+void UsbipClient::HandleHeartbeat(const network::MessageView& message) {
     LOG_DEBUG("Received heartbeat from server");
 
     // 回复心跳
@@ -3,12 +3,17 @@
 #include "network/tcp_socket.h"
 #include "network/message_handler.h"
 #include "protocol/usbip_protocol.h"
+#include "protocol/urb_table.h"
+#include "protocol/dedup_store.h"
 #include <string>
 #include <memory>
 #include <functional>
 #include <vector>
+#include <unordered_map>
 #include <atomic>
+#include <mutex>
 #include <thread>
+#include <chrono>
 
 namespace usb_redirector {
 namespace receiver {
@@ -16,7 +21,7 @@ namespace receiver {
 class UsbipClient {
 public:
     using DeviceListCallback = std::function<void(const std::vector<protocol::UsbipDeviceInfo>& devices)>;
-    using UrbCallback = std::function<void(const protocol::UsbUrb& urb)>;
+    using UrbCallback = std::function<void(protocol::UsbUrb urb)>;
     using ErrorCallback = std::function<void(const std::string& error)>;
     
     UsbipClient();
@@ -30,6 +35,25 @@ public:
     void SetDeviceListCallback(DeviceListCallback callback) { device_list_callback_ = std::move(callback); }
     void SetUrbCallback(UrbCallback callback) { urb_callback_ = std::move(callback); }
     void SetErrorCallback(ErrorCallback callback) { error_callback_ = std::move(callback); }
+
+    // 本端偏好的帧校验模式，连接时与发送端协商
+    void SetChecksumMode(network::ChecksumMode mode) { message_handler_->SetPreferredChecksumMode(mode); }
+
+    // 启用按内容哈希去重的READ传输：extent保存在directory下，已有的extent不再经网络拉取。
+    // max_bytes为0表示不限容量。连接前调用，随能力协商告知发送端
+    bool EnableDedupCache(const std::string& directory, uint64_t max_bytes = 0);
+    protocol::DedupStatistics GetDedupStatistics() const { return dedup_store_.GetStatistics(); }
+
+    // 载荷压缩（双方都启用时生效），连接前调用
+    void SetCompressionConfig(const network::CompressionConfig& config) {
+        message_handler_->SetCompressionConfig(config);
+    }
+    network::CompressionStatistics GetCompressionStatistics() const {
+        return message_handler_->GetCompressionStatistics();
+    }
+
+    // 各发送优先级的帧数和排队时间
+    network::SendStatistics GetSendStatistics() const { return tcp_client_->GetSendStatistics(); }
     
     // 连接到发送端
     bool Connect(const std::string& host, uint16_t port = 3240);
@@ -40,25 +64,59 @@ public:
     bool RequestDeviceList();
     bool ImportDevice(const std::string& bus_id);
     bool SendUrbResponse(const protocol::UsbUrb& urb);
+
+    // 请求发送端撤销seqnum对应的URB（主机侧超时等），发送端回复USBIP_RET_UNLINK
+    bool UnlinkUrb(uint32_t seqnum);
+
+    // 在途URB（已收到USBIP_CMD_SUBMIT但尚未回复）
+    size_t GetInflightUrbCount() const { return urb_table_.Size(); }
+    size_t GetEndpointQueueDepth(uint8_t endpoint, protocol::UsbDirection direction) const {
+        return urb_table_.QueueDepth(endpoint, direction);
+    }
     
     // 心跳
     void StartHeartbeat(int interval_seconds = 30);
     void StopHeartbeat();
 
 private:
-    void OnNetworkMessage(const network::NetworkMessage& message);
+    void OnNetworkMessage(const network::MessageView& message);
     void OnNetworkError(const std::string& error);
     void OnNetworkConnect(bool connected);
     
-    void HandleDeviceListResponse(const network::NetworkMessage& message);
-    void HandleDeviceImportResponse(const network::NetworkMessage& message);
-    void HandleUrbSubmit(const network::NetworkMessage& message);
-    void HandleHeartbeat(const network::NetworkMessage& message);
+    void HandleDeviceListResponse(const network::MessageView& message);
+    void HandleDeviceImportResponse(const network::MessageView& message);
+    void HandleUrbSubmit(const network::MessageView& message);
+    void HandleHeartbeat(const network::MessageView& message);
+    void HandleUrbUnlink(const network::MessageView& message);
+    void HandleUrbUnlinkResponse(const network::MessageView& message);
+    void HandleDedupOffer(const network::MessageView& message);
+    void HandleDedupData(const network::MessageView& message);
+    // 提议的数据到齐后按普通URB_SUBMIT处理，payload为USBIP头部加完整数据
+    void DeliverDedupPayload(const std::vector<uint8_t>& payload);
     
     void HeartbeatThread();
     
     std::unique_ptr<network::TcpSocket> tcp_client_;
     std::unique_ptr<network::MessageHandler> message_handler_;
+    protocol::UrbTable urb_table_;
+    protocol::SequenceSpace seqnums_;       // 本端发起的USBIP命令
+
+    // 等待发送端补发extent的去重提议。数量有上限，超时未补齐的在登记新提议时丢弃
+    static constexpr size_t MAX_PENDING_OFFERS = 64;
+    static constexpr std::chrono::seconds OFFER_TIMEOUT{10};
+    struct PendingOffer {
+        std::vector<uint8_t> payload;       // USBIP头部加完整数据，命中的extent已填入
+        size_t header_length = 0;
+        std::vector<protocol::DedupExtent> extents;
+        std::vector<bool> missing;
+        size_t remaining = 0;
+        std::chrono::steady_clock::time_point created;
+    };
+    // 为新提议腾出位置：先丢弃超时的提议，仍已满时返回false。需持offers_mutex_
+    bool ReserveOfferSlot();
+    protocol::DedupStore dedup_store_;
+    std::unordered_map<uint32_t, PendingOffer> pending_offers_;
+    std::mutex offers_mutex_;
     
     DeviceListCallback device_list_callback_;
     UrbCallback urb_callback_;
@@ -8,6 +8,7 @@
 #include <sys/stat.h>
 #include <arpa/inet.h>
 #include <algorithm>
+#include <cerrno>
 
 namespace usb_redirector {
 namespace receiver {
@@ -17,7 +18,10 @@ VirtualUsbDevice::VirtualUsbDevice()
     , attached_(false)
     , processing_(false)
     , port_number_(-1)
-    , current_configuration_(0) {
+    , current_configuration_(0)
+    , bot_stage_(BotStage::COMMAND)
+    , bot_cbw_{}
+    , bot_csw_{} {
 
     // 初始化字符串描述符
     string_descriptors_.resize(4);
@@ -31,6 +35,38 @@ VirtualUsbDevice::~VirtualUsbDevice() {
     DestroyDevice();
 }
 
+bool VirtualUsbDevice::SetDiskImage(const std::string& path, uint64_t create_bytes, bool read_only,
+                                    const std::string& overlay_path) {
+    auto disk = std::make_unique<protocol::ScsiDisk>();
+    if (!disk->Open(path, create_bytes, read_only)) {
+        return false;
+    }
+    if (!overlay_path.empty() && !disk->AttachOverlay(overlay_path)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(bot_mutex_);
+    disk_ = std::move(disk);
+    bot_stage_ = BotStage::COMMAND;
+    bot_data_.clear();
+    return true;
+}
+
+bool VirtualUsbDevice::HasDiskImage() const {
+    std::lock_guard<std::mutex> lock(bot_mutex_);
+    return disk_ != nullptr;
+}
+
+bool VirtualUsbDevice::DiscardDiskOverlay() {
+    // 命令在bot_mutex_下执行，持锁丢弃时没有命令在访问overlay
+    std::lock_guard<std::mutex> lock(bot_mutex_);
+    if (!disk_ || !disk_->HasOverlay()) {
+        return false;
+    }
+    disk_->DiscardOverlay();
+    return true;
+}
+
 bool VirtualUsbDevice::CreateDevice(const protocol::UsbipDeviceInfo& device_info) {
     std::lock_guard<std::mutex> lock(mutex_);
 
@@ -126,7 +162,7 @@ void VirtualUsbDevice::DestroyDevice() {
     }
 }
 
-void VirtualUsbDevice::ProcessUrb(const protocol::UsbUrb& urb) {
+void VirtualUsbDevice::ProcessUrb(protocol::UsbUrb urb) {
     if (!attached_.load()) {
         LOG_WARNING("Device not attached, ignoring URB");
         return;
@@ -211,7 +247,7 @@ void VirtualUsbDevice::HandleControlUrb(const protocol::UsbUrb& urb) {
     response.actual_length = static_cast<uint32_t>(response.data.size());
 
     if (urb_response_callback_) {
-        urb_response_callback_(response);
+        urb_response_callback_(std::move(response));
     }
 }
 
@@ -255,7 +291,7 @@ void VirtualUsbDevice::SimulateDeviceResponse(const protocol::UsbUrb& urb) {
     response.actual_length = static_cast<uint32_t>(response.data.size());
 
     if (urb_response_callback_) {
-        urb_response_callback_(response);
+        urb_response_callback_(std::move(response));
     }
 }
 
@@ -301,9 +337,13 @@ std::vector<uint8_t> VirtualUsbDevice::HandleClassRequest(const protocol::UsbSet
     // 大容量存储类请求
     if (device_info_.bDeviceClass == static_cast<uint8_t>(protocol::UsbDeviceClass::MASS_STORAGE)) {
         switch (setup.bRequest) {
-            case 0xFF: // Bulk-Only Mass Storage Reset
+            case 0xFF: { // Bulk-Only Mass Storage Reset
                 LOG_INFO("Mass storage reset request");
+                std::lock_guard<std::mutex> lock(bot_mutex_);
+                bot_stage_ = BotStage::COMMAND;
+                bot_data_.clear();
                 break;
+            }
             case 0xFE: // Get Max LUN
                 response.push_back(0); // 只有一个LUN
                 LOG_INFO("Get Max LUN request");
@@ -383,6 +423,10 @@ std::vector<uint8_t> VirtualUsbDevice::GetStringDescriptor(uint8_t index) {
 }
 
 void VirtualUsbDevice::HandleMassStorageUrb(const protocol::UsbUrb& urb) {
+    if (HandleDiskUrb(urb)) {
+        return;
+    }
+
     // 简化的大容量存储设备处理
     protocol::UsbUrb response = urb;
     response.direction = (urb.direction == protocol::UsbDirection::IN) ?
@@ -398,7 +442,7 @@ void VirtualUsbDevice::HandleMassStorageUrb(const protocol::UsbUrb& urb) {
         response.data.resize(13);
         // 简化的CSW：签名 + 标签 + 残留 + 状态
         uint32_t signature = 0x53425355; // "USBS"
-        std::memcpy(response.data.data(), &signature, 4);
+        std::memcpy(response.data.mutable_data(), &signature, 4);
         // 其他字段设为0（成功状态）
     }
 
@@ -406,11 +450,114 @@ void VirtualUsbDevice::HandleMassStorageUrb(const protocol::UsbUrb& urb) {
     response.actual_length = static_cast<uint32_t>(response.data.size());
 
     if (urb_response_callback_) {
-        urb_response_callback_(response);
+        urb_response_callback_(std::move(response));
+    }
+}
+
+bool VirtualUsbDevice::HandleDiskUrb(const protocol::UsbUrb& urb) {
+    protocol::UsbUrb response = urb;
+    response.direction = (urb.direction == protocol::UsbDirection::IN) ?
+                        protocol::UsbDirection::OUT : protocol::UsbDirection::IN;
+    response.status = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(bot_mutex_);
+        if (!disk_) {
+            return false;
+        }
+
+        if (urb.direction == protocol::UsbDirection::OUT) {
+            response.data.clear();
+            response.actual_length = static_cast<uint32_t>(urb.data.size());
+
+            if (bot_stage_ == BotStage::DATA_OUT) {
+                // 大的数据OUT阶段可能分成多个URB到达，收齐后再执行
+                // 单个URB即可收齐时直接共享URB的缓冲区
+                if (bot_data_.empty()) {
+                    bot_data_ = urb.data;
+                } else {
+                    bot_data_.append(urb.data.data(), urb.data.size());
+                }
+                if (bot_data_.size() >= bot_cbw_.dCBWDataTransferLength) {
+                    const utils::PooledBuffer data_out = std::move(bot_data_);
+                    ExecuteDiskCommand(data_out.data(), static_cast<uint32_t>(data_out.size()));
+                }
+            } else if (bot_stage_ == BotStage::COMMAND && urb.data.size() == sizeof(bot_cbw_) &&
+                       std::memcmp(urb.data.data(), &protocol::CBW_SIGNATURE, 4) == 0) {
+                std::memcpy(&bot_cbw_, urb.data.data(), sizeof(bot_cbw_));
+                bool data_out = bot_cbw_.dCBWDataTransferLength > 0 &&
+                                (bot_cbw_.bmCBWFlags & protocol::CBW_FLAG_DATA_IN) == 0;
+                if (data_out) {
+                    bot_data_.clear();
+                    bot_stage_ = BotStage::DATA_OUT;
+                } else {
+                    ExecuteDiskCommand(nullptr, 0);
+                }
+            } else {
+                // 非法CBW或阶段错误：STALL，主机随后做复位恢复
+                LOG_WARNING("Unexpected bulk OUT transfer in mass storage stage " << static_cast<int>(bot_stage_));
+                response.status = -EPIPE;
+                response.actual_length = 0;
+            }
+        } else {
+            if (bot_stage_ == BotStage::DATA_IN) {
+                // IN URB的缓冲区长度即本次最多返回的数据量，剩余部分留给下一个IN URB
+                size_t length = urb.data.empty() ? bot_data_.size() : std::min(urb.data.size(), bot_data_.size());
+                if (length == bot_data_.size()) {
+                    response.data = std::move(bot_data_);
+                    bot_stage_ = BotStage::STATUS;
+                } else {
+                    // 切片共享同一块缓冲，不拷贝数据
+                    response.data = bot_data_.Slice(0, length);
+                    bot_data_ = bot_data_.Slice(length, bot_data_.size() - length);
+                }
+            } else if (bot_stage_ == BotStage::STATUS) {
+                const uint8_t* csw = reinterpret_cast<const uint8_t*>(&bot_csw_);
+                response.data.assign(csw, csw + sizeof(bot_csw_));
+                bot_stage_ = BotStage::COMMAND;
+            } else {
+                response.data.clear();
+                response.status = -EPIPE;
+            }
+            response.actual_length = static_cast<uint32_t>(response.data.size());
+        }
+    }
+
+    if (urb_response_callback_) {
+        urb_response_callback_(std::move(response));
+    }
+    return true;
+}
+
+void VirtualUsbDevice::ExecuteDiskCommand(const uint8_t* data_out, uint32_t data_out_length) {
+    uint32_t expected = bot_cbw_.dCBWDataTransferLength;
+    bool data_in_phase = expected > 0 && (bot_cbw_.bmCBWFlags & protocol::CBW_FLAG_DATA_IN);
+    utils::PooledBuffer data_in;
+    uint8_t status = disk_->Execute(bot_cbw_.CBWCB, std::min<uint8_t>(bot_cbw_.bCBWCBLength, sizeof(bot_cbw_.CBWCB)),
+                                    data_out, data_out_length, data_in_phase ? expected : 0, data_in);
+
+    uint32_t moved = 0;
+    if (data_in_phase) {
+        // 数据IN阶段：多于主机期望的部分截断，少于时由CSW报告残留
+        if (data_in.size() > expected) {
+            data_in.resize(expected);
+        }
+        moved = static_cast<uint32_t>(data_in.size());
+        bot_data_ = std::move(data_in);
+        bot_stage_ = BotStage::DATA_IN;
+    } else {
+        moved = std::min(data_out_length, expected);
+        bot_stage_ = BotStage::STATUS;
     }
+
+    bot_csw_.dCSWSignature = protocol::CSW_SIGNATURE;
+    bot_csw_.dCSWTag = bot_cbw_.dCBWTag;
+    bot_csw_.dCSWDataResidue = expected - moved;
+    bot_csw_.bCSWStatus = status == protocol::SCSI_STATUS_GOOD ? protocol::CSW_STATUS_PASSED
+                                                               : protocol::CSW_STATUS_FAILED;
 }
 
-std::vector<uint8_t> VirtualUsbDevice::ProcessScsiCommand(const std::vector<uint8_t>& cbw_data) {
+std::vector<uint8_t> VirtualUsbDevice::ProcessScsiCommand(const utils::PooledBuffer& cbw_data) {
     std::vector<uint8_t> response;
 
     // 简化的SCSI命令处理
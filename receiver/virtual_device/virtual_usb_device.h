@@ -2,6 +2,8 @@
 
 #include "protocol/usb_types.h"
 #include "protocol/usbip_protocol.h"
+#include "protocol/mass_storage.h"
+#include "protocol/scsi_disk.h"
 #include <string>
 #include <memory>
 #include <functional>
@@ -15,7 +17,7 @@ namespace receiver {
 
 class VirtualUsbDevice {
 public:
-    using UrbResponseCallback = std::function<void(const protocol::UsbUrb& urb)>;
+    using UrbResponseCallback = std::function<void(protocol::UsbUrb urb)>;
 
     VirtualUsbDevice();
     ~VirtualUsbDevice();
@@ -29,6 +31,15 @@ public:
         urb_response_callback_ = std::move(callback);
     }
 
+    // 使用本地磁盘镜像应答大容量存储命令，不再经网络转发。
+    // 镜像不存在且create_bytes非零时创建稀疏镜像；给出overlay_path时本会话的写入
+    // 落在写时复制层，镜像可被多个会话只读共享
+    bool SetDiskImage(const std::string& path, uint64_t create_bytes = 0, bool read_only = false,
+                      const std::string& overlay_path = "");
+    bool HasDiskImage() const;
+    // 丢弃本会话写入写时复制层的全部数据
+    bool DiscardDiskOverlay();
+
     // 设备管理
     bool CreateDevice(const protocol::UsbipDeviceInfo& device_info);
     bool AttachDevice();
@@ -40,7 +51,10 @@ public:
     bool IsAttached() const { return attached_.load(); }
 
     // URB处理
-    void ProcessUrb(const protocol::UsbUrb& urb);
+    void ProcessUrb(protocol::UsbUrb urb);
+    // 磁盘镜像上的Bulk-Only状态机：CBW -> 数据 -> CSW，即ProcessUrb对大容量存储bulk URB的处理，
+    // 应答经UrbResponseCallback返回，不经过vhci端口。未设置镜像时返回false
+    bool HandleDiskUrb(const protocol::UsbUrb& urb);
 
     // 获取设备信息
     const protocol::UsbipDeviceInfo& GetDeviceInfo() const { return device_info_; }
@@ -76,7 +90,8 @@ private:
 
     // 大容量存储设备特定处理
     void HandleMassStorageUrb(const protocol::UsbUrb& urb);
-    std::vector<uint8_t> ProcessScsiCommand(const std::vector<uint8_t>& cbw_data);
+    std::vector<uint8_t> ProcessScsiCommand(const utils::PooledBuffer& cbw_data);
+    void ExecuteDiskCommand(const uint8_t* data_out, uint32_t data_out_length);   // 需持bot_mutex_
 
     // 系统接口
     bool ExecuteCommand(const std::string& command);
@@ -103,6 +118,20 @@ private:
     std::vector<uint8_t> device_descriptor_;
     std::vector<uint8_t> config_descriptor_;
     std::vector<std::string> string_descriptors_;
+
+    // 磁盘镜像和Bulk-Only传输阶段
+    enum class BotStage {
+        COMMAND,        // 等待CBW
+        DATA_OUT,       // 等待主机写入的数据
+        DATA_IN,        // 数据待主机读取
+        STATUS          // CSW待主机读取
+    };
+    std::unique_ptr<protocol::ScsiDisk> disk_;
+    BotStage bot_stage_;
+    protocol::CommandBlockWrapper bot_cbw_;
+    protocol::CommandStatusWrapper bot_csw_;
+    utils::PooledBuffer bot_data_;
+    mutable std::mutex bot_mutex_;
 };
 
 class UsbipManager {
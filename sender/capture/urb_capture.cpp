@@ -1,21 +1,50 @@
 #include "urb_capture.h"
 #include "usb/mass_storage_device.h"
 #include "utils/logger.h"
+#include "utils/thread_affinity.h"
 #include <algorithm>
+#include <cstring>
 
 namespace usb_redirector {
 namespace sender {
 
 UrbCapture::UrbCapture() 
-    : capturing_(false)
+    : work_stealing_(true)
+    , capturing_(false)
     , should_stop_(false)
-    , statistics_{} {
+    , pipeline_count_(1)
+    , next_shared_pipeline_(0) {
+    // 0号流水线接收注入的URB
+    pipelines_[0].reset(new Pipeline(0));
 }
 
 UrbCapture::~UrbCapture() {
     StopCapture();
 }
 
+UrbCapture::Pipeline& UrbCapture::AssignPipeline() {
+    size_t count = pipeline_count_.load(std::memory_order_relaxed);
+    // 优先复用设备已移除的流水线
+    for (size_t i = 1; i < count; ++i) {
+        if (pipelines_[i]->devices == 0) {
+            return *pipelines_[i];
+        }
+    }
+    if (count < MAX_PIPELINES) {
+        pipelines_[count].reset(new Pipeline(count));
+        pipeline_count_.store(count + 1, std::memory_order_release);
+        return *pipelines_[count];
+    }
+    next_shared_pipeline_ = next_shared_pipeline_ % (MAX_PIPELINES - 1) + 1;
+    return *pipelines_[next_shared_pipeline_];
+}
+
+void UrbCapture::StartWorker(Pipeline& pipeline) {
+    if (!pipeline.worker.joinable()) {
+        pipeline.worker = std::thread(&UrbCapture::WorkerThread, this, std::ref(pipeline));
+    }
+}
+
 bool UrbCapture::AddDevice(std::shared_ptr<MassStorageDevice> device) {
     if (!device) {
         return false;
@@ -29,13 +58,21 @@ bool UrbCapture::AddDevice(std::shared_ptr<MassStorageDevice> device) {
         return true; // 已存在
     }
     
-    // 设置设备的数据回调
-    device->SetDataCallback([this](const protocol::UsbUrb& urb) {
-        OnDeviceData(urb);
+    Pipeline& pipeline = AssignPipeline();
+    ++pipeline.devices;
+    
+    // 设置设备的数据回调，URB直接进入该设备的流水线
+    Pipeline* target = &pipeline;
+    device->SetDataCallback([this, target](protocol::UsbUrb urb) {
+        OnDeviceData(*target, std::move(urb));
     });
     
     devices_.push_back(device);
-    LOG_INFO("Added device to URB capture: " << device->GetPath());
+    device_pipelines_.push_back(&pipeline);
+    if (capturing_.load()) {
+        StartWorker(pipeline);
+    }
+    LOG_INFO("Added device to URB capture: " << device->GetPath() << " (pipeline " << pipeline.index << ")");
     return true;
 }
 
@@ -48,6 +85,9 @@ void UrbCapture::RemoveDevice(std::shared_ptr<MassStorageDevice> device) {
     
     auto it = std::find(devices_.begin(), devices_.end(), device);
     if (it != devices_.end()) {
+        size_t index = static_cast<size_t>(it - devices_.begin());
+        --device_pipelines_[index]->devices;
+        device_pipelines_.erase(device_pipelines_.begin() + index);
         devices_.erase(it);
         LOG_INFO("Removed device from URB capture: " << device->GetPath());
     }
@@ -55,6 +95,10 @@ void UrbCapture::RemoveDevice(std::shared_ptr<MassStorageDevice> device) {
 
 void UrbCapture::RemoveAllDevices() {
     std::lock_guard<std::mutex> lock(devices_mutex_);
+    for (Pipeline* pipeline : device_pipelines_) {
+        --pipeline->devices;
+    }
+    device_pipelines_.clear();
     devices_.clear();
     LOG_INFO("Removed all devices from URB capture");
 }
@@ -67,12 +111,16 @@ bool UrbCapture::StartCapture() {
     should_stop_.store(false);
     capturing_.store(true);
     
-    // 启动处理线程
-    processing_thread_ = std::thread(&UrbCapture::ProcessingThread, this);
-    
-    // 启动所有设备的捕获
     {
         std::lock_guard<std::mutex> lock(devices_mutex_);
+
+        // 启动各流水线的处理线程
+        size_t count = pipeline_count_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) {
+            StartWorker(*pipelines_[i]);
+        }
+
+        // 启动所有设备的捕获
         for (auto& device : devices_) {
             if (!device->StartCapture()) {
                 LOG_WARNING("Failed to start capture for device: " << device->GetPath());
@@ -92,123 +140,194 @@ void UrbCapture::StopCapture() {
     should_stop_.store(true);
     capturing_.store(false);
     
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+
     // 停止所有设备的捕获
-    {
-        std::lock_guard<std::mutex> lock(devices_mutex_);
-        for (auto& device : devices_) {
-            device->StopCapture();
-        }
+    for (auto& device : devices_) {
+        device->StopCapture();
     }
     
-    // 通知处理线程退出
-    queue_cv_.notify_all();
-    
-    if (processing_thread_.joinable()) {
-        processing_thread_.join();
+    // 通知处理线程退出，并放行等待队列空间的生产者
+    size_t count = pipeline_count_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+        pipelines_[i]->ready.Notify();
+        pipelines_[i]->space.Notify();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (pipelines_[i]->worker.joinable()) {
+            pipelines_[i]->worker.join();
+        }
     }
     
     LOG_INFO("URB capture stopped");
 }
 
-void UrbCapture::InjectUrb(const protocol::UsbUrb& urb) {
+bool UrbCapture::InjectUrb(protocol::UsbUrb& urb) {
     if (!capturing_.load()) {
-        return;
+        return false;
     }
-    
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        urb_queue_.push(urb);
+    Pipeline& pipeline = *pipelines_[0];
+    if (!pipeline.queue.TryPush(urb)) {
+        pipeline.counters.backpressure_events.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
-    queue_cv_.notify_one();
+    pipeline.ready.Notify();
+    return true;
+}
+
+size_t UrbCapture::QueueDepth() const {
+    size_t depth = 0;
+    size_t count = pipeline_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        depth += pipelines_[i]->queue.SizeApprox();
+    }
+    return depth;
 }
 
 UrbCapture::Statistics UrbCapture::GetStatistics() const {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    return statistics_;
+    Statistics stats = {};
+    protocol::UrbCounters counters = metrics_.GetCounters();
+    stats.total_urbs = counters.total_urbs;
+    stats.control_urbs = counters.control_urbs;
+    stats.bulk_urbs = counters.bulk_urbs;
+    stats.interrupt_urbs = counters.interrupt_urbs;
+    stats.iso_urbs = counters.iso_urbs;
+    stats.bytes_transferred = counters.bytes_transferred;
+    stats.errors = counters.errors;
+    for (size_t type = 0; type < protocol::URB_TRANSFER_TYPE_COUNT; ++type) {
+        auto transfer_type = static_cast<protocol::UsbTransferType>(type);
+        stats.end_to_end[type] = metrics_.GetLatency(protocol::UrbLatencyKind::END_TO_END, transfer_type);
+        stats.device_transfer[type] = metrics_.GetLatency(protocol::UrbLatencyKind::DEVICE_TRANSFER, transfer_type);
+    }
+
+    size_t count = pipeline_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        const Pipeline& pipeline = *pipelines_[i];
+        const PipelineCounters& c = pipeline.counters;
+        stats.backpressure_events += c.backpressure_events.load(std::memory_order_relaxed);
+        stats.stolen_urbs += c.stolen_urbs.load(std::memory_order_relaxed);
+        stats.wakeups += pipeline.ready.WakeCount();
+    }
+    return stats;
 }
 
 void UrbCapture::ResetStatistics() {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    statistics_ = {};
+    metrics_.Reset();
+    size_t count = pipeline_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        PipelineCounters& c = pipelines_[i]->counters;
+        c.stolen_urbs.store(0, std::memory_order_relaxed);
+        c.backpressure_events.store(0, std::memory_order_relaxed);
+    }
     LOG_INFO("URB capture statistics reset");
 }
 
-void UrbCapture::ProcessingThread() {
-    LOG_INFO("URB processing thread started");
+size_t UrbCapture::DrainPipeline(Pipeline& pipeline, bool stolen) {
+    if (pipeline.draining.exchange(true, std::memory_order_acquire)) {
+        return 0;
+    }
+    // 取出一个即交还其槽位，回调执行期间生产者已可继续投递
+    size_t drained = pipeline.queue.Drain(URB_BATCH_SIZE, [this](protocol::UsbUrb&& urb) {
+        metrics_.RecordUrb(urb);
+        if (urb_callback_) {
+            urb_callback_(std::move(urb));
+        }
+    });
+    pipeline.draining.store(false, std::memory_order_release);
+
+    if (drained > 0) {
+        if (stolen) {
+            pipeline.counters.stolen_urbs.fetch_add(drained, std::memory_order_relaxed);
+        }
+        pipeline.space.Notify();
+    }
+    return drained;
+}
+
+bool UrbCapture::StealWork(const Pipeline& self) {
+    Pipeline* victim = nullptr;
+    size_t backlog = STEAL_THRESHOLD - 1;
+    size_t count = pipeline_count_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        Pipeline& candidate = *pipelines_[i];
+        if (&candidate == &self || candidate.draining.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        size_t depth = candidate.queue.SizeApprox();
+        if (depth > backlog) {
+            backlog = depth;
+            victim = &candidate;
+        }
+    }
+    return victim && DrainPipeline(*victim, true) > 0;
+}
+
+void UrbCapture::WorkerThread(Pipeline& pipeline) {
+    if (!cpus_.empty()) {
+        int cpu = cpus_[pipeline.index % cpus_.size()];
+        if (!utils::PinCurrentThread(cpu)) {
+            LOG_WARNING("Failed to pin URB pipeline " << pipeline.index << " to CPU " << cpu);
+        }
+    }
+    LOG_INFO("URB pipeline " << pipeline.index << " thread started");
     
+    // 开启代取时空闲线程定期醒来查看其他流水线的积压
+    const auto idle_timeout = std::chrono::milliseconds(work_stealing_ ? 10 : 100);
     while (!should_stop_.load()) {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        
-        // 等待URB数据或停止信号
-        queue_cv_.wait(lock, [this] {
-            return !urb_queue_.empty() || should_stop_.load();
-        });
-        
-        if (should_stop_.load()) {
-            break;
+        if (DrainPipeline(pipeline, false) > 0) {
+            continue;
+        }
+        if (pipeline.draining.load(std::memory_order_relaxed)) {
+            // 其他线程正在代取本流水线
+            std::this_thread::yield();
+            continue;
         }
         
-        // 处理队列中的所有URB
-        while (!urb_queue_.empty()) {
-            protocol::UsbUrb urb = urb_queue_.front();
-            urb_queue_.pop();
-            lock.unlock();
-            
-            // 更新统计信息
-            UpdateStatistics(urb);
-            
-            // 调用回调函数
-            if (urb_callback_) {
-                urb_callback_(urb);
-            }
-            
-            lock.lock();
+        // 队列为空时先短暂自旋，再尝试代取，仍无事可做才睡眠；
+        // 登记等待后再检查一次，避免错过睡眠前刚放入的URB
+        if (pipeline.queue.SpinUntilNotEmpty(URB_SPIN_LIMIT)) {
+            continue;
+        }
+        if (work_stealing_ && StealWork(pipeline)) {
+            continue;
         }
+        uint32_t epoch = pipeline.ready.PrepareWait();
+        if (!pipeline.queue.Empty() || should_stop_.load()) {
+            pipeline.ready.CancelWait();
+            continue;
+        }
+        pipeline.ready.Wait(epoch, idle_timeout);
     }
     
-    LOG_INFO("URB processing thread stopped");
+    LOG_INFO("URB pipeline " << pipeline.index << " thread stopped");
 }
 
-void UrbCapture::OnDeviceData(const protocol::UsbUrb& urb) {
+void UrbCapture::OnDeviceData(Pipeline& pipeline, protocol::UsbUrb urb) {
     if (!capturing_.load()) {
         return;
     }
     
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        urb_queue_.push(urb);
-    }
-    queue_cv_.notify_one();
-}
-
-void UrbCapture::UpdateStatistics(const protocol::UsbUrb& urb) {
-    std::lock_guard<std::mutex> lock(stats_mutex_);
-    
-    statistics_.total_urbs++;
-    statistics_.bytes_transferred += urb.actual_length;
-    
-    if (urb.status != 0) {
-        statistics_.errors++;
-    }
-    
-    switch (urb.type) {
-        case protocol::UsbTransferType::CONTROL:
-            statistics_.control_urbs++;
-            break;
-        case protocol::UsbTransferType::BULK:
-            statistics_.bulk_urbs++;
-            break;
-        case protocol::UsbTransferType::INTERRUPT:
-            statistics_.interrupt_urbs++;
-            break;
-        case protocol::UsbTransferType::ISOCHRONOUS:
-            statistics_.iso_urbs++;
-            break;
+    if (!pipeline.queue.TryPush(urb)) {
+        // 队列已满：设备回调等处理线程腾出空间，把压力传回设备读取
+        pipeline.counters.backpressure_events.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            uint32_t epoch = pipeline.space.PrepareWait();
+            if (pipeline.queue.TryPush(urb)) {
+                pipeline.space.CancelWait();
+                break;
+            }
+            if (!capturing_.load()) {
+                pipeline.space.CancelWait();
+                return;
+            }
+            pipeline.space.Wait(epoch, std::chrono::milliseconds(10));
+        }
     }
+    pipeline.ready.Notify();
 }
 
 // UrbProcessor implementation
-UrbProcessor::UrbProcessor() : next_seqnum_(1) {}
+UrbProcessor::UrbProcessor() {}
 
 std::vector<uint8_t> UrbProcessor::ProcessUrb(const protocol::UsbUrb& urb) {
     std::vector<uint8_t> result;
@@ -236,11 +355,43 @@ network::NetworkMessage UrbProcessor::CreateUsbipResponse(const protocol::UsbUrb
     return network::NetworkMessage(network::MessageType::URB_RESPONSE, usbip_data);
 }
 
+bool UrbProcessor::BuildUsbipFrame(const protocol::UsbUrb& urb, network::OutgoingFrame& frame, uint32_t* seqnum) {
+    uint8_t header[USBIP_HEADER_SIZE];
+    size_t header_length = BuildUsbipHeader(urb, header, seqnum);
+    if (!frame.AppendCopy(header, header_length)) {
+        return false;
+    }
+
+    return frame.AppendRef(urb.data.data(), urb.data.size());
+}
+
+size_t UrbProcessor::BuildUsbipHeader(const protocol::UsbUrb& urb, uint8_t* header, uint32_t* seqnum) {
+    static_assert(sizeof(protocol::UsbipRetSubmit) <= USBIP_HEADER_SIZE, "USBIP header buffer too small");
+
+    if (urb.direction == protocol::UsbDirection::OUT) {
+        auto cmd_submit = CreateCmdSubmit(urb);
+        if (seqnum) {
+            *seqnum = cmd_submit.header.seqnum;
+        }
+        protocol::UsbipProtocol::HostToNetwork(cmd_submit);
+        std::memcpy(header, &cmd_submit, sizeof(cmd_submit));
+        return sizeof(cmd_submit);
+    }
+
+    auto ret_submit = CreateRetSubmit(urb);
+    if (seqnum) {
+        *seqnum = ret_submit.header.seqnum;
+    }
+    protocol::UsbipProtocol::HostToNetwork(ret_submit);
+    std::memcpy(header, &ret_submit, sizeof(ret_submit));
+    return sizeof(ret_submit);
+}
+
 protocol::UsbipCmdSubmit UrbProcessor::CreateCmdSubmit(const protocol::UsbUrb& urb) {
     protocol::UsbipCmdSubmit cmd = {};
     
     cmd.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_CMD_SUBMIT);
-    cmd.header.seqnum = next_seqnum_++;
+    cmd.header.seqnum = seqnums_.Next();
     cmd.header.devid = 0; // 设备ID，需要根据实际设备设置
     cmd.header.direction = static_cast<uint32_t>(urb.direction);
     cmd.header.ep = urb.endpoint;
@@ -265,7 +416,7 @@ protocol::UsbipRetSubmit UrbProcessor::CreateRetSubmit(const protocol::UsbUrb& u
     protocol::UsbipRetSubmit ret = {};
     
     ret.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_RET_SUBMIT);
-    ret.header.seqnum = next_seqnum_++;
+    ret.header.seqnum = seqnums_.Next();
     ret.header.devid = 0; // 设备ID，需要根据实际设备设置
     ret.header.direction = static_cast<uint32_t>(urb.direction);
     ret.header.ep = urb.endpoint;
@@ -1,23 +1,39 @@
 #pragma once
 
 #include "protocol/usb_types.h"
+#include "protocol/urb_metrics.h"
 #include "network/message_handler.h"
+#include "utils/mpsc_ring.h"
+#include "utils/notifier.h"
 #include <memory>
 #include <functional>
 #include <thread>
 #include <atomic>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <vector>
 
 namespace usb_redirector {
 namespace sender {
 
 class MassStorageDevice;
 
+// URB捕获按设备分成多条流水线，每条流水线有自己的有界无锁MPSC队列和处理线程，
+// 繁忙的存储设备不会让同一台机器上对延迟敏感的设备（如HID）排在它的队列后面。
+// 设备回调线程把URB放入所属流水线的队列，处理线程成批取出后交给回调；处理线程空闲时才睡眠，
+// 生产者只在它睡眠时唤醒；队列满时设备回调等待处理线程腾出空间（背压）。
+// 处理线程可按配置的CPU列表绑核。某条流水线积压而其处理线程没有在取（被抢占或所在核繁忙）时，
+// 空闲的处理线程代为取出一批；同一流水线同时只有一个线程在取，设备内URB的顺序不变
 class UrbCapture {
 public:
-    using UrbCallback = std::function<void(const protocol::UsbUrb& urb)>;
+    static constexpr size_t URB_QUEUE_CAPACITY = 4096;
+    static constexpr size_t URB_BATCH_SIZE = 64;     // 处理线程每批最多取出的URB数
+    static constexpr size_t URB_SPIN_LIMIT = 256;    // 处理线程睡眠前的自旋次数
+    static constexpr size_t MAX_PIPELINES = 16;      // 含注入用的0号流水线；设备更多时轮流共用
+    static constexpr size_t STEAL_THRESHOLD = URB_BATCH_SIZE;   // 积压达到该值才代取
+
+    // URB按值交给回调，回调可直接移走其中的数据缓冲。
+    // 不同流水线的URB会在各自的处理线程上并发回调，同一设备的URB按序、不并发
+    using UrbCallback = std::function<void(protocol::UsbUrb urb)>;
     
     UrbCapture();
     ~UrbCapture();
@@ -28,8 +44,13 @@ public:
     
     // 设置回调函数
     void SetUrbCallback(UrbCallback callback) { urb_callback_ = std::move(callback); }
+
+    // 处理线程绑定的CPU：第i条流水线绑定到cpus[i % cpus.size()]，为空时不绑定。StartCapture之前调用
+    void SetCpuSet(std::vector<int> cpus) { cpus_ = std::move(cpus); }
+    // 空闲处理线程代取其他流水线的积压（默认开启）。StartCapture之前调用
+    void SetWorkStealing(bool enabled) { work_stealing_ = enabled; }
     
-    // 添加要监控的设备
+    // 添加要监控的设备，每个设备分配一条流水线
     bool AddDevice(std::shared_ptr<MassStorageDevice> device);
     void RemoveDevice(std::shared_ptr<MassStorageDevice> device);
     void RemoveAllDevices();
@@ -39,8 +60,15 @@ public:
     void StopCapture();
     bool IsCapturing() const { return capturing_.load(); }
     
-    // 手动注入URB (用于测试)
-    void InjectUrb(const protocol::UsbUrb& urb);
+    // 手动注入URB (用于测试)，进入0号流水线。不阻塞，队列已满或未在捕获时返回false，URB保持不变
+    bool InjectUrb(protocol::UsbUrb& urb);
+    // 各流水线队列中等待处理的URB总数（近似值）
+    size_t QueueDepth() const;
+    size_t PipelineCount() const { return pipeline_count_.load(std::memory_order_acquire); }
+
+    // URB计数和延迟直方图：捕获线程在此计数，传输引擎记录设备传输时间，发送端记录端到端延迟
+    protocol::UrbMetrics& Metrics() { return metrics_; }
+    const protocol::UrbMetrics& Metrics() const { return metrics_; }
     
     // 获取统计信息
     struct Statistics {
@@ -51,37 +79,78 @@ public:
         uint64_t iso_urbs;
         uint64_t bytes_transferred;
         uint64_t errors;
+        uint64_t backpressure_events;   // 生产者遇到队列已满的次数
+        uint64_t wakeups;               // 唤醒处理线程的次数
+        uint64_t stolen_urbs;           // 由其他流水线的处理线程代取的URB数
+        // 按UsbTransferType索引的延迟分布（所有端点合并）
+        utils::LatencySummary end_to_end[protocol::URB_TRANSFER_TYPE_COUNT];
+        utils::LatencySummary device_transfer[protocol::URB_TRANSFER_TYPE_COUNT];
     };
     
+    // 合并各线程的计数块和直方图，不加锁（各计数分别读取，彼此之间不是同一时刻的快照）
     Statistics GetStatistics() const;
     void ResetStatistics();
 
 private:
-    void ProcessingThread();
-    void OnDeviceData(const protocol::UsbUrb& urb);
-    void UpdateStatistics(const protocol::UsbUrb& urb);
+    // 流水线自身的计数（URB计数在metrics_的线程计数块中），按缓存行对齐避免伪共享
+    struct alignas(64) PipelineCounters {
+        std::atomic<uint64_t> stolen_urbs{0};
+        std::atomic<uint64_t> backpressure_events{0};
+    };
+
+    struct Pipeline {
+        explicit Pipeline(size_t index) : index(index), queue(URB_QUEUE_CAPACITY) {}
+
+        const size_t index;
+        utils::MpscRing<protocol::UsbUrb> queue;
+        utils::Notifier ready;              // 唤醒处理线程
+        utils::Notifier space;              // 唤醒等待队列空间的生产者
+        alignas(64) std::atomic<bool> draining{false};     // 取用权：处理线程与代取线程互斥
+        PipelineCounters counters;
+        size_t devices = 0;                 // 使用该流水线的设备数，受devices_mutex_保护
+        std::thread worker;
+    };
+
+    void WorkerThread(Pipeline& pipeline);
+    // 取得取用权后成批处理，返回处理的URB数；取用权被占用时返回0
+    size_t DrainPipeline(Pipeline& pipeline, bool stolen);
+    // 从积压最多的其他流水线代取一批
+    bool StealWork(const Pipeline& self);
+    void OnDeviceData(Pipeline& pipeline, protocol::UsbUrb urb);
+    // 为设备选择流水线，需持devices_mutex_
+    Pipeline& AssignPipeline();
+    void StartWorker(Pipeline& pipeline);
     
     std::vector<std::shared_ptr<MassStorageDevice>> devices_;
+    std::vector<Pipeline*> device_pipelines_;       // 与devices_一一对应
     UrbCallback urb_callback_;
+    protocol::UrbMetrics metrics_;
+    std::vector<int> cpus_;
+    bool work_stealing_;
     
     std::atomic<bool> capturing_;
     std::atomic<bool> should_stop_;
     
-    std::thread processing_thread_;
-    
-    std::queue<protocol::UsbUrb> urb_queue_;
-    mutable std::mutex queue_mutex_;
-    std::condition_variable queue_cv_;
+    // 流水线只增不减（设备移除后留作复用），读取统计时无需加锁即可遍历
+    std::unique_ptr<Pipeline> pipelines_[MAX_PIPELINES];
+    std::atomic<size_t> pipeline_count_;
+    size_t next_shared_pipeline_;                   // 流水线用完后轮流共用
     
     mutable std::mutex devices_mutex_;
-    mutable std::mutex stats_mutex_;
-    Statistics statistics_;
 };
 
+// 每个会话一个实例，序列号在会话内连续，可被多个设备线程并发使用
 class UrbProcessor {
 public:
     UrbProcessor();
     ~UrbProcessor() = default;
+
+    // 禁止拷贝
+    UrbProcessor(const UrbProcessor&) = delete;
+    UrbProcessor& operator=(const UrbProcessor&) = delete;
+
+    // 新会话开始时重置序列号
+    void Reset() { seqnums_.Reset(); }
     
     // 处理URB数据，转换为USBIP格式
     std::vector<uint8_t> ProcessUrb(const protocol::UsbUrb& urb);
@@ -90,11 +159,19 @@ public:
     network::NetworkMessage CreateUsbipSubmit(const protocol::UsbUrb& urb);
     network::NetworkMessage CreateUsbipResponse(const protocol::UsbUrb& urb);
 
+    // 分散-聚集形式：USBIP头部拷贝进帧，数据直接引用urb.data（发送完成前urb必须保持有效）
+    // seqnum返回分配的USBIP序列号，用于登记在途URB
+    bool BuildUsbipFrame(const protocol::UsbUrb& urb, network::OutgoingFrame& frame, uint32_t* seqnum = nullptr);
+
+    // 只生成网络字节序的USBIP头部（去重提议以extent哈希代替数据），返回写入的字节数
+    static constexpr size_t USBIP_HEADER_SIZE = sizeof(protocol::UsbipCmdSubmit);
+    size_t BuildUsbipHeader(const protocol::UsbUrb& urb, uint8_t* header, uint32_t* seqnum = nullptr);
+
 private:
     protocol::UsbipCmdSubmit CreateCmdSubmit(const protocol::UsbUrb& urb);
     protocol::UsbipRetSubmit CreateRetSubmit(const protocol::UsbUrb& urb);
     
-    uint32_t next_seqnum_;
+    protocol::SequenceSpace seqnums_;
 };
 
 } // namespace sender
@@ -1,18 +1,63 @@
 #include <iostream>
 #include <signal.h>
 #include <memory>
+#include <string>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <errno.h>
 
 #include "usb/usb_device_manager.h"
 #include "usb/mass_storage_device.h"
 #include "capture/urb_capture.h"
 #include "network/tcp_socket.h"
 #include "network/message_handler.h"
+#include "protocol/urb_table.h"
+#include "protocol/dedup_store.h"
 #include "utils/logger.h"
+#include "utils/thread_affinity.h"
 
 using namespace usb_redirector;
 
+// 一个已接受的连接：帧序列号和协商的校验、压缩、分片状态（MessageHandler）、USBIP序列号、
+// 在途URB和去重提议都属于连接，新连接从全新的状态开始，断开时随会话一起销毁
+struct ClientSession {
+    explicit ClientSession(std::shared_ptr<network::TcpSocket> client)
+        : socket(std::move(client)) {
+        // 去重和压缩由接收端按需开启，发送端总是声明支持（压缩仍按数据和链路自适应旁路）
+        message_handler.SetLocalFeatures(network::FEATURE_DEDUP);
+        network::CompressionConfig compression;
+        compression.enabled = true;
+        message_handler.SetCompressionConfig(compression);
+        // 大的批量帧分片发送，控制和中断传输不必等整帧批量数据写完
+        message_handler.SetFragmentSize(network::MessageHandler::DEFAULT_FRAGMENT_SIZE);
+    }
+
+    // 以帧的优先级交给socket，并以USBIP序列号标记，URB被撤销时可从发送队列中取回
+    network::MessageHandler::FrameSender FrameSenderFor(uint32_t seqnum) const {
+        network::TcpSocket* target = socket.get();
+        return [target, seqnum](const struct iovec* iov, size_t count, network::SendPriority priority) {
+            return target->SendV(iov, count, priority, seqnum);
+        };
+    }
+
+    std::shared_ptr<network::TcpSocket> socket;
+    network::MessageHandler message_handler;
+    sender::UrbProcessor urb_processor;                 // 会话内共用，USBIP序列号连续
+    protocol::UrbTable urb_table;                       // 已发出、等待接收端回复的URB
+
+    // 已发出DEDUP_OFFER、等待接收端回复的READ数据，以提议ID（USBIP序列号）为键
+    std::unordered_map<uint32_t, utils::PooledBuffer> dedup_offers;
+    std::mutex dedup_mutex;
+};
+
+// 会话列表不可变，连接建立和断开时拷贝后整体替换，发送URB的热路径只取快照
+using SessionList = std::vector<std::shared_ptr<ClientSession>>;
+using SessionListPtr = std::shared_ptr<const SessionList>;
+
 class UsbSender {
 public:
     UsbSender() 
@@ -20,13 +65,19 @@ public:
         , server_port_(3240) // USBIP默认端口
         , device_manager_(std::make_unique<sender::UsbDeviceManager>())
         , urb_capture_(std::make_unique<sender::UrbCapture>())
-        , message_handler_(std::make_unique<network::MessageHandler>())
-        , tcp_server_(std::make_unique<network::TcpSocket>()) {
+        , tcp_server_(std::make_unique<network::TcpServer>())
+        , sessions_(std::make_shared<const SessionList>())
+        , dedup_bytes_saved_(0) {
     }
     
     ~UsbSender() {
         Stop();
     }
+
+    // 各设备捕获流水线的处理线程绑定的CPU
+    void SetCaptureCpus(std::vector<int> cpus) {
+        urb_capture_->SetCpuSet(std::move(cpus));
+    }
     
     bool Initialize() {
         // 初始化日志
@@ -41,12 +92,17 @@ public:
             return false;
         }
         
+        // 设备传输时间与捕获计数记入同一组指标
+        if (auto* engine = device_manager_->GetTransferEngine()) {
+            engine->SetMetrics(&urb_capture_->Metrics());
+        }
+        
         // 设置网络回调
         SetupNetworkCallbacks();
         
         // 设置URB捕获回调
-        urb_capture_->SetUrbCallback([this](const protocol::UsbUrb& urb) {
-            OnUrbCaptured(urb);
+        urb_capture_->SetUrbCallback([this](protocol::UsbUrb urb) {
+            OnUrbCaptured(std::move(urb));
         });
         
         LOG_INFO("USB Sender initialized successfully");
@@ -59,7 +115,7 @@ public:
         }
         
         // 启动TCP服务器
-        if (!tcp_server_->Listen("0.0.0.0", server_port_)) {
+        if (!tcp_server_->Start("0.0.0.0", server_port_)) {
             LOG_ERROR("Failed to start TCP server on port " << server_port_);
             return false;
         }
@@ -95,14 +151,26 @@ public:
         
         running_ = false;
         
-        // 停止URB捕获
+        // 停止URB捕获，传输引擎不再记录到捕获的指标中
         urb_capture_->StopCapture();
+        if (auto* engine = device_manager_->GetTransferEngine()) {
+            engine->SetMetrics(nullptr);
+        }
         
         // 停止热插拔监控
         device_manager_->StopHotplugMonitoring();
         
-        // 关闭网络连接
-        tcp_server_->Close();
+        // 关闭网络连接（各会话随断开回调移除），未回复的URB不会再完成
+        tcp_server_->Stop();
+        SessionListPtr sessions;
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            sessions.swap(sessions_);
+            sessions_ = std::make_shared<const SessionList>();
+        }
+        for (auto& session : *sessions) {
+            session->urb_table.CancelAll(-ECONNRESET);
+        }
         
         // 清理设备
         mass_storage_devices_.clear();
@@ -125,36 +193,135 @@ public:
             // 打印统计信息
             auto stats = urb_capture_->GetStatistics();
             if (stats.total_urbs > 0) {
+                auto snapshot = Sessions();
+                const SessionList& sessions = *snapshot;
+                size_t in_flight = 0;
+                for (const auto& session : sessions) {
+                    in_flight += session->urb_table.Size();
+                }
                 LOG_INFO("URB Stats - Total: " << stats.total_urbs 
                         << ", Control: " << stats.control_urbs
                         << ", Bulk: " << stats.bulk_urbs
                         << ", Bytes: " << stats.bytes_transferred
-                        << ", Errors: " << stats.errors);
+                        << ", Errors: " << stats.errors
+                        << ", Capture queue: " << urb_capture_->QueueDepth()
+                        << " (backpressure " << stats.backpressure_events
+                        << ", pipelines " << urb_capture_->PipelineCount()
+                        << ", stolen " << stats.stolen_urbs << ")"
+                        << ", Clients: " << sessions.size()
+                        << ", In flight: " << in_flight
+                        << ", USB transfers: " << UsbTransfersInFlight()
+                        << ", Dedup saved: " << dedup_bytes_saved_.load() << " bytes");
+
+                // 各类传输的端到端延迟和设备传输时间、各优先级的网络排队时间（p50/p99/p999）
+                static const char* const type_names[] = {"Control", "Iso", "Bulk", "Interrupt"};
+                for (size_t type = 0; type < protocol::URB_TRANSFER_TYPE_COUNT; ++type) {
+                    if (stats.end_to_end[type].count + stats.device_transfer[type].count > 0) {
+                        LOG_INFO("URB latency " << type_names[type] << " (us) - End-to-end: "
+                                << FormatPercentiles(stats.end_to_end[type])
+                                << ", Device: " << FormatPercentiles(stats.device_transfer[type]));
+                    }
+                }
+                for (const auto& session : sessions) {
+                    auto send_stats = session->socket->GetSendStatistics();
+                    LOG_INFO("Client " << session->socket->GetRemoteAddress()
+                            << " - Compression ratio: " << session->message_handler.GetCompressionStatistics().Ratio()
+                            << ", Send queue wait (us) - Control: "
+                            << FormatPercentiles(send_stats.classes[static_cast<size_t>(network::SendPriority::CONTROL)].wait)
+                            << ", Interrupt: "
+                            << FormatPercentiles(send_stats.classes[static_cast<size_t>(network::SendPriority::INTERRUPT)].wait)
+                            << ", Bulk: "
+                            << FormatPercentiles(send_stats.classes[static_cast<size_t>(network::SendPriority::BULK)].wait));
+                }
             }
         }
     }
 
 private:
     void SetupNetworkCallbacks() {
-        tcp_server_->SetConnectCallback([this](bool connected) {
+        // 每个接受的连接建立自己的会话，在连接开始接收数据之前设置回调
+        tcp_server_->SetClientConnectCallback([this](std::shared_ptr<network::TcpSocket> client) {
+            OnClientAccepted(std::move(client));
+        });
+    }
+    
+    void OnClientAccepted(std::shared_ptr<network::TcpSocket> client) {
+        auto session = std::make_shared<ClientSession>(client);
+        // 回调只持弱引用：会话持有连接，连接持有回调
+        std::weak_ptr<ClientSession> weak_session = session;
+        
+        client->SetConnectCallback([this, weak_session](bool connected) {
+            auto session = weak_session.lock();
+            if (!session) {
+                return;
+            }
             if (connected) {
-                LOG_INFO("Client connected");
-            } else {
-                LOG_INFO("Client disconnected");
+                LOG_INFO("Client connected: " << session->socket->GetRemoteAddress());
+                return;
             }
+            LOG_INFO("Client disconnected");
+            RemoveSession(session);
         });
         
-        tcp_server_->SetDataCallback([this](const uint8_t* data, size_t len) {
-            message_handler_->ProcessReceivedData(data, len);
+        client->SetDataCallback([weak_session](const uint8_t* data, size_t len) {
+            if (auto session = weak_session.lock()) {
+                session->message_handler.ProcessReceivedData(data, len);
+            }
         });
         
-        tcp_server_->SetErrorCallback([this](const std::string& error) {
+        client->SetErrorCallback([](const std::string& error) {
             LOG_ERROR("Network error: " << error);
         });
         
-        message_handler_->SetMessageCallback([this](const network::NetworkMessage& message) {
-            OnNetworkMessage(message);
+        // 消息回调在该连接的数据回调中调用，此时会话必定存在
+        ClientSession* raw_session = session.get();
+        session->message_handler.SetMessageCallback([this, raw_session](const network::MessageView& message) {
+            OnNetworkMessage(*raw_session, message);
         });
+        
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        // 未能接管的连接不会报告断开，登记新会话时一并清理
+        auto sessions = std::make_shared<SessionList>();
+        for (const auto& existing : *sessions_) {
+            if (existing->socket->IsConnected()) {
+                sessions->push_back(existing);
+            }
+        }
+        sessions->push_back(std::move(session));
+        sessions_ = std::move(sessions);
+    }
+    
+    void RemoveSession(const std::shared_ptr<ClientSession>& session) {
+        {
+            std::lock_guard<std::mutex> lock(sessions_mutex_);
+            auto sessions = std::make_shared<SessionList>(*sessions_);
+            sessions->erase(std::remove(sessions->begin(), sessions->end(), session), sessions->end());
+            sessions_ = std::move(sessions);
+        }
+        
+        // 连接断开后在途URB不会再收到回复，未补齐的去重提议随之失效
+        size_t cancelled = session->urb_table.CancelAll(-ECONNRESET);
+        if (cancelled > 0) {
+            LOG_WARNING("Dropped " << cancelled << " in-flight URBs");
+        }
+        std::lock_guard<std::mutex> lock(session->dedup_mutex);
+        session->dedup_offers.clear();
+    }
+    
+    // 当前会话列表的快照：只增加一次引用计数，不拷贝列表
+    SessionListPtr Sessions() {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        return sessions_;
+    }
+    
+    static std::string FormatPercentiles(const utils::LatencySummary& latency) {
+        return std::to_string(latency.p50_us) + "/" + std::to_string(latency.p99_us) + "/" +
+               std::to_string(latency.p999_us);
+    }
+    
+    size_t UsbTransfersInFlight() const {
+        auto* engine = device_manager_->GetTransferEngine();
+        return engine ? engine->InflightCount() : 0;
     }
     
     void ScanMassStorageDevices() {
@@ -196,38 +363,130 @@ private:
         }
     }
     
-    void OnUrbCaptured(const protocol::UsbUrb& urb) {
-        // 将URB转换为网络消息并发送
-        sender::UrbProcessor processor;
-        auto message = processor.CreateUsbipSubmit(urb);
-        auto data = message_handler_->SerializeMessage(message);
-        
-        if (!tcp_server_->Send(data)) {
+    void OnUrbCaptured(protocol::UsbUrb urb) {
+        // 发往每个已连接的会话，各自分配USBIP序列号并登记在途URB（URB拷贝共享数据缓冲区）
+        // 列表只在连接建立和断开时整体替换，这里不分配内存
+        auto snapshot = Sessions();
+        const SessionList& sessions = *snapshot;
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            if (!sessions[i]->socket->IsConnected()) {
+                continue;
+            }
+            if (i + 1 == sessions.size()) {
+                SendUrb(*sessions[i], std::move(urb));
+            } else {
+                SendUrb(*sessions[i], urb);
+            }
+        }
+    }
+    
+    void SendUrb(ClientSession& session, protocol::UsbUrb urb) {
+        // 协商了去重时，较大的READ数据先只发extent哈希，接收端本地没有的再补发。
+        // 接收端不接受头部加数据超过单条消息上限的提议
+        if ((session.message_handler.GetNegotiatedFeatures() & network::FEATURE_DEDUP) &&
+            urb.direction == protocol::UsbDirection::IN && urb.data.size() >= protocol::DEDUP_EXTENT_SIZE &&
+            urb.data.size() + sender::UrbProcessor::USBIP_HEADER_SIZE <= network::MessageHandler::MAX_MESSAGE_SIZE) {
+            SendDedupOffer(session, std::move(urb));
+            return;
+        }
+
+        // 消息头、USBIP头部和URB数据分段发送，数据直接从URB缓冲区写出
+        network::OutgoingFrame frame;
+        uint32_t seqnum = 0;
+        if (!session.urb_processor.BuildUsbipFrame(urb, frame, &seqnum)) {
+            LOG_WARNING("Failed to build URB frame");
+            return;
+        }
+
+        // 登记为在途URB，收到USBIP_RET_SUBMIT时按seqnum配对
+        if (!session.urb_table.Insert(MakeInflight(urb, seqnum))) {
+            LOG_WARNING("Too many URBs in flight (" << session.urb_table.MaxConcurrent()
+                        << "), seqnum " << seqnum << " will not be tracked");
+        }
+        auto priority = network::MessageHandler::TransferPriority(urb.type);
+        if (!session.message_handler.SendFrame(network::MessageType::URB_SUBMIT, frame, priority,
+                                               session.FrameSenderFor(seqnum))) {
             LOG_WARNING("Failed to send URB data over network");
         }
     }
     
-    void OnNetworkMessage(const network::NetworkMessage& message) {
-        switch (static_cast<network::MessageType>(message.header.type)) {
+    static protocol::InflightUrb MakeInflight(const protocol::UsbUrb& urb, uint32_t seqnum) {
+        protocol::InflightUrb inflight;
+        inflight.seqnum = seqnum;
+        inflight.endpoint = urb.endpoint;
+        inflight.direction = urb.direction;
+        inflight.type = urb.type;
+        inflight.capture_time_us = urb.timestamp;
+        return inflight;
+    }
+    
+    void SendDedupOffer(ClientSession& session, protocol::UsbUrb urb) {
+        uint8_t header[sender::UrbProcessor::USBIP_HEADER_SIZE];
+        uint32_t seqnum = 0;
+        size_t header_length = session.urb_processor.BuildUsbipHeader(urb, header, &seqnum);
+
+        if (!session.urb_table.Insert(MakeInflight(urb, seqnum))) {
+            LOG_WARNING("Too many URBs in flight (" << session.urb_table.MaxConcurrent()
+                        << "), seqnum " << seqnum << " will not be tracked");
+        }
+
+        // 数据保留到接收端回复DEDUP_REQUEST，提议ID即USBIP序列号
+        auto extents = protocol::HashExtents(urb.data.data(), urb.data.size());
+        {
+            std::lock_guard<std::mutex> lock(session.dedup_mutex);
+            session.dedup_offers[seqnum] = std::move(urb.data);
+        }
+
+        auto offer = network::MessageHandler::CreateDedupOffer(seqnum, header, header_length, extents);
+        auto data = session.message_handler.SerializeMessage(offer);
+        if (!session.socket->Send(data, network::SendPriority::BULK, seqnum)) {
+            LOG_WARNING("Failed to send dedup offer over network");
+            std::lock_guard<std::mutex> lock(session.dedup_mutex);
+            session.dedup_offers.erase(seqnum);
+        }
+    }
+
+    void OnNetworkMessage(ClientSession& session, const network::MessageView& message) {
+        switch (message.Type()) {
             case network::MessageType::DEVICE_LIST_REQUEST:
-                HandleDeviceListRequest();
+                HandleDeviceListRequest(session);
                 break;
                 
             case network::MessageType::DEVICE_IMPORT_REQUEST:
-                HandleDeviceImportRequest(message);
+                HandleDeviceImportRequest(session, message);
                 break;
                 
             case network::MessageType::HEARTBEAT:
-                HandleHeartbeat();
+                HandleHeartbeat(session);
+                break;
+
+            case network::MessageType::CAPABILITIES:
+                HandleCapabilities(session);
+                break;
+                
+            case network::MessageType::URB_RESPONSE:
+                HandleUrbResponse(session, message);
+                break;
+                
+            case network::MessageType::URB_UNLINK:
+                HandleUrbUnlink(session, message);
+                break;
+                
+            case network::MessageType::URB_UNLINK_RESPONSE:
+                HandleUrbUnlinkResponse(message);
+                break;
+
+            case network::MessageType::DEDUP_REQUEST:
+                HandleDedupRequest(session, message);
                 break;
                 
             default:
-                LOG_WARNING("Unknown message type: " << message.header.type);
+                LOG_WARNING("Unknown message type: " << message.Header().type);
                 break;
         }
     }
     
-    void HandleDeviceListRequest() {
+    void HandleDeviceListRequest(ClientSession& session) {
         LOG_INFO("Received device list request");
         
         std::vector<protocol::UsbipDeviceInfo> device_list;
@@ -259,14 +518,14 @@ private:
         }
         
         auto response = network::MessageHandler::CreateDeviceListResponse(device_list);
-        auto data = message_handler_->SerializeMessage(response);
-        tcp_server_->Send(data);
+        auto data = session.message_handler.SerializeMessage(response);
+        session.socket->Send(data);
         
         LOG_INFO("Sent device list with " << device_list.size() << " devices");
     }
     
-    void HandleDeviceImportRequest(const network::NetworkMessage& message) {
-        std::string bus_id(message.payload.begin(), message.payload.end());
+    void HandleDeviceImportRequest(ClientSession& session, const network::MessageView& message) {
+        std::string bus_id(message.begin(), message.end());
         LOG_INFO("Received device import request for: " << bus_id);
         
         // 查找对应的设备
@@ -280,16 +539,137 @@ private:
         
         auto response = network::MessageHandler::CreateDeviceImportResponse(found, 
             found ? "" : "Device not found");
-        auto data = message_handler_->SerializeMessage(response);
-        tcp_server_->Send(data);
+        auto data = session.message_handler.SerializeMessage(response);
+        session.socket->Send(data);
         
         LOG_INFO("Device import " << (found ? "successful" : "failed") << " for: " << bus_id);
     }
     
-    void HandleHeartbeat() {
+    void HandleUrbResponse(ClientSession& session, const network::MessageView& message) {
+        protocol::UsbipRetSubmit ret_submit;
+        if (!protocol::UsbipProtocol::ParseRetSubmit(message.Data(), message.Size(), ret_submit)) {
+            LOG_WARNING("Invalid URB response message size");
+            return;
+        }
+        
+        const uint8_t* data = message.Data() + sizeof(ret_submit);
+        size_t len = message.Size() - sizeof(ret_submit);
+        protocol::InflightUrb completed;
+        if (!session.urb_table.Complete(ret_submit.header.seqnum, ret_submit.status, data, len, &completed)) {
+            LOG_WARNING("URB response for unknown seqnum: " << ret_submit.header.seqnum);
+            return;
+        }
+
+        if (completed.capture_time_us > 0) {
+            uint64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            uint8_t endpoint = completed.endpoint | (completed.direction == protocol::UsbDirection::IN ? 0x80 : 0);
+            urb_capture_->Metrics().RecordLatency(protocol::UrbLatencyKind::END_TO_END, completed.type, endpoint,
+                                                  now_us > completed.capture_time_us
+                                                      ? now_us - completed.capture_time_us : 0);
+        }
+    }
+    
+    void HandleUrbUnlink(ClientSession& session, const network::MessageView& message) {
+        protocol::UsbipCmdUnlink cmd_unlink;
+        if (!protocol::UsbipProtocol::ParseCmdUnlink(message.Data(), message.Size(), cmd_unlink)) {
+            LOG_WARNING("Invalid URB unlink message size");
+            return;
+        }
+        
+        uint32_t target = cmd_unlink.unlink_seqnum;
+        
+        // 撤销该URB在本端仍持有的部分：发送队列中尚未写出的帧（分片消息已写出前半部分时，
+        // 接收端在下一个首分片到达时丢弃未完成的部分）和等待DEDUP_REQUEST的保留数据。
+        // seqnum是本会话分配给捕获URB的编号，设备上的块读写由本端SCSI层发起、不对应任何
+        // seqnum，因此不在撤销范围内，已提交给设备的传输照常完成
+        size_t dropped = session.socket->DropQueuedFrames(target);
+        bool released = false;
+        {
+            std::lock_guard<std::mutex> lock(session.dedup_mutex);
+            released = session.dedup_offers.erase(target) > 0;
+        }
+        bool cancelled = dropped > 0 || released;
+        // 在途表的槽位总是释放，迟到的结果不再配对
+        session.urb_table.Remove(target);
+        
+        // 按USBIP约定：撤销成功返回-ECONNRESET，数据已经全部交出（URB已完成）返回0
+        int32_t status = cancelled ? -ECONNRESET : 0;
+        LOG_DEBUG("Unlink seqnum " << target << ": " << (status ? "cancelled" : "already completed")
+                  << ", " << dropped << " queued frames dropped");
+        
+        // 以最低优先级发送，不会越过同一URB仍在排队的响应
+        auto response = network::MessageHandler::CreateUrbUnlinkResponse(cmd_unlink.header.seqnum, status);
+        auto data = session.message_handler.SerializeMessage(response);
+        session.socket->Send(data, network::SendPriority::BULK);
+    }
+    
+    void HandleUrbUnlinkResponse(const network::MessageView& message) {
+        protocol::UsbipRetUnlink ret_unlink;
+        if (!protocol::UsbipProtocol::ParseRetUnlink(message.Data(), message.Size(), ret_unlink)) {
+            LOG_WARNING("Invalid URB unlink response size");
+            return;
+        }
+        LOG_DEBUG("Unlink " << ret_unlink.header.seqnum << " completed with status " << ret_unlink.status);
+    }
+    
+    void HandleDedupRequest(ClientSession& session, const network::MessageView& message) {
+        uint32_t offer_id = 0;
+        std::vector<uint32_t> missing;
+        if (!network::MessageHandler::ParseDedupRequest(message, offer_id, missing)) {
+            LOG_WARNING("Invalid dedup request");
+            return;
+        }
+
+        utils::PooledBuffer data;
+        {
+            std::lock_guard<std::mutex> lock(session.dedup_mutex);
+            auto it = session.dedup_offers.find(offer_id);
+            if (it == session.dedup_offers.end()) {
+                LOG_WARNING("Dedup request for unknown offer " << offer_id);
+                return;
+            }
+            data = std::move(it->second);
+            session.dedup_offers.erase(it);
+        }
+
+        // 只补发接收端缺少的extent，其余由接收端本地存储应答
+        auto send_frame = session.FrameSenderFor(offer_id);
+        size_t sent = 0;
+        for (uint32_t index : missing) {
+            size_t offset = static_cast<size_t>(index) * protocol::DEDUP_EXTENT_SIZE;
+            if (offset >= data.size()) {
+                LOG_WARNING("Dedup request for invalid extent " << index << " of offer " << offer_id);
+                continue;
+            }
+            size_t len = std::min<size_t>(protocol::DEDUP_EXTENT_SIZE, data.size() - offset);
+
+            network::OutgoingFrame frame;
+            network::MessageHandler::BuildDedupData(frame, offer_id, index, data.data() + offset, len);
+            if (!session.message_handler.SendFrame(network::MessageType::DEDUP_DATA, frame,
+                                                   network::SendPriority::BULK, send_frame)) {
+                LOG_WARNING("Failed to send dedup data over network");
+                return;
+            }
+            sent += len;
+        }
+
+        dedup_bytes_saved_ += data.size() - sent;
+        LOG_DEBUG("Dedup offer " << offer_id << ": " << missing.size() << " extents sent, "
+                  << data.size() - sent << " bytes saved");
+    }
+
+    void HandleCapabilities(ClientSession& session) {
+        // 协商已由该连接的MessageHandler完成，回复本端能力让对端得出相同结果
+        auto response = session.message_handler.CreateCapabilities();
+        auto data = session.message_handler.SerializeMessage(response);
+        session.socket->Send(data);
+    }
+
+    void HandleHeartbeat(ClientSession& session) {
         auto response = network::MessageHandler::CreateHeartbeat();
-        auto data = message_handler_->SerializeMessage(response);
-        tcp_server_->Send(data);
+        auto data = session.message_handler.SerializeMessage(response);
+        session.socket->Send(data);
     }
 
 private:
@@ -298,10 +678,14 @@ private:
     
     std::unique_ptr<sender::UsbDeviceManager> device_manager_;
     std::unique_ptr<sender::UrbCapture> urb_capture_;
-    std::unique_ptr<network::MessageHandler> message_handler_;
-    std::unique_ptr<network::TcpSocket> tcp_server_;
+    std::unique_ptr<network::TcpServer> tcp_server_;
     
     std::vector<std::shared_ptr<sender::MassStorageDevice>> mass_storage_devices_;
+
+    // 已连接的客户端，每个连接一个会话
+    SessionListPtr sessions_;
+    std::mutex sessions_mutex_;
+    std::atomic<uint64_t> dedup_bytes_saved_;
 };
 
 // 全局变量用于信号处理
@@ -314,13 +698,42 @@ void SignalHandler(int signal) {
     }
 }
 
+void PrintUsage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " [options]\n"
+              << "Options:\n"
+              << "  --capture-cpus <list> Pin per-device URB capture pipelines to these CPUs,\n"
+              << "                        e.g. 2,3 or 4-7 (default: not pinned)\n"
+              << "  --help                Show this help message\n";
+}
+
 int main(int argc, char* argv[]) {
     // 设置信号处理
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
     
+    std::vector<int> capture_cpus;
+    
+    // 解析命令行参数
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg == "--help") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else if (arg == "--capture-cpus") {
+            if (i + 1 >= argc || !utils::ParseCpuList(argv[++i], capture_cpus)) {
+                std::cerr << "Error: --capture-cpus requires a CPU list such as 0,2 or 4-7\n";
+                return 1;
+            }
+        } else {
+            // 此前发送端不解析参数，未知参数只提示而不退出
+            std::cerr << "Warning: Ignoring unknown argument: " << arg << "\n";
+        }
+    }
+    
     try {
         g_sender = std::make_unique<UsbSender>();
+        g_sender->SetCaptureCpus(capture_cpus);
         
         if (!g_sender->Initialize()) {
             LOG_ERROR("Failed to initialize USB Sender");
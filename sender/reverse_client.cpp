@@ -29,7 +29,7 @@ ReverseClient::ReverseClient()
     });
     
     // 设置消息处理回调
-    message_handler_->SetMessageCallback([this](const network::NetworkMessage& message) {
+    message_handler_->SetMessageCallback([this](const network::MessageView& message) {
         OnNetworkMessage(message);
     });
 }
@@ -113,6 +113,10 @@ void ReverseClient::OnNetworkConnect(bool connected) {
     
     if (connected) {
         LOG_INFO("Network connection established with Linux server");
+
+        // 新连接使用新的会话状态并重新协商校验模式
+        message_handler_->ResetSession();
+        SendMessage(message_handler_->CreateCapabilities());
     } else {
         LOG_INFO("Network connection lost");
     }
@@ -131,7 +135,7 @@ void ReverseClient::OnNetworkError(const std::string& error) {
     connected_.store(false);
 }
 
-void ReverseClient::OnNetworkMessage(const network::NetworkMessage& message) {
+void ReverseClient::OnNetworkMessage(const network::MessageView& message) {
     if (message_callback_) {
         message_callback_(message);
     }
@@ -13,7 +13,8 @@ namespace sender {
 class ReverseClient {
 public:
     using ConnectCallback = std::function<void(bool connected)>;
-    using MessageCallback = std::function<void(const network::NetworkMessage& message)>;
+    // 回调中的消息视图只在回调期间有效，需要保留时调用Retain()
+    using MessageCallback = std::function<void(const network::MessageView& message)>;
     
     ReverseClient();
     ~ReverseClient();
@@ -41,7 +42,7 @@ private:
     void OnNetworkConnect(bool connected);
     void OnNetworkData(const uint8_t* data, size_t len);
     void OnNetworkError(const std::string& error);
-    void OnNetworkMessage(const network::NetworkMessage& message);
+    void OnNetworkMessage(const network::MessageView& message);
     
     void ReconnectThread();
     
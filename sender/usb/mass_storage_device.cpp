@@ -1,27 +1,94 @@
 #include "mass_storage_device.h"
 #include "utils/logger.h"
 #include <cstring>
+#include <algorithm>
 #include <chrono>
 
 namespace usb_redirector {
 namespace sender {
 
-static constexpr uint32_t CBW_SIGNATURE = 0x43425355; // "USBC"
-static constexpr uint32_t CSW_SIGNATURE = 0x53425355; // "USBS"
-static constexpr uint8_t CBW_FLAG_DATA_IN = 0x80;
-static constexpr uint8_t CBW_FLAG_DATA_OUT = 0x00;
+using protocol::CBW_SIGNATURE;
+using protocol::CSW_SIGNATURE;
+using protocol::CBW_FLAG_DATA_IN;
+using protocol::CBW_FLAG_DATA_OUT;
+
+// libusb传输状态映射为块读写层的传输状态
+template <typename Status>
+static Status TransportStatus(int status) {
+    if (status == LIBUSB_TRANSFER_COMPLETED) {
+        return Status::OK;
+    }
+    return status == LIBUSB_TRANSFER_STALL ? Status::STALL : Status::ERROR;
+}
+
+// 经传输引擎访问批量端点，供BotBlockIo使用
+class MassStorageDevice::BulkTransport : public protocol::BulkOnlyTransport {
+public:
+    explicit BulkTransport(MassStorageDevice& owner) : owner_(owner) {}
+    
+    bool SubmitBulk(bool in, uint8_t* data, uint32_t length, Completion completion) override {
+        uint8_t endpoint = in ? owner_.bulk_in_endpoint_.address : owner_.bulk_out_endpoint_.address;
+        return owner_.device_->SubmitBulkTransfer(endpoint, data, static_cast<int>(length), 0,
+            [completion = std::move(completion)](uint32_t, int status, uint8_t*, int actual_length) {
+                completion(TransportStatus<Status>(status), static_cast<uint32_t>(actual_length));
+            });
+    }
+    
+    bool ClearHalt(bool in) override {
+        return owner_.device_->ClearHalt(in ? owner_.bulk_in_endpoint_.address : owner_.bulk_out_endpoint_.address);
+    }
+
+private:
+    MassStorageDevice& owner_;
+};
+
+// UAS的四条管道：命令管道为普通批量传输，状态和数据管道按标签使用批量流，供UasBlockIo使用
+class MassStorageDevice::UasPipes : public protocol::UasTransport {
+public:
+    UasPipes(MassStorageDevice& owner, uint16_t streams) : owner_(owner), streams_(streams) {}
+    
+    bool SubmitBulk(protocol::UasPipe pipe, uint16_t stream_id, uint8_t* data, uint32_t length,
+                    Completion completion) override {
+        uint8_t endpoint = owner_.uas_pipes_[static_cast<int>(pipe) - 1].address;
+        auto callback = [completion = std::move(completion)](uint32_t, int status, uint8_t*, int actual_length) {
+            completion(TransportStatus<Status>(status), static_cast<uint32_t>(actual_length));
+        };
+        if (pipe == protocol::UasPipe::COMMAND) {
+            return owner_.device_->SubmitBulkTransfer(endpoint, data, static_cast<int>(length), 0, std::move(callback));
+        }
+        return owner_.device_->SubmitBulkStreamTransfer(endpoint, stream_id, data, static_cast<int>(length), 0,
+                                                        std::move(callback));
+    }
+    
+    uint16_t StreamCount() const override { return streams_; }
+
+private:
+    MassStorageDevice& owner_;
+    uint16_t streams_;
+};
+
+static uint64_t ReadBigEndian(const uint8_t* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
 
 MassStorageDevice::MassStorageDevice(std::shared_ptr<UsbDevice> device)
     : device_(std::move(device))
     , initialized_(false)
     , capturing_(false)
     , interface_number_(-1)
-    , next_tag_(1)
-    , total_blocks_(0)
-    , block_size_(512) {
+    , uas_enabled_(true)
+    , uas_alt_setting_(-1)
+    , next_tag_(1) {
     
     bulk_in_endpoint_ = {};
     bulk_out_endpoint_ = {};
+    for (auto& pipe : uas_pipes_) {
+        pipe = {};
+    }
 }
 
 MassStorageDevice::~MassStorageDevice() {
@@ -30,6 +97,7 @@ MassStorageDevice::~MassStorageDevice() {
 
 bool MassStorageDevice::Initialize() {
     std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::shared_mutex> io_lock(io_mutex_);
     
     if (initialized_) {
         return true;
@@ -52,17 +120,41 @@ bool MassStorageDevice::Initialize() {
         return false;
     }
     
-    // 重置设备
-    if (!ResetDevice()) {
-        LOG_WARNING("Failed to reset device, continuing anyway");
+    if (uas_enabled_ && uas_alt_setting_ >= 0 && SetupUas()) {
+        block_io_ = std::make_unique<protocol::UasBlockIo>(*uas_transport_, block_io_config_);
+        LOG_INFO("Using USB Attached SCSI with " << uas_transport_->StreamCount() << " streams");
+    } else {
+        transport_ = std::make_unique<BulkTransport>(*this);
+        block_io_ = std::make_unique<protocol::BotBlockIo>(*transport_, block_io_config_);
+        
+        // 重置设备
+        if (!ResetDevice()) {
+            LOG_WARNING("Failed to reset device, continuing anyway");
+        }
     }
     
-    // 获取设备容量
-    uint64_t capacity;
-    if (GetCapacity(capacity, block_size_)) {
-        total_blocks_ = capacity;
-        LOG_INFO("Mass storage device capacity: " << total_blocks_ << " blocks, " 
-                << block_size_ << " bytes per block");
+    // 枚举LUN并获取各自的容量
+    EnumerateLuns();
+    
+    // 顺序预读缓存，设备读经ReadBlocksDirect完成
+    if (read_ahead_config_.cache_bytes > 0) {
+        read_ahead_ = std::make_unique<protocol::ReadAheadCache>(luns_[0].block_size, read_ahead_config_,
+            [this](uint8_t lun, uint64_t lba, uint32_t block_count, uint8_t* data) {
+                return ReadBlocksDirect(lun, lba, block_count, data);
+            });
+        for (uint8_t lun = 0; lun < luns_.size(); ++lun) {
+            if (luns_[lun].ready && UsesCache(lun)) {
+                read_ahead_->SetLunBlocks(lun, luns_[lun].total_blocks);
+            }
+        }
+    }
+    
+    // 写回合并，写出经WriteBlocksDirect完成
+    if (write_coalescer_config_.max_pending_bytes > 0) {
+        coalescer_ = std::make_unique<protocol::WriteCoalescer>(luns_[0].block_size, write_coalescer_config_,
+            [this](uint8_t lun, uint64_t lba, uint32_t block_count, const uint8_t* data) {
+                return WriteBlocksDirect(lun, lba, block_count, data, false);
+            });
     }
     
     initialized_ = true;
@@ -71,15 +163,26 @@ bool MassStorageDevice::Initialize() {
 }
 
 void MassStorageDevice::Cleanup() {
+    // 先写出待写数据并停止合并和预读线程，它们访问设备时需要获取io_mutex_
+    coalescer_.reset();
+    read_ahead_.reset();
+    
     std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::shared_mutex> io_lock(io_mutex_);
     
     StopCapture();
     
     if (device_ && initialized_) {
+        if (uas_transport_) {
+            device_->FreeStreams({uas_pipes_[1].address, uas_pipes_[2].address, uas_pipes_[3].address});
+        }
         device_->ReleaseInterface(interface_number_);
         device_->Close();
     }
     
+    block_io_.reset();
+    transport_.reset();
+    uas_transport_.reset();
     initialized_ = false;
     LOG_INFO("Mass storage device cleaned up");
 }
@@ -110,6 +213,13 @@ bool MassStorageDevice::FindEndpoints() {
         return false;
     }
     
+    // 当前所在的备用设置：Bulk-Only端点直接记录，
+    // UAS端点要等其后的管道用途描述符才知道是哪条管道
+    bool in_mass_storage = false;
+    uint8_t interface_protocol = 0;
+    EndpointInfo* last_endpoint = nullptr;
+    EndpointInfo uas_endpoint = {};
+    
     // 解析配置描述符
     size_t offset = 0;
     while (offset < config_desc.size()) {
@@ -123,35 +233,65 @@ bool MassStorageDevice::FindEndpoints() {
         }
         
         if (desc_type == static_cast<uint8_t>(protocol::UsbDescriptorType::INTERFACE)) {
+            in_mass_storage = false;
+            last_endpoint = nullptr;
             if (desc_length >= 9) {
                 const auto* iface_desc = reinterpret_cast<const protocol::UsbInterfaceDescriptor*>(&config_desc[offset]);
                 
-                // 检查是否是大容量存储接口
-                if (iface_desc->bInterfaceClass == static_cast<uint8_t>(protocol::UsbDeviceClass::MASS_STORAGE)) {
-                    interface_number_ = iface_desc->bInterfaceNumber;
-                    LOG_INFO("Found mass storage interface: " << interface_number_);
+                // 检查是否是大容量存储接口（只取第一个）
+                if (iface_desc->bInterfaceClass == static_cast<uint8_t>(protocol::UsbDeviceClass::MASS_STORAGE) &&
+                    (interface_number_ < 0 || iface_desc->bInterfaceNumber == interface_number_)) {
+                    in_mass_storage = true;
+                    interface_protocol = iface_desc->bInterfaceProtocol;
+                    if (interface_number_ < 0) {
+                        interface_number_ = iface_desc->bInterfaceNumber;
+                        LOG_INFO("Found mass storage interface: " << interface_number_);
+                    }
+                    if (interface_protocol == protocol::MASS_STORAGE_PROTOCOL_UAS) {
+                        uas_alt_setting_ = iface_desc->bAlternateSetting;
+                        LOG_INFO("Found UAS alternate setting: " << uas_alt_setting_);
+                    }
                 }
             }
         } else if (desc_type == static_cast<uint8_t>(protocol::UsbDescriptorType::ENDPOINT)) {
-            if (desc_length >= 7 && interface_number_ >= 0) {
+            last_endpoint = nullptr;
+            if (desc_length >= 7 && in_mass_storage) {
                 const auto* ep_desc = reinterpret_cast<const protocol::UsbEndpointDescriptor*>(&config_desc[offset]);
                 
                 // 检查是否是批量传输端点
                 if ((ep_desc->bmAttributes & 0x03) == static_cast<uint8_t>(protocol::UsbTransferType::BULK)) {
-                    EndpointInfo ep_info;
+                    EndpointInfo ep_info = {};
                     ep_info.address = ep_desc->bEndpointAddress;
                     ep_info.max_packet_size = ep_desc->wMaxPacketSize;
                     ep_info.is_in = (ep_desc->bEndpointAddress & 0x80) != 0;
                     
-                    if (ep_info.is_in) {
+                    if (interface_protocol == protocol::MASS_STORAGE_PROTOCOL_UAS) {
+                        uas_endpoint = ep_info;
+                        last_endpoint = &uas_endpoint;
+                    } else if (ep_info.is_in) {
                         bulk_in_endpoint_ = ep_info;
+                        last_endpoint = &bulk_in_endpoint_;
                         LOG_INFO("Found bulk IN endpoint: 0x" << std::hex << static_cast<int>(ep_info.address));
                     } else {
                         bulk_out_endpoint_ = ep_info;
+                        last_endpoint = &bulk_out_endpoint_;
                         LOG_INFO("Found bulk OUT endpoint: 0x" << std::hex << static_cast<int>(ep_info.address));
                     }
                 }
             }
+        } else if (desc_type == static_cast<uint8_t>(protocol::UsbDescriptorType::SS_ENDPOINT_COMPANION)) {
+            // bmAttributes位4:0为批量端点支持的流数量的log2
+            if (desc_length >= 4 && last_endpoint) {
+                uint8_t exponent = config_desc[offset + 3] & 0x1F;
+                last_endpoint->max_streams = exponent > 0 ? (1u << exponent) : 0;
+            }
+        } else if (desc_type == protocol::UAS_PIPE_USAGE_DESCRIPTOR) {
+            uint8_t pipe_id = desc_length >= 3 ? config_desc[offset + 2] : 0;
+            if (last_endpoint == &uas_endpoint && pipe_id >= 1 && pipe_id <= 4) {
+                uas_pipes_[pipe_id - 1] = uas_endpoint;
+                LOG_INFO("Found UAS pipe " << static_cast<int>(pipe_id) << ": 0x" << std::hex
+                         << static_cast<int>(uas_endpoint.address));
+            }
         }
         
         offset += desc_length;
@@ -160,6 +300,37 @@ bool MassStorageDevice::FindEndpoints() {
     return interface_number_ >= 0 && bulk_in_endpoint_.address != 0 && bulk_out_endpoint_.address != 0;
 }
 
+bool MassStorageDevice::SetupUas() {
+    for (const auto& pipe : uas_pipes_) {
+        if (pipe.address == 0) {
+            LOG_INFO("UAS alternate setting is missing a pipe, using Bulk-Only");
+            return false;
+        }
+    }
+    
+    // 不使用流的USB 2 UAS需要READ READY/WRITE READY流程，这里直接用Bulk-Only
+    uint32_t max_streams = std::min({uas_pipes_[1].max_streams, uas_pipes_[2].max_streams, uas_pipes_[3].max_streams});
+    if (max_streams == 0) {
+        LOG_INFO("UAS without bulk streams is not supported, using Bulk-Only");
+        return false;
+    }
+    
+    if (!device_->SetAltSetting(interface_number_, uas_alt_setting_)) {
+        return false;
+    }
+    
+    uint32_t wanted = static_cast<uint32_t>(std::min<size_t>(block_io_config_.max_uas_commands_in_flight, max_streams));
+    int streams = device_->AllocStreams(wanted, {uas_pipes_[1].address, uas_pipes_[2].address, uas_pipes_[3].address});
+    if (streams <= 0) {
+        // Bulk-Only固定为备用设置0
+        device_->SetAltSetting(interface_number_, 0);
+        return false;
+    }
+    
+    uas_transport_ = std::make_unique<UasPipes>(*this, static_cast<uint16_t>(std::min(streams, 0xFFFF)));
+    return true;
+}
+
 bool MassStorageDevice::ResetDevice() {
     // 发送批量存储重置请求
     int actual_length;
@@ -187,71 +358,348 @@ bool MassStorageDevice::GetMaxLun(uint8_t& max_lun) {
     ) && actual_length == 1;
 }
 
+bool MassStorageDevice::ReportLuns(uint8_t& max_lun) {
+    // 分配长度：列表头8字节加最多16个LUN条目
+    static constexpr uint32_t kReportLength = 8 + 8 * (protocol::MASS_STORAGE_MAX_LUN + 1);
+    uint8_t cdb[12] = {};
+    cdb[0] = static_cast<uint8_t>(ScsiCommand::REPORT_LUNS);
+    cdb[9] = kReportLength;
+    
+    uint8_t report[kReportLength] = {};
+    uint8_t status = 0;
+    uint32_t received = 0;
+    if (!block_io_->ExecuteScsi(0, cdb, sizeof(cdb), true, report, kReportLength, status, &received) ||
+        status != 0 || received < 16) {
+        return false;
+    }
+    
+    uint64_t list_length = std::min<uint64_t>(ReadBigEndian(report, 4), received - 8);
+    max_lun = 0;
+    for (uint64_t offset = 8; offset + 8 <= 8 + list_length; offset += 8) {
+        // 只认单级外设寻址的LUN（字节0为0），与命令IU中的LUN格式一致
+        if (report[offset] == 0) {
+            max_lun = std::max(max_lun, report[offset + 1]);
+        }
+    }
+    return true;
+}
+
+void MassStorageDevice::EnumerateLuns() {
+    uint8_t max_lun = 0;
+    bool found = uas_transport_ ? ReportLuns(max_lun) : GetMaxLun(max_lun);
+    if (!found) {
+        // 单LUN设备可以不支持GET MAX LUN（STALL）
+        LOG_DEBUG("LUN enumeration not supported, assuming a single LUN");
+        max_lun = 0;
+    }
+    max_lun = std::min(max_lun, protocol::MASS_STORAGE_MAX_LUN);
+    
+    luns_.assign(static_cast<size_t>(max_lun) + 1, LunInfo());
+    for (uint8_t lun = 0; lun < luns_.size(); ++lun) {
+        LunInfo& info = luns_[lun];
+        uint32_t block_size = 0;
+        if (ReadCapacity(lun, info.total_blocks, block_size) && block_size > 0) {
+            info.block_size = block_size;
+            info.ready = true;
+            LOG_INFO("LUN " << static_cast<int>(lun) << " capacity: " << info.total_blocks << " blocks, "
+                    << info.block_size << " bytes per block");
+        } else {
+            // 读卡器的空卡槽：记录sense（通常为NOT READY / MEDIUM NOT PRESENT）
+            info.total_blocks = 0;
+            UpdateSense(lun);
+            LOG_INFO("LUN " << static_cast<int>(lun) << " not ready, sense key 0x" << std::hex
+                    << static_cast<int>(info.sense_key) << " ASC 0x" << static_cast<int>(info.asc)
+                    << " ASCQ 0x" << static_cast<int>(info.ascq));
+        }
+    }
+}
+
+MassStorageDevice::LunInfo MassStorageDevice::GetLunInfo(uint8_t lun) const {
+    std::shared_lock<std::shared_mutex> io_lock(io_mutex_);
+    std::lock_guard<std::mutex> lock(lun_mutex_);
+    return lun < luns_.size() ? luns_[lun] : LunInfo();
+}
+
 bool MassStorageDevice::GetCapacity(uint64_t& total_blocks, uint32_t& block_size) {
-    // 先尝试READ CAPACITY (16)
-    CommandBlockWrapper cbw = {};
-    cbw.dCBWSignature = CBW_SIGNATURE;
-    cbw.dCBWTag = next_tag_++;
-    cbw.dCBWDataTransferLength = 32; // READ CAPACITY (16) 返回32字节
-    cbw.bmCBWFlags = CBW_FLAG_DATA_IN;
-    cbw.bCBWLUN = 0;
-    cbw.bCBWCBLength = 16;
-    
-    // READ CAPACITY (16) 命令
-    cbw.CBWCB[0] = static_cast<uint8_t>(ScsiCommand::READ_CAPACITY_16);
-    cbw.CBWCB[1] = 0x10; // Service Action
-    // 其他字节保持为0
-    
-    if (!SendCBW(cbw)) {
-        LOG_ERROR("Failed to send READ CAPACITY (16) CBW");
+    return GetCapacity(0, total_blocks, block_size);
+}
+
+bool MassStorageDevice::GetCapacity(uint8_t lun, uint64_t& total_blocks, uint32_t& block_size) {
+    std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+    if (!initialized_) {
+        LOG_ERROR("Mass storage device not initialized");
         return false;
     }
+    return ReadCapacity(lun, total_blocks, block_size);
+}
+
+bool MassStorageDevice::ReadCapacity(uint8_t lun, uint64_t& total_blocks, uint32_t& block_size) {
+    // 先尝试READ CAPACITY (16)
+    uint8_t cdb[16] = {};
+    cdb[0] = static_cast<uint8_t>(ScsiCommand::READ_CAPACITY_16);
+    cdb[1] = 0x10; // Service Action
+    cdb[13] = 32;  // 分配长度：返回32字节
     
-    std::vector<uint8_t> capacity_data;
-    if (!TransferData(true, capacity_data, 32)) {
-        LOG_WARNING("READ CAPACITY (16) failed, trying READ CAPACITY (10)");
-        
-        // 尝试READ CAPACITY (10)
-        cbw.dCBWTag = next_tag_++;
-        cbw.dCBWDataTransferLength = 8;
-        cbw.bCBWCBLength = 10;
-        std::memset(cbw.CBWCB, 0, 16);
-        cbw.CBWCB[0] = static_cast<uint8_t>(ScsiCommand::READ_CAPACITY_10);
+    uint8_t capacity_data[32] = {};
+    uint8_t status = 0;
+    uint32_t received = 0;
+    
+    if (block_io_->ExecuteScsi(lun, cdb, 16, true, capacity_data, 32, status, &received) &&
+        status == 0 && received >= 12) {
+        // 解析READ CAPACITY (16) 响应
+        total_blocks = 0;
+        for (int i = 0; i < 8; ++i) {
+            total_blocks = (total_blocks << 8) | capacity_data[i];
+        }
+        total_blocks += 1; // 最后一个块号+1
         
-        if (!SendCBW(cbw) || !TransferData(true, capacity_data, 8)) {
-            LOG_ERROR("Both READ CAPACITY commands failed");
+        block_size = (capacity_data[8] << 24) | (capacity_data[9] << 16) |
+                    (capacity_data[10] << 8) | capacity_data[11];
+        return true;
+    }
+    
+    LOG_WARNING("READ CAPACITY (16) failed, trying READ CAPACITY (10)");
+    
+    // 尝试READ CAPACITY (10)
+    std::memset(cdb, 0, sizeof(cdb));
+    cdb[0] = static_cast<uint8_t>(ScsiCommand::READ_CAPACITY_10);
+    
+    if (!block_io_->ExecuteScsi(lun, cdb, 10, true, capacity_data, 8, status, &received) ||
+        status != 0 || received < 8) {
+        LOG_ERROR("Both READ CAPACITY commands failed");
+        return false;
+    }
+    
+    // 解析READ CAPACITY (10) 响应
+    uint32_t last_block = (capacity_data[0] << 24) | (capacity_data[1] << 16) |
+                         (capacity_data[2] << 8) | capacity_data[3];
+    block_size = (capacity_data[4] << 24) | (capacity_data[5] << 16) |
+                (capacity_data[6] << 8) | capacity_data[7];
+    total_blocks = static_cast<uint64_t>(last_block) + 1;
+    return true;
+}
+
+void MassStorageDevice::ResetRecovery() {
+    if (uas_transport_) {
+        // UAS没有类复位请求，清除各管道的STALL
+        for (const auto& pipe : uas_pipes_) {
+            device_->ClearHalt(pipe.address);
+        }
+        return;
+    }
+    
+    if (!ResetDevice()) {
+        LOG_WARNING("Bulk-only mass storage reset failed");
+    }
+    device_->ClearHalt(bulk_in_endpoint_.address);
+    device_->ClearHalt(bulk_out_endpoint_.address);
+}
+
+void MassStorageDevice::UpdateSense(uint8_t lun) {
+    uint8_t cdb[6] = {};
+    cdb[0] = static_cast<uint8_t>(ScsiCommand::REQUEST_SENSE);
+    cdb[4] = 18; // 固定格式sense数据
+    
+    uint8_t sense[18] = {};
+    uint8_t status = 0;
+    uint32_t received = 0;
+    if (!block_io_->ExecuteScsi(lun, cdb, sizeof(cdb), true, sense, sizeof(sense), status, &received) ||
+        status != 0 || received < 14) {
+        LOG_WARNING("REQUEST SENSE failed on LUN " << static_cast<int>(lun));
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(lun_mutex_);
+    LunInfo& info = luns_[lun];
+    info.sense_key = sense[2] & 0x0F;
+    info.asc = sense[12];
+    info.ascq = sense[13];
+}
+
+void MassStorageDevice::Recover(uint8_t lun) {
+    // 先在管道仍可用时取sense，批量存储复位之后设备可能已清除它
+    {
+        std::shared_lock<std::shared_mutex> lock(io_mutex_);
+        if (!initialized_) {
+            return;
+        }
+        UpdateSense(lun);
+    }
+    
+    // 复位影响所有LUN，等其他LUN的在途读写结束后再做
+    std::unique_lock<std::shared_mutex> lock(io_mutex_);
+    if (initialized_) {
+        ResetRecovery();
+    }
+}
+
+bool MassStorageDevice::CheckRange(uint8_t lun, uint64_t start_block, uint32_t block_count, const char* operation,
+                                   uint32_t& block_size) const {
+    std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+    if (lun >= luns_.size()) {
+        LOG_ERROR(operation << " on invalid LUN " << static_cast<int>(lun));
+        return false;
+    }
+    
+    const LunInfo& info = luns_[lun];
+    if (info.total_blocks > 0 && (start_block >= info.total_blocks || block_count > info.total_blocks - start_block)) {
+        LOG_ERROR(operation << " beyond end of LUN " << static_cast<int>(lun) << ": LBA "
+                  << start_block << " + " << block_count);
+        return false;
+    }
+    block_size = info.block_size;
+    return true;
+}
+
+bool MassStorageDevice::ReadBlocks(uint64_t start_block, uint32_t block_count, std::vector<uint8_t>& data) {
+    return ReadBlocks(0, start_block, block_count, data);
+}
+
+bool MassStorageDevice::ReadBlocks(uint8_t lun, uint64_t start_block, uint32_t block_count,
+                                   std::vector<uint8_t>& data) {
+    uint32_t block_size = 0;
+    if (!CheckRange(lun, start_block, block_count, "Read", block_size)) {
+        return false;
+    }
+    
+    // 重叠的待写数据先落到设备，读到的才是最新内容
+    bool cached = UsesCache(lun);
+    if (coalescer_ && cached) {
+        coalescer_->FlushRange(lun, start_block, block_count);
+    }
+    
+    data.resize(static_cast<size_t>(block_count) * block_size);
+    if (read_ahead_ && cached) {
+        return read_ahead_->Read(lun, start_block, block_count, data.data());
+    }
+    return ReadBlocksDirect(lun, start_block, block_count, data.data());
+}
+
+bool MassStorageDevice::ReadBlocksDirect(uint8_t lun, uint64_t start_block, uint32_t block_count, uint8_t* data) {
+    bool ok = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+        if (!initialized_ || lun >= luns_.size()) {
+            LOG_ERROR("Mass storage device not initialized");
             return false;
         }
-        
-        // 解析READ CAPACITY (10) 响应
-        if (capacity_data.size() >= 8) {
-            uint32_t last_block = (capacity_data[0] << 24) | (capacity_data[1] << 16) |
-                                 (capacity_data[2] << 8) | capacity_data[3];
-            block_size = (capacity_data[4] << 24) | (capacity_data[5] << 16) |
-                        (capacity_data[6] << 8) | capacity_data[7];
-            total_blocks = static_cast<uint64_t>(last_block) + 1;
+    
+        ok = block_io_->Read(lun, start_block, block_count, luns_[lun].block_size, data);
+    }
+    if (!ok) {
+        Recover(lun);
+    }
+    return ok;
+}
+
+bool MassStorageDevice::WriteBlocks(uint64_t start_block, uint32_t block_count, const std::vector<uint8_t>& data,
+                                    bool fua) {
+    return WriteBlocks(0, start_block, block_count, data, fua);
+}
+
+bool MassStorageDevice::WriteBlocks(uint8_t lun, uint64_t start_block, uint32_t block_count,
+                                    const std::vector<uint8_t>& data, bool fua) {
+    uint32_t block_size = 0;
+    if (!CheckRange(lun, start_block, block_count, "Write", block_size)) {
+        return false;
+    }
+    
+    if (data.size() < static_cast<size_t>(block_count) * block_size) {
+        LOG_ERROR("Write buffer too small: " << data.size() << " bytes for " << block_count << " blocks");
+        return false;
+    }
+    
+    if (coalescer_ && !fua && UsesCache(lun)) {
+        coalescer_->Write(lun, start_block, block_count, data.data());
+        return true;
+    }
+    
+    // FUA是屏障：之前的写入必须先于它到达设备
+    bool ok = !coalescer_ || coalescer_->Flush();
+    return WriteBlocksDirect(lun, start_block, block_count, data.data(), fua) && ok;
+}
+
+bool MassStorageDevice::WriteBlocksDirect(uint8_t lun, uint64_t start_block, uint32_t block_count,
+                                          const uint8_t* data, bool fua) {
+    bool ok = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+        if (!initialized_ || lun >= luns_.size()) {
+            LOG_ERROR("Mass storage device not initialized");
+            return false;
         }
-    } else {
-        // 解析READ CAPACITY (16) 响应
-        if (capacity_data.size() >= 32) {
-            total_blocks = 0;
-            for (int i = 0; i < 8; ++i) {
-                total_blocks = (total_blocks << 8) | capacity_data[i];
-            }
-            total_blocks += 1; // 最后一个块号+1
-            
-            block_size = (capacity_data[8] << 24) | (capacity_data[9] << 16) |
-                        (capacity_data[10] << 8) | capacity_data[11];
+    
+        // 预读可能与写入并发进行：extent在调度预读时就已建立，写完成后的失效会把
+        // 仍在读的extent标记为过期，读完即丢弃。写失败时设备内容也不再可信
+        ok = block_io_->Write(lun, start_block, block_count, luns_[lun].block_size, data, fua);
+        if (read_ahead_) {
+            read_ahead_->Invalidate(lun, start_block, block_count);
+        }
+    }
+    if (!ok) {
+        Recover(lun);
+    }
+    return ok;
+}
+
+bool MassStorageDevice::SynchronizeCache() {
+    bool ok = !coalescer_ || coalescer_->Flush();
+    
+    std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+    if (!initialized_) {
+        LOG_ERROR("Mass storage device not initialized");
+        return false;
+    }
+    
+    for (uint8_t lun = 0; lun < luns_.size(); ++lun) {
+        if (luns_[lun].ready && !block_io_->SynchronizeCache(lun)) {
+            LOG_WARNING("SYNCHRONIZE CACHE failed on LUN " << static_cast<int>(lun));
+            ok = false;
         }
     }
+    return ok;
+}
+
+bool MassStorageDevice::SynchronizeCache(uint8_t lun) {
+    bool ok = !coalescer_ || coalescer_->Flush();
     
-    CommandStatusWrapper csw;
-    if (!ReceiveCSW(csw, cbw.dCBWTag)) {
-        LOG_ERROR("Failed to receive CSW for READ CAPACITY");
+    std::shared_lock<std::shared_mutex> lock(io_mutex_);
+    
+    if (!initialized_ || lun >= luns_.size()) {
+        LOG_ERROR("Mass storage device not initialized");
         return false;
     }
     
-    return csw.bCSWStatus == 0; // 成功状态
+    if (!block_io_->SynchronizeCache(lun)) {
+        LOG_WARNING("SYNCHRONIZE CACHE failed on LUN " << static_cast<int>(lun));
+        return false;
+    }
+    return ok;
+}
+
+protocol::ReadAheadStatistics MassStorageDevice::GetReadAheadStatistics() const {
+    return read_ahead_ ? read_ahead_->GetStatistics() : protocol::ReadAheadStatistics();
+}
+
+protocol::WriteCoalescerStatistics MassStorageDevice::GetWriteCoalescerStatistics() const {
+    return coalescer_ ? coalescer_->GetStatistics() : protocol::WriteCoalescerStatistics();
+}
+
+bool MassStorageDevice::HandleRead10(uint8_t lun, const uint8_t* cdb, std::vector<uint8_t>& response) {
+    uint64_t lba = ReadBigEndian(&cdb[2], 4);
+    uint32_t block_count = static_cast<uint32_t>(ReadBigEndian(&cdb[7], 2));
+    return ReadBlocks(lun, lba, block_count, response);
+}
+
+bool MassStorageDevice::HandleWrite10(uint8_t lun, const uint8_t* cdb, const std::vector<uint8_t>& data) {
+    uint64_t lba = ReadBigEndian(&cdb[2], 4);
+    uint32_t block_count = static_cast<uint32_t>(ReadBigEndian(&cdb[7], 2));
+    return WriteBlocks(lun, lba, block_count, data, (cdb[1] & protocol::SCSI_CDB_FUA) != 0);
 }
 
 bool MassStorageDevice::SendCBW(const CommandBlockWrapper& cbw) {
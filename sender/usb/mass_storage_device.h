@@ -2,54 +2,28 @@
 
 #include "usb_device_manager.h"
 #include "protocol/usb_types.h"
+#include "protocol/mass_storage.h"
+#include "protocol/bot_block_io.h"
+#include "protocol/uas_block_io.h"
+#include "protocol/read_ahead_cache.h"
+#include "protocol/write_coalescer.h"
 #include <memory>
 #include <vector>
 #include <functional>
+#include <shared_mutex>
 
 namespace usb_redirector {
 namespace sender {
 
-// SCSI命令
-enum class ScsiCommand : uint8_t {
-    TEST_UNIT_READY = 0x00,
-    REQUEST_SENSE = 0x03,
-    INQUIRY = 0x12,
-    READ_CAPACITY_10 = 0x25,
-    READ_10 = 0x28,
-    WRITE_10 = 0x2A,
-    READ_CAPACITY_16 = 0x9E,
-    READ_16 = 0x88,
-    WRITE_16 = 0x8A
-};
-
-// USB大容量存储类特定请求
-enum class MassStorageRequest : uint8_t {
-    BULK_ONLY_MASS_STORAGE_RESET = 0xFF,
-    GET_MAX_LUN = 0xFE
-};
-
-// 命令块包装器 (CBW)
-struct CommandBlockWrapper {
-    uint32_t dCBWSignature;      // 0x43425355 "USBC"
-    uint32_t dCBWTag;            // 命令标签
-    uint32_t dCBWDataTransferLength; // 数据传输长度
-    uint8_t bmCBWFlags;          // 标志位
-    uint8_t bCBWLUN;             // 逻辑单元号
-    uint8_t bCBWCBLength;        // 命令块长度
-    uint8_t CBWCB[16];           // 命令块
-} __attribute__((packed));
-
-// 命令状态包装器 (CSW)
-struct CommandStatusWrapper {
-    uint32_t dCSWSignature;      // 0x53425355 "USBS"
-    uint32_t dCSWTag;            // 命令标签
-    uint32_t dCSWDataResidue;    // 数据残留
-    uint8_t bCSWStatus;          // 命令状态
-} __attribute__((packed));
+// SCSI和Bulk-Only Transport定义位于公共库，与接收端共用
+using protocol::ScsiCommand;
+using protocol::MassStorageRequest;
+using protocol::CommandBlockWrapper;
+using protocol::CommandStatusWrapper;
 
 class MassStorageDevice {
 public:
-    using DataCallback = std::function<void(const protocol::UsbUrb& urb)>;
+    using DataCallback = std::function<void(protocol::UsbUrb urb)>;
     
     explicit MassStorageDevice(std::shared_ptr<UsbDevice> device);
     ~MassStorageDevice();
@@ -78,23 +52,89 @@ public:
     // 处理SCSI命令
     bool ProcessScsiCommand(const CommandBlockWrapper& cbw, std::vector<uint8_t>& response_data);
     
-    // 获取设备容量信息
+    // 逻辑单元信息（多卡槽读卡器每个卡槽一个LUN）
+    struct LunInfo {
+        uint64_t total_blocks = 0;
+        uint32_t block_size = 512;
+        bool ready = false;             // READ CAPACITY成功，即有介质
+        uint8_t sense_key = 0;          // 最近一次失败后REQUEST SENSE的结果
+        uint8_t asc = 0;
+        uint8_t ascq = 0;
+    };
+    
+    // Initialize时经GET MAX LUN（UAS下为REPORT LUNS）枚举的LUN
+    uint8_t GetLunCount() const { return static_cast<uint8_t>(luns_.size()); }
+    LunInfo GetLunInfo(uint8_t lun) const;
+    
+    // 获取设备容量信息（不带lun时为LUN 0）
     bool GetCapacity(uint64_t& total_blocks, uint32_t& block_size);
+    bool GetCapacity(uint8_t lun, uint64_t& total_blocks, uint32_t& block_size);
     
-    // 读写操作
+    // 块读写参数（单条命令的最大数据量、在途命令数），需在Initialize之前设置
+    void SetBlockIoConfig(const protocol::BlockIoConfig& config) { block_io_config_ = config; }
+    
+    // 设备提供UAS备用设置且支持批量流时优先使用UAS，需在Initialize之前设置
+    void SetUasEnabled(bool enabled) { uas_enabled_ = enabled; }
+    bool IsUas() const { return uas_transport_ != nullptr; }
+    
+    // 顺序预读缓存参数，cache_bytes为0时关闭，需在Initialize之前设置
+    void SetReadAheadConfig(const protocol::ReadAheadConfig& config) { read_ahead_config_ = config; }
+    protocol::ReadAheadStatistics GetReadAheadStatistics() const;
+    
+    // 写回合并参数，max_pending_bytes为0时关闭，需在Initialize之前设置
+    void SetWriteCoalescerConfig(const protocol::WriteCoalescerConfig& config) { write_coalescer_config_ = config; }
+    protocol::WriteCoalescerStatistics GetWriteCoalescerStatistics() const;
+    
+    // 读写操作：拆分为多条READ/WRITE命令流水线执行，2 TiB以上自动使用16字节命令。
+    // 开启写回合并时普通写入先进入合并队列，写回失败在下一次SynchronizeCache时报告；
+    // FUA写入是屏障，先写出全部待写数据再直接写设备。
+    // 不同LUN的读写可以由多个线程同时发起，命令在批量管道上交错执行（不带lun时为LUN 0）
     bool ReadBlocks(uint64_t start_block, uint32_t block_count, std::vector<uint8_t>& data);
-    bool WriteBlocks(uint64_t start_block, uint32_t block_count, const std::vector<uint8_t>& data);
+    bool ReadBlocks(uint8_t lun, uint64_t start_block, uint32_t block_count, std::vector<uint8_t>& data);
+    bool WriteBlocks(uint64_t start_block, uint32_t block_count, const std::vector<uint8_t>& data, bool fua = false);
+    bool WriteBlocks(uint8_t lun, uint64_t start_block, uint32_t block_count, const std::vector<uint8_t>& data,
+                     bool fua = false);
+    
+    // SYNCHRONIZE CACHE：写出待写数据并让设备落盘（不带lun时为所有有介质的LUN）
+    bool SynchronizeCache();
+    bool SynchronizeCache(uint8_t lun);
 
 private:
+    class BulkTransport;
+    
+    class UasPipes;
+    
     struct EndpointInfo {
         uint8_t address;
         uint16_t max_packet_size;
         bool is_in;
+        uint32_t max_streams;           // SuperSpeed端点伴随描述符声明的流数量
     };
     
     bool FindEndpoints();
+    // 切换到UAS备用设置并分配流，失败时退回Bulk-Only
+    bool SetupUas();
     bool ResetDevice();
     bool GetMaxLun(uint8_t& max_lun);
+    bool ReportLuns(uint8_t& max_lun);
+    // 枚举LUN并读取各自的容量
+    void EnumerateLuns();
+    // LUN和越界检查
+    bool CheckRange(uint8_t lun, uint64_t start_block, uint32_t block_count, const char* operation,
+                    uint32_t& block_size) const;
+    bool ReadCapacity(uint8_t lun, uint64_t& total_blocks, uint32_t& block_size);
+    // 预读缓存和写合并按LUN 0的块大小建立，块大小不同的LUN绕过它们
+    bool UsesCache(uint8_t lun) const { return luns_[lun].block_size == luns_[0].block_size; }
+    // 命令失败后读取sense数据，更新LUN的sense状态
+    void UpdateSense(uint8_t lun);
+    // 独占地做复位恢复（等其他LUN的在途读写结束），然后更新sense状态
+    void Recover(uint8_t lun);
+    // 绕过预读缓存直接读设备
+    bool ReadBlocksDirect(uint8_t lun, uint64_t start_block, uint32_t block_count, uint8_t* data);
+    // 绕过写合并直接写设备
+    bool WriteBlocksDirect(uint8_t lun, uint64_t start_block, uint32_t block_count, const uint8_t* data, bool fua);
+    // 复位恢复：BOT下类复位请求后清除两个批量端点的STALL，UAS下清除各管道的STALL
+    void ResetRecovery();
     
     // SCSI命令处理
     bool HandleInquiry(std::vector<uint8_t>& response);
@@ -102,8 +142,8 @@ private:
     bool HandleRequestSense(std::vector<uint8_t>& response);
     bool HandleReadCapacity10(std::vector<uint8_t>& response);
     bool HandleReadCapacity16(std::vector<uint8_t>& response);
-    bool HandleRead10(const uint8_t* cdb, std::vector<uint8_t>& response);
-    bool HandleWrite10(const uint8_t* cdb, const std::vector<uint8_t>& data);
+    bool HandleRead10(uint8_t lun, const uint8_t* cdb, std::vector<uint8_t>& response);
+    bool HandleWrite10(uint8_t lun, const uint8_t* cdb, const std::vector<uint8_t>& data);
     
     // 传输操作
     bool SendCBW(const CommandBlockWrapper& cbw);
@@ -127,11 +167,27 @@ private:
     EndpointInfo bulk_in_endpoint_;
     EndpointInfo bulk_out_endpoint_;
     
+    // UAS备用设置的四条管道，按UasPipe编号减1索引
+    bool uas_enabled_;
+    int uas_alt_setting_;
+    EndpointInfo uas_pipes_[4];
+    
     uint32_t next_tag_;
-    uint64_t total_blocks_;
-    uint32_t block_size_;
+    std::vector<LunInfo> luns_;
+    mutable std::mutex lun_mutex_;          // 保护luns_中的sense状态
+    
+    protocol::BlockIoConfig block_io_config_;
+    std::unique_ptr<BulkTransport> transport_;
+    std::unique_ptr<UasPipes> uas_transport_;
+    std::unique_ptr<protocol::BlockIo> block_io_;
+    protocol::ReadAheadConfig read_ahead_config_;
+    std::unique_ptr<protocol::ReadAheadCache> read_ahead_;
+    protocol::WriteCoalescerConfig write_coalescer_config_;
+    std::unique_ptr<protocol::WriteCoalescer> coalescer_;
     
     mutable std::mutex mutex_;
+    // 读写持共享锁，不同LUN的读写互不阻塞；复位恢复、初始化和清理持独占锁
+    mutable std::shared_mutex io_mutex_;
 };
 
 } // namespace sender
@@ -0,0 +1,395 @@
+#include "transfer_engine.h"
+#include "usb_device_manager.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace usb_redirector {
+namespace sender {
+
+// 停止时被撤销的传输迟迟不完成，每隔这么久告警并重新撤销一次
+static constexpr auto STOP_CANCEL_INTERVAL = std::chrono::seconds(2);
+
+TransferEngine::TransferEngine(libusb_context* context, const TransferEngineConfig& config)
+    : context_(context)
+    , config_(config)
+    , inflight_(0)
+    , metrics_(nullptr)
+    , running_(false)
+    , event_thread_id_(std::thread::id()) {
+    config_.pool_size = std::max<size_t>(1, config_.pool_size);
+    config_.max_depth_per_endpoint = std::max<size_t>(1, config_.max_depth_per_endpoint);
+}
+
+TransferEngine::~TransferEngine() {
+    Stop();
+}
+
+bool TransferEngine::Start() {
+    if (running_.load()) {
+        return true;
+    }
+
+    if (!context_) {
+        LOG_ERROR("USB context not initialized");
+        return false;
+    }
+
+    // 一次性分配传输池，之后的提交不再分配libusb_transfer
+    slots_.clear();
+    free_slots_.clear();
+    for (size_t i = 0; i < config_.pool_size; ++i) {
+        libusb_transfer* transfer = libusb_alloc_transfer(0);
+        if (!transfer) {
+            LOG_ERROR("Failed to allocate libusb transfer " << i);
+            for (auto& slot : slots_) {
+                libusb_free_transfer(slot->transfer);
+            }
+            slots_.clear();
+            free_slots_.clear();
+            return false;
+        }
+
+        auto slot = std::make_unique<Slot>();
+        slot->engine = this;
+        slot->transfer = transfer;
+        slot->control_buffer.reserve(LIBUSB_CONTROL_SETUP_SIZE + 256);
+        free_slots_.push_back(slot.get());
+        slots_.push_back(std::move(slot));
+    }
+
+    inflight_ = 0;
+    depth_.clear();
+    running_.store(true);
+    event_thread_ = std::thread(&TransferEngine::EventThread, this);
+
+    LOG_INFO("Transfer engine started: " << config_.pool_size << " transfers, depth "
+             << config_.max_depth_per_endpoint << " per endpoint");
+    return true;
+}
+
+void TransferEngine::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    CancelAll();
+    slot_available_.notify_all();
+
+    // 事件线程在在途传输全部完成后才退出：libusb持有的传输的user_data指向槽位，
+    // 回调执行之前槽位和引擎都不能释放
+    if (event_thread_.joinable()) {
+        event_thread_.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) {
+        libusb_free_transfer(slot->transfer);
+    }
+    slots_.clear();
+    free_slots_.clear();
+    depth_.clear();
+    inflight_ = 0;
+
+    LOG_INFO("Transfer engine stopped");
+}
+
+void TransferEngine::EventThread() {
+    event_thread_id_.store(std::this_thread::get_id());
+
+    auto stop_time = std::chrono::steady_clock::time_point();
+    while (true) {
+        if (!running_.load()) {
+            if (InflightCount() == 0) {
+                break;
+            }
+            // 撤销之后才提交的传输不会被第一次撤销覆盖；设备拔出时libusb以NO_DEVICE完成，
+            // 所以被撤销的传输最终都会完成
+            auto now = std::chrono::steady_clock::now();
+            if (stop_time == std::chrono::steady_clock::time_point()) {
+                stop_time = now;
+            } else if (now - stop_time > STOP_CANCEL_INTERVAL) {
+                LOG_WARNING("Still waiting for " << InflightCount() << " cancelled transfers to complete");
+                CancelAll();
+                stop_time = now;
+            }
+        }
+
+        struct timeval tv = {0, 100000}; // 100ms，及时响应停止
+        int ret = libusb_handle_events_timeout_completed(context_, &tv, nullptr);
+        if (ret != LIBUSB_SUCCESS && ret != LIBUSB_ERROR_INTERRUPTED) {
+            LOG_ERROR("Failed to handle USB events: " << libusb_error_name(ret));
+        }
+    }
+
+    event_thread_id_.store(std::thread::id());
+}
+
+void TransferEngine::CancelAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& slot : slots_) {
+        if (slot->in_use) {
+            libusb_cancel_transfer(slot->transfer);
+        }
+    }
+}
+
+uint64_t TransferEngine::DepthKey(const UsbDevice& device, uint8_t endpoint) {
+    return (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&device)) << 8) | endpoint;
+}
+
+unsigned int TransferEngine::ResolveTimeout(int timeout_ms, unsigned int default_timeout) const {
+    return timeout_ms < 0 ? default_timeout : static_cast<unsigned int>(timeout_ms);
+}
+
+TransferEngine::Slot* TransferEngine::AcquireSlot(uint64_t depth_key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto ready = [this, depth_key]() {
+        if (!running_.load()) {
+            return true;
+        }
+        auto it = depth_.find(depth_key);
+        size_t depth = (it == depth_.end()) ? 0 : it->second;
+        return !free_slots_.empty() && depth < config_.max_depth_per_endpoint;
+    };
+
+    if (!ready()) {
+        // 事件线程上等待会阻塞完成处理，直接失败
+        if (IsEventThread() ||
+            !slot_available_.wait_for(lock, std::chrono::milliseconds(config_.submit_wait_ms), ready)) {
+            LOG_WARNING("Transfer queue full (" << inflight_ << " in flight)");
+            return nullptr;
+        }
+    }
+
+    if (!running_.load()) {
+        LOG_ERROR("Transfer engine not running");
+        return nullptr;
+    }
+
+    Slot* slot = free_slots_.back();
+    free_slots_.pop_back();
+    slot->in_use = true;
+    slot->depth_key = depth_key;
+    depth_[depth_key]++;
+    ++inflight_;
+    return slot;
+}
+
+void TransferEngine::ReleaseSlot(Slot* slot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = depth_.find(slot->depth_key);
+        if (it != depth_.end() && --it->second == 0) {
+            depth_.erase(it);
+        }
+        slot->in_use = false;
+        slot->data = nullptr;
+        slot->callback = nullptr;
+        free_slots_.push_back(slot);
+        --inflight_;
+    }
+    slot_available_.notify_all();
+}
+
+bool TransferEngine::SubmitSlot(UsbDevice& device, Slot* slot, uint32_t urb_id, CompletionCallback callback) {
+    slot->urb_id = urb_id;
+    slot->callback = std::move(callback);
+    slot->submit_time = std::chrono::steady_clock::now();
+
+    if (!device.SubmitTransfer(slot->transfer, urb_id)) {
+        ReleaseSlot(slot);
+        return false;
+    }
+    return true;
+}
+
+bool TransferEngine::SubmitBulk(UsbDevice& device, uint8_t endpoint, uint8_t* data, int length,
+                                uint32_t urb_id, CompletionCallback callback, int timeout_ms) {
+    libusb_device_handle* handle = device.GetHandle();
+    if (!handle) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    Slot* slot = AcquireSlot(DepthKey(device, endpoint));
+    if (!slot) {
+        return false;
+    }
+
+    slot->data = data;
+    slot->control_length = 0;
+    libusb_fill_bulk_transfer(slot->transfer, handle, endpoint, data, length,
+                              &TransferEngine::OnTransferComplete, slot,
+                              ResolveTimeout(timeout_ms, config_.bulk_timeout_ms));
+    return SubmitSlot(device, slot, urb_id, std::move(callback));
+}
+
+bool TransferEngine::SubmitBulkStream(UsbDevice& device, uint8_t endpoint, uint32_t stream_id, uint8_t* data,
+                                      int length, uint32_t urb_id, CompletionCallback callback, int timeout_ms) {
+    libusb_device_handle* handle = device.GetHandle();
+    if (!handle) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    // 同一端点上各个流的传输共用该端点的深度限制
+    Slot* slot = AcquireSlot(DepthKey(device, endpoint));
+    if (!slot) {
+        return false;
+    }
+
+    slot->data = data;
+    slot->control_length = 0;
+    libusb_fill_bulk_stream_transfer(slot->transfer, handle, endpoint, stream_id, data, length,
+                                     &TransferEngine::OnTransferComplete, slot,
+                                     ResolveTimeout(timeout_ms, config_.bulk_timeout_ms));
+    return SubmitSlot(device, slot, urb_id, std::move(callback));
+}
+
+bool TransferEngine::SubmitInterrupt(UsbDevice& device, uint8_t endpoint, uint8_t* data, int length,
+                                     uint32_t urb_id, CompletionCallback callback, int timeout_ms) {
+    libusb_device_handle* handle = device.GetHandle();
+    if (!handle) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    Slot* slot = AcquireSlot(DepthKey(device, endpoint));
+    if (!slot) {
+        return false;
+    }
+
+    slot->data = data;
+    slot->control_length = 0;
+    libusb_fill_interrupt_transfer(slot->transfer, handle, endpoint, data, length,
+                                   &TransferEngine::OnTransferComplete, slot,
+                                   ResolveTimeout(timeout_ms, config_.interrupt_timeout_ms));
+    return SubmitSlot(device, slot, urb_id, std::move(callback));
+}
+
+bool TransferEngine::SubmitControl(UsbDevice& device, uint8_t request_type, uint8_t request, uint16_t value,
+                                   uint16_t index, uint8_t* data, uint16_t length,
+                                   uint32_t urb_id, CompletionCallback callback, int timeout_ms) {
+    libusb_device_handle* handle = device.GetHandle();
+    if (!handle) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    Slot* slot = AcquireSlot(DepthKey(device, 0));
+    if (!slot) {
+        return false;
+    }
+
+    slot->data = data;
+    slot->control_length = length;
+    slot->control_buffer.resize(LIBUSB_CONTROL_SETUP_SIZE + length);
+    uint8_t* buffer = slot->control_buffer.data();
+    libusb_fill_control_setup(buffer, request_type, request, value, index, length);
+    if (!(request_type & LIBUSB_ENDPOINT_IN) && data && length > 0) {
+        std::memcpy(buffer + LIBUSB_CONTROL_SETUP_SIZE, data, length);
+    }
+
+    libusb_fill_control_transfer(slot->transfer, handle, buffer,
+                                 &TransferEngine::OnTransferComplete, slot,
+                                 ResolveTimeout(timeout_ms, config_.control_timeout_ms));
+    return SubmitSlot(device, slot, urb_id, std::move(callback));
+}
+
+void LIBUSB_CALL TransferEngine::OnTransferComplete(libusb_transfer* transfer) {
+    auto* slot = static_cast<Slot*>(transfer->user_data);
+    TransferEngine* engine = slot->engine;
+
+    uint32_t urb_id = slot->urb_id;
+    int status = transfer->status;
+    int actual_length = transfer->actual_length;
+    uint8_t* data = slot->data;
+
+    if (protocol::UrbMetrics* metrics = engine->metrics_.load(std::memory_order_acquire)) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - slot->submit_time).count();
+        // libusb的传输类型编号与UsbTransferType一致，批量流按批量计
+        auto type = transfer->type == LIBUSB_TRANSFER_TYPE_BULK_STREAM
+            ? protocol::UsbTransferType::BULK : static_cast<protocol::UsbTransferType>(transfer->type);
+        // 控制传输的方向取自setup包
+        uint8_t endpoint = transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL
+            ? static_cast<uint8_t>(slot->control_buffer[0] & LIBUSB_ENDPOINT_IN) : transfer->endpoint;
+        metrics->RecordLatency(protocol::UrbLatencyKind::DEVICE_TRANSFER, type, endpoint,
+                               static_cast<uint64_t>(elapsed));
+    }
+
+    // 控制传输的数据阶段位于setup包之后，IN方向拷回调用方缓冲区
+    if (transfer->type == LIBUSB_TRANSFER_TYPE_CONTROL && data && actual_length > 0 &&
+        (slot->control_buffer[0] & LIBUSB_ENDPOINT_IN)) {
+        std::memcpy(data, slot->control_buffer.data() + LIBUSB_CONTROL_SETUP_SIZE,
+                    std::min<size_t>(actual_length, slot->control_length));
+    }
+
+    // 先归还传输再回调，回调中可以继续提交
+    CompletionCallback callback = std::move(slot->callback);
+    engine->ReleaseSlot(slot);
+
+    if (callback) {
+        callback(urb_id, status, data, actual_length);
+    }
+}
+
+size_t TransferEngine::InflightCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return inflight_;
+}
+
+size_t TransferEngine::QueueDepth(const UsbDevice& device, uint8_t endpoint) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = depth_.find(DepthKey(device, endpoint));
+    return it == depth_.end() ? 0 : it->second;
+}
+
+const char* TransferEngine::StatusName(int status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_COMPLETED: return "COMPLETED";
+        case LIBUSB_TRANSFER_ERROR: return "ERROR";
+        case LIBUSB_TRANSFER_TIMED_OUT: return "TIMED_OUT";
+        case LIBUSB_TRANSFER_CANCELLED: return "CANCELLED";
+        case LIBUSB_TRANSFER_STALL: return "STALL";
+        case LIBUSB_TRANSFER_NO_DEVICE: return "NO_DEVICE";
+        case LIBUSB_TRANSFER_OVERFLOW: return "OVERFLOW";
+        default: return "UNKNOWN";
+    }
+}
+
+// TransferWaiter implementation
+TransferWaiter::TransferWaiter(size_t count)
+    : results_(count)
+    , pending_(count) {
+}
+
+TransferEngine::CompletionCallback TransferWaiter::Callback(size_t index) {
+    return [this, index](uint32_t, int status, uint8_t*, int actual_length) {
+        Finish(index, status, actual_length);
+    };
+}
+
+void TransferWaiter::Abandon(size_t index) {
+    Finish(index, LIBUSB_TRANSFER_ERROR, 0);
+}
+
+void TransferWaiter::Finish(size_t index, int status, int actual_length) {
+    // 持锁通知，Wait返回后本对象即可销毁
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_[index].status = status;
+    results_[index].actual_length = actual_length;
+    --pending_;
+    done_.notify_all();
+}
+
+void TransferWaiter::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+} // namespace sender
+} // namespace usb_redirector
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <libusb.h>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include "protocol/urb_metrics.h"
+
+namespace usb_redirector {
+namespace sender {
+
+class UsbDevice;
+
+// 异步传输引擎配置
+struct TransferEngineConfig {
+    size_t pool_size = 128;                 // 预分配的libusb_transfer数量，即全局在途上限
+    size_t max_depth_per_endpoint = 16;     // 每个端点（设备+端点地址）的在途上限
+    unsigned int control_timeout_ms = 5000; // 各类传输的默认超时，0表示不超时
+    unsigned int bulk_timeout_ms = 5000;
+    unsigned int interrupt_timeout_ms = 5000;
+    unsigned int submit_wait_ms = 5000;     // 池或端点队列满时提交的最长等待
+};
+
+// 基于libusb_submit_transfer的异步传输引擎：启动时一次性分配libusb_transfer池，
+// 由专用线程处理libusb事件，完成回调在该线程上调用（此时传输已归还到池中）
+class TransferEngine {
+public:
+    // status为libusb_transfer_status；data为提交时的数据缓冲区
+    using CompletionCallback = std::function<void(uint32_t urb_id, int status,
+                                                  uint8_t* data, int actual_length)>;
+
+    // 使用配置中对应类型的默认超时
+    static constexpr int DEFAULT_TIMEOUT = -1;
+
+    explicit TransferEngine(libusb_context* context, const TransferEngineConfig& config = TransferEngineConfig());
+    ~TransferEngine();
+
+    // 禁止拷贝
+    TransferEngine(const TransferEngine&) = delete;
+    TransferEngine& operator=(const TransferEngine&) = delete;
+
+    bool Start();
+    // 撤销所有在途传输并等待其完成后停止事件线程
+    void Stop();
+    bool IsRunning() const { return running_.load(); }
+
+    // 提交传输。池或端点队列满时最多等待submit_wait_ms（在事件线程上不等待），
+    // urb_id非0时经UsbDevice登记，可用UsbDevice::CancelTransfer撤销。
+    // 返回true后回调必定被调用一次；返回false时不会调用回调
+    bool SubmitBulk(UsbDevice& device, uint8_t endpoint, uint8_t* data, int length,
+                    uint32_t urb_id, CompletionCallback callback, int timeout_ms = DEFAULT_TIMEOUT);
+    // USB 3批量流传输，端点的流需已由UsbDevice::AllocStreams分配
+    bool SubmitBulkStream(UsbDevice& device, uint8_t endpoint, uint32_t stream_id, uint8_t* data, int length,
+                          uint32_t urb_id, CompletionCallback callback, int timeout_ms = DEFAULT_TIMEOUT);
+    bool SubmitInterrupt(UsbDevice& device, uint8_t endpoint, uint8_t* data, int length,
+                         uint32_t urb_id, CompletionCallback callback, int timeout_ms = DEFAULT_TIMEOUT);
+    // 控制传输：setup包由引擎填充，data只是数据阶段（IN方向完成时拷回）
+    bool SubmitControl(UsbDevice& device, uint8_t request_type, uint8_t request, uint16_t value,
+                       uint16_t index, uint8_t* data, uint16_t length,
+                       uint32_t urb_id, CompletionCallback callback, int timeout_ms = DEFAULT_TIMEOUT);
+
+    // 当前线程是否为事件线程（事件线程上不能同步等待传输完成）
+    bool IsEventThread() const { return std::this_thread::get_id() == event_thread_id_.load(); }
+
+    // 完成的传输按类型和端点记录设备传输时间（提交到完成），为空时不记录
+    void SetMetrics(protocol::UrbMetrics* metrics) { metrics_.store(metrics, std::memory_order_release); }
+
+    size_t InflightCount() const;
+    size_t QueueDepth(const UsbDevice& device, uint8_t endpoint) const;
+    const TransferEngineConfig& GetConfig() const { return config_; }
+
+    static const char* StatusName(int status);
+
+private:
+    struct Slot {
+        TransferEngine* engine = nullptr;
+        libusb_transfer* transfer = nullptr;
+        bool in_use = false;
+        uint64_t depth_key = 0;
+        uint32_t urb_id = 0;
+        std::chrono::steady_clock::time_point submit_time;
+        uint8_t* data = nullptr;            // 调用方缓冲区
+        uint16_t control_length = 0;        // 控制传输数据阶段长度
+        std::vector<uint8_t> control_buffer; // setup包 + 数据阶段
+        CompletionCallback callback;
+    };
+
+    static void LIBUSB_CALL OnTransferComplete(libusb_transfer* transfer);
+    static uint64_t DepthKey(const UsbDevice& device, uint8_t endpoint);
+
+    Slot* AcquireSlot(uint64_t depth_key);
+    void ReleaseSlot(Slot* slot);
+    bool SubmitSlot(UsbDevice& device, Slot* slot, uint32_t urb_id, CompletionCallback callback);
+    unsigned int ResolveTimeout(int timeout_ms, unsigned int default_timeout) const;
+    // 撤销所有在途传输，完成回调稍后在事件线程上调用
+    void CancelAll();
+    void EventThread();
+
+    libusb_context* context_;
+    TransferEngineConfig config_;
+
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<Slot*> free_slots_;
+    std::unordered_map<uint64_t, size_t> depth_;
+    size_t inflight_;
+    mutable std::mutex mutex_;
+    std::condition_variable slot_available_;
+
+    std::atomic<protocol::UrbMetrics*> metrics_;
+
+    std::atomic<bool> running_;
+    std::thread event_thread_;
+    std::atomic<std::thread::id> event_thread_id_;
+};
+
+// 同步等待一组异步传输完成
+class TransferWaiter {
+public:
+    explicit TransferWaiter(size_t count);
+
+    // 第index个传输的完成回调
+    TransferEngine::CompletionCallback Callback(size_t index);
+    // 第index个传输未能提交，视为以错误完成
+    void Abandon(size_t index);
+    void Wait();
+
+    int Status(size_t index) const { return results_[index].status; }
+    int ActualLength(size_t index) const { return results_[index].actual_length; }
+    bool Succeeded(size_t index) const { return results_[index].status == LIBUSB_TRANSFER_COMPLETED; }
+
+private:
+    struct Result {
+        int status = LIBUSB_TRANSFER_ERROR;
+        int actual_length = 0;
+    };
+
+    void Finish(size_t index, int status, int actual_length);
+
+    std::vector<Result> results_;
+    size_t pending_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+};
+
+} // namespace sender
+} // namespace usb_redirector
@@ -27,6 +27,16 @@ bool UsbDeviceManager::Initialize() {
     // 设置调试级别
     libusb_set_option(context_, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_INFO);
 
+    // 启动异步传输引擎
+    transfer_engine_ = std::make_unique<TransferEngine>(context_, engine_config_);
+    if (!transfer_engine_->Start()) {
+        LOG_ERROR("Failed to start transfer engine");
+        transfer_engine_.reset();
+        libusb_exit(context_);
+        context_ = nullptr;
+        return false;
+    }
+
     LOG_INFO("USB device manager initialized successfully");
     return true;
 }
@@ -34,6 +44,12 @@ bool UsbDeviceManager::Initialize() {
 void UsbDeviceManager::Cleanup() {
     StopHotplugMonitoring();
 
+    // 先停止引擎，撤销并等待所有在途传输
+    if (transfer_engine_) {
+        transfer_engine_->Stop();
+        transfer_engine_.reset();
+    }
+
     {
         std::lock_guard<std::mutex> lock(devices_mutex_);
         devices_.clear();
@@ -340,6 +356,81 @@ bool UsbDevice::ReleaseInterface(int interface_number) {
     return true;
 }
 
+bool UsbDevice::SetAltSetting(int interface_number, int alt_setting) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!handle_) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    int ret = libusb_set_interface_alt_setting(handle_, interface_number, alt_setting);
+    if (ret != LIBUSB_SUCCESS) {
+        LOG_ERROR("Failed to select alternate setting " << alt_setting << " of interface " << interface_number
+                  << ": " << libusb_error_name(ret));
+        return false;
+    }
+    return true;
+}
+
+int UsbDevice::AllocStreams(uint32_t num_streams, const std::vector<uint8_t>& endpoints) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!handle_) {
+        LOG_ERROR("Device not opened");
+        return 0;
+    }
+
+    std::vector<unsigned char> addresses(endpoints.begin(), endpoints.end());
+    int ret = libusb_alloc_streams(handle_, num_streams, addresses.data(), static_cast<int>(addresses.size()));
+    if (ret < 0) {
+        LOG_WARNING("Failed to allocate " << num_streams << " bulk streams: " << libusb_error_name(ret));
+        return 0;
+    }
+    return ret;
+}
+
+void UsbDevice::FreeStreams(const std::vector<uint8_t>& endpoints) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!handle_) {
+        return;
+    }
+
+    std::vector<unsigned char> addresses(endpoints.begin(), endpoints.end());
+    libusb_free_streams(handle_, addresses.data(), static_cast<int>(addresses.size()));
+}
+
+static TransferEngineConfig EngineConfigOf(const UsbDeviceManager* manager) {
+    return manager ? manager->GetTransferEngineConfig() : TransferEngineConfig();
+}
+
+TransferEngine* UsbDevice::SyncEngine() const {
+    TransferEngine* engine = manager_ ? manager_->GetTransferEngine() : nullptr;
+    // 事件线程上等待会阻塞完成处理
+    if (!engine || !engine->IsRunning() || engine->IsEventThread()) {
+        return nullptr;
+    }
+    return engine;
+}
+
+bool UsbDevice::WaitTransfer(TransferWaiter& waiter, bool submitted, int* actual_length, const char* kind) {
+    if (!submitted) {
+        LOG_ERROR(kind << " transfer submit failed");
+        return false;
+    }
+
+    waiter.Wait();
+    if (actual_length) {
+        *actual_length = waiter.ActualLength(0);
+    }
+    if (!waiter.Succeeded(0)) {
+        LOG_ERROR(kind << " transfer failed: " << TransferEngine::StatusName(waiter.Status(0)));
+        return false;
+    }
+    return true;
+}
+
 bool UsbDevice::ControlTransfer(uint8_t request_type, uint8_t request, uint16_t value,
                                uint16_t index, uint8_t* data, uint16_t length, int* actual_length) {
     if (!handle_) {
@@ -347,7 +438,15 @@ bool UsbDevice::ControlTransfer(uint8_t request_type, uint8_t request, uint16_t
         return false;
     }
 
-    int ret = libusb_control_transfer(handle_, request_type, request, value, index, data, length, 5000);
+    if (TransferEngine* engine = SyncEngine()) {
+        TransferWaiter waiter(1);
+        bool submitted = engine->SubmitControl(*this, request_type, request, value, index,
+                                               data, length, 0, waiter.Callback(0));
+        return WaitTransfer(waiter, submitted, actual_length, "Control");
+    }
+
+    int ret = libusb_control_transfer(handle_, request_type, request, value, index, data, length,
+                                      EngineConfigOf(manager_).control_timeout_ms);
     if (ret < 0) {
         LOG_ERROR("Control transfer failed: " << libusb_error_name(ret));
         return false;
@@ -366,7 +465,14 @@ bool UsbDevice::BulkTransfer(uint8_t endpoint, uint8_t* data, int length, int* a
         return false;
     }
 
-    int ret = libusb_bulk_transfer(handle_, endpoint, data, length, actual_length, 5000);
+    if (TransferEngine* engine = SyncEngine()) {
+        TransferWaiter waiter(1);
+        bool submitted = engine->SubmitBulk(*this, endpoint, data, length, 0, waiter.Callback(0));
+        return WaitTransfer(waiter, submitted, actual_length, "Bulk");
+    }
+
+    int ret = libusb_bulk_transfer(handle_, endpoint, data, length, actual_length,
+                                   EngineConfigOf(manager_).bulk_timeout_ms);
     if (ret != LIBUSB_SUCCESS) {
         LOG_ERROR("Bulk transfer failed: " << libusb_error_name(ret));
         return false;
@@ -381,7 +487,14 @@ bool UsbDevice::InterruptTransfer(uint8_t endpoint, uint8_t* data, int length, i
         return false;
     }
 
-    int ret = libusb_interrupt_transfer(handle_, endpoint, data, length, actual_length, 5000);
+    if (TransferEngine* engine = SyncEngine()) {
+        TransferWaiter waiter(1);
+        bool submitted = engine->SubmitInterrupt(*this, endpoint, data, length, 0, waiter.Callback(0));
+        return WaitTransfer(waiter, submitted, actual_length, "Interrupt");
+    }
+
+    int ret = libusb_interrupt_transfer(handle_, endpoint, data, length, actual_length,
+                                        EngineConfigOf(manager_).interrupt_timeout_ms);
     if (ret != LIBUSB_SUCCESS) {
         LOG_ERROR("Interrupt transfer failed: " << libusb_error_name(ret));
         return false;
@@ -390,21 +503,128 @@ bool UsbDevice::InterruptTransfer(uint8_t endpoint, uint8_t* data, int length, i
     return true;
 }
 
-bool UsbDevice::SubmitTransfer(libusb_transfer* transfer) {
+bool UsbDevice::SubmitBulkTransfer(uint8_t endpoint, uint8_t* data, int length, uint32_t urb_id,
+                                   TransferEngine::CompletionCallback callback) {
+    TransferEngine* engine = manager_ ? manager_->GetTransferEngine() : nullptr;
+    if (!engine || !engine->IsRunning()) {
+        return false;
+    }
+    return engine->SubmitBulk(*this, endpoint, data, length, urb_id, std::move(callback));
+}
+
+bool UsbDevice::SubmitBulkStreamTransfer(uint8_t endpoint, uint32_t stream_id, uint8_t* data, int length,
+                                         uint32_t urb_id, TransferEngine::CompletionCallback callback) {
+    TransferEngine* engine = manager_ ? manager_->GetTransferEngine() : nullptr;
+    if (!engine || !engine->IsRunning()) {
+        return false;
+    }
+    return engine->SubmitBulkStream(*this, endpoint, stream_id, data, length, urb_id, std::move(callback));
+}
+
+bool UsbDevice::SubmitInterruptTransfer(uint8_t endpoint, uint8_t* data, int length, uint32_t urb_id,
+                                        TransferEngine::CompletionCallback callback) {
+    TransferEngine* engine = manager_ ? manager_->GetTransferEngine() : nullptr;
+    if (!engine || !engine->IsRunning()) {
+        return false;
+    }
+    return engine->SubmitInterrupt(*this, endpoint, data, length, urb_id, std::move(callback));
+}
+
+bool UsbDevice::SubmitControlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                                      uint8_t* data, uint16_t length, uint32_t urb_id,
+                                      TransferEngine::CompletionCallback callback) {
+    TransferEngine* engine = manager_ ? manager_->GetTransferEngine() : nullptr;
+    if (!engine || !engine->IsRunning()) {
+        return false;
+    }
+    return engine->SubmitControl(*this, request_type, request, value, index, data, length,
+                                 urb_id, std::move(callback));
+}
+
+bool UsbDevice::ClearHalt(uint8_t endpoint) {
+    if (!handle_) {
+        LOG_ERROR("Device not opened");
+        return false;
+    }
+
+    int ret = libusb_clear_halt(handle_, endpoint);
+    if (ret != LIBUSB_SUCCESS) {
+        LOG_ERROR("Failed to clear halt on endpoint 0x" << std::hex << static_cast<int>(endpoint)
+                  << ": " << libusb_error_name(ret));
+        return false;
+    }
+    return true;
+}
+
+bool UsbDevice::SubmitTransfer(libusb_transfer* transfer, uint32_t seqnum) {
     if (!handle_) {
         LOG_ERROR("Device not opened");
         return false;
     }
 
+    TrackedTransfer* tracked = nullptr;
+    if (seqnum != 0) {
+        // 换上中转回调，完成时从登记表移除后再调用原回调
+        tracked = new TrackedTransfer{this, seqnum, transfer->callback, transfer->user_data};
+        transfer->callback = &UsbDevice::OnTrackedTransferComplete;
+        transfer->user_data = tracked;
+
+        std::lock_guard<std::mutex> lock(transfers_mutex_);
+        tracked_transfers_[seqnum] = transfer;
+    }
+
     int ret = libusb_submit_transfer(transfer);
     if (ret != LIBUSB_SUCCESS) {
         LOG_ERROR("Submit transfer failed: " << libusb_error_name(ret));
+        if (tracked) {
+            {
+                std::lock_guard<std::mutex> lock(transfers_mutex_);
+                tracked_transfers_.erase(seqnum);
+            }
+            transfer->callback = tracked->callback;
+            transfer->user_data = tracked->user_data;
+            delete tracked;
+        }
         return false;
     }
 
     return true;
 }
 
+bool UsbDevice::CancelTransfer(uint32_t seqnum) {
+    // 持锁期间传输不会被完成回调释放
+    std::lock_guard<std::mutex> lock(transfers_mutex_);
+    auto it = tracked_transfers_.find(seqnum);
+    if (it == tracked_transfers_.end()) {
+        return false;
+    }
+
+    int ret = libusb_cancel_transfer(it->second);
+    if (ret != LIBUSB_SUCCESS) {
+        // NOT_FOUND表示传输已经完成，只是回调尚未执行
+        LOG_DEBUG("Cancel transfer " << seqnum << ": " << libusb_error_name(ret));
+        return false;
+    }
+
+    return true;
+}
+
+void LIBUSB_CALL UsbDevice::OnTrackedTransferComplete(libusb_transfer* transfer) {
+    auto* tracked = static_cast<TrackedTransfer*>(transfer->user_data);
+    {
+        std::lock_guard<std::mutex> lock(tracked->device->transfers_mutex_);
+        tracked->device->tracked_transfers_.erase(tracked->seqnum);
+    }
+
+    transfer->callback = tracked->callback;
+    transfer->user_data = tracked->user_data;
+    delete tracked;
+
+    if (transfer->callback) {
+        transfer->callback(transfer);
+    }
+}
+
 bool UsbDevice::GetDeviceDescriptor(protocol::UsbDeviceDescriptor& desc) {
     if (!device_) {
         return false;
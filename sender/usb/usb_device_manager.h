@@ -7,7 +7,9 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <unordered_map>
 #include "protocol/usb_types.h"
+#include "transfer_engine.h"
 
 namespace usb_redirector {
 namespace sender {
@@ -45,6 +47,11 @@ public:
     // 获取libusb上下文
     libusb_context* GetContext() const { return context_; }
 
+    // 异步传输引擎，需在Initialize之前设置配置
+    void SetTransferEngineConfig(const TransferEngineConfig& config) { engine_config_ = config; }
+    const TransferEngineConfig& GetTransferEngineConfig() const { return engine_config_; }
+    TransferEngine* GetTransferEngine() const { return transfer_engine_.get(); }
+
 private:
     void HotplugThread();
     static int HotplugCallback(libusb_context* ctx, libusb_device* device,
@@ -61,6 +68,9 @@ private:
     std::thread hotplug_thread_;
     libusb_hotplug_callback_handle hotplug_handle_;
 
+    TransferEngineConfig engine_config_;
+    std::unique_ptr<TransferEngine> transfer_engine_;
+
     mutable std::mutex devices_mutex_;
 };
 
@@ -82,19 +92,43 @@ public:
     bool Open();
     void Close();
     bool IsOpen() const { return handle_ != nullptr; }
+    libusb_device_handle* GetHandle() const { return handle_; }
 
     // 声明接口
     bool ClaimInterface(int interface_number);
     bool ReleaseInterface(int interface_number);
+    bool SetAltSetting(int interface_number, int alt_setting);
 
-    // 传输操作
+    // 为一组批量端点分配USB 3流，返回实际分配的流数量，失败时返回0
+    int AllocStreams(uint32_t num_streams, const std::vector<uint8_t>& endpoints);
+    void FreeStreams(const std::vector<uint8_t>& endpoints);
+
+    // 同步传输：引擎运行时经异步引擎提交并等待完成，超时取引擎配置
     bool ControlTransfer(uint8_t request_type, uint8_t request, uint16_t value,
                         uint16_t index, uint8_t* data, uint16_t length, int* actual_length);
     bool BulkTransfer(uint8_t endpoint, uint8_t* data, int length, int* actual_length);
     bool InterruptTransfer(uint8_t endpoint, uint8_t* data, int length, int* actual_length);
 
-    // 异步传输
-    bool SubmitTransfer(libusb_transfer* transfer);
+    // 经传输引擎异步提交，urb_id随完成回调返回。引擎未运行时返回false
+    bool SubmitBulkTransfer(uint8_t endpoint, uint8_t* data, int length, uint32_t urb_id,
+                            TransferEngine::CompletionCallback callback);
+    bool SubmitBulkStreamTransfer(uint8_t endpoint, uint32_t stream_id, uint8_t* data, int length, uint32_t urb_id,
+                                  TransferEngine::CompletionCallback callback);
+    bool SubmitInterruptTransfer(uint8_t endpoint, uint8_t* data, int length, uint32_t urb_id,
+                                 TransferEngine::CompletionCallback callback);
+    bool SubmitControlTransfer(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+                               uint8_t* data, uint16_t length, uint32_t urb_id,
+                               TransferEngine::CompletionCallback callback);
+
+    // 清除端点的STALL状态
+    bool ClearHalt(uint8_t endpoint);
+
+    // 提交已填充的libusb_transfer。seqnum非0时登记该传输，之后可按seqnum撤销
+    bool SubmitTransfer(libusb_transfer* transfer, uint32_t seqnum = 0);
+
+    // 撤销seqnum对应的在途传输（libusb_cancel_transfer），
+    // 传输随后以LIBUSB_TRANSFER_CANCELLED状态调用其完成回调。未找到时返回false
+    bool CancelTransfer(uint32_t seqnum);
 
     // 获取描述符
     bool GetDeviceDescriptor(protocol::UsbDeviceDescriptor& desc);
@@ -102,6 +136,19 @@ public:
     bool GetStringDescriptor(uint8_t desc_index, std::string& str);
 
 private:
+    // 登记的传输：完成时先注销再转交原回调
+    struct TrackedTransfer {
+        UsbDevice* device;
+        uint32_t seqnum;
+        libusb_transfer_cb_fn callback;
+        void* user_data;
+    };
+    static void LIBUSB_CALL OnTrackedTransferComplete(libusb_transfer* transfer);
+
+    // 可以在当前线程同步等待的引擎，否则返回nullptr（走libusb同步接口）
+    TransferEngine* SyncEngine() const;
+    bool WaitTransfer(TransferWaiter& waiter, bool submitted, int* actual_length, const char* kind);
+
     void LoadDeviceInfo();
 
     libusb_device* device_;
@@ -111,6 +158,9 @@ private:
 
     std::vector<int> claimed_interfaces_;
     mutable std::mutex mutex_;
+
+    std::unordered_map<uint32_t, libusb_transfer*> tracked_transfers_;
+    std::mutex transfers_mutex_;
 };
 
 } // namespace sender
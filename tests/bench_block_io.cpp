@@ -0,0 +1,125 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include "protocol/bot_block_io.h"
+#include "protocol/uas_block_io.h"
+#include "utils/logger.h"
+#include "emulated_bot_device.h"
+#include "emulated_uas_device.h"
+
+using namespace usb_redirector;
+
+// 块读写基准：对文件支撑的仿真BOT/UAS设备，比较不同命令大小和在途命令数下的吞吐量
+// 用法: bench_block_io [total_mb] [latency_us] [bandwidth_mb_per_s] [service_us]
+//   latency_us          每次传输从提交到到达设备的延迟（模拟主机调度和总线往返）
+//   bandwidth_mb_per_s  BOT数据阶段带宽上限，0表示不限
+//   service_us          每条命令在设备上的处理时间（两种设备相同；UAS设备可并发处理多条）
+
+static constexpr uint32_t BLOCK_SIZE = 512;
+
+static double RunBenchmark(protocol::BlockIo& block_io, bool is_read, std::vector<uint8_t>& buffer,
+                           uint64_t total_blocks) {
+    uint32_t chunk_blocks = static_cast<uint32_t>(buffer.size() / BLOCK_SIZE);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t lba = 0; lba < total_blocks; lba += chunk_blocks) {
+        bool ok = is_read ? block_io.Read(0, lba, chunk_blocks, BLOCK_SIZE, buffer.data())
+                          : block_io.Write(0, lba, chunk_blocks, BLOCK_SIZE, buffer.data());
+        if (!ok) {
+            std::cerr << "Block I/O failed at LBA " << lba << std::endl;
+            return 0.0;
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return elapsed > 0 ? static_cast<double>(total_blocks) * BLOCK_SIZE / elapsed / 1e6 : 0.0;
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t total_mb = 64;
+    uint32_t latency_us = 250;
+    double bandwidth = 0;
+    if (argc > 1) {
+        total_mb = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        latency_us = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+    }
+    if (argc > 3) {
+        bandwidth = std::strtod(argv[3], nullptr);
+    }
+    uint32_t service_us = 500;
+    if (argc > 4) {
+        service_us = static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10));
+    }
+
+    utils::Logger::Instance().SetLogLevel(utils::LogLevel::WARNING);
+
+    uint64_t total_blocks = total_mb * 1024 * 1024 / BLOCK_SIZE;
+    // 每次调用读写4 MiB，由BotBlockIo拆分为多条命令
+    std::vector<uint8_t> buffer(4 * 1024 * 1024);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = static_cast<uint8_t>(i * 131 + 17);
+    }
+
+    std::cout << "=== BOT Block I/O Benchmark (" << total_mb << " MB, latency " << latency_us << " us, bandwidth "
+              << (bandwidth > 0 ? std::to_string(static_cast<int>(bandwidth)) + " MB/s" : std::string("unlimited"))
+              << ") ===" << std::endl;
+    std::cout << std::left << std::setw(12) << "transfer" << std::setw(10) << "depth"
+              << std::right << std::setw(12) << "write MB/s" << std::setw(12) << "read MB/s" << std::endl;
+
+    for (uint32_t transfer_kb : {64, 128, 512}) {
+        for (size_t depth : {1, 2, 4, 8}) {
+            EmulatedBotDevice device(total_blocks, BLOCK_SIZE, latency_us, bandwidth);
+            protocol::BlockIoConfig config;
+            config.max_transfer_bytes = transfer_kb * 1024;
+            config.max_commands_in_flight = depth;
+            protocol::BotBlockIo block_io(device, config);
+
+            double write_rate = RunBenchmark(block_io, false, buffer, total_blocks);
+            double read_rate = RunBenchmark(block_io, true, buffer, total_blocks);
+
+            std::cout << std::left << std::setw(12) << (std::to_string(transfer_kb) + " KB")
+                      << std::setw(10) << depth
+                      << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(12) << write_rate << std::setw(12) << read_rate << std::endl;
+        }
+    }
+
+    // UAS：命令按标签分流，设备以UAS_WORKERS路并发处理，与同样处理时间的BOT对比
+    static constexpr size_t UAS_WORKERS = 8;
+    std::cout << "\n=== BOT vs UAS (128 KB commands, " << service_us << " us per command on the device, "
+              << UAS_WORKERS << " UAS device workers) ===" << std::endl;
+    std::cout << std::left << std::setw(12) << "transport" << std::setw(10) << "depth"
+              << std::right << std::setw(12) << "write MB/s" << std::setw(12) << "read MB/s" << std::endl;
+
+    protocol::BlockIoConfig config;
+    config.max_transfer_bytes = 128 * 1024;
+    for (size_t depth : {1, 4}) {
+        EmulatedBotDevice device(total_blocks, BLOCK_SIZE, latency_us, bandwidth);
+        device.SetServiceTime(service_us);
+        config.max_commands_in_flight = depth;
+        protocol::BotBlockIo block_io(device, config);
+
+        double write_rate = RunBenchmark(block_io, false, buffer, total_blocks);
+        double read_rate = RunBenchmark(block_io, true, buffer, total_blocks);
+        std::cout << std::left << std::setw(12) << "BOT" << std::setw(10) << depth
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << write_rate << std::setw(12) << read_rate << std::endl;
+    }
+    for (size_t depth : {1, 4, 16, 32}) {
+        EmulatedUasDevice device(total_blocks, BLOCK_SIZE, 32, latency_us, UAS_WORKERS, service_us);
+        config.max_uas_commands_in_flight = depth;
+        protocol::UasBlockIo block_io(device, config);
+
+        double write_rate = RunBenchmark(block_io, false, buffer, total_blocks);
+        double read_rate = RunBenchmark(block_io, true, buffer, total_blocks);
+        std::cout << std::left << std::setw(12) << "UAS" << std::setw(10) << depth
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << write_rate << std::setw(12) << read_rate << std::endl;
+    }
+
+    return 0;
+}
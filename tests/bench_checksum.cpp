@@ -0,0 +1,78 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include "network/message_handler.h"
+#include "utils/crc32c.h"
+
+using namespace usb_redirector;
+
+// 帧校验基准：比较各校验模式在不同载荷大小下的吞吐量
+// 用法: bench_checksum [bytes_per_run]
+
+using ChecksumFunction = uint32_t (*)(const uint8_t*, size_t);
+
+static uint32_t LegacySum(const uint8_t* data, size_t len) {
+    return network::MessageHandler::CalculateChecksum(network::ChecksumMode::LEGACY_SUM, data, len);
+}
+
+static uint32_t Crc32cDispatched(const uint8_t* data, size_t len) {
+    return network::MessageHandler::CalculateChecksum(network::ChecksumMode::CRC32C, data, len);
+}
+
+static uint32_t Crc32cPortable(const uint8_t* data, size_t len) {
+    return utils::Crc32cPortable(data, len);
+}
+
+static uint32_t NoChecksum(const uint8_t* data, size_t len) {
+    return network::MessageHandler::CalculateChecksum(network::ChecksumMode::NONE, data, len);
+}
+
+static void RunBenchmark(const char* name, ChecksumFunction function,
+                         const std::vector<uint8_t>& buffer, size_t payload_size, size_t total_bytes) {
+    size_t iterations = std::max<size_t>(1, total_bytes / payload_size);
+    volatile uint32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        sink = sink + function(buffer.data(), payload_size);
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double bytes = static_cast<double>(iterations) * payload_size;
+    std::cout << std::left << std::setw(22) << name
+              << std::setw(10) << payload_size
+              << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+              << (elapsed > 0 ? bytes / elapsed / 1e9 : 0.0)
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t total_bytes = 1024ull * 1024 * 1024;
+    if (argc > 1) {
+        total_bytes = std::strtoull(argv[1], nullptr, 10);
+    }
+
+    std::vector<uint8_t> buffer(1024 * 1024);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        buffer[i] = static_cast<uint8_t>(i * 131 + 17);
+    }
+
+    std::string crc_name = std::string("crc32c (") + utils::Crc32cImplementation() + ")";
+
+    std::cout << "=== Frame Checksum Benchmark (" << total_bytes / (1024 * 1024) << " MB per run) ===" << std::endl;
+    std::cout << std::left << std::setw(22) << "mode" << std::setw(10) << "size"
+              << std::right << std::setw(10) << "GB/s" << std::endl;
+
+    for (size_t payload_size : {64, 4096, 65536, 1024 * 1024}) {
+        RunBenchmark("legacy-sum", LegacySum, buffer, payload_size, total_bytes);
+        RunBenchmark(crc_name.c_str(), Crc32cDispatched, buffer, payload_size, total_bytes);
+        RunBenchmark("crc32c (slicing-by-8)", Crc32cPortable, buffer, payload_size, total_bytes);
+        RunBenchmark("none", NoChecksum, buffer, payload_size, total_bytes);
+    }
+
+    return 0;
+}
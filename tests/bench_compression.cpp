@@ -0,0 +1,221 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "network/compression.h"
+#include "utils/lz4.h"
+#include "utils/logger.h"
+
+using namespace usb_redirector;
+
+// 载荷压缩基准：对几类有代表性的大容量存储数据，测量LZ4压缩率和压缩/解压速度，
+// 并按流水模型估算限速链路上的有效吞吐量（原始数据量/耗时，耗时取压缩、传输、解压中最慢的一级）：
+//   raw       不压缩
+//   lz4       总是压缩
+//   adaptive  AdaptiveCompressor按压缩率和链路带宽自动旁路
+// 用法: bench_compression [dataset_mb] [payload_kb]
+
+static constexpr size_t MB = 1024 * 1024;
+
+struct Dataset {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+static uint64_t NextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// 文本日志：时间戳、级别和带变化数字的消息
+static Dataset MakeTextLog(size_t size) {
+    static const char* levels[] = {"INFO", "DEBUG", "WARNING", "ERROR"};
+    static const char* messages[] = {"Submitted URB to endpoint", "Completed bulk transfer of",
+                                     "Device reported sense key", "Heartbeat from client at"};
+    Dataset dataset{"text-log", {}};
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    std::string line;
+    while (dataset.data.size() < size) {
+        uint64_t r = NextRandom(state);
+        line = "2024-05-" + std::to_string(10 + r % 20) + " 12:" + std::to_string(10 + (r >> 8) % 50) + ":" +
+               std::to_string(10 + (r >> 16) % 50) + "." + std::to_string((r >> 24) % 1000) + " [" +
+               levels[(r >> 34) % 4] + "] " + messages[(r >> 36) % 4] + " " + std::to_string((r >> 40) % 65536) + "\n";
+        dataset.data.insert(dataset.data.end(), line.begin(), line.end());
+    }
+    dataset.data.resize(size);
+    return dataset;
+}
+
+// 稀疏镜像：大部分块为零，少量块为文本或随机数据（类似新建文件系统）
+static Dataset MakeSparseImage(size_t size) {
+    Dataset dataset{"sparse-image", std::vector<uint8_t>(size, 0)};
+    Dataset text = MakeTextLog(size);
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    for (size_t offset = 0; offset + 4096 <= size; offset += 4096) {
+        uint64_t r = NextRandom(state) % 8;
+        if (r == 0) {
+            std::memcpy(dataset.data.data() + offset, text.data.data() + offset, 4096);
+        } else if (r == 1) {
+            for (size_t i = 0; i < 4096; i += 8) {
+                uint64_t value = NextRandom(state);
+                std::memcpy(dataset.data.data() + offset + i, &value, 8);
+            }
+        }
+    }
+    return dataset;
+}
+
+// 可执行文件：基准程序自身，反复拼接到所需大小
+static Dataset MakeExecutable(size_t size, const char* path) {
+    Dataset dataset{"executable", {}};
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) {
+        binary.assign(4096, 0x90);
+    }
+    while (dataset.data.size() < size) {
+        dataset.data.insert(dataset.data.end(), binary.begin(), binary.end());
+    }
+    dataset.data.resize(size);
+    return dataset;
+}
+
+// 已压缩的媒体（照片、视频、压缩包）：近似随机数据
+static Dataset MakeCompressedMedia(size_t size) {
+    Dataset dataset{"compressed-media", std::vector<uint8_t>(size)};
+    uint64_t state = 0xD1B54A32D192ED03ULL;
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t value = NextRandom(state);
+        std::memcpy(dataset.data.data() + i, &value, 8);
+    }
+    return dataset;
+}
+
+struct CodecResult {
+    double ratio;
+    double compress_rate;       // 字节/秒
+    double decompress_rate;
+};
+
+static CodecResult MeasureCodec(const Dataset& dataset, size_t payload) {
+    std::vector<uint8_t> compressed(utils::Lz4CompressBound(payload));
+    std::vector<std::vector<uint8_t>> blocks;
+    std::vector<size_t> lengths;
+    size_t total_out = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < dataset.data.size(); offset += payload) {
+        size_t len = std::min(payload, dataset.data.size() - offset);
+        size_t out = utils::Lz4Compress(dataset.data.data() + offset, len, compressed.data(), compressed.size());
+        blocks.emplace_back(compressed.begin(), compressed.begin() + out);
+        lengths.push_back(len);
+        total_out += out;
+    }
+    double compress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint8_t> output(payload);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (!utils::Lz4Decompress(blocks[i].data(), blocks[i].size(), output.data(), lengths[i])) {
+            std::cerr << "Decompression failed" << std::endl;
+        }
+    }
+    double decompress_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double bytes = static_cast<double>(dataset.data.size());
+    return {static_cast<double>(total_out) / bytes, bytes / std::max(compress_seconds, 1e-9),
+            bytes / std::max(decompress_seconds, 1e-9)};
+}
+
+// 以AdaptiveCompressor发送整个数据集，按流水模型返回有效吞吐量（字节/秒）
+static double RunAdaptive(const Dataset& dataset, size_t payload, uint64_t link, double decompress_rate,
+                          double& wire_ratio) {
+    network::CompressionConfig config;
+    config.enabled = true;
+    config.link_bytes_per_second = link;
+    network::AdaptiveCompressor compressor(config);
+
+    std::vector<uint8_t> out;
+    double wire_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < dataset.data.size(); offset += payload) {
+        size_t len = std::min(payload, dataset.data.size() - offset);
+        struct iovec segment = {const_cast<uint8_t*>(dataset.data.data() + offset), len};
+        wire_bytes += compressor.Compress(&segment, 1, len, out, 0) ? out.size() : len;
+    }
+    double cpu_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = compressor.GetStatistics();
+    double bytes = static_cast<double>(dataset.data.size());
+    double wire_seconds = wire_bytes / link;
+    double decompress_seconds = stats.bytes_in / decompress_rate;
+    wire_ratio = wire_bytes / bytes;
+    return bytes / std::max({cpu_seconds, wire_seconds, decompress_seconds});
+}
+
+int main(int argc, char* argv[]) {
+    size_t dataset_mb = 64;
+    size_t payload_kb = 64;
+    if (argc > 1) {
+        dataset_mb = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        payload_kb = std::strtoull(argv[2], nullptr, 10);
+    }
+
+    utils::Logger::Instance().SetLogLevel(utils::LogLevel::WARNING);
+
+    size_t size = dataset_mb * MB;
+    size_t payload = payload_kb * 1024;
+    std::vector<Dataset> datasets;
+    datasets.push_back(MakeTextLog(size));
+    datasets.push_back(MakeSparseImage(size));
+    datasets.push_back(MakeExecutable(size, argv[0]));
+    datasets.push_back(MakeCompressedMedia(size));
+
+    std::cout << "=== LZ4 Payload Compression Benchmark (" << dataset_mb << " MB per dataset, "
+              << payload_kb << " KB payloads) ===" << std::endl;
+    std::cout << std::left << std::setw(18) << "dataset" << std::right << std::setw(8) << "ratio"
+              << std::setw(14) << "comp MB/s" << std::setw(14) << "decomp MB/s" << std::endl;
+
+    std::vector<CodecResult> results;
+    for (const auto& dataset : datasets) {
+        CodecResult result = MeasureCodec(dataset, payload);
+        results.push_back(result);
+        std::cout << std::left << std::setw(18) << dataset.name << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(8) << result.ratio << std::setprecision(0)
+                  << std::setw(14) << result.compress_rate / 1e6 << std::setw(14) << result.decompress_rate / 1e6
+                  << std::endl;
+    }
+
+    std::cout << "\nEffective throughput on throttled links (MB/s of original data)" << std::endl;
+    std::cout << std::left << std::setw(18) << "dataset" << std::setw(10) << "link"
+              << std::right << std::setw(10) << "raw" << std::setw(10) << "lz4" << std::setw(10) << "adaptive"
+              << std::setw(12) << "wire ratio" << std::endl;
+
+    for (size_t i = 0; i < datasets.size(); ++i) {
+        const CodecResult& codec = results[i];
+        for (uint64_t mbps : {10, 100, 1000, 10000, 40000}) {
+            double link = mbps * 125000.0;
+            double always = std::min({codec.compress_rate, codec.decompress_rate, link / codec.ratio});
+            double wire_ratio = 1.0;
+            double adaptive = RunAdaptive(datasets[i], payload, static_cast<uint64_t>(link),
+                                          codec.decompress_rate, wire_ratio);
+
+            std::cout << std::left << std::setw(18) << datasets[i].name << std::setw(10)
+                      << (std::to_string(mbps) + "M") << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(10) << link / 1e6 << std::setw(10) << always / 1e6
+                      << std::setw(10) << adaptive / 1e6 << std::setprecision(3) << std::setw(12) << wire_ratio
+                      << std::endl;
+        }
+    }
+
+    return 0;
+}
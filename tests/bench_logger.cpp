@@ -0,0 +1,129 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include "utils/logger.h"
+
+using namespace usb_redirector;
+
+// 日志调用开销：级别不满足的LOG_DEBUG（只有一次原子读）和写入文件的LOG_INFO，N个线程同时写：
+//   sync   原先的做法：每条日志构造ostringstream，持全局锁用localtime/put_time生成时间戳，逐行写入并flush
+//   async  格式化到线程局部缓冲后放入本线程队列，由后台线程成批写出
+// 提交耗时不含后台线程写文件的时间，Flush后的总耗时给出端到端的吞吐量
+// 用法: bench_logger [calls_per_thread] [max_threads] [log_file]
+
+// 原Logger的同步写出路径
+struct SyncLogger {
+    std::mutex mutex;
+    std::ofstream file;
+
+    void Log(const std::string& message, const char* location) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::system_clock::now();
+        auto time = std::chrono::system_clock::to_time_t(now);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
+        std::ostringstream timestamp;
+        timestamp << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
+        timestamp << '.' << std::setfill('0') << std::setw(3) << ms.count();
+        file << "[" + timestamp.str() + "] [INFO] " + message + location << std::endl;
+        file.flush();
+    }
+};
+
+static double NsPerCall(std::chrono::steady_clock::time_point start, size_t calls) {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+           static_cast<double>(calls);
+}
+
+int main(int argc, char* argv[]) {
+    size_t per_thread = 200000;
+    size_t max_threads = std::max<size_t>(4, std::thread::hardware_concurrency());
+    const char* log_file = "/dev/null";
+    if (argc > 1) {
+        per_thread = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        max_threads = std::strtoull(argv[2], nullptr, 10);
+    }
+    if (argc > 3) {
+        log_file = argv[3];
+    }
+
+    auto& logger = utils::Logger::Instance();
+    logger.SetConsoleOutput(false);
+    logger.SetLogFile(log_file);
+    logger.SetLogLevel(utils::LogLevel::INFO);
+
+    std::cout << "=== Logger Benchmark (" << per_thread << " calls per thread, output " << log_file
+              << ") ===" << std::endl;
+
+    // 关闭的级别：参数不求值
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < per_thread; ++i) {
+        LOG_DEBUG("Processing URB: id=" << i << " length=" << sink);
+    }
+    std::cout << "disabled LOG_DEBUG: " << std::fixed << std::setprecision(2)
+              << NsPerCall(start, per_thread) << " ns/call" << std::endl;
+
+    SyncLogger sync;
+    sync.file.open(log_file, std::ios::app);
+
+    std::cout << std::left << std::setw(8) << "logger" << std::setw(10) << "threads" << std::right
+              << std::setw(16) << "submit ns/call" << std::setw(16) << "total ns/line"
+              << std::setw(14) << "Mlines/s" << std::endl;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        auto sync_begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> sync_workers;
+        for (size_t t = 0; t < threads; ++t) {
+            sync_workers.emplace_back([&sync, per_thread]() {
+                for (size_t i = 0; i < per_thread; ++i) {
+                    std::ostringstream oss;
+                    oss << "URB " << i << " submitted on endpoint 0x81, " << 4096 << " bytes";
+                    sync.Log(oss.str(), " (bench_logger.cpp:1)");
+                }
+            });
+        }
+        for (auto& worker : sync_workers) {
+            worker.join();
+        }
+        double sync_total = NsPerCall(sync_begin, threads * per_thread);
+        std::cout << std::left << std::setw(8) << "sync" << std::setw(10) << threads << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(16) << sync_total * threads
+                  << std::setw(16) << sync_total << std::setw(14) << 1e3 / sync_total << std::endl;
+
+        logger.Flush();
+        std::vector<double> submit(threads);
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&submit, t, per_thread]() {
+                auto thread_start = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < per_thread; ++i) {
+                    LOG_INFO("URB " << i << " submitted on endpoint 0x81, " << 4096 << " bytes");
+                }
+                submit[t] = NsPerCall(thread_start, per_thread);
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        logger.Flush();
+        double total = NsPerCall(begin, threads * per_thread);
+
+        double average = 0;
+        for (double value : submit) {
+            average += value / static_cast<double>(threads);
+        }
+        std::cout << std::left << std::setw(8) << "async" << std::setw(10) << threads << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(16) << average << std::setw(16) << total
+                  << std::setw(14) << 1e3 / total << std::endl;
+    }
+    return 0;
+}
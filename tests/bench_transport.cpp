@@ -0,0 +1,101 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include "network/tcp_socket.h"
+#include "network/event_loop.h"
+#include "utils/logger.h"
+
+using namespace usb_redirector;
+
+// 回环基准：比较epoll与io_uring后端的消息吞吐量和每条消息的系统调用次数
+// 用法: bench_transport [messages_per_run]
+
+static const char* BackendName(network::IoBackend backend) {
+    return backend == network::IoBackend::IO_URING ? "io_uring" : "reactor";
+}
+
+static bool RunBenchmark(network::IoBackend backend, size_t message_size, size_t message_count, uint16_t port) {
+    network::EventLoopGroup group(1, backend);
+    if (group.GetBackend() != backend) {
+        std::cout << std::left << std::setw(10) << BackendName(backend)
+                  << "not supported on this kernel, skipped" << std::endl;
+        return true;
+    }
+
+    std::atomic<size_t> received_bytes{0};
+    network::TcpServer server(group);
+    server.SetClientConnectCallback([&](std::shared_ptr<network::TcpSocket> client) {
+        client->SetDataCallback([&](const uint8_t*, size_t len) {
+            received_bytes += len;
+        });
+    });
+    if (!server.Start("127.0.0.1", port)) {
+        std::cerr << "Failed to start server on port " << port << std::endl;
+        return false;
+    }
+
+    network::TcpSocket client(group);
+    if (!client.Connect("127.0.0.1", port)) {
+        std::cerr << "Failed to connect to port " << port << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> message(message_size, 0xA5);
+    const size_t expected = message_size * message_count;
+    uint64_t syscalls_before = group.GetSyscallCount();
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < message_count; ++i) {
+        if (!client.Send(message)) {
+            std::cerr << "Send failed" << std::endl;
+            return false;
+        }
+    }
+
+    while (received_bytes.load() < expected) {
+        std::this_thread::yield();
+    }
+
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t syscalls = group.GetSyscallCount() - syscalls_before;
+
+    std::cout << std::left << std::setw(10) << BackendName(backend)
+              << std::setw(8) << message_size
+              << std::right << std::setw(14) << std::fixed << std::setprecision(0) << message_count / elapsed
+              << std::setw(12) << std::setprecision(1) << expected / elapsed / (1024 * 1024)
+              << std::setw(16) << std::setprecision(3) << static_cast<double>(syscalls) / message_count
+              << std::endl;
+
+    client.Close();
+    server.Stop();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    utils::Logger::Instance().SetLogLevel(utils::LogLevel::WARNING);
+
+    size_t message_count = 200000;
+    if (argc > 1) {
+        message_count = std::strtoul(argv[1], nullptr, 10);
+    }
+
+    std::cout << "=== Transport Loopback Benchmark (" << message_count << " messages) ===" << std::endl;
+    std::cout << std::left << std::setw(10) << "backend" << std::setw(8) << "size"
+              << std::right << std::setw(14) << "msgs/sec" << std::setw(12) << "MB/s"
+              << std::setw(16) << "syscalls/msg" << std::endl;
+
+    uint16_t port = 13400;
+    for (size_t message_size : {64, 512}) {
+        for (auto backend : {network::IoBackend::REACTOR, network::IoBackend::IO_URING}) {
+            if (!RunBenchmark(backend, message_size, message_count, port++)) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+#include "protocol/usb_types.h"
+#include "utils/mpsc_ring.h"
+#include "utils/notifier.h"
+#include "utils/logger.h"
+
+using namespace usb_redirector;
+
+// URB捕获队列压力测试：N个生产者线程（模拟设备回调）向单个处理线程投递URB，
+// 测量吞吐量（URB/s）和从投递到处理线程拿到URB的延迟分布：
+//   mutex  std::queue + 互斥锁 + 每次投递notify_one（UrbCapture原先的做法）
+//   ring   有界MPSC无锁队列 + 批量取出 + 仅在处理线程睡眠时唤醒，队列满时生产者等待（背压）
+// 用法: bench_urb_queue [urbs_per_producer] [max_producers]
+
+static constexpr size_t PAYLOAD_SIZE = 512;
+static constexpr size_t RING_CAPACITY = 4096;
+static constexpr size_t BATCH_SIZE = 64;
+static constexpr size_t SPIN_LIMIT = 256;
+
+static uint64_t NowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static protocol::UsbUrb MakeUrb(uint32_t id) {
+    protocol::UsbUrb urb = {};
+    urb.id = id;
+    urb.type = protocol::UsbTransferType::BULK;
+    urb.direction = protocol::UsbDirection::IN;
+    urb.endpoint = 0x81;
+    urb.data.resize(PAYLOAD_SIZE);
+    urb.timestamp = NowNs();
+    return urb;
+}
+
+struct Result {
+    double seconds = 0;
+    uint64_t backpressure = 0;
+    uint64_t wakeups = 0;
+    std::vector<uint32_t> latencies_ns;
+};
+
+// 处理线程的工作：记录延迟并释放URB
+struct Consumer {
+    std::vector<uint32_t> latencies;
+    uint64_t bytes = 0;
+
+    void Handle(protocol::UsbUrb&& urb) {
+        latencies.push_back(static_cast<uint32_t>(std::min<uint64_t>(NowNs() - urb.timestamp, UINT32_MAX)));
+        bytes += urb.data.size();
+    }
+};
+
+static Result RunMutexQueue(size_t producers, size_t per_producer) {
+    std::queue<protocol::UsbUrb> queue;
+    std::mutex mutex;
+    std::condition_variable cv;
+    const size_t total = producers * per_producer;
+    Consumer consumer;
+    consumer.latencies.reserve(total);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread worker([&]() {
+        size_t handled = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (handled < total) {
+            cv.wait(lock, [&]() { return !queue.empty(); });
+            while (!queue.empty()) {
+                protocol::UsbUrb urb = std::move(queue.front());
+                queue.pop();
+                lock.unlock();
+                consumer.Handle(std::move(urb));
+                ++handled;
+                lock.lock();
+            }
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (size_t i = 0; i < per_producer; ++i) {
+                protocol::UsbUrb urb = MakeUrb(static_cast<uint32_t>(p * per_producer + i));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    queue.push(std::move(urb));
+                }
+                cv.notify_one();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    worker.join();
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.latencies_ns = std::move(consumer.latencies);
+    return result;
+}
+
+static Result RunRing(size_t producers, size_t per_producer) {
+    utils::MpscRing<protocol::UsbUrb> ring(RING_CAPACITY);
+    utils::Notifier ready;
+    utils::Notifier space;
+    std::atomic<uint64_t> backpressure{0};
+    const size_t total = producers * per_producer;
+    Consumer consumer;
+    consumer.latencies.reserve(total);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread worker([&]() {
+        size_t handled = 0;
+        while (handled < total) {
+            size_t drained = ring.Drain(BATCH_SIZE, [&](protocol::UsbUrb&& urb) {
+                consumer.Handle(std::move(urb));
+            });
+            if (drained > 0) {
+                handled += drained;
+                space.Notify();
+                continue;
+            }
+            if (ring.SpinUntilNotEmpty(SPIN_LIMIT)) {
+                continue;
+            }
+            uint32_t epoch = ready.PrepareWait();
+            if (!ring.Empty()) {
+                ready.CancelWait();
+                continue;
+            }
+            ready.Wait(epoch, std::chrono::milliseconds(100));
+        }
+    });
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (size_t i = 0; i < per_producer; ++i) {
+                protocol::UsbUrb urb = MakeUrb(static_cast<uint32_t>(p * per_producer + i));
+                if (!ring.TryPush(urb)) {
+                    backpressure.fetch_add(1, std::memory_order_relaxed);
+                    for (;;) {
+                        uint32_t epoch = space.PrepareWait();
+                        if (ring.TryPush(urb)) {
+                            space.CancelWait();
+                            break;
+                        }
+                        space.Wait(epoch, std::chrono::milliseconds(10));
+                    }
+                }
+                ready.Notify();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    worker.join();
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.backpressure = backpressure.load();
+    result.wakeups = ready.WakeCount();
+    result.latencies_ns = std::move(consumer.latencies);
+    return result;
+}
+
+static double Percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return sorted[index] / 1000.0;
+}
+
+static void Print(const char* name, size_t producers, Result result) {
+    std::sort(result.latencies_ns.begin(), result.latencies_ns.end());
+    double rate = static_cast<double>(result.latencies_ns.size()) / result.seconds;
+    std::cout << std::left << std::setw(8) << name
+              << std::setw(11) << producers
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << rate / 1e6
+              << std::setw(10) << Percentile(result.latencies_ns, 0.50)
+              << std::setw(10) << Percentile(result.latencies_ns, 0.99)
+              << std::setw(10) << Percentile(result.latencies_ns, 0.999)
+              << std::setw(12) << (result.latencies_ns.empty() ? 0 : result.latencies_ns.back() / 1000.0)
+              << std::setw(14) << result.backpressure
+              << std::setw(10) << result.wakeups << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t per_producer = 200000;
+    size_t max_producers = std::max<size_t>(4, std::thread::hardware_concurrency());
+    if (argc > 1) {
+        per_producer = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        max_producers = std::strtoull(argv[2], nullptr, 10);
+    }
+
+    utils::Logger::Instance().SetLogLevel(utils::LogLevel::WARNING);
+
+    std::cout << "=== URB Capture Queue Benchmark (" << per_producer << " URBs per producer, "
+              << PAYLOAD_SIZE << " B payload) ===" << std::endl;
+    std::cout << std::left << std::setw(8) << "queue" << std::setw(11) << "producers"
+              << std::right << std::setw(10) << "MURB/s" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p99 us" << std::setw(10) << "p999 us" << std::setw(12) << "max us"
+              << std::setw(14) << "backpressure" << std::setw(10) << "wakeups" << std::endl;
+
+    for (size_t producers = 1; producers <= max_producers; producers *= 2) {
+        Print("mutex", producers, RunMutexQueue(producers, per_producer));
+        Print("ring", producers, RunRing(producers, per_producer));
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unistd.h>
+#include "protocol/bot_block_io.h"
+
+// 文件支撑的仿真Bulk-Only大容量存储设备（测试和基准用）。
+// 设备线程按BOT状态机依次消费OUT/IN端点上排队的传输：CBW -> 数据 -> CSW，
+// 支持READ/WRITE(10/16)和SYNCHRONIZE CACHE(10)；SetLuns后按CBW中的LUN访问各自的区域。
+// 每次传输在提交latency_us之后才"到达"设备，数据阶段按bandwidth限速，
+// 以此模拟主机调度和总线往返，使流水线的效果可以在没有硬件时测量
+class EmulatedBotDevice : public usb_redirector::protocol::BulkOnlyTransport {
+public:
+    EmulatedBotDevice(uint64_t total_blocks, uint32_t block_size,
+                      uint32_t latency_us = 0, double bandwidth_mb_per_s = 0, uint64_t lba_base = 0)
+        : total_blocks_(total_blocks)
+        , block_size_(block_size)
+        , latency_(latency_us)
+        , bandwidth_(bandwidth_mb_per_s * 1e6)
+        , lba_base_(lba_base)
+        , file_(std::tmpfile())
+        , stopping_(false) {
+        if (file_) {
+            ftruncate(fileno(file_), static_cast<off_t>(total_blocks_ * block_size_));
+        }
+        thread_ = std::thread(&EmulatedBotDevice::DeviceThread, this);
+    }
+
+    ~EmulatedBotDevice() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        queued_.notify_all();
+        thread_.join();
+
+        // 未被消费的传输以错误完成
+        for (auto* queue : {&in_, &out_}) {
+            for (auto& transfer : *queue) {
+                transfer.completion(Status::ERROR, 0);
+            }
+        }
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    bool SubmitBulk(bool in, uint8_t* data, uint32_t length, Completion completion) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        auto& queue = in ? in_ : out_;
+        queue.push_back({data, length, std::move(completion), Clock::now() + latency_});
+        if (!in) {
+            // OUT端点上排队的CBW数近似等于在途命令数
+            max_out_queue_ = std::max(max_out_queue_, out_.size());
+        }
+        queued_.notify_all();
+        return true;
+    }
+
+    bool ClearHalt(bool) override {
+        return true;
+    }
+
+    // 每条命令在设备上的处理时间，BOT设备一次只处理一条命令
+    void SetServiceTime(uint32_t service_us) { service_ = std::chrono::microseconds(service_us); }
+
+    // 模拟多卡槽读卡器：每个LUN一块total_blocks大小的独立介质。须在提交传输前调用
+    void SetLuns(uint8_t luns) {
+        luns_ = std::max<uint8_t>(1, std::min<uint8_t>(luns, MAX_LUNS));
+        if (file_) {
+            ftruncate(fileno(file_), static_cast<off_t>(luns_ * total_blocks_ * block_size_));
+        }
+    }
+
+    uint64_t Commands() const { return commands_.load(); }
+    uint64_t LongCommands() const { return long_commands_.load(); }
+    uint64_t Syncs() const { return syncs_.load(); }
+    uint64_t FuaWrites() const { return fua_writes_.load(); }
+    uint64_t LunCommands(uint8_t lun) const { return lun < MAX_LUNS ? lun_commands_[lun].load() : 0; }
+    // 相邻两条读写命令属于不同LUN的次数
+    uint64_t LunSwitches() const { return lun_switches_.load(); }
+    size_t MaxOutQueue() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return max_out_queue_;
+    }
+
+private:
+    static constexpr uint8_t MAX_LUNS = 16;
+
+    using Clock = std::chrono::steady_clock;
+    using CommandBlockWrapper = usb_redirector::protocol::CommandBlockWrapper;
+    using CommandStatusWrapper = usb_redirector::protocol::CommandStatusWrapper;
+
+    struct Transfer {
+        uint8_t* data;
+        uint32_t length;
+        Completion completion;
+        Clock::time_point ready_time;
+    };
+
+    static uint64_t ReadBigEndian(const uint8_t* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = (value << 8) | in[i];
+        }
+        return value;
+    }
+
+    // 取出端点队首的传输，等到其到达设备的时间
+    bool Take(std::deque<Transfer>& queue, Transfer& transfer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queued_.wait(lock, [&]() { return stopping_ || !queue.empty(); });
+        if (stopping_) {
+            return false;
+        }
+        transfer = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        std::this_thread::sleep_until(transfer.ready_time);
+        return true;
+    }
+
+    void Throttle(Clock::time_point start, size_t bytes) {
+        if (bandwidth_ > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(bytes / bandwidth_)));
+        }
+    }
+
+    void DeviceThread() {
+        namespace proto = usb_redirector::protocol;
+
+        while (true) {
+            Transfer cbw_transfer;
+            if (!Take(out_, cbw_transfer)) {
+                return;
+            }
+
+            CommandBlockWrapper cbw = {};
+            std::memcpy(&cbw, cbw_transfer.data, std::min<size_t>(cbw_transfer.length, sizeof(cbw)));
+            cbw_transfer.completion(Status::OK, cbw_transfer.length);
+            std::this_thread::sleep_for(service_);
+
+            uint8_t opcode = cbw.CBWCB[0];
+            bool is_read = opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_10) ||
+                           opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_16);
+            bool is_write = opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_10) ||
+                            opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_16);
+            bool is_long = opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_16) ||
+                           opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_16);
+            bool is_sync = opcode == static_cast<uint8_t>(proto::ScsiCommand::SYNCHRONIZE_CACHE_10);
+
+            uint64_t lba = is_long ? ReadBigEndian(&cbw.CBWCB[2], 8) : ReadBigEndian(&cbw.CBWCB[2], 4);
+            uint64_t count = is_long ? ReadBigEndian(&cbw.CBWCB[10], 4) : ReadBigEndian(&cbw.CBWCB[7], 2);
+
+            bool valid = cbw.dCBWSignature == proto::CBW_SIGNATURE && (is_read || is_write) &&
+                         cbw.bCBWLUN < luns_ &&
+                         lba >= lba_base_ && lba - lba_base_ + count <= total_blocks_ &&
+                         count * block_size_ == cbw.dCBWDataTransferLength;
+            off_t offset = static_cast<off_t>((cbw.bCBWLUN * total_blocks_ + lba - lba_base_) * block_size_);
+
+            if (is_sync) {
+                valid = cbw.dCBWSignature == proto::CBW_SIGNATURE && cbw.dCBWDataTransferLength == 0;
+                ++syncs_;
+            } else {
+                ++commands_;
+                ++lun_commands_[cbw.bCBWLUN % MAX_LUNS];
+                if (commands_ > 1 && cbw.bCBWLUN != last_lun_) {
+                    ++lun_switches_;
+                }
+                last_lun_ = cbw.bCBWLUN;
+            }
+            if (is_long) {
+                ++long_commands_;
+            }
+            if (is_write && (cbw.CBWCB[1] & proto::SCSI_CDB_FUA)) {
+                ++fua_writes_;
+            }
+
+            uint32_t residue = cbw.dCBWDataTransferLength;
+            if (cbw.dCBWDataTransferLength > 0) {
+                bool data_in = (cbw.bmCBWFlags & proto::CBW_FLAG_DATA_IN) != 0;
+                Transfer data_transfer;
+                if (!Take(data_in ? in_ : out_, data_transfer)) {
+                    return;
+                }
+
+                auto start = Clock::now();
+                uint32_t length = std::min(data_transfer.length, cbw.dCBWDataTransferLength);
+                if (valid && is_read && data_in) {
+                    valid = pread(fileno(file_), data_transfer.data, length, offset) == static_cast<ssize_t>(length);
+                } else if (valid && is_write && !data_in) {
+                    valid = pwrite(fileno(file_), data_transfer.data, length, offset) == static_cast<ssize_t>(length);
+                } else {
+                    valid = false;
+                }
+                Throttle(start, length);
+
+                // 出错时不返回数据，由CSW报告残留
+                uint32_t moved = valid ? length : 0;
+                residue = cbw.dCBWDataTransferLength - moved;
+                data_transfer.completion(Status::OK, data_in && !valid ? 0 : data_transfer.length);
+            }
+
+            Transfer csw_transfer;
+            if (!Take(in_, csw_transfer)) {
+                return;
+            }
+            CommandStatusWrapper csw = {};
+            csw.dCSWSignature = proto::CSW_SIGNATURE;
+            csw.dCSWTag = cbw.dCBWTag;
+            csw.dCSWDataResidue = residue;
+            csw.bCSWStatus = valid ? proto::CSW_STATUS_PASSED : proto::CSW_STATUS_FAILED;
+            std::memcpy(csw_transfer.data, &csw, std::min<size_t>(csw_transfer.length, sizeof(csw)));
+            csw_transfer.completion(Status::OK, sizeof(csw));
+        }
+    }
+
+    uint64_t total_blocks_;
+    uint32_t block_size_;
+    std::chrono::microseconds latency_;
+    std::chrono::microseconds service_{0};
+    double bandwidth_;
+    uint64_t lba_base_;
+    uint8_t luns_ = 1;
+    uint8_t last_lun_ = 0;                      // 仅设备线程访问
+    FILE* file_;
+
+    std::deque<Transfer> in_;
+    std::deque<Transfer> out_;
+    size_t max_out_queue_ = 0;
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable queued_;
+    std::thread thread_;
+
+    std::atomic<uint64_t> commands_{0};
+    std::atomic<uint64_t> long_commands_{0};
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> fua_writes_{0};
+    std::atomic<uint64_t> lun_commands_[MAX_LUNS] = {};
+    std::atomic<uint64_t> lun_switches_{0};
+};
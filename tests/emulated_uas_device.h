@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unistd.h>
+#include "protocol/uas_block_io.h"
+
+// 文件支撑的仿真UAS大容量存储设备（测试和基准用）。
+// 命令线程从命令管道接收命令IU放入设备队列，workers个工作线程并发执行，
+// 每条命令耗时service_us（模拟介质/NCQ延迟），因此可以乱序完成；
+// 数据和状态经命令标签对应的流返回。支持READ/WRITE(10/16)、READ CAPACITY(10/16)
+// 和SYNCHRONIZE CACHE(10)，其余命令以CHECK CONDITION结束；SetLuns后按命令IU中的LUN访问各自的区域
+class EmulatedUasDevice : public usb_redirector::protocol::UasTransport {
+public:
+    using Pipe = usb_redirector::protocol::UasPipe;
+
+    EmulatedUasDevice(uint64_t total_blocks, uint32_t block_size, uint16_t streams = 32,
+                      uint32_t latency_us = 0, size_t workers = 4, uint32_t service_us = 0)
+        : total_blocks_(total_blocks)
+        , block_size_(block_size)
+        , streams_(streams)
+        , latency_(latency_us)
+        , service_(service_us)
+        , file_(std::tmpfile())
+        , stopping_(false) {
+        if (file_) {
+            ftruncate(fileno(file_), static_cast<off_t>(total_blocks_ * block_size_));
+        }
+        command_thread_ = std::thread(&EmulatedUasDevice::CommandThread, this);
+        for (size_t i = 0; i < std::max<size_t>(1, workers); ++i) {
+            workers_.emplace_back(&EmulatedUasDevice::WorkerThread, this);
+        }
+    }
+
+    ~EmulatedUasDevice() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        command_thread_.join();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+
+        // 未被消费的传输以错误完成
+        for (auto& transfer : commands_in_) {
+            transfer.completion(Status::ERROR, 0);
+        }
+        for (auto& entry : streams_in_) {
+            for (auto& transfer : entry.second) {
+                transfer.completion(Status::ERROR, 0);
+            }
+        }
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+
+    bool SubmitBulk(Pipe pipe, uint16_t stream_id, uint8_t* data, uint32_t length, Completion completion) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        if (pipe == Pipe::COMMAND) {
+            commands_in_.push_back({data, length, std::move(completion), Clock::now() + latency_});
+        } else {
+            if (stream_id == 0 || stream_id > streams_) {
+                return false;
+            }
+            streams_in_[StreamKey(pipe, stream_id)].push_back({data, length, std::move(completion), Clock::now()});
+        }
+        changed_.notify_all();
+        return true;
+    }
+
+    uint16_t StreamCount() const override { return streams_; }
+
+    // 模拟多卡槽读卡器：每个LUN一块total_blocks大小的独立介质。须在提交传输前调用
+    void SetLuns(uint8_t luns) {
+        luns_ = std::max<uint8_t>(1, std::min<uint8_t>(luns, MAX_LUNS));
+        if (file_) {
+            ftruncate(fileno(file_), static_cast<off_t>(luns_ * total_blocks_ * block_size_));
+        }
+    }
+
+    uint64_t Commands() const { return commands_.load(); }
+    uint64_t LongCommands() const { return long_commands_.load(); }
+    uint64_t Syncs() const { return syncs_.load(); }
+    uint64_t FuaWrites() const { return fua_writes_.load(); }
+    uint64_t LunCommands(uint8_t lun) const { return lun < MAX_LUNS ? lun_commands_[lun].load() : 0; }
+    // 相邻接收的两条命令属于不同LUN的次数
+    uint64_t LunSwitches() const { return lun_switches_.load(); }
+    // 先于更早收到的命令完成的次数
+    uint64_t OutOfOrderCompletions() const { return out_of_order_.load(); }
+    // 同一标签在上一条命令完成前被再次使用的次数
+    uint64_t OverlappedTags() const { return overlapped_tags_.load(); }
+    size_t MaxOutstanding() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return max_outstanding_;
+    }
+
+private:
+    static constexpr uint8_t MAX_LUNS = 16;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Transfer {
+        uint8_t* data;
+        uint32_t length;
+        Completion completion;
+        Clock::time_point ready_time;
+    };
+
+    struct Command {
+        uint64_t sequence;
+        uint16_t tag;
+        uint8_t lun;
+        uint8_t cdb[16];
+    };
+
+    static uint32_t StreamKey(Pipe pipe, uint16_t stream_id) {
+        return (static_cast<uint32_t>(pipe) << 16) | stream_id;
+    }
+
+    static uint64_t ReadBigEndian(const uint8_t* in, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value = (value << 8) | in[i];
+        }
+        return value;
+    }
+
+    static void PutBigEndian(uint8_t* out, uint64_t value, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            out[i] = static_cast<uint8_t>(value);
+            value >>= 8;
+        }
+    }
+
+    // 取出流上排队的传输
+    bool TakeStream(Pipe pipe, uint16_t tag, Transfer& transfer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto& queue = streams_in_[StreamKey(pipe, tag)];
+        changed_.wait(lock, [&]() { return stopping_ || !queue.empty(); });
+        if (stopping_) {
+            return false;
+        }
+        transfer = std::move(queue.front());
+        queue.pop_front();
+        return true;
+    }
+
+    void CommandThread() {
+        namespace proto = usb_redirector::protocol;
+        uint64_t sequence = 0;
+
+        while (true) {
+            Transfer transfer;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [this]() { return stopping_ || !commands_in_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                transfer = std::move(commands_in_.front());
+                commands_in_.pop_front();
+            }
+            std::this_thread::sleep_until(transfer.ready_time);
+
+            proto::UasCommandIu iu = {};
+            std::memcpy(&iu, transfer.data, std::min<size_t>(transfer.length, sizeof(iu)));
+            transfer.completion(Status::OK, transfer.length);
+
+            Command command;
+            command.sequence = sequence++;
+            command.tag = static_cast<uint16_t>(ReadBigEndian(reinterpret_cast<const uint8_t*>(&iu.wTag), 2));
+            command.lun = iu.LUN[1];
+            std::memcpy(command.cdb, iu.CDB, sizeof(command.cdb));
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (iu.bIUID != static_cast<uint8_t>(proto::UasIuId::COMMAND) || active_tags_.count(command.tag) > 0) {
+                ++overlapped_tags_;
+            }
+            if (command.sequence > 0 && command.lun != last_lun_) {
+                ++lun_switches_;
+            }
+            last_lun_ = command.lun;
+            active_tags_.insert(command.tag);
+            outstanding_.insert(command.sequence);
+            max_outstanding_ = std::max(max_outstanding_, outstanding_.size());
+            queue_.push_back(command);
+            changed_.notify_all();
+        }
+    }
+
+    void WorkerThread() {
+        while (true) {
+            Command command;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                changed_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                command = queue_.front();
+                queue_.pop_front();
+            }
+
+            std::this_thread::sleep_for(service_);
+            if (!Execute(command)) {
+                return;
+            }
+        }
+    }
+
+    bool Execute(const Command& command) {
+        namespace proto = usb_redirector::protocol;
+
+        uint8_t opcode = command.cdb[0];
+        bool is_read = opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_10) ||
+                       opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_16);
+        bool is_write = opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_10) ||
+                        opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_16);
+        bool is_long = opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_16) ||
+                       opcode == static_cast<uint8_t>(proto::ScsiCommand::WRITE_16);
+
+        bool valid = false;
+        if (is_read || is_write) {
+            ++commands_;
+            ++lun_commands_[command.lun % MAX_LUNS];
+            if (is_long) {
+                ++long_commands_;
+            }
+            if (is_write && (command.cdb[1] & proto::SCSI_CDB_FUA)) {
+                ++fua_writes_;
+            }
+
+            uint64_t lba = is_long ? ReadBigEndian(&command.cdb[2], 8) : ReadBigEndian(&command.cdb[2], 4);
+            uint64_t count = is_long ? ReadBigEndian(&command.cdb[10], 4) : ReadBigEndian(&command.cdb[7], 2);
+            valid = command.lun < luns_ && lba < total_blocks_ && count <= total_blocks_ - lba;
+
+            Transfer data;
+            if (!TakeStream(is_read ? Pipe::DATA_IN : Pipe::DATA_OUT, command.tag, data)) {
+                return false;
+            }
+            size_t length = std::min<size_t>(data.length, count * block_size_);
+            off_t offset = static_cast<off_t>((command.lun * total_blocks_ + lba) * block_size_);
+            if (valid && is_read) {
+                valid = pread(fileno(file_), data.data, length, offset) == static_cast<ssize_t>(length);
+            } else if (valid) {
+                valid = pwrite(fileno(file_), data.data, length, offset) == static_cast<ssize_t>(length);
+            }
+            // 出错时不返回数据
+            data.completion(Status::OK, valid || !is_read ? static_cast<uint32_t>(length) : 0);
+        } else if (opcode == static_cast<uint8_t>(proto::ScsiCommand::SYNCHRONIZE_CACHE_10)) {
+            ++syncs_;
+            valid = true;
+        } else if (opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_CAPACITY_10) ||
+                   opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_CAPACITY_16)) {
+            Transfer data;
+            if (!TakeStream(Pipe::DATA_IN, command.tag, data)) {
+                return false;
+            }
+            uint8_t capacity[32] = {};
+            uint32_t length;
+            if (opcode == static_cast<uint8_t>(proto::ScsiCommand::READ_CAPACITY_16)) {
+                PutBigEndian(&capacity[0], total_blocks_ - 1, 8);
+                PutBigEndian(&capacity[8], block_size_, 4);
+                length = 32;
+            } else {
+                PutBigEndian(&capacity[0], std::min<uint64_t>(total_blocks_ - 1, 0xFFFFFFFFull), 4);
+                PutBigEndian(&capacity[4], block_size_, 4);
+                length = 8;
+            }
+            length = std::min(length, data.length);
+            std::memcpy(data.data, capacity, length);
+            data.completion(Status::OK, length);
+            valid = true;
+        }
+
+        Transfer status;
+        if (!TakeStream(Pipe::STATUS, command.tag, status)) {
+            return false;
+        }
+        proto::UasSenseIu sense = {};
+        sense.bIUID = static_cast<uint8_t>(proto::UasIuId::SENSE);
+        PutBigEndian(reinterpret_cast<uint8_t*>(&sense.wTag), command.tag, 2);
+        uint32_t length = 16;
+        if (valid) {
+            sense.bStatus = proto::SCSI_STATUS_GOOD;
+        } else {
+            // 固定格式sense数据：ILLEGAL REQUEST
+            sense.bStatus = proto::SCSI_STATUS_CHECK_CONDITION;
+            PutBigEndian(reinterpret_cast<uint8_t*>(&sense.wSenseLength), sizeof(sense.SenseData), 2);
+            sense.SenseData[0] = 0x70;
+            sense.SenseData[2] = 0x05;
+            sense.SenseData[7] = 10;
+            length = sizeof(sense);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active_tags_.erase(command.tag);
+            outstanding_.erase(command.sequence);
+            if (!outstanding_.empty() && *outstanding_.begin() < command.sequence) {
+                ++out_of_order_;
+            }
+        }
+
+        length = std::min(length, status.length);
+        std::memcpy(status.data, &sense, length);
+        status.completion(Status::OK, length);
+        return true;
+    }
+
+    uint64_t total_blocks_;
+    uint32_t block_size_;
+    uint16_t streams_;
+    std::chrono::microseconds latency_;
+    std::chrono::microseconds service_;
+    uint8_t luns_ = 1;
+    uint8_t last_lun_ = 0;
+    FILE* file_;
+
+    std::deque<Transfer> commands_in_;
+    std::map<uint32_t, std::deque<Transfer>> streams_in_;
+    std::deque<Command> queue_;                 // 已接收、等待执行的命令
+    std::set<uint16_t> active_tags_;
+    std::set<uint64_t> outstanding_;            // 已接收、尚未完成的命令序号
+    size_t max_outstanding_ = 0;
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::thread command_thread_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<uint64_t> commands_{0};
+    std::atomic<uint64_t> long_commands_{0};
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> fua_writes_{0};
+    std::atomic<uint64_t> out_of_order_{0};
+    std::atomic<uint64_t> overlapped_tags_{0};
+    std::atomic<uint64_t> lun_commands_[MAX_LUNS] = {};
+    std::atomic<uint64_t> lun_switches_{0};
+};
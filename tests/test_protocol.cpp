@@ -1,12 +1,145 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "protocol/usbip_protocol.h"
 #include "protocol/usb_types.h"
+#include "protocol/urb_table.h"
+#include "protocol/urb_metrics.h"
+#include "protocol/bot_block_io.h"
+#include "protocol/read_ahead_cache.h"
+#include "protocol/write_coalescer.h"
+#include "protocol/uas_block_io.h"
+#include "protocol/scsi_disk.h"
+#include "emulated_bot_device.h"
+#include "emulated_uas_device.h"
 #include "utils/logger.h"
+#include "utils/buffer_pool.h"
+#include "utils/mpsc_ring.h"
+#include "utils/notifier.h"
+#include "utils/thread_affinity.h"
+#include "utils/latency_histogram.h"
+#if defined(USB_REDIRECTOR_TEST_RECEIVER)
+#include "virtual_device/virtual_usb_device.h"
+#endif
+#if defined(USB_REDIRECTOR_TEST_SENDER)
+#include "capture/urb_capture.h"
+#endif
 
 using namespace usb_redirector;
 
+// 统计本线程在计数窗口内的堆分配次数，用于验证URB缓冲稳态下不分配内存。
+// 替换全部形式的operator new/delete（含数组、按大小和按对齐），使分配与释放成对；
+// new/delete都不内联，编译器看到的是成对的new/delete而不是malloc/free
+static std::atomic<uint64_t> g_heap_allocations(0);
+static thread_local bool g_count_allocations = false;
+// 其他线程（捕获流水线的处理线程）在回调中据此打开本线程的计数
+static std::atomic<bool> g_counting_window(false);
+
+static void* CountedAlloc(size_t size, size_t alignment) {
+    if (g_count_allocations) {
+        g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else if (posix_memalign(&p, alignment, size) != 0) {
+        p = nullptr;
+    }
+    return p;
+}
+
+static void* CountedNew(size_t size, size_t alignment) {
+    if (void* p = CountedAlloc(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+#define COUNTED_OPERATOR __attribute__((noinline))
+
+COUNTED_OPERATOR void* operator new(size_t size) {
+    return CountedNew(size, 0);
+}
+COUNTED_OPERATOR void* operator new[](size_t size) {
+    return CountedNew(size, 0);
+}
+COUNTED_OPERATOR void* operator new(size_t size, std::align_val_t al) {
+    return CountedNew(size, static_cast<size_t>(al));
+}
+COUNTED_OPERATOR void* operator new[](size_t size, std::align_val_t al) {
+    return CountedNew(size, static_cast<size_t>(al));
+}
+COUNTED_OPERATOR void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+COUNTED_OPERATOR void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+COUNTED_OPERATOR void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, static_cast<size_t>(al));
+}
+COUNTED_OPERATOR void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, static_cast<size_t>(al));
+}
+
+COUNTED_OPERATOR void operator delete(void* p) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+COUNTED_OPERATOR void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+#undef COUNTED_OPERATOR
+
 void TestUsbipProtocol() {
     std::cout << "Testing USBIP Protocol..." << std::endl;
 
@@ -45,6 +178,37 @@ void TestUsbipProtocol() {
 
     std::cout << "URB command serialization: PASSED" << std::endl;
 
+    // 测试URB撤销命令的序列化和解析（与CMD_SUBMIT同为48字节）
+    protocol::UsbipCmdUnlink unlink = {};
+    unlink.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_CMD_UNLINK);
+    unlink.header.seqnum = 7;
+    unlink.unlink_seqnum = 0x01020304;
+    auto unlink_serialized = protocol::UsbipProtocol::SerializeCmdUnlink(unlink);
+    assert(unlink_serialized.size() == 48);
+    assert(unlink_serialized[20] == 0x01 && unlink_serialized[23] == 0x04);
+
+    protocol::UsbipCmdUnlink unlink_parsed;
+    assert(protocol::UsbipProtocol::ParseCmdUnlink(unlink_serialized.data(), unlink_serialized.size(), unlink_parsed));
+    assert(unlink_parsed.header.command == static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_CMD_UNLINK));
+    assert(unlink_parsed.header.seqnum == 7);
+    assert(unlink_parsed.unlink_seqnum == 0x01020304);
+    assert(!protocol::UsbipProtocol::ParseCmdUnlink(unlink_serialized.data(), 47, unlink_parsed));
+
+    protocol::UsbipRetUnlink ret_unlink = {};
+    ret_unlink.header.command = static_cast<uint32_t>(protocol::UsbipOpCode::USBIP_RET_UNLINK);
+    ret_unlink.header.seqnum = 7;
+    ret_unlink.status = -104; // -ECONNRESET
+    auto ret_unlink_serialized = protocol::UsbipProtocol::SerializeRetUnlink(ret_unlink);
+    assert(ret_unlink_serialized.size() == 48);
+
+    protocol::UsbipRetUnlink ret_unlink_parsed;
+    assert(protocol::UsbipProtocol::ParseRetUnlink(ret_unlink_serialized.data(), ret_unlink_serialized.size(),
+                                                   ret_unlink_parsed));
+    assert(ret_unlink_parsed.header.seqnum == 7);
+    assert(ret_unlink_parsed.status == -104);
+
+    std::cout << "URB unlink serialization: PASSED" << std::endl;
+
     // 测试字节序转换
     protocol::UsbipHeader header = {};
     header.command = 0x12345678;
@@ -91,6 +255,1223 @@ void TestUsbTypes() {
     std::cout << "URB structure: PASSED" << std::endl;
 }
 
+void TestPooledBuffer() {
+    std::cout << "Testing Pooled URB Buffers..." << std::endl;
+
+    // 与std::vector一致的基本语义
+    utils::PooledBuffer buffer(100);
+    assert(buffer.size() == 100 && buffer.capacity() == 512);
+    assert(std::all_of(buffer.begin(), buffer.end(), [](uint8_t b) { return b == 0; }));
+    buffer.assign(size_t(8), uint8_t(0x5A));
+    assert(buffer.size() == 8 && buffer[7] == 0x5A);
+    buffer.resize(5000);
+    assert(buffer.capacity() == 4096 * 16 && buffer[7] == 0x5A && buffer[4999] == 0);
+    std::vector<uint8_t> bytes = {1, 2, 3, 4, 5, 6};
+    buffer = bytes;
+    assert(buffer.ToVector() == bytes);
+    buffer.append(bytes.data(), bytes.size());
+    assert(buffer.size() == 12 && buffer[6] == 1);
+    utils::PooledBuffer empty;
+    assert(empty.empty() && empty.data() == nullptr && empty.capacity() == 0);
+    utils::PooledBuffer huge(2 * 1024 * 1024);
+    assert(huge.capacity() == 2 * 1024 * 1024);
+
+    // 拷贝共享同一块，读取不复制，写入（mutable_data）前复制；切片共享且不拷贝
+    utils::PooledBuffer shared = buffer;
+    assert(shared.IsShared() && buffer.IsShared() && shared.data() == buffer.data());
+    assert(shared.begin() == buffer.begin() && shared[0] == 1 && shared.IsShared());
+    shared.mutable_data()[0] = 0xEE;
+    assert(!shared.IsShared() && !buffer.IsShared() && buffer[0] == 1 && shared[0] == 0xEE);
+    utils::PooledBuffer slice = buffer.Slice(6, 100);
+    assert(slice.size() == 6 && slice.IsShared() && slice == utils::PooledBuffer(bytes));
+    utils::PooledBuffer moved = std::move(slice);
+    assert(slice.empty() && moved.size() == 6);
+
+    // 释放后块回到池中被复用
+    auto& pool = utils::BufferPool::Instance();
+    auto before = pool.GetStatistics();
+    {
+        utils::PooledBuffer a(3000);
+    }
+    {
+        utils::PooledBuffer b(3000);
+    }
+    auto after = pool.GetStatistics();
+    assert(after.acquires == before.acquires + 2);
+    assert(after.reuses >= before.reuses + 1);
+
+    std::cout << "Pooled buffer semantics: PASSED" << std::endl;
+
+    // URB沿回调链按值移动，接收方再共享一份（如去重时保留的数据）、切出一段应答后释放。
+    // 预热后稳态循环中不应再有任何堆分配
+    std::vector<protocol::UsbUrb> held;
+    held.reserve(4);
+    std::function<void(protocol::UsbUrb)> deliver = [&held](protocol::UsbUrb urb) {
+        held.push_back(std::move(urb));
+    };
+    const size_t sizes[] = {31, 512, 4096, 13, 60000, 1024 * 1024};
+    uint64_t checksum = 0;
+    auto run = [&](int iterations) {
+        for (int i = 0; i < iterations; ++i) {
+            for (size_t size : sizes) {
+                protocol::UsbUrb urb = {};
+                urb.id = static_cast<uint32_t>(i);
+                urb.type = protocol::UsbTransferType::BULK;
+                urb.data.resize(size);
+                urb.data.mutable_data()[size - 1] = static_cast<uint8_t>(i);
+                deliver(std::move(urb));
+                assert(urb.data.empty());
+            }
+            utils::PooledBuffer kept = held.back().data;
+            utils::PooledBuffer response = kept.Slice(0, 64 * 1024);
+            protocol::UsbUrb reply = held[2];
+            reply.data.assign(size_t(13), uint8_t(0));
+            checksum += kept[kept.size() - 1] + response.size() + reply.data.size();
+            held.clear();
+        }
+    };
+
+    run(4);
+    g_heap_allocations.store(0);
+    g_count_allocations = true;
+    run(1000);
+    g_count_allocations = false;
+    uint64_t allocations = g_heap_allocations.load();
+    std::cout << "Heap allocations in steady state: " << allocations << " (checksum " << checksum << ")" << std::endl;
+    assert(allocations == 0);
+
+    std::cout << "Zero-allocation URB path: PASSED" << std::endl;
+}
+
+#if defined(USB_REDIRECTOR_TEST_RECEIVER)
+// 接收端：BOT命令经VirtualUsbDevice的磁盘状态机写入和读出镜像，应答经回调交回
+static void RunReceiverDiskPath() {
+    char path[] = "/tmp/test_zero_alloc_disk_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    const uint32_t block_size = 512;
+    const uint32_t blocks = 128;            // 每条命令64KiB
+    const size_t length = static_cast<size_t>(blocks) * block_size;
+    receiver::VirtualUsbDevice device;
+    assert(device.SetDiskImage(path, 4 * 1024 * 1024));
+
+    uint64_t checksum = 0;
+    size_t responses = 0;
+    uint8_t fill = 0;
+    bool passed = true;
+    device.SetUrbResponseCallback([&](protocol::UsbUrb response) {
+        ++responses;
+        passed = passed && response.status == 0;
+        if (response.data.size() == length) {
+            // 读回的数据即刚写入的内容
+            passed = passed && response.data[0] == fill && response.data[length - 1] == fill;
+        }
+        if (!response.data.empty()) {
+            checksum += response.data[response.data.size() - 1];
+        }
+    });
+
+    auto bulk = [&](protocol::UsbDirection direction, const uint8_t* data, size_t size) {
+        protocol::UsbUrb urb = {};
+        urb.type = protocol::UsbTransferType::BULK;
+        urb.direction = direction;
+        urb.endpoint = direction == protocol::UsbDirection::IN ? 0x81 : 0x02;
+        if (data) {
+            urb.data.assign(data, data + size);
+        } else {
+            urb.data.resize(size);          // IN URB的缓冲区长度即主机期望的数据量
+        }
+        assert(device.HandleDiskUrb(urb));
+    };
+
+    uint8_t payload[4096];
+    protocol::CommandBlockWrapper cbw;
+    auto run = [&](int iterations) {
+        for (int i = 0; i < iterations; ++i) {
+            uint64_t lba = static_cast<uint64_t>(i % 64) * blocks;
+            fill = static_cast<uint8_t>(i);
+            std::memset(payload, fill, sizeof(payload));
+
+            protocol::BotBlockIo::BuildReadWrite(cbw, false, 0, lba, blocks, block_size, 2 * i);
+            bulk(protocol::UsbDirection::OUT, reinterpret_cast<const uint8_t*>(&cbw), sizeof(cbw));
+            for (size_t offset = 0; offset < length; offset += sizeof(payload)) {
+                bulk(protocol::UsbDirection::OUT, payload, sizeof(payload));
+            }
+            bulk(protocol::UsbDirection::IN, nullptr, sizeof(protocol::CommandStatusWrapper));
+
+            protocol::BotBlockIo::BuildReadWrite(cbw, true, 0, lba, blocks, block_size, 2 * i + 1);
+            bulk(protocol::UsbDirection::OUT, reinterpret_cast<const uint8_t*>(&cbw), sizeof(cbw));
+            bulk(protocol::UsbDirection::IN, nullptr, length);
+            bulk(protocol::UsbDirection::IN, nullptr, sizeof(protocol::CommandStatusWrapper));
+        }
+    };
+
+    run(4);
+    g_heap_allocations.store(0);
+    g_count_allocations = true;
+    run(200);
+    g_count_allocations = false;
+    uint64_t allocations = g_heap_allocations.load();
+    std::cout << "Heap allocations on receiver disk path: " << allocations << " (checksum " << checksum
+              << ")" << std::endl;
+    assert(passed && responses == 204 * (2 + length / sizeof(payload) + 3));
+    assert(allocations == 0);
+    std::remove(path);
+}
+#endif
+
+#if defined(USB_REDIRECTOR_TEST_SENDER)
+// 发送端：注入的URB经捕获队列到处理线程，回调中按会话的做法生成USBIP帧并分段交出
+static void RunSenderCapturePath() {
+    sender::UrbCapture capture;
+    sender::UrbProcessor processor;
+    network::MessageHandler handler;
+    handler.SetFragmentSize(network::MessageHandler::DEFAULT_FRAGMENT_SIZE);
+    std::atomic<size_t> delivered{0};
+    std::atomic<uint64_t> sent_bytes{0};
+    network::MessageHandler::FrameSender sink = [&sent_bytes](const struct iovec* iov, size_t count,
+                                                              network::SendPriority) {
+        for (size_t i = 0; i < count; ++i) {
+            sent_bytes.fetch_add(iov[i].iov_len, std::memory_order_relaxed);
+        }
+        return true;
+    };
+    capture.SetUrbCallback([&](protocol::UsbUrb urb) {
+        // 处理线程上的分配从窗口内的第一次回调起计数
+        g_count_allocations = g_counting_window.load(std::memory_order_acquire);
+        network::OutgoingFrame frame;
+        if (processor.BuildUsbipFrame(urb, frame)) {
+            handler.SendFrame(network::MessageType::URB_SUBMIT, frame,
+                              network::MessageHandler::TransferPriority(urb.type), sink);
+        }
+        delivered.fetch_add(1, std::memory_order_release);
+    });
+    capture.SetWorkStealing(false);
+    assert(capture.StartCapture());
+
+    const size_t sizes[] = {31, 512, 4096, 13, 60000, 1024 * 1024};
+    size_t injected = 0;
+    auto run = [&](int iterations) {
+        for (int i = 0; i < iterations; ++i) {
+            for (size_t size : sizes) {
+                protocol::UsbUrb urb = {};
+                urb.id = static_cast<uint32_t>(i);
+                urb.type = protocol::UsbTransferType::BULK;
+                urb.direction = protocol::UsbDirection::IN;
+                urb.endpoint = 0x81;
+                urb.data.resize(size);
+                urb.data.mutable_data()[size - 1] = static_cast<uint8_t>(i);
+                while (!capture.InjectUrb(urb)) {
+                    std::this_thread::yield();
+                }
+                ++injected;
+            }
+            // 限制在途数量，缓冲池各档的空闲块足以周转
+            while (delivered.load(std::memory_order_acquire) + 4 < injected) {
+                std::this_thread::yield();
+            }
+        }
+        while (delivered.load(std::memory_order_acquire) < injected) {
+            std::this_thread::yield();
+        }
+    };
+
+    run(4);
+    g_heap_allocations.store(0);
+    g_counting_window.store(true, std::memory_order_release);
+    g_count_allocations = true;
+    run(500);
+    g_count_allocations = false;
+    g_counting_window.store(false, std::memory_order_release);
+    uint64_t allocations = g_heap_allocations.load();
+    capture.StopCapture();
+    std::cout << "Heap allocations on sender capture path: " << allocations << " (" << sent_bytes.load()
+              << " bytes framed)" << std::endl;
+    assert(allocations == 0);
+}
+#endif
+
+void TestZeroAllocationPipelines() {
+    std::cout << "Testing Zero-allocation URB Pipelines..." << std::endl;
+#if defined(USB_REDIRECTOR_TEST_RECEIVER)
+    RunReceiverDiskPath();
+#endif
+#if defined(USB_REDIRECTOR_TEST_SENDER)
+    RunSenderCapturePath();
+#endif
+    std::cout << "Zero-allocation URB pipelines: PASSED" << std::endl;
+}
+
+void TestMpscRing() {
+    std::cout << "Testing MPSC URB Ring..." << std::endl;
+
+    // 满时拒绝且不移走元素
+    utils::MpscRing<protocol::UsbUrb> small(3);
+    assert(small.Capacity() == 4);
+    for (uint32_t i = 0; i < 4; ++i) {
+        protocol::UsbUrb urb = {};
+        urb.id = i;
+        assert(small.TryPush(urb));
+    }
+    protocol::UsbUrb rejected = {};
+    rejected.data = {1, 2, 3};
+    assert(!small.TryPush(rejected) && rejected.data.size() == 3);
+    std::vector<uint32_t> ids;
+    assert(small.Drain(2, [&ids](protocol::UsbUrb&& urb) { ids.push_back(urb.id); }) == 2);
+    assert(small.TryPush(rejected) && rejected.data.empty());
+    small.Drain(10, [&ids](protocol::UsbUrb&& urb) { ids.push_back(urb.id); });
+    assert(ids.size() == 5 && ids[0] == 0 && ids[3] == 3 && small.Empty());
+
+    // 多个生产者并发投递，消费者成批取出并在空闲时睡眠；每个生产者内部保持顺序
+    const size_t producers = 4;
+    const uint32_t per_producer = 20000;
+    utils::MpscRing<protocol::UsbUrb> ring(64);
+    utils::Notifier ready;
+    utils::Notifier space;
+    std::atomic<uint64_t> full{0};
+    std::vector<uint32_t> next(producers, 0);
+    bool ordered = true;
+    size_t handled = 0;
+
+    std::thread consumer([&]() {
+        while (handled < producers * per_producer) {
+            size_t drained = ring.Drain(16, [&](protocol::UsbUrb&& urb) {
+                uint32_t producer = urb.id >> 24;
+                ordered = ordered && (urb.id & 0xFFFFFF) == next[producer] && urb.data.size() == 8;
+                ++next[producer];
+            });
+            if (drained > 0) {
+                handled += drained;
+                space.Notify();
+                continue;
+            }
+            uint32_t epoch = ready.PrepareWait();
+            if (!ring.Empty()) {
+                ready.CancelWait();
+                continue;
+            }
+            ready.Wait(epoch, std::chrono::milliseconds(100));
+        }
+    });
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            for (uint32_t i = 0; i < per_producer; ++i) {
+                protocol::UsbUrb urb = {};
+                urb.id = (p << 24) | i;
+                urb.data.resize(8);
+                while (!ring.TryPush(urb)) {
+                    full.fetch_add(1);
+                    uint32_t epoch = space.PrepareWait();
+                    if (ring.TryPush(urb)) {
+                        space.CancelWait();
+                        break;
+                    }
+                    space.Wait(epoch, std::chrono::milliseconds(10));
+                }
+                ready.Notify();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    consumer.join();
+    assert(ordered && ring.Empty());
+    for (uint32_t count : next) {
+        assert(count == per_producer);
+    }
+    std::cout << "Backpressure events: " << full.load() << ", consumer wakeups: " << ready.WakeCount() << std::endl;
+
+    // 没有等待方时通知不进入内核
+    utils::Notifier idle;
+    idle.Notify();
+    assert(idle.WakeCount() == 0);
+    uint32_t epoch = idle.PrepareWait();
+    assert(!idle.Wait(epoch, std::chrono::milliseconds(1)));
+
+    std::cout << "MPSC URB Ring: PASSED" << std::endl;
+}
+
+void TestThreadAffinity() {
+    std::cout << "Testing CPU List and Pinning..." << std::endl;
+
+    std::vector<int> cpus;
+    assert(utils::ParseCpuList("0,2,4-6", cpus));
+    assert((cpus == std::vector<int>{0, 2, 4, 5, 6}));
+    assert(utils::ParseCpuList("3", cpus) && cpus.size() == 1 && cpus[0] == 3);
+    assert(!utils::ParseCpuList("", cpus));
+    assert(!utils::ParseCpuList("1,,2", cpus));
+    assert(!utils::ParseCpuList("5-2", cpus));
+    assert(!utils::ParseCpuList("1x", cpus));
+    assert(!utils::ParseCpuList("-1", cpus));
+    assert(!utils::ParseCpuList("0-99999999", cpus));
+    assert(!utils::ParseCpuList(std::to_string(utils::MAX_CPUS), cpus));
+    assert(utils::ParseCpuList("0-" + std::to_string(utils::MAX_CPUS - 1), cpus));
+    assert(cpus.size() == static_cast<size_t>(utils::MAX_CPUS));
+    assert(!utils::PinCurrentThread(-1));
+
+#if defined(__linux__)
+    // 绑到本进程允许使用的第一个CPU
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    assert(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int first = 0;
+    while (!CPU_ISSET(first, &allowed)) {
+        ++first;
+    }
+    std::thread pinned([first]() {
+        assert(utils::PinCurrentThread(first));
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        assert(pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+        assert(CPU_COUNT(&set) == 1 && CPU_ISSET(first, &set));
+    });
+    pinned.join();
+#endif
+
+    std::cout << "CPU List and Pinning: PASSED" << std::endl;
+}
+
+void TestLatencyHistogram() {
+    std::cout << "Testing Latency Histogram..." << std::endl;
+
+    // 分桶：小值精确，其余相对误差不超过1/16，桶边界连续
+    for (uint64_t value = 0; value < 16; ++value) {
+        assert(utils::LatencyHistogram::BucketIndex(value) == value);
+    }
+    for (size_t i = 1; i < utils::LatencyHistogram::BUCKET_COUNT; ++i) {
+        assert(utils::LatencyHistogram::BucketLowerBound(i) == utils::LatencyHistogram::BucketUpperBound(i - 1) + 1);
+        assert(utils::LatencyHistogram::BucketIndex(utils::LatencyHistogram::BucketLowerBound(i)) == i);
+        assert(utils::LatencyHistogram::BucketIndex(utils::LatencyHistogram::BucketUpperBound(i)) == i);
+    }
+    for (uint64_t value : {17ull, 1000ull, 123456ull, 987654321ull}) {
+        size_t index = utils::LatencyHistogram::BucketIndex(value);
+        uint64_t width = utils::LatencyHistogram::BucketUpperBound(index) -
+                         utils::LatencyHistogram::BucketLowerBound(index) + 1;
+        assert(width * 16 <= value);
+    }
+    assert(utils::LatencyHistogram::BucketIndex(UINT64_MAX) == utils::LatencyHistogram::BUCKET_COUNT - 1);
+
+    // 1..10000均匀分布的分位数
+    utils::LatencyHistogram histogram;
+    assert(histogram.Percentile(0.5) == 0 && histogram.Count() == 0);
+    for (uint64_t value = 1; value <= 10000; ++value) {
+        histogram.Record(value);
+    }
+    auto summary = histogram.Summarize();
+    assert(summary.count == 10000 && summary.max_us == 10000);
+    assert(summary.p50_us >= 5000 && summary.p50_us <= 5000 + 5000 / 16);
+    assert(summary.p99_us >= 9900 && summary.p99_us <= 10000);
+    assert(summary.p999_us >= 9990 && summary.p999_us <= 10000);
+    assert(summary.mean_us > 5000.0 && summary.mean_us < 5001.0);
+
+    // 少量慢请求只影响尾部分位
+    utils::LatencyHistogram tail;
+    for (int i = 0; i < 990; ++i) {
+        tail.Record(100);
+    }
+    for (int i = 0; i < 10; ++i) {
+        tail.Record(50000);
+    }
+    assert(tail.Percentile(0.5) >= 100 && tail.Percentile(0.99) <= 100 + 100 / 16);
+    assert(tail.Percentile(0.999) > 45000 && tail.Percentile(0.999) <= 50000);
+    histogram.Merge(tail);
+    assert(histogram.Count() == 11000 && histogram.Max() == 50000);
+    histogram.Reset();
+    assert(histogram.Count() == 0 && histogram.Percentile(0.99) == 0);
+
+    // URB指标：多个线程并发记录，读取时合并各线程的计数块
+    protocol::UrbMetrics metrics;
+    assert(metrics.GetCounters().total_urbs == 0);
+    const size_t thread_count = 4;
+    const size_t per_thread = 20000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&metrics, t]() {
+            protocol::UsbUrb urb = {};
+            urb.type = (t % 2) ? protocol::UsbTransferType::INTERRUPT : protocol::UsbTransferType::BULK;
+            urb.endpoint = (t % 2) ? 0x83 : 0x81;
+            urb.actual_length = 512;
+            for (size_t i = 0; i < per_thread; ++i) {
+                urb.status = (i % 1000 == 0) ? -1 : 0;
+                metrics.RecordUrb(urb);
+                metrics.RecordLatency(protocol::UrbLatencyKind::END_TO_END, urb.type, urb.endpoint,
+                                      (t % 2) ? 50 : 1000 + i % 100);
+            }
+            // 设备传输时间只记在一个OUT端点上
+            metrics.RecordLatency(protocol::UrbLatencyKind::DEVICE_TRANSFER, protocol::UsbTransferType::BULK, 0x02, 7);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto counters = metrics.GetCounters();
+    assert(counters.total_urbs == thread_count * per_thread);
+    assert(counters.bulk_urbs == counters.interrupt_urbs && counters.control_urbs == 0);
+    assert(counters.bytes_transferred == thread_count * per_thread * 512);
+    assert(counters.errors == thread_count * per_thread / 1000);
+
+    auto bulk = metrics.GetLatency(protocol::UrbLatencyKind::END_TO_END, protocol::UsbTransferType::BULK);
+    auto interrupt = metrics.GetLatency(protocol::UrbLatencyKind::END_TO_END, protocol::UsbTransferType::INTERRUPT);
+    assert(bulk.count == thread_count / 2 * per_thread && bulk.p50_us >= 1000 && bulk.max_us == 1099);
+    assert(interrupt.count == thread_count / 2 * per_thread && interrupt.p999_us == 50);
+    assert(metrics.GetLatency(protocol::UrbLatencyKind::END_TO_END, protocol::UsbTransferType::CONTROL).count == 0);
+
+    auto endpoints = metrics.GetEndpointLatencies(protocol::UrbLatencyKind::END_TO_END);
+    assert(endpoints.size() == 2);
+    for (const auto& entry : endpoints) {
+        assert(entry.endpoint == (entry.type == protocol::UsbTransferType::BULK ? 0x81 : 0x83));
+        assert(entry.latency.count == thread_count / 2 * per_thread);
+    }
+    auto device = metrics.GetEndpointLatencies(protocol::UrbLatencyKind::DEVICE_TRANSFER);
+    assert(device.size() == 1 && device[0].endpoint == 0x02 && device[0].latency.count == thread_count);
+
+    // 本线程的计数块在首次记录后复用，记录不再分配内存
+    protocol::UsbUrb urb = {};
+    urb.type = protocol::UsbTransferType::CONTROL;
+    metrics.RecordUrb(urb);
+    metrics.RecordLatency(protocol::UrbLatencyKind::END_TO_END, urb.type, 0x80, 10);
+    g_heap_allocations = 0;
+    g_count_allocations = true;
+    for (int i = 0; i < 1000; ++i) {
+        metrics.RecordUrb(urb);
+        metrics.RecordLatency(protocol::UrbLatencyKind::END_TO_END, urb.type, 0x80, 10);
+    }
+    g_count_allocations = false;
+    assert(g_heap_allocations == 0);
+    assert(metrics.GetCounters().control_urbs == 1001);
+
+    metrics.Reset();
+    assert(metrics.GetCounters().total_urbs == 0);
+    assert(metrics.GetLatency(protocol::UrbLatencyKind::END_TO_END, protocol::UsbTransferType::BULK).count == 0);
+
+    std::cout << "Latency Histogram: PASSED" << std::endl;
+}
+
+void TestLogger() {
+    std::cout << "Testing Async Logger..." << std::endl;
+
+    char path[] = "/tmp/test_logger_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    auto& logger = utils::Logger::Instance();
+    logger.SetConsoleOutput(false);
+    logger.SetLogFile(path);
+
+    // 级别不满足时不求值参数
+    int evaluated = 0;
+    auto touch = [&evaluated]() { return ++evaluated; };
+    LOG_DEBUG("debug " << touch());
+    assert(evaluated == 0);
+    LOG_INFO("info " << touch());
+    assert(evaluated == 1);
+
+    // 复用的流每条日志恢复默认格式
+    LOG_INFO("hex 0x" << std::hex << 255);
+    LOG_INFO("dec " << 255);
+
+    // 多个线程并发写，条数超过单线程队列容量（写满时等待后台线程）
+    const size_t thread_count = 4;
+    const size_t per_thread = utils::Logger::THREAD_QUEUE_SIZE * 4;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([t, per_thread]() {
+            for (size_t i = 0; i < per_thread; ++i) {
+                LOG_WARNING("thread " << t << " line " << i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // 过长的消息截断正文，保留源文件位置
+    LOG_INFO(std::string(utils::Logger::MESSAGE_CAPACITY * 2, 'x'));
+
+    // 预热后提交一条日志不分配内存
+    LOG_INFO("warm up");
+    g_heap_allocations = 0;
+    g_count_allocations = true;
+    for (int i = 0; i < 100; ++i) {
+        LOG_INFO("steady " << i << " " << 1.5);
+    }
+    g_count_allocations = false;
+    assert(g_heap_allocations == 0);
+
+    logger.Flush();
+
+    std::ifstream input(path);
+    std::string line;
+    std::vector<size_t> next_line(thread_count, 0);
+    size_t thread_lines = 0;
+    size_t steady_lines = 0;
+    bool saw_hex = false, saw_dec = false, saw_truncated = false;
+    while (std::getline(input, line)) {
+        assert(line.find("debug") == std::string::npos);
+        assert(line.size() > 26 && line[0] == '[' && line[24] == ']');
+        assert(line.find("(test_protocol.cpp:") != std::string::npos);
+        saw_hex |= line.find("hex 0xff ") != std::string::npos;
+        saw_dec |= line.find("dec 255 ") != std::string::npos;
+        if (line.find("xxxx") != std::string::npos) {
+            saw_truncated = line.size() < utils::Logger::MESSAGE_CAPACITY + 64;
+        }
+        if (line.find("steady ") != std::string::npos) {
+            ++steady_lines;
+        }
+        size_t pos = line.find("[WARN] thread ");
+        if (pos != std::string::npos) {
+            size_t t = 0, i = 0;
+            assert(std::sscanf(line.c_str() + pos, "[WARN] thread %zu line %zu", &t, &i) == 2);
+            // 同一线程的日志保持先后顺序
+            assert(t < thread_count && i == next_line[t]);
+            ++next_line[t];
+            ++thread_lines;
+        }
+    }
+    assert(saw_hex && saw_dec && saw_truncated);
+    assert(thread_lines == thread_count * per_thread);
+    assert(steady_lines == 100);
+
+    logger.SetLogFile("");
+    logger.SetConsoleOutput(true);
+    unlink(path);
+
+    std::cout << "Async Logger: PASSED" << std::endl;
+}
+
+void TestSequenceSpace() {
+    std::cout << "Testing Sequence Space..." << std::endl;
+
+    // 多线程并发分配，序列号互不重复且连续
+    protocol::SequenceSpace space;
+    const size_t thread_count = 4;
+    const size_t per_thread = 100000;
+    std::vector<std::vector<uint32_t>> allocated(thread_count);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&, t] {
+            allocated[t].reserve(per_thread);
+            for (size_t i = 0; i < per_thread; ++i) {
+                allocated[t].push_back(space.Next());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<uint32_t> all;
+    for (const auto& values : allocated) {
+        all.insert(all.end(), values.begin(), values.end());
+    }
+    std::sort(all.begin(), all.end());
+    assert(all.front() == 1);
+    assert(all.back() == thread_count * per_thread);
+    assert(std::adjacent_find(all.begin(), all.end()) == all.end());
+
+    // 回绕时跳过0
+    protocol::SequenceSpace wrapping(0xFFFFFFFF);
+    assert(wrapping.Next() == 0xFFFFFFFF);
+    assert(wrapping.Next() == 1);
+
+    // 独立的空间互不影响，重置后重新开始
+    protocol::SequenceSpace other;
+    assert(other.Next() == 1);
+    space.Reset();
+    assert(space.Next() == 1);
+    assert(alignof(protocol::SequenceSpace) >= 64);
+
+    std::cout << "Sequence Space: PASSED" << std::endl;
+}
+
+void TestUrbTable() {
+    std::cout << "Testing URB Table..." << std::endl;
+
+    const size_t max_urbs = 64;
+    protocol::UrbTable table(max_urbs);
+
+    // 填满后拒绝新的URB，重复的seqnum也被拒绝
+    size_t completed = 0;
+    int32_t last_status = 0;
+    for (uint32_t seqnum = 1; seqnum <= max_urbs; ++seqnum) {
+        auto direction = (seqnum % 2) ? protocol::UsbDirection::IN : protocol::UsbDirection::OUT;
+        assert(table.Insert(seqnum, 1, direction, nullptr, 0,
+            [&](const protocol::InflightUrb&, int32_t status, const uint8_t*, size_t) {
+                ++completed;
+                last_status = status;
+            }));
+    }
+    assert(table.Size() == max_urbs);
+    assert(!table.Insert(max_urbs + 1, 1, protocol::UsbDirection::IN));
+    assert(table.QueueDepth(1, protocol::UsbDirection::IN) == max_urbs / 2);
+    assert(table.QueueDepth(1, protocol::UsbDirection::OUT) == max_urbs / 2);
+    assert(table.QueueDepth(2, protocol::UsbDirection::IN) == 0);
+
+    // 乱序完成，每次删除后其余记录仍可查到（验证后移删除）
+    for (uint32_t seqnum = 1; seqnum <= max_urbs; seqnum += 3) {
+        assert(table.Complete(seqnum, 0));
+        assert(!table.Complete(seqnum, 0));
+        for (uint32_t other = 1; other <= max_urbs; ++other) {
+            protocol::InflightUrb urb;
+            bool removed = (other - 1) % 3 == 0 && other <= seqnum;
+            assert(table.Lookup(other, urb) == !removed);
+        }
+    }
+    size_t remaining = table.Size();
+    assert(completed == max_urbs - remaining);
+    assert(!table.Insert(2, 1, protocol::UsbDirection::OUT));
+
+    // 断开时全部以错误状态完成
+    assert(table.CancelAll(-104) == remaining);
+    assert(completed == max_urbs);
+    assert(last_status == -104);
+    assert(table.Size() == 0);
+    assert(table.QueueDepth(1, protocol::UsbDirection::IN) == 0);
+
+    // 响应数据拷贝到登记的缓冲区（超出部分截断）
+    uint8_t buffer[4] = {};
+    const uint8_t response[] = {1, 2, 3, 4, 5, 6};
+    size_t reported = 0;
+    assert(table.Insert(0xFFFFFFFF, 2, protocol::UsbDirection::IN, buffer, sizeof(buffer),
+        [&](const protocol::InflightUrb& urb, int32_t, const uint8_t*, size_t len) {
+            assert(urb.endpoint == 2 && urb.submit_time_us > 0);
+            reported = len;
+        }));
+    assert(table.Complete(0xFFFFFFFF, 0, response, sizeof(response)));
+    assert(reported == sizeof(response));
+    assert(std::memcmp(buffer, response, sizeof(buffer)) == 0);
+
+    // 按记录登记，完成时取回类型和捕获时间
+    protocol::InflightUrb record;
+    record.seqnum = 77;
+    record.endpoint = 0x81;
+    record.direction = protocol::UsbDirection::IN;
+    record.type = protocol::UsbTransferType::INTERRUPT;
+    record.capture_time_us = 1234;
+    assert(table.Insert(record));
+    assert(table.QueueDepth(0x81, protocol::UsbDirection::IN) == 1);
+    protocol::InflightUrb finished;
+    assert(table.Complete(77, 0, nullptr, 0, &finished));
+    assert(finished.type == protocol::UsbTransferType::INTERRUPT && finished.capture_time_us == 1234);
+    assert(finished.submit_time_us > 0 && table.Size() == 0);
+
+    // 大量随机插入删除，与参照集合保持一致
+    protocol::UrbTable churn(256);
+    std::vector<uint32_t> live;
+    uint32_t state = 12345;
+    for (int i = 0; i < 200000; ++i) {
+        state = state * 1103515245 + 12345;
+        if (live.size() < 256 && (state & 0x100)) {
+            uint32_t seqnum = state >> 8;
+            if (std::find(live.begin(), live.end(), seqnum) == live.end()) {
+                assert(churn.Insert(seqnum, 1, protocol::UsbDirection::IN));
+                live.push_back(seqnum);
+            }
+        } else if (!live.empty()) {
+            size_t index = (state >> 4) % live.size();
+            assert(churn.Remove(live[index]));
+            live[index] = live.back();
+            live.pop_back();
+        }
+    }
+    assert(churn.Size() == live.size());
+    for (uint32_t seqnum : live) {
+        protocol::InflightUrb urb;
+        assert(churn.Lookup(seqnum, urb) && urb.seqnum == seqnum);
+    }
+
+    std::cout << "URB Table: PASSED" << std::endl;
+}
+
+void TestBotBlockIo() {
+    std::cout << "Testing BOT Block I/O..." << std::endl;
+
+    // 命令长度选择：最后一个块超出32位LBA或块数超出16位时使用16字节命令
+    assert(!protocol::BotBlockIo::NeedsLongCommand(0xFFFFFFFFull, 1));
+    assert(protocol::BotBlockIo::NeedsLongCommand(0xFFFFFFFFull, 2));
+    assert(protocol::BotBlockIo::NeedsLongCommand(0, 0x10000));
+
+    protocol::CommandBlockWrapper cbw;
+    protocol::BotBlockIo::BuildReadWrite(cbw, true, 1, 0x12345678, 8, 512, 42);
+    assert(cbw.bCBWCBLength == 10 && cbw.CBWCB[0] == 0x28);
+    assert(cbw.CBWCB[2] == 0x12 && cbw.CBWCB[5] == 0x78 && cbw.CBWCB[8] == 8);
+    assert(cbw.dCBWDataTransferLength == 4096 && cbw.bmCBWFlags == 0x80 && cbw.bCBWLUN == 1);
+    protocol::BotBlockIo::BuildReadWrite(cbw, false, 0, 0x123456789Aull, 3, 4096, 43);
+    assert(cbw.bCBWCBLength == 16 && cbw.CBWCB[0] == 0x8A);
+    assert(cbw.CBWCB[5] == 0x12 && cbw.CBWCB[9] == 0x9A && cbw.CBWCB[13] == 3);
+
+    // 多条命令流水线读写，数据一致且确有多条命令同时在途
+    const uint32_t block_size = 512;
+    EmulatedBotDevice device(4096, block_size, 200);
+    protocol::BlockIoConfig config;
+    config.max_transfer_bytes = 16 * block_size;
+    config.max_commands_in_flight = 4;
+    protocol::BotBlockIo block_io(device, config);
+
+    const uint32_t block_count = 1000;
+    std::vector<uint8_t> written(block_count * block_size);
+    for (size_t i = 0; i < written.size(); ++i) {
+        written[i] = static_cast<uint8_t>(i * 7 + i / 512);
+    }
+    assert(block_io.Write(0, 7, block_count, block_size, written.data()));
+    std::vector<uint8_t> read(written.size());
+    assert(block_io.Read(0, 7, block_count, block_size, read.data()));
+    assert(read == written);
+    assert(device.Commands() == 2 * ((block_count + 15) / 16));
+    assert(device.MaxOutQueue() > 2);
+
+    // 设备报告失败后返回false，之后的命令不受影响
+    assert(!block_io.Read(0, 4090, 16, block_size, read.data()));
+    assert(block_io.Read(0, 7, 16, block_size, read.data()));
+    assert(std::memcmp(read.data(), written.data(), 16 * block_size) == 0);
+
+    // 跨越32位LBA边界时自动切换到READ(16)/WRITE(16)
+    EmulatedBotDevice high_device(64, block_size, 0, 0, 0xFFFFFFF0ull);
+    protocol::BotBlockIo high_io(high_device, config);
+    assert(high_io.Write(0, 0xFFFFFFF0ull, 64, block_size, written.data()));
+    assert(high_io.Read(0, 0xFFFFFFF0ull, 64, block_size, read.data()));
+    assert(std::memcmp(read.data(), written.data(), 64 * block_size) == 0);
+    assert(high_device.LongCommands() == 6);  // 每个方向首条命令止于0xFFFFFFFF，仍为10字节
+
+    // FUA写入在CDB中置位，SYNCHRONIZE CACHE不带数据阶段
+    protocol::BotBlockIo::BuildReadWrite(cbw, false, 0, 100, 1, block_size, 44, true);
+    assert(cbw.CBWCB[0] == 0x2A && (cbw.CBWCB[1] & protocol::SCSI_CDB_FUA) != 0);
+    assert(block_io.Write(0, 7, 32, block_size, written.data(), true));
+    assert(device.FuaWrites() == 2);
+    assert(block_io.SynchronizeCache(0));
+    assert(device.Syncs() == 1);
+
+    std::cout << "BOT Block I/O: PASSED" << std::endl;
+}
+
+void TestUasBlockIo() {
+    std::cout << "Testing UAS Block I/O..." << std::endl;
+
+    // 命令IU：标签大端，LUN在第二个字节，CDB原样拷贝
+    protocol::UasCommandIu iu;
+    uint8_t cdb[16];
+    uint8_t cdb_length = protocol::BlockIo::BuildReadWriteCdb(cdb, true, 0x1000, 8);
+    assert(cdb_length == 10 && cdb[0] == 0x28);
+    protocol::UasBlockIo::BuildCommandIu(iu, 0x0102, 3, cdb, cdb_length);
+    const uint8_t* raw = reinterpret_cast<const uint8_t*>(&iu);
+    assert(raw[0] == 0x01 && raw[2] == 0x01 && raw[3] == 0x02 && raw[9] == 3);
+    assert(std::memcmp(&raw[16], cdb, cdb_length) == 0);
+
+    // 设备以8路并发处理，每条命令耗时200us，命令可以乱序完成
+    const uint32_t block_size = 512;
+    EmulatedUasDevice device(4096, block_size, 16, 50, 8, 200);
+    protocol::BlockIoConfig config;
+    config.max_transfer_bytes = 16 * block_size;
+    config.max_uas_commands_in_flight = 32;
+    protocol::UasBlockIo block_io(device, config);
+    assert(block_io.Depth() == 16);  // 受流数量限制
+
+    const uint32_t block_count = 1000;
+    std::vector<uint8_t> written(block_count * block_size);
+    for (size_t i = 0; i < written.size(); ++i) {
+        written[i] = static_cast<uint8_t>(i * 5 + i / 512);
+    }
+    assert(block_io.Write(0, 9, block_count, block_size, written.data()));
+    std::vector<uint8_t> read(written.size());
+    assert(block_io.Read(0, 9, block_count, block_size, read.data()));
+    assert(read == written);
+    assert(device.Commands() == 2 * ((block_count + 15) / 16));
+    assert(device.MaxOutstanding() > 8);
+    assert(device.OutOfOrderCompletions() > 0);
+    assert(device.OverlappedTags() == 0);
+
+    // 任意SCSI命令：READ CAPACITY(16)经数据IN流返回
+    uint8_t capacity_cdb[16] = {static_cast<uint8_t>(protocol::ScsiCommand::READ_CAPACITY_16), 0x10};
+    uint8_t capacity[32] = {};
+    uint8_t status = 0xFF;
+    uint32_t received = 0;
+    assert(block_io.ExecuteScsi(0, capacity_cdb, 16, true, capacity, 32, status, &received));
+    assert(status == protocol::SCSI_STATUS_GOOD && received == 32);
+    assert(capacity[6] == 0x0F && capacity[7] == 0xFF && capacity[10] == 0x02);
+
+    // 越界命令以CHECK CONDITION结束，之后的命令不受影响
+    assert(!block_io.Read(0, 4090, 16, block_size, read.data()));
+    assert(block_io.Read(0, 9, 16, block_size, read.data()));
+    assert(std::memcmp(read.data(), written.data(), 16 * block_size) == 0);
+
+    // FUA和SYNCHRONIZE CACHE
+    assert(block_io.Write(0, 9, 32, block_size, written.data(), true));
+    assert(device.FuaWrites() == 2);
+    assert(block_io.SynchronizeCache(0));
+    assert(device.Syncs() == 1);
+
+    std::cout << "UAS Block I/O: PASSED" << std::endl;
+}
+
+void TestMultiLunBlockIo() {
+    std::cout << "Testing Multi-LUN Block I/O..." << std::endl;
+
+    // 读卡器的两个卡槽由两个线程同时读写：命令在同一组管道上交错，各LUN的数据互不干扰
+    const uint32_t block_size = 512;
+    const uint32_t block_count = 400;
+    protocol::BlockIoConfig config;
+    config.max_transfer_bytes = 8 * block_size;
+
+    auto exercise = [&](protocol::BlockIo& block_io) {
+        std::atomic<bool> ok{true};
+        std::vector<std::thread> threads;
+        for (uint8_t lun = 0; lun < 2; ++lun) {
+            threads.emplace_back([&, lun]() {
+                std::vector<uint8_t> written(block_count * block_size);
+                for (size_t i = 0; i < written.size(); ++i) {
+                    written[i] = static_cast<uint8_t>(i * 3 + lun * 101 + i / 512);
+                }
+                std::vector<uint8_t> read(written.size());
+                if (!block_io.Write(lun, 5, block_count, block_size, written.data()) ||
+                    !block_io.Read(lun, 5, block_count, block_size, read.data()) || read != written) {
+                    ok = false;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return ok.load();
+    };
+
+    EmulatedBotDevice bot_device(1024, block_size, 100);
+    bot_device.SetLuns(2);
+    protocol::BotBlockIo bot_io(bot_device, config);
+    assert(exercise(bot_io));
+    assert(bot_device.LunCommands(0) == 100 && bot_device.LunCommands(1) == 100);
+    assert(bot_device.LunSwitches() > 4);
+
+    // 不存在的LUN由设备拒绝，不影响其他LUN
+    std::vector<uint8_t> block(block_size);
+    assert(!bot_io.Read(2, 0, 1, block_size, block.data()));
+    assert(bot_io.Read(1, 5, 1, block_size, block.data()));
+    assert(block[0] == 101);
+
+    EmulatedUasDevice uas_device(1024, block_size, 16, 50, 8, 100);
+    uas_device.SetLuns(2);
+    protocol::UasBlockIo uas_io(uas_device, config);
+    assert(exercise(uas_io));
+    assert(uas_device.LunCommands(0) == 100 && uas_device.LunCommands(1) == 100);
+    assert(uas_device.LunSwitches() > 4);
+    assert(uas_device.OverlappedTags() == 0);
+
+    std::cout << "Multi-LUN Block I/O: PASSED" << std::endl;
+}
+
+void TestScsiDisk() {
+    std::cout << "Testing SCSI Disk Image..." << std::endl;
+
+    char path[] = "/tmp/test_scsi_disk_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    const uint32_t block_size = 512;
+    const uint64_t total_blocks = 8192;   // 4 MiB
+    utils::PooledBuffer data_in;
+    auto execute = [&](protocol::ScsiDisk& disk, std::initializer_list<uint8_t> cdb_bytes,
+                       const std::vector<uint8_t>& data_out = {}, uint32_t data_in_length = UINT32_MAX) {
+        uint8_t cdb[16] = {};
+        std::copy(cdb_bytes.begin(), cdb_bytes.end(), cdb);
+        return disk.Execute(cdb, static_cast<uint8_t>(cdb_bytes.size()), data_out.data(),
+                            static_cast<uint32_t>(data_out.size()), data_in_length, data_in);
+    };
+    auto sense_key = [&](protocol::ScsiDisk& disk) {
+        assert(execute(disk, {0x03, 0, 0, 0, 18, 0}) == protocol::SCSI_STATUS_GOOD);
+        return data_in[2];
+    };
+
+    {
+        // 新建的镜像是稀疏文件
+        protocol::ScsiDisk disk(block_size);
+        assert(disk.Open(path, total_blocks * block_size));
+        assert(disk.TotalBlocks() == total_blocks);
+        assert(disk.AllocatedBytes() < total_blocks * block_size / 2);
+
+        assert(execute(disk, {0x00, 0, 0, 0, 0, 0}) == protocol::SCSI_STATUS_GOOD);
+
+        // READ CAPACITY(10/16)
+        assert(execute(disk, {0x25, 0, 0, 0, 0, 0, 0, 0, 0, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 8 && data_in[2] == 0x1F && data_in[3] == 0xFF && data_in[6] == 0x02);
+        assert(execute(disk, {0x9E, 0x10, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 32, 0, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 32 && data_in[6] == 0x1F && data_in[7] == 0xFF && data_in[10] == 0x02);
+
+        // MODE SENSE(6)：缓存页，未写保护
+        assert(execute(disk, {0x1A, 0, 0x3F, 0, 192, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 24 && data_in[0] == 23 && (data_in[2] & 0x80) == 0 && data_in[4] == 0x08);
+        assert(execute(disk, {0x5A, 0, 0x08, 0, 0, 0, 0, 0, 255, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 28 && data_in[1] == 26 && data_in[8] == 0x08);
+
+        // WRITE(10)后以READ(16)读回，未写过的块读出为零
+        std::vector<uint8_t> written(16 * block_size);
+        for (size_t i = 0; i < written.size(); ++i) {
+            written[i] = static_cast<uint8_t>(i * 13 + 1);
+        }
+        assert(execute(disk, {0x2A, 0, 0, 0, 0x10, 0, 0, 0, 16, 0}, written) == protocol::SCSI_STATUS_GOOD);
+        assert(execute(disk, {0x88, 0, 0, 0, 0, 0, 0, 0, 0x0F, 0xF8, 0, 0, 0, 32, 0, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 32 * block_size);
+        assert(std::all_of(data_in.begin(), data_in.begin() + 8 * block_size, [](uint8_t b) { return b == 0; }));
+        assert(std::equal(written.begin(), written.end(), data_in.begin() + 8 * block_size));
+
+        // 越界：CHECK CONDITION，REQUEST SENSE报告ILLEGAL REQUEST / LBA OUT OF RANGE
+        assert(execute(disk, {0x28, 0, 0, 0, 0x1F, 0xFF, 0, 0, 2, 0}) == protocol::SCSI_STATUS_CHECK_CONDITION);
+        assert(sense_key(disk) == protocol::SCSI_SENSE_ILLEGAL_REQUEST && data_in[12] == 0x21);
+        assert(sense_key(disk) == protocol::SCSI_SENSE_NO_SENSE);
+        assert(execute(disk, {0xC0, 0, 0, 0, 0, 0}) == protocol::SCSI_STATUS_CHECK_CONDITION);
+        assert(sense_key(disk) == protocol::SCSI_SENSE_ILLEGAL_REQUEST && data_in[12] == 0x20);
+
+        // READ(16)覆盖整个镜像而主机只期望64KiB：不读取，ILLEGAL REQUEST / INVALID FIELD IN CDB
+        auto reads = disk.GetStatistics().read_blocks;
+        assert(execute(disk, {0x88, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x20, 0, 0, 0}, {}, 64 * 1024) ==
+               protocol::SCSI_STATUS_CHECK_CONDITION);
+        assert(data_in.empty() && disk.GetStatistics().read_blocks == reads);
+        assert(sense_key(disk) == protocol::SCSI_SENSE_ILLEGAL_REQUEST && data_in[12] == 0x24);
+        assert(execute(disk, {0x28, 0, 0, 0, 0, 0, 0, 0, 128, 0}, {}, 64 * 1024) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == 64 * 1024);
+
+        // FUA写入和SYNCHRONIZE CACHE经msync落盘
+        assert(execute(disk, {0x2A, protocol::SCSI_CDB_FUA, 0, 0, 0, 0x20, 0, 0, 1, 0}, written) ==
+               protocol::SCSI_STATUS_GOOD);
+        assert(execute(disk, {0x35, 0, 0, 0, 0, 0, 0, 0, 0, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(disk.GetStatistics().syncs == 2);
+        assert(disk.GetStatistics().written_blocks == 17);
+    }
+
+    {
+        // 重新以只读方式打开：数据仍在，写入被拒绝
+        protocol::ScsiDisk disk(block_size);
+        assert(disk.Open(path, 0, true));
+        assert(execute(disk, {0x28, 0, 0, 0, 0, 0x20, 0, 0, 1, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in.size() == block_size && data_in[0] == 1 && data_in[1] == 14);
+        assert(execute(disk, {0x1A, 0, 0x08, 0, 192, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert((data_in[2] & 0x80) != 0);
+        std::vector<uint8_t> block(block_size, 0xEE);
+        assert(execute(disk, {0x2A, 0, 0, 0, 0, 0x20, 0, 0, 1, 0}, block) == protocol::SCSI_STATUS_CHECK_CONDITION);
+        assert(sense_key(disk) == protocol::SCSI_SENSE_DATA_PROTECT);
+    }
+
+    {
+        // 两个会话只读共享同一镜像，各自的写入落在自己的写时复制层
+        std::string overlay_a = std::string(path) + ".a";
+        std::string overlay_b = std::string(path) + ".b";
+        protocol::ScsiDisk session_a(block_size);
+        protocol::ScsiDisk session_b(block_size);
+        assert(session_a.Open(path, 0, true) && session_a.AttachOverlay(overlay_a));
+        assert(session_b.Open(path, 0, true) && session_b.AttachOverlay(overlay_b));
+        assert(!session_a.IsReadOnly() && access(overlay_a.c_str(), F_OK) != 0);
+
+        std::vector<uint8_t> block_a(block_size, 0xAA);
+        std::vector<uint8_t> block_b(2 * block_size, 0xBB);
+        assert(execute(session_a, {0x2A, 0, 0, 0, 0, 0x21, 0, 0, 1, 0}, block_a) == protocol::SCSI_STATUS_GOOD);
+        assert(execute(session_b, {0x2A, 0, 0, 0, 0, 0x20, 0, 0, 2, 0}, block_b) == protocol::SCSI_STATUS_GOOD);
+        assert(session_a.OverlayBlocks() == 1 && session_b.OverlayBlocks() == 2);
+
+        // 跨越两层的读：LBA 0x20来自镜像，0x21来自本会话的overlay
+        assert(execute(session_a, {0x28, 0, 0, 0, 0, 0x20, 0, 0, 2, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in[0] == 1 && data_in[1] == 14 && data_in[block_size] == 0xAA);
+        assert(session_a.GetStatistics().overlay_reads == 1);
+        assert(execute(session_b, {0x28, 0, 0, 0, 0, 0x20, 0, 0, 2, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in[0] == 0xBB && data_in[block_size] == 0xBB);
+
+        // 丢弃后立即恢复为镜像内容，镜像本身未被修改
+        session_a.DiscardOverlay();
+        assert(session_a.OverlayBlocks() == 0);
+        assert(execute(session_a, {0x28, 0, 0, 0, 0, 0x21, 0, 0, 1, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in[0] == 0);
+
+        protocol::ScsiDisk base(block_size);
+        assert(base.Open(path, 0, true));
+        assert(execute(base, {0x28, 0, 0, 0, 0, 0x20, 0, 0, 1, 0}) == protocol::SCSI_STATUS_GOOD);
+        assert(data_in[0] == 1);
+    }
+
+    // 未打开镜像：NOT READY / MEDIUM NOT PRESENT
+    protocol::ScsiDisk empty(block_size);
+    assert(execute(empty, {0x00, 0, 0, 0, 0, 0}) == protocol::SCSI_STATUS_CHECK_CONDITION);
+    assert(sense_key(empty) == protocol::SCSI_SENSE_NOT_READY && data_in[12] == 0x3A);
+
+    unlink(path);
+    std::cout << "SCSI Disk Image: PASSED" << std::endl;
+}
+
+void TestReadAheadCache() {
+    std::cout << "Testing Read-Ahead Cache..." << std::endl;
+
+    const uint32_t block_size = 512;
+    const uint64_t total_blocks = 2048;
+    EmulatedBotDevice device(total_blocks, block_size);
+    protocol::BotBlockIo block_io(device);
+
+    std::vector<uint8_t> pattern(total_blocks * block_size);
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        pattern[i] = static_cast<uint8_t>(i * 13 + i / block_size);
+    }
+    assert(block_io.Write(0, 0, total_blocks, block_size, pattern.data()));
+
+    // 8个块一个extent，最多缓存8个extent，顺序读两次后预读后面4个extent
+    protocol::ReadAheadConfig config;
+    config.cache_bytes = 8 * 8 * block_size;
+    config.extent_bytes = 8 * block_size;
+    config.sequential_threshold = 2;
+    config.prefetch_extents = 4;
+    std::atomic<uint64_t> device_reads{0};
+    protocol::ReadAheadCache cache(block_size, config,
+        [&](uint8_t lun, uint64_t lba, uint32_t count, uint8_t* data) {
+            ++device_reads;
+            return block_io.Read(lun, lba, count, block_size, data);
+        });
+    cache.SetLunBlocks(0, total_blocks);
+
+    // 以4块为单位顺序读前256块，数据一致，大部分来自缓存
+    std::vector<uint8_t> buffer(4 * block_size);
+    for (uint64_t lba = 0; lba < 256; lba += 4) {
+        assert(cache.Read(0, lba, 4, buffer.data()));
+        assert(std::memcmp(buffer.data(), &pattern[lba * block_size], buffer.size()) == 0);
+        cache.WaitForPrefetch();
+    }
+    auto stats = cache.GetStatistics();
+    assert(stats.hit_blocks + stats.miss_blocks == 256);
+    assert(stats.miss_blocks <= 8);
+    assert(stats.prefetched > 0 && device_reads < 64);
+
+    // 写入后失效：未读过的预读extent计入浪费，之后读到新数据
+    uint64_t wasted_before = stats.prefetch_wasted;
+    std::vector<uint8_t> updated(16 * block_size, 0xAB);
+    assert(block_io.Write(0, 256, 16, block_size, updated.data()));
+    cache.Invalidate(0, 256, 16);
+    stats = cache.GetStatistics();
+    assert(stats.invalidated >= 2 && stats.prefetch_wasted == wasted_before + 2);
+    std::vector<uint8_t> verify(16 * block_size);
+    assert(cache.Read(0, 256, 16, verify.data()));
+    assert(verify == updated);
+
+    // 随机访问不触发预读，预读不越过设备末尾
+    cache.WaitForPrefetch();
+    uint64_t prefetched = cache.GetStatistics().prefetched;
+    assert(cache.Read(0, 1000, 4, buffer.data()));
+    assert(cache.Read(0, 50, 4, buffer.data()));
+    cache.WaitForPrefetch();
+    assert(cache.GetStatistics().prefetched == prefetched);
+    for (uint64_t lba = total_blocks - 12; lba < total_blocks; lba += 4) {
+        assert(cache.Read(0, lba, 4, buffer.data()));
+        assert(std::memcmp(buffer.data(), &pattern[lba * block_size], buffer.size()) == 0);
+    }
+    cache.WaitForPrefetch();
+
+    std::cout << "Read-Ahead Cache: PASSED" << std::endl;
+}
+
+void TestWriteCoalescer() {
+    std::cout << "Testing Write Coalescer..." << std::endl;
+
+    const uint32_t block_size = 512;
+    struct DeviceWrite {
+        uint64_t lba;
+        uint32_t count;
+    };
+    std::mutex device_mutex;
+    std::vector<DeviceWrite> device_writes;
+    std::vector<uint8_t> media(256 * block_size, 0);
+    std::atomic<bool> fail_writes{false};
+    auto write_function = [&](uint8_t, uint64_t lba, uint32_t count, const uint8_t* data) {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        device_writes.push_back({lba, count});
+        std::memcpy(&media[lba * block_size], data, static_cast<size_t>(count) * block_size);
+        return !fail_writes;
+    };
+    auto block = [&](uint8_t value, uint32_t count) {
+        return std::vector<uint8_t>(static_cast<size_t>(count) * block_size, value);
+    };
+
+    // 窗口足够长，只有屏障和阈值触发写出
+    protocol::WriteCoalescerConfig config;
+    config.max_pending_bytes = 64 * block_size;
+    config.window_us = 10 * 1000 * 1000;
+    {
+        protocol::WriteCoalescer coalescer(block_size, config, write_function);
+
+        // 16次相邻的单块写合并为一次设备写，顺序不影响合并
+        for (uint32_t i = 0; i < 16; ++i) {
+            uint64_t lba = i ^ 1;
+            coalescer.Write(0, lba, 1, block(static_cast<uint8_t>(lba + 1), 1).data());
+        }
+        assert(coalescer.PendingBytes() == 16 * block_size && device_writes.empty());
+        assert(coalescer.Flush());
+        assert(device_writes.size() == 1 && device_writes[0].lba == 0 && device_writes[0].count == 16);
+        for (uint32_t i = 0; i < 16; ++i) {
+            assert(media[i * block_size] == i + 1);
+        }
+        auto stats = coalescer.GetStatistics();
+        assert(stats.writes_in == 16 && stats.device_writes == 1 && stats.barriers == 1);
+        assert(stats.CoalescingRatio() == 16.0);
+
+        // 重叠写入后写的数据覆盖先写的，重叠块只写出一次
+        device_writes.clear();
+        coalescer.Write(0, 100, 8, block(0x11, 8).data());
+        coalescer.Write(0, 104, 8, block(0x22, 8).data());
+        coalescer.Write(0, 98, 4, block(0x33, 4).data());
+        assert(coalescer.Flush());
+        assert(device_writes.size() == 1 && device_writes[0].lba == 98 && device_writes[0].count == 14);
+        assert(media[99 * block_size] == 0x33 && media[101 * block_size] == 0x33);
+        assert(media[102 * block_size] == 0x11 && media[104 * block_size] == 0x22);
+        assert(media[111 * block_size] == 0x22);
+
+        // 读前只写出与读范围重叠的区段
+        device_writes.clear();
+        coalescer.Write(0, 10, 2, block(0x44, 2).data());
+        coalescer.Write(0, 50, 2, block(0x55, 2).data());
+        assert(coalescer.FlushRange(0, 11, 4));
+        assert(device_writes.size() == 1 && device_writes[0].lba == 10);
+        assert(coalescer.PendingBytes() == 2 * block_size);
+        assert(coalescer.FlushRange(0, 52, 4));
+        assert(device_writes.size() == 1);
+
+        // 超过阈值时在写入线程上立即写出
+        coalescer.Write(0, 128, 64, block(0x66, 64).data());
+        assert(coalescer.PendingBytes() == 0 && device_writes.size() == 3);
+
+        // 写回失败在下一次屏障时报告一次
+        fail_writes = true;
+        coalescer.Write(0, 0, 1, block(0x77, 1).data());
+        assert(!coalescer.FlushRange(0, 0, 1));
+        fail_writes = false;
+        assert(!coalescer.Flush());
+        assert(coalescer.Flush());
+    }
+
+    // 窗口到期后由后台线程写出
+    config.window_us = 1000;
+    device_writes.clear();
+    {
+        protocol::WriteCoalescer coalescer(block_size, config, write_function);
+        coalescer.Write(0, 20, 1, block(0x88, 1).data());
+        coalescer.Write(0, 21, 1, block(0x99, 1).data());
+        for (int i = 0; i < 1000 && coalescer.PendingBytes() > 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        assert(coalescer.PendingBytes() == 0);
+        std::lock_guard<std::mutex> lock(device_mutex);
+        assert(device_writes.size() == 1 && device_writes[0].lba == 20 && device_writes[0].count == 2);
+    }
+
+    // 析构时写出剩余数据
+    config.window_us = 10 * 1000 * 1000;
+    device_writes.clear();
+    {
+        protocol::WriteCoalescer coalescer(block_size, config, write_function);
+        coalescer.Write(0, 200, 1, block(0xAA, 1).data());
+    }
+    assert(device_writes.size() == 1 && media[200 * block_size] == 0xAA);
+
+    std::cout << "Write Coalescer: PASSED" << std::endl;
+}
+
 int main() {
     // 初始化日志
     utils::Logger::Instance().SetLogLevel(utils::LogLevel::INFO);
@@ -101,6 +1482,20 @@ int main() {
     try {
         TestUsbipProtocol();
         TestUsbTypes();
+        TestPooledBuffer();
+        TestZeroAllocationPipelines();
+        TestMpscRing();
+        TestThreadAffinity();
+        TestLatencyHistogram();
+        TestLogger();
+        TestSequenceSpace();
+        TestUrbTable();
+        TestBotBlockIo();
+        TestUasBlockIo();
+        TestMultiLunBlockIo();
+        TestReadAheadCache();
+        TestWriteCoalescer();
+        TestScsiDisk();
 
         std::cout << "\nAll tests PASSED!" << std::endl;
         return 0;